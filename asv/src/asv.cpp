@@ -33,6 +33,7 @@ SOFTWARE.
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
 #include "zmq.h"
 #include "dsv.h"
 #include "dsv_msg.h"
@@ -53,8 +54,9 @@ struct state
     void *dsv_ctx;
     int operation;
     int index;
+    int count;
     dsv_info_t dsv;
-    int dsv_val;
+    std::vector< int > values;
 }g_state;
 /*==============================================================================
                            Function Definitions
@@ -67,23 +69,116 @@ static void usage( void )
 {
     fprintf( stderr,
              "asv command is dedicated for array type of dsv"
-             "usage: asv [set][get][add][-i][-v] <variable-name> [<value>]\n"
-             "    set - set an item value of an array dsv\n"
-             "    get - get an item value of an array dsv\n"
-             "    add - add an item to an array dsv\n"
-             "    del - delete an item from an array dsv\n"
-             "    ins - insert an item to an array dsv\n"
+             "usage: asv [set][get][add][-i][-n][-v][-f] <variable-name>\n"
+             "    set - set items from index of an array dsv\n"
+             "    get - get items from index of an array dsv\n"
+             "    add - add items to the end of an array dsv\n"
+             "    del - delete items from index of an array dsv\n"
+             "    ins - insert items from index of an array dsv\n"
              "    -i <index> - index of item, used in set/get/del/ins command\n"
-             "    -v <value> - value of item, used in set/add/ins\n"
+             "    -n <count> - number of items, used in get/del, default 1\n"
+             "    -v <values> - values of items, used in set/add/ins, a list\n"
+             "                  of values and ranges, eg, 1,2,10-20\n"
+             "    -f <file> - read the values from a file instead of -v\n"
              "example:\n"
              "   asv set -i 3 -v 9900 [123]/SYS/TEST/INT_ARRAY\n"
-             "   asv get -i 3 [123]/SYS/TEST/INT_ARRAY\n"
+             "   asv set -i 0 -v 1,2,3,100-199 [123]/SYS/TEST/INT_ARRAY\n"
+             "   asv get -i 3 -n 10 [123]/SYS/TEST/INT_ARRAY\n"
              "   asv add -v 9809 [123]/SYS/TEST/INT_ARRAY\n"
-             "   asv del -i 3 [123]/SYS/TEST/INT_ARRAY\n"
+             "   asv add -f table.txt [123]/SYS/TEST/INT_ARRAY\n"
+             "   asv del -i 3 -n 2 [123]/SYS/TEST/INT_ARRAY\n"
              "   asv ins -i 3 -v 9900 [123]/SYS/TEST/INT_ARRAY\n"
            );
 }
 
+/*!=============================================================================
+
+    Parse a list of values and ranges into g_state.values, eg,
+    1,2,10-20,-5--1
+    values are separated by commas or white spaces
+
+@param[in]
+    str
+        list of values
+
+@retval
+    0 - success
+    EINVAL - not a list of integers
+/*============================================================================*/
+static int ParseValues( const char *str )
+{
+    char *end;
+
+    while( *str != '\0' )
+    {
+        if( *str == ',' || isspace( (unsigned char)*str ) )
+        {
+            str++;
+            continue;
+        }
+
+        long first = strtol( str, &end, 0 );
+        if( end == str )
+        {
+            fprintf( stderr, "Invalid value: %s\n", str );
+            return EINVAL;
+        }
+        str = end;
+
+        long last = first;
+        if( *str == '-' )
+        {
+            last = strtol( str + 1, &end, 0 );
+            if( end == str + 1 || last < first )
+            {
+                fprintf( stderr, "Invalid range: %ld%s\n", first, str );
+                return EINVAL;
+            }
+            str = end;
+        }
+
+        for( long v = first; v <= last; v++ )
+        {
+            g_state.values.push_back( (int)v );
+        }
+    }
+
+    return 0;
+}
+
+/*!=============================================================================
+
+    Read a list of values and ranges from a file into g_state.values
+
+@param[in]
+    path
+        file name
+
+@retval
+    0 - success
+    others - failed
+/*============================================================================*/
+static int ReadValues( const char *path )
+{
+    int rc = 0;
+    char line[BUFSIZ];
+
+    FILE *fp = fopen( path, "r" );
+    if( fp == NULL )
+    {
+        fprintf( stderr, "Unable to open %s: %s\n", path, strerror( errno ) );
+        return errno;
+    }
+
+    while( rc == 0 && fgets( line, sizeof(line), fp ) != NULL )
+    {
+        rc = ParseValues( line );
+    }
+
+    fclose( fp );
+    return rc;
+}
+
 /*!=============================================================================
 
     Process asv add command, eg,
@@ -117,7 +212,10 @@ int ProcessAddItem( int argc, char **argv )
             return rc;
         }
 
-        rc = DSV_AddItemToArray( g_state.dsv_ctx, hndl, g_state.dsv_val );
+        rc = DSV_AppendItems( g_state.dsv_ctx,
+                              hndl,
+                              g_state.values.data(),
+                              g_state.values.size() );
     }
     else
     {
@@ -160,10 +258,14 @@ static int ProcessInsItem( int argc, char **argv )
             return rc;
         }
 
-        rc = DSV_InsItemToArray( g_state.dsv_ctx,
-                                 hndl,
-                                 g_state.index,
-                                 g_state.dsv_val );
+        /* no range message for insert, one item after another */
+        for( size_t i = 0; i < g_state.values.size() && rc == 0; i++ )
+        {
+            rc = DSV_InsItemToArray( g_state.dsv_ctx,
+                                     hndl,
+                                     g_state.index + i,
+                                     g_state.values[i] );
+        }
     }
     else
     {
@@ -206,7 +308,10 @@ int ProcessDelItem( int argc, char **argv )
             return rc;
         }
 
-        rc = DSV_DelItemFromArray( g_state.dsv_ctx, hndl, g_state.index );
+        rc = DSV_DeleteRange( g_state.dsv_ctx,
+                              hndl,
+                              g_state.index,
+                              g_state.count );
     }
     else
     {
@@ -251,10 +356,11 @@ int ProcessSetItem( int argc, char **argv )
             return rc;
         }
 
-        rc = DSV_SetItemInArray( g_state.dsv_ctx,
-                                 hndl,
-                                 g_state.index,
-                                 g_state.dsv_val );
+        rc = DSV_SetArrayRange( g_state.dsv_ctx,
+                                hndl,
+                                g_state.index,
+                                g_state.values.data(),
+                                g_state.values.size() );
     }
     else
     {
@@ -285,7 +391,8 @@ int ProcessSetItem( int argc, char **argv )
 int ProcessGetItem( int argc, char **argv )
 {
     int rc = EINVAL;
-    int value;
+    int count = g_state.count;
+    std::vector< int > values( count );
     char dsv_name[DSV_STRING_SIZE_MAX];
     if( optind == argc - 1 )
     {
@@ -298,10 +405,17 @@ int ProcessGetItem( int argc, char **argv )
             return rc;
         }
 
-        rc = DSV_GetItemFromArray( g_state.dsv_ctx, hndl, g_state.index, &value );
+        rc = DSV_GetArrayRange( g_state.dsv_ctx,
+                                hndl,
+                                g_state.index,
+                                values.data(),
+                                &count );
         if( rc == 0 )
         {
-            printf( "%s[%d]=%d\n", dsv_name, g_state.index, value );
+            for( int i = 0; i < count; i++ )
+            {
+                printf( "%s[%d]=%d\n", dsv_name, g_state.index + i, values[i] );
+            }
         }
         else
         {
@@ -342,7 +456,8 @@ int ProcessOptions( int argc, char **argv )
     char name[DSV_STRING_SIZE_MAX];
 
     /* process all the command line options */
-    while( (opt = getopt( argc, argv, "i:v:" )) != -1 )
+    g_state.count = 1;
+    while( (opt = getopt( argc, argv, "i:n:v:f:" )) != -1 )
     {
         switch( opt )
         {
@@ -350,8 +465,16 @@ int ProcessOptions( int argc, char **argv )
             g_state.index = atoi( optarg );
             break;
 
+        case 'n':
+            g_state.count = atoi( optarg );
+            break;
+
         case 'v':
-            g_state.dsv_val = atoi( optarg );
+            rc = ParseValues( optarg );
+            break;
+
+        case 'f':
+            rc = ReadValues( optarg );
             break;
 
         default:
@@ -0,0 +1,297 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <vector>
+#include <algorithm>
+#include "dsv.h"
+#include "dsv_log.h"
+
+/*! number of asynchronous gets kept in flight in the pipelined test */
+#define BENCH_WINDOW        ( 64 )
+
+/*! microseconds between the sets before the primary is killed */
+#define BENCH_SET_INTERVAL  ( 1000 )
+
+static struct state
+{
+    int count;
+    const char *transport;
+    const char *name;
+    int inflight;
+    pid_t primary;
+}g_state;
+
+/*!=============================================================================
+    Display the usage information for the command.
+==============================================================================*/
+static void usage( void )
+{
+    fprintf( stderr,
+             "dsv_bench measures the request latency to the dsv server\n"
+             "usage: dsv_bench [-n count][-t transport][-k pid] <variable-name>\n"
+             "    -n <count> - number of requests, default 10000\n"
+             "    -t <tcp|ipc|both> - transport to measure, default both\n"
+             "    -k <pid> - measure the failover to the standby by killing\n"
+             "               the primary dsv_server, the variable is uint32\n"
+             "example:\n"
+             "   dsv_bench -n 100000 [123]/SYS/TEST/U32\n"
+             "   dsv_bench -n 1000 -k `pidof -s dsv_server` [123]/SYS/TEST/U32\n"
+           );
+}
+
+static double now_us( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void on_reply( uint32_t id,
+                      int result,
+                      const void *value,
+                      size_t len,
+                      void *arg )
+{
+    --g_state.inflight;
+}
+
+/*!=============================================================================
+
+    Run the round trip and the pipelined test over one transport
+
+@param[in]
+    transport
+        "tcp" or "ipc"
+@return
+    0 - success
+    others - failed
+==============================================================================*/
+static int RunBench( const char *transport )
+{
+    setenv( "DSV_TRANSPORT", transport, 1 );
+    void *ctx = DSV_Open();
+    if( ctx == NULL )
+    {
+        return EFAULT;
+    }
+
+    void *hndl = DSV_Handle( ctx, g_state.name );
+    if( hndl == NULL )
+    {
+        dsvlog( LOG_ERR, "Unable to find dsv: %s", g_state.name );
+        DSV_Close( ctx );
+        return ENOENT;
+    }
+
+    /* synchronous round trips, one request in flight */
+    std::vector< double > lat( g_state.count );
+    for( int i = 0; i < g_state.count; i++ )
+    {
+        double t0 = now_us();
+        DSV_Type( ctx, hndl );
+        lat[i] = now_us() - t0;
+    }
+    std::sort( lat.begin(), lat.end() );
+    double sum = 0;
+    for( auto l : lat )
+    {
+        sum += l;
+    }
+
+    /* pipelined gets, BENCH_WINDOW requests in flight */
+    int sent = 0;
+    g_state.inflight = 0;
+    double t0 = now_us();
+    while( sent < g_state.count || g_state.inflight > 0 )
+    {
+        while( sent < g_state.count && g_state.inflight < BENCH_WINDOW )
+        {
+            if( DSV_GetAsync( ctx, hndl, on_reply, NULL ) == 0 )
+            {
+                DSV_Close( ctx );
+                return EFAULT;
+            }
+            ++g_state.inflight;
+            ++sent;
+        }
+        DSV_Dispatch( ctx, -1 );
+    }
+    double elapsed = now_us() - t0;
+
+    printf( "%s: round trip avg %.1f us, min %.1f us, p50 %.1f us, "
+            "p99 %.1f us; pipelined %.0f gets/s\n",
+            transport,
+            sum / g_state.count,
+            lat[0],
+            lat[g_state.count / 2],
+            lat[g_state.count * 99 / 100],
+            g_state.count / elapsed * 1e6 );
+
+    DSV_Close( ctx );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Set the variable count times, kill the primary server and measure how long
+    it takes until the standby answers. The value read back tells how many
+    sets the standby had not received yet.
+
+@return
+    0 - success
+    others - failed
+==============================================================================*/
+static int RunFailover( void )
+{
+    int rc;
+    uint32_t value = 0;
+    void *ctx = DSV_Open();
+    if( ctx == NULL )
+    {
+        return EFAULT;
+    }
+
+    void *hndl = DSV_Handle( ctx, g_state.name );
+    if( hndl == NULL || DSV_Type( ctx, hndl ) != DSV_TYPE_UINT32 )
+    {
+        dsvlog( LOG_ERR, "Unable to find uint32 dsv: %s", g_state.name );
+        DSV_Close( ctx );
+        return ENOENT;
+    }
+
+    for( uint32_t i = 1; i <= (uint32_t)g_state.count; i++ )
+    {
+        DSV_Set( ctx, hndl, i );
+        usleep( BENCH_SET_INTERVAL );
+    }
+
+    double t0 = now_us();
+    if( kill( g_state.primary, SIGKILL ) != 0 )
+    {
+        dsvlog( LOG_ERR, "Unable to kill %d: %s", g_state.primary, strerror( errno ) );
+        DSV_Close( ctx );
+        return errno;
+    }
+
+    /* the request waits in the socket until the standby binds the endpoint */
+    rc = DSV_Get( ctx, hndl, &value );
+    double elapsed = now_us() - t0;
+    if( rc == 0 )
+    {
+        printf( "failover %.1f ms, value %u of %d, lost updates %d\n",
+                elapsed / 1e3,
+                value,
+                g_state.count,
+                g_state.count - (int)value );
+    }
+
+    DSV_Close( ctx );
+    return rc;
+}
+
+/*!=============================================================================
+
+    Entry point for the benchmark
+
+@param[in]
+    argc
+        number of arguments passed to the process
+
+@param[in]
+    argv
+        array of null terminated argument strings passed to the process
+        The arguments are processed using getopt()
+
+@retval
+    EXIT_SUCCESS - success
+    EXIT_FAILURE - failed
+/*============================================================================*/
+int main( int argc, char *argv[] )
+{
+    int rc = 0;
+    int opt;
+
+    g_state.count = 10000;
+    g_state.transport = "both";
+
+    while( (opt = getopt( argc, argv, "n:t:k:" )) != -1 )
+    {
+        switch( opt )
+        {
+        case 'n':
+            g_state.count = atoi( optarg );
+            break;
+
+        case 't':
+            g_state.transport = optarg;
+            break;
+
+        case 'k':
+            g_state.primary = atoi( optarg );
+            break;
+
+        default:
+            usage();
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    if( optind != argc - 1 || g_state.count <= 0 )
+    {
+        usage();
+        exit( EXIT_FAILURE );
+    }
+    g_state.name = argv[optind];
+
+    DSV_LogInit( NULL, NULL );
+
+    if( g_state.primary != 0 )
+    {
+        rc = RunFailover();
+        return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if( strcmp( g_state.transport, "ipc" ) != 0 )
+    {
+        rc = RunBench( "tcp" );
+    }
+    if( rc == 0 && strcmp( g_state.transport, "tcp" ) != 0 )
+    {
+        rc = RunBench( "ipc" );
+    }
+
+    return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -100,7 +100,7 @@ static void InitDevlist()
     if( g_state.hndl_devlist == NULL )
     {
         /* create devlist dsv if it hasn't been created */
-        dsv_info_t dsv;
+        dsv_info_t dsv = { 0 };
         int array[] = { DSV_DEFAULT_INSTID };
         dsv.pName = strdup( DSV_DEVLIST );
         dsv.type = DSV_TYPE_INT_ARRAY;
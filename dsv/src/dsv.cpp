@@ -29,6 +29,7 @@ SOFTWARE.
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -50,7 +51,9 @@ typedef enum dsv_operation
     DSV_SUB,
     DSV_SAVE,
     DSV_RESTORE,
-    DSV_TRACK
+    DSV_TRACK,
+    DSV_HISTORY,
+    DSV_DELETE
 }dsv_op_t;
 
 using dsv_array_t = std::vector< int >;
@@ -142,6 +145,8 @@ static void usage( void )
              "    save - persist all sysvars that need to save\n"
              "    restore - restore all sysvars from non-volatile memory\n"
              "    track - track the change of particular dsvs\n"
+             "    history - print the history of dsvs created with history=N\n"
+             "    delete - delete dsvs, a name ending with '*' is a prefix\n"
              "    -f <file-name> - create a batch of DSVs from a JSON file\n"
              "    -i <instance ID> - create a DSV with instance ID\n"
              "    -y <type> - create a DSV with type\n"
@@ -153,11 +158,14 @@ static void usage( void )
              "   sv -c /SYS/STS/DEVICE_NAME -i 1235 -v \"wifi router\" -y string -d \"device name\" -t \"sys.sts\"\n"
              "   sv set [0]/SYS/STS/DATE 2023-12-25\n"
              "   sv set [0]/SYS/STS/NAME \"wifi router\"\n"
+             "   sv set [0]/SYS/STS/MAC 0050c2a1b2c3\n"
              "   sv get [123]/SYS/STS/DEVICE_NAME\n"
              "   sv sub [123]/SYS/STS/DEVICE_NAME\n"
              "   sv save\n"
              "   sv restore\n"
              "   sv track enable /SYS/STS/DEVICE_NAME\n"
+             "   sv history [123]/SYS/STS/TEMPERATURE\n"
+             "   sv delete \"[123]*\"\n"
            );
 }
 
@@ -177,6 +185,17 @@ static int HandleNotification( void )
     {
         dsv_info_t dsv;
         dsv.type = DSV_Type( g_state.dsv_ctx, hndl );
+        if( DSV_ItemType( dsv.type ) != DSV_TYPE_INVALID ||
+            dsv.type == DSV_TYPE_BLOB )
+        {
+            /* only the head of a long value is received */
+            size_t *len = (size_t *)value;
+            if( *len > sizeof(value) - sizeof(size_t) )
+            {
+                *len = sizeof(value) - sizeof(size_t);
+            }
+        }
+
         if( dsv.type == DSV_TYPE_STR )
         {
             printf( "%s=%s\n", full_name, value );
@@ -187,6 +206,18 @@ static int HandleNotification( void )
             DSV_PrintArray( value, buffer, DSV_STRING_SIZE_MAX );
             printf( "%s=%s\n", full_name, buffer );
         }
+        else if( dsv.type == DSV_TYPE_BLOB )
+        {
+            char buffer[DSV_STRING_SIZE_MAX];
+            DSV_PrintBlob( value, buffer, DSV_STRING_SIZE_MAX );
+            printf( "%s=%s\n", full_name, buffer );
+        }
+        else if( DSV_ItemType( dsv.type ) != DSV_TYPE_INVALID )
+        {
+            char buffer[DSV_STRING_SIZE_MAX];
+            DSV_PrintItems( dsv.type, value, buffer, DSV_STRING_SIZE_MAX );
+            printf( "%s=%s\n", full_name, buffer );
+        }
         else
         {
             dsv.value = *(dsv_value_t *)value;
@@ -318,6 +349,117 @@ static int ProcessTrack( int argc, char **argv )
     return 0;
 
 }
+/*!=============================================================================
+
+    Process dsv history command, print the samples of the history of the dsvs
+
+@param[in]
+    argc
+        number of arguments passed to the process
+
+@param[in]
+    argv
+        array of null terminated argument strings passed to the process
+        The arguments are processed using getopt()
+
+@retval
+    0 - success
+    others - failed
+/*============================================================================*/
+static int ProcessHistory( int argc, char **argv )
+{
+    int rc = 0;
+    char value[DSV_STRING_SIZE_MAX];
+    dsv_history_t history;
+
+    for(; optind < argc; ++optind )
+    {
+        void *hndl = DSV_Handle( g_state.dsv_ctx, argv[optind] );
+        if( hndl == NULL )
+        {
+            fprintf( stderr, "%s is not found\n", argv[optind] );
+            rc = ENOENT;
+            continue;
+        }
+
+        rc = DSV_GetHistory( g_state.dsv_ctx, hndl, NULL, NULL, &history );
+        if( rc != 0 )
+        {
+            fprintf( stderr, "%s has no history\n", argv[optind] );
+            continue;
+        }
+
+        dsv_info_t dsv = { 0 };
+        int size = DSV_GetSizeFromType( history.type );
+        dsv.type = history.type;
+        for( size_t i = 0; i < history.count; i++ )
+        {
+            memcpy( &dsv.value, &history.values[i * size], size );
+            DSV_Value2Str( value, DSV_STRING_SIZE_MAX, &dsv );
+            printf( "%" PRId64 ".%09" PRId64 " %s\n",
+                    history.stamps[i] / 1000000000,
+                    history.stamps[i] % 1000000000,
+                    value );
+        }
+    }
+
+    return rc;
+}
+/*!=============================================================================
+
+    Process dsv delete command, delete the dsvs by name, or by prefix for a
+    name ending with '*'
+
+@param[in]
+    argc
+        number of arguments passed to the process
+
+@param[in]
+    argv
+        array of null terminated argument strings passed to the process
+        The arguments are processed using getopt()
+
+@retval
+    0 - success
+    others - failed
+/*============================================================================*/
+static int ProcessDelete( int argc, char **argv )
+{
+    int rc = 0;
+    size_t count;
+
+    for(; optind < argc; ++optind )
+    {
+        char *name = argv[optind];
+        size_t len = strlen( name );
+        if( len > 0 && name[len - 1] == '*' )
+        {
+            name[len - 1] = '\0';
+            rc = DSV_DeleteByPrefix( g_state.dsv_ctx, name, &count );
+            if( rc == 0 )
+            {
+                printf( "%zu dsvs deleted\n", count );
+            }
+            continue;
+        }
+
+        void *hndl = DSV_Handle( g_state.dsv_ctx, name );
+        if( hndl == NULL )
+        {
+            fprintf( stderr, "%s is not found\n", name );
+            rc = ENOENT;
+            continue;
+        }
+
+        rc = DSV_Delete( g_state.dsv_ctx, hndl );
+        if( rc != 0 )
+        {
+            fprintf( stderr, "%s: %s\n", name, strerror( rc ) );
+        }
+    }
+
+    return rc;
+}
 /*!=============================================================================
 
     Process dsv get/read command
@@ -571,6 +713,16 @@ static int ProcessOptions( int argc, char **argv )
                 g_state.operation = DSV_TRACK;
                 optind++;
             }
+            else if( (strcmp( argv[optind], "history" ) == 0) )
+            {
+                g_state.operation = DSV_HISTORY;
+                optind++;
+            }
+            else if( (strcmp( argv[optind], "delete" ) == 0) )
+            {
+                g_state.operation = DSV_DELETE;
+                optind++;
+            }
             else
             {
                 fprintf( stderr, "Missing/Unspported operation type\n" );
@@ -654,6 +806,12 @@ int main( int argc, char *argv[] )
     case DSV_TRACK:
         rc = ProcessTrack( argc, argv );
         break;
+    case DSV_HISTORY:
+        rc = ProcessHistory( argc, argv );
+        break;
+    case DSV_DELETE:
+        rc = ProcessDelete( argc, argv );
+        break;
     default:
         break;
     }
@@ -689,6 +847,13 @@ int main( int argc, char *argv[] )
             free( g_state.dsv.value.pArray );
         }
     }
+    if( DSV_TYPE_IS_BLOB( g_state.dsv.type ) )
+    {
+        if( g_state.dsv.value.pBlob )
+        {
+            free( g_state.dsv.value.pBlob );
+        }
+    }
 
     /* close the system variable manager */
     DSV_Close( g_state.dsv_ctx );
@@ -0,0 +1,585 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <assert.h>
+#include <algorithm>
+#include "dsv.h"
+#include "dsv_log.h"
+#include "dsv_calc.h"
+
+/*==============================================================================
+                               Macros
+==============================================================================*/
+/*! deepest evaluation stack of an expression, so calc_eval never allocates */
+#define CALC_DEPTH_MAX          ( 64 )
+
+/*! deepest nesting of parentheses, unary operators and function calls, so
+ *  the parser never runs out of stack */
+#define CALC_NESTING_MAX        ( 64 )
+
+#define CALC_OP( ins )          ( (ins) & 0xFF )
+#define CALC_ARG( ins )         ( (ins) >> 8 )
+
+/*! binary operators from the lowest precedence, unary ones are above */
+#define CALC_LEVELS             ( 5 )
+
+/*==============================================================================
+                              Structures
+==============================================================================*/
+typedef enum calc_op
+{
+    CALC_OP_CONST,
+    CALC_OP_INPUT,
+    CALC_OP_ADD,
+    CALC_OP_SUB,
+    CALC_OP_MUL,
+    CALC_OP_DIV,
+    CALC_OP_MOD,
+    CALC_OP_NEG,
+    CALC_OP_NOT,
+    CALC_OP_LT,
+    CALC_OP_LE,
+    CALC_OP_GT,
+    CALC_OP_GE,
+    CALC_OP_EQ,
+    CALC_OP_NE,
+    CALC_OP_AND,
+    CALC_OP_OR,
+    CALC_OP_ABS,
+    CALC_OP_SQRT,
+    CALC_OP_MIN,
+    CALC_OP_MAX
+
+}calc_op_t;
+
+typedef struct calc_token
+{
+    const char *str;
+
+    int op;
+
+    /*! precedence level of a binary operator, or number of arguments of a
+     *  function */
+    int arg;
+
+}calc_token_t;
+
+/*! two character operators first, so that "<=" is not taken as "<" */
+static const calc_token_t g_binary[] =
+{
+    { "||", CALC_OP_OR,  0 },
+    { "&&", CALC_OP_AND, 1 },
+    { "==", CALC_OP_EQ,  2 },
+    { "!=", CALC_OP_NE,  2 },
+    { "<=", CALC_OP_LE,  2 },
+    { ">=", CALC_OP_GE,  2 },
+    { "<",  CALC_OP_LT,  2 },
+    { ">",  CALC_OP_GT,  2 },
+    { "+",  CALC_OP_ADD, 3 },
+    { "-",  CALC_OP_SUB, 3 },
+    { "*",  CALC_OP_MUL, 4 },
+    { "/",  CALC_OP_DIV, 4 },
+    { "%",  CALC_OP_MOD, 4 }
+};
+
+static const calc_token_t g_functions[] =
+{
+    { "abs",  CALC_OP_ABS,  1 },
+    { "sqrt", CALC_OP_SQRT, 1 },
+    { "min",  CALC_OP_MIN,  2 },
+    { "max",  CALC_OP_MAX,  2 }
+};
+
+typedef struct calc_parser
+{
+    const char *expr;
+
+    /*! next character to parse */
+    const char *p;
+
+    /*! instance of names without the [instID] prefix */
+    uint32_t instID;
+
+    /*! depth of the evaluation stack after the code emitted so far */
+    uint32_t depth;
+
+    /*! operands being parsed, one inside the other */
+    uint32_t nesting;
+
+    calc_program_t *prog;
+
+}calc_parser_t;
+
+/*==============================================================================
+                              Local Functions
+==============================================================================*/
+static int calc_binary( calc_parser_t *ps, int level );
+static int calc_unary( calc_parser_t *ps );
+
+/*!=============================================================================
+
+    Log a syntax error with its position in the expression
+
+@param[in]
+    ps
+        parser
+@param[in]
+    what
+        what is wrong
+@return
+    EINVAL
+==============================================================================*/
+static int calc_error( const calc_parser_t *ps, const char *what )
+{
+    dsvlog( LOG_ERR, "%s at %d of \"%s\"",
+            what, (int)( ps->p - ps->expr ), ps->expr );
+    return EINVAL;
+}
+
+/*!=============================================================================
+
+    Skip the white space before the next token
+
+@param[in]
+    ps
+        parser
+==============================================================================*/
+static void calc_skip( calc_parser_t *ps )
+{
+    while( isspace( (unsigned char)*ps->p ) )
+    {
+        ps->p++;
+    }
+}
+
+/*!=============================================================================
+
+    Append an instruction to the program
+
+@param[in]
+    ps
+        parser
+@param[in]
+    op
+        opcode
+@param[in]
+    arg
+        argument of the opcode
+@param[in]
+    pushed
+        change of the stack depth by the instruction
+@return
+    0 for success, EINVAL if the stack gets too deep
+==============================================================================*/
+static int calc_emit( calc_parser_t *ps, int op, uint32_t arg, int pushed )
+{
+    ps->depth += pushed;
+    if( ps->depth > CALC_DEPTH_MAX )
+    {
+        return calc_error( ps, "expression too deep" );
+    }
+
+    ps->prog->depth = std::max( ps->prog->depth, ps->depth );
+    ps->prog->code.push_back( ( arg << 8 ) | op );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Parse the full name of an input dsv, eg [123]/SYS/P1, or /SYS/P1 for a
+    dsv of the same instance as the calculated one
+
+@param[in]
+    ps
+        parser, at '[' or '/'
+@return
+    0 for success, EINVAL for a bad name
+==============================================================================*/
+static int calc_input( calc_parser_t *ps )
+{
+    char prefix[16] = "";
+    const char *start = ps->p;
+
+    if( *ps->p == '[' )
+    {
+        ps->p++;
+        while( isdigit( (unsigned char)*ps->p ) )
+        {
+            ps->p++;
+        }
+        if( *ps->p != ']' )
+        {
+            return calc_error( ps, "expect ]" );
+        }
+        ps->p++;
+    }
+    else
+    {
+        snprintf( prefix, sizeof(prefix), "[%u]", ps->instID );
+    }
+
+    if( *ps->p != '/' )
+    {
+        return calc_error( ps, "expect /" );
+    }
+    while( isalnum( (unsigned char)*ps->p ) ||
+           ( *ps->p != '\0' && strchr( "_/#.", *ps->p ) != NULL ) )
+    {
+        ps->p++;
+    }
+
+    std::string name = prefix + std::string( start, ps->p - start );
+    std::vector< std::string > &inputs = ps->prog->inputs;
+    auto e = std::find( inputs.begin(), inputs.end(), name );
+    if( e == inputs.end() )
+    {
+        e = inputs.insert( inputs.end(), name );
+    }
+    return calc_emit( ps, CALC_OP_INPUT, e - inputs.begin(), 1 );
+}
+
+/*!=============================================================================
+
+    Parse a call of a function, eg max( a, b )
+
+@param[in]
+    ps
+        parser, at the function name
+@return
+    0 for success, EINVAL for a syntax error
+==============================================================================*/
+static int calc_function( calc_parser_t *ps )
+{
+    const char *start = ps->p;
+    while( isalpha( (unsigned char)*ps->p ) )
+    {
+        ps->p++;
+    }
+
+    const calc_token_t *f = NULL;
+    for( auto &t : g_functions )
+    {
+        if( strlen( t.str ) == (size_t)( ps->p - start ) &&
+            strncmp( t.str, start, ps->p - start ) == 0 )
+        {
+            f = &t;
+        }
+    }
+    if( f == NULL )
+    {
+        return calc_error( ps, "unknown function" );
+    }
+
+    calc_skip( ps );
+    if( *ps->p != '(' )
+    {
+        return calc_error( ps, "expect (" );
+    }
+    ps->p++;
+
+    for( int i = 0; i < f->arg; i++ )
+    {
+        if( i > 0 )
+        {
+            calc_skip( ps );
+            if( *ps->p != ',' )
+            {
+                return calc_error( ps, "expect ," );
+            }
+            ps->p++;
+        }
+
+        int rc = calc_binary( ps, 0 );
+        if( rc != 0 )
+        {
+            return rc;
+        }
+    }
+
+    calc_skip( ps );
+    if( *ps->p != ')' )
+    {
+        return calc_error( ps, "expect )" );
+    }
+    ps->p++;
+    return calc_emit( ps, f->op, 0, 1 - f->arg );
+}
+
+/*!=============================================================================
+
+    Parse a number, an input, a function call, a parenthesized expression,
+    or any of them after unary operators
+
+@param[in]
+    ps
+        parser
+@return
+    0 for success, EINVAL for a syntax error
+==============================================================================*/
+static int calc_operand( calc_parser_t *ps )
+{
+    int rc;
+
+    calc_skip( ps );
+    switch( *ps->p )
+    {
+    case '-':
+    case '!':
+    {
+        int op = *ps->p == '-' ? CALC_OP_NEG : CALC_OP_NOT;
+        ps->p++;
+        rc = calc_unary( ps );
+        return rc != 0 ? rc : calc_emit( ps, op, 0, 0 );
+    }
+
+    case '+':
+        ps->p++;
+        return calc_unary( ps );
+
+    case '(':
+        ps->p++;
+        rc = calc_binary( ps, 0 );
+        if( rc != 0 )
+        {
+            return rc;
+        }
+        calc_skip( ps );
+        if( *ps->p != ')' )
+        {
+            return calc_error( ps, "expect )" );
+        }
+        ps->p++;
+        return 0;
+
+    case '[':
+    case '/':
+        return calc_input( ps );
+
+    default:
+        break;
+    }
+
+    if( isalpha( (unsigned char)*ps->p ) )
+    {
+        return calc_function( ps );
+    }
+
+    char *end;
+    double value = strtod( ps->p, &end );
+    if( end == ps->p )
+    {
+        return calc_error( ps, "expect a value" );
+    }
+    ps->p = end;
+    ps->prog->consts.push_back( value );
+    return calc_emit( ps, CALC_OP_CONST, ps->prog->consts.size() - 1, 1 );
+}
+
+/*!=============================================================================
+
+    Parse an operand, within CALC_NESTING_MAX operands being parsed
+
+@param[in]
+    ps
+        parser
+@return
+    0 for success, EINVAL for a syntax error or an expression too deep
+==============================================================================*/
+static int calc_unary( calc_parser_t *ps )
+{
+    if( ps->nesting == CALC_NESTING_MAX )
+    {
+        return calc_error( ps, "expression too deep" );
+    }
+
+    ps->nesting++;
+    int rc = calc_operand( ps );
+    ps->nesting--;
+    return rc;
+}
+
+/*!=============================================================================
+
+    Parse the operands and binary operators of a precedence level and the
+    levels above it
+
+@param[in]
+    ps
+        parser
+@param[in]
+    level
+        precedence level, 0 for the whole expression
+@return
+    0 for success, EINVAL for a syntax error
+==============================================================================*/
+static int calc_binary( calc_parser_t *ps, int level )
+{
+    if( level == CALC_LEVELS )
+    {
+        return calc_unary( ps );
+    }
+
+    int rc = calc_binary( ps, level + 1 );
+    while( rc == 0 )
+    {
+        const calc_token_t *op = NULL;
+
+        calc_skip( ps );
+        for( auto &t : g_binary )
+        {
+            if( t.arg == level && strncmp( ps->p, t.str, strlen( t.str ) ) == 0 )
+            {
+                op = &t;
+                break;
+            }
+        }
+        if( op == NULL )
+        {
+            break;
+        }
+
+        ps->p += strlen( op->str );
+        rc = calc_binary( ps, level + 1 );
+        if( rc == 0 )
+        {
+            rc = calc_emit( ps, op->op, 0, -1 );
+        }
+    }
+    return rc;
+}
+
+/*==============================================================================
+                              Functions
+==============================================================================*/
+
+/*!=============================================================================
+
+    Compile the expression of a calculated dsv into the stack machine code run
+    by calc_eval(). The expression holds numbers, full names of dsvs, the
+    operators of C and the functions abs, sqrt, min and max, eg
+    "[123]/P1 * [123]/V1", or "/P1 * /V1" within one instance. A name runs
+    up to a character other than letters, digits and _/#., so a division
+    right after a name needs a space.
+
+@param[in]
+    expr
+        expression
+@param[in]
+    instID
+        instance of the names without an [instID] prefix
+@param[out]
+    prog
+        compiled program
+@return
+    0 for success, EINVAL for a syntax error
+==============================================================================*/
+int calc_compile( const char *expr, uint32_t instID, calc_program_t *prog )
+{
+    assert( expr );
+    assert( prog );
+
+    calc_parser_t ps = { expr, expr, instID, 0, 0, prog };
+    prog->code.clear();
+    prog->consts.clear();
+    prog->inputs.clear();
+    prog->depth = 0;
+
+    int rc = calc_binary( &ps, 0 );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+
+    calc_skip( &ps );
+    if( *ps.p != '\0' )
+    {
+        return calc_error( &ps, "unexpected character" );
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Evaluate a compiled expression
+
+@param[in]
+    prog
+        program compiled by calc_compile()
+@param[in]
+    inputs
+        values of the dsvs in prog->inputs, in the same order
+@return
+    value of the expression, comparisons give 1 or 0
+==============================================================================*/
+double calc_eval( const calc_program_t *prog, const double *inputs )
+{
+    assert( prog );
+
+    double stack[CALC_DEPTH_MAX];
+    double *sp = stack;
+
+    for( uint32_t ins : prog->code )
+    {
+        switch( CALC_OP( ins ) )
+        {
+        case CALC_OP_CONST: *sp++ = prog->consts[CALC_ARG( ins )]; break;
+        case CALC_OP_INPUT: *sp++ = inputs[CALC_ARG( ins )];       break;
+        case CALC_OP_ADD:   sp--; sp[-1] += sp[0];                 break;
+        case CALC_OP_SUB:   sp--; sp[-1] -= sp[0];                 break;
+        case CALC_OP_MUL:   sp--; sp[-1] *= sp[0];                 break;
+        case CALC_OP_DIV:   sp--; sp[-1] /= sp[0];                 break;
+        case CALC_OP_MOD:   sp--; sp[-1] = fmod( sp[-1], sp[0] );  break;
+        case CALC_OP_NEG:   sp[-1] = -sp[-1];                      break;
+        case CALC_OP_NOT:   sp[-1] = sp[-1] == 0;                  break;
+        case CALC_OP_LT:    sp--; sp[-1] = sp[-1] < sp[0];         break;
+        case CALC_OP_LE:    sp--; sp[-1] = sp[-1] <= sp[0];        break;
+        case CALC_OP_GT:    sp--; sp[-1] = sp[-1] > sp[0];         break;
+        case CALC_OP_GE:    sp--; sp[-1] = sp[-1] >= sp[0];        break;
+        case CALC_OP_EQ:    sp--; sp[-1] = sp[-1] == sp[0];        break;
+        case CALC_OP_NE:    sp--; sp[-1] = sp[-1] != sp[0];        break;
+        case CALC_OP_AND:   sp--; sp[-1] = sp[-1] != 0 && sp[0] != 0; break;
+        case CALC_OP_OR:    sp--; sp[-1] = sp[-1] != 0 || sp[0] != 0; break;
+        case CALC_OP_ABS:   sp[-1] = fabs( sp[-1] );               break;
+        case CALC_OP_SQRT:  sp[-1] = sqrt( sp[-1] );               break;
+        case CALC_OP_MIN:   sp--; sp[-1] = std::min( sp[-1], sp[0] ); break;
+        case CALC_OP_MAX:   sp--; sp[-1] = std::max( sp[-1], sp[0] ); break;
+        default:
+            assert( false );
+            break;
+        }
+    }
+
+    return stack[0];
+}
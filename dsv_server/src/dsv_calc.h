@@ -0,0 +1,67 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+#ifndef DSV_CALC_H
+#define DSV_CALC_H
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+/*==============================================================================
+                               Macros
+==============================================================================*/
+/*! longest expression of a calculated dsv */
+#define CALC_EXPR_SIZE_MAX      ( 4 * 1024 )
+
+/*==============================================================================
+                              Structures
+==============================================================================*/
+/*! expression of a calculated dsv compiled by calc_compile(). An instruction
+ *  holds the opcode in the low 8 bits and its argument in the others */
+typedef struct calc_program
+{
+    std::vector< uint32_t > code;
+
+    std::vector< double > consts;
+
+    /*! full names of the input dsvs, each one listed once */
+    std::vector< std::string > inputs;
+
+    /*! maximum depth of the evaluation stack */
+    uint32_t depth;
+
+}calc_program_t;
+
+/*==============================================================================
+                              Functions
+==============================================================================*/
+int calc_compile( const char *expr, uint32_t instID, calc_program_t *prog );
+double calc_eval( const calc_program_t *prog, const double *inputs );
+
+#endif // DSV_CALC_H
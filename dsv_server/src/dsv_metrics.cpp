@@ -0,0 +1,375 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include "dsv.h"
+#include "dsv_msg.h"
+#include "dsv_log.h"
+#include "dsv_var.h"
+#include "dsv_metrics.h"
+
+/*==============================================================================
+                               Macros
+==============================================================================*/
+/*! milliseconds between the publications of the metrics */
+#define METRICS_INTERVAL        ( 1000 )
+
+/*! bucket 0 counts the latencies under 1us, bucket i those in
+ *  [2^(i-1), 2^i) us, the last one those above */
+#define METRICS_BUCKETS         ( 16 )
+
+/*==============================================================================
+                              Structures
+==============================================================================*/
+/*! metrics of one request type, cumulated since the start */
+typedef struct metrics_type
+{
+    uint64_t count;
+
+    /*! requests answered with a non zero result */
+    uint64_t errors;
+
+    uint64_t latency[METRICS_BUCKETS];
+
+    /*! count when the metrics were last published */
+    uint64_t published;
+
+    dsv_info_t *dsv_count;
+
+    dsv_info_t *dsv_errors;
+
+    dsv_info_t *dsv_latency;
+
+}metrics_type_t;
+
+static struct metrics
+{
+    /*! indexed by dsv_msg_type_t, DSV_MSG_MAX for the subscriptions */
+    metrics_type_t types[DSV_MSG_MAX + 1];
+
+    dsv_info_t *dsv_dsvs;
+
+    dsv_info_t *dsv_queue_depth;
+
+    dsv_info_t *dsv_rejects;
+
+    /*! messages handled since the queues were last seen empty */
+    uint32_t run;
+
+    /*! longest run since the last publication */
+    uint32_t depth;
+
+    /*! time of the next publication, in ms of CLOCK_MONOTONIC */
+    int64_t next;
+
+}g_metrics;
+
+/*! names of the request types in the metrics, indexed by dsv_msg_type_t */
+static const char *g_type_names[] =
+{
+    NULL,
+    "CREATE",
+    "GET_HANDLE",
+    "GET_TYPE",
+    "GET_LEN",
+    "SET",
+    "GET",
+    "GET_NEXT",
+    "ADD_ITEM",
+    "DEL_ITEM",
+    "INS_ITEM",
+    "SET_ITEM",
+    "GET_ITEM",
+    "APPLY_ID",
+    "SAVE",
+    "RESTORE",
+    "TRACK",
+    "HELLO",
+    "INCR",
+    "FETCH_ADD",
+    "CAS",
+    "SET_RANGE",
+    "APPEND_ITEMS",
+    "DEL_RANGE",
+    "GET_RANGE",
+    "RESYNC",
+    "GET_HISTORY",
+    "QUERY_TAG",
+    "QUERY_FILTER",
+    "ALIAS",
+    "CREATE_BATCH",
+    "DELETE",
+    "DELETE_PREFIX",
+    "SUBSCRIBE"
+};
+
+static_assert( sizeof(g_type_names) / sizeof(g_type_names[0]) ==
+               DSV_MSG_MAX + 1,
+               "a name for each request type and the subscriptions" );
+
+/*==============================================================================
+                              Local Functions
+==============================================================================*/
+
+/*!=============================================================================
+
+    Get a built-in dsv of the metrics, logging a failure
+
+@param[in]
+    prefix
+        prefix of the metrics of the server
+@param[in]
+    name
+        name of the metric under the prefix
+@param[in]
+    type
+        type of the dsv
+@return
+    dsv information
+    NULL - out of memory
+==============================================================================*/
+static dsv_info_t *metrics_dsv( const std::string &prefix,
+                                const std::string &name,
+                                int type )
+{
+    dsv_info_t *dsv = var_builtin( ( prefix + name ).c_str(), type );
+    if( dsv == NULL )
+    {
+        dsvlog( LOG_ERR, "no memory for the metric %s", name.c_str() );
+    }
+    return dsv;
+}
+
+/*!=============================================================================
+
+    Publish a new value of a metric, an unchanged number is not published
+
+@param[in]
+    dsv
+        dsv of the metric, NULL if it could not be created
+@param[in]
+    value
+        value in the type of the dsv
+@param[in]
+    len
+        length of the value
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback invoked with the notification
+==============================================================================*/
+static void metrics_publish( dsv_info_t *dsv,
+                             const void *value,
+                             size_t len,
+                             char *fwd_buf,
+                             void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    if( dsv == NULL )
+    {
+        return;
+    }
+    if( !DSV_TYPE_IS_BLOB( dsv->type ) && memcmp( &dsv->value, value, len ) == 0 )
+    {
+        return;
+    }
+    if( var_builtin_set( dsv, value, len, fwd_buf ) == 0 )
+    {
+        cb( (const dsv_msg_forward_t *)fwd_buf );
+    }
+}
+
+/*==============================================================================
+                              Functions
+==============================================================================*/
+
+/*!=============================================================================
+
+    Create the built-in dsvs of the metrics of the server. In a cluster the
+    metrics of shard n are under DSV_STATS_PREFIX "n/".
+
+@param[in]
+    shard
+        index of the shard served
+@param[in]
+    count
+        number of shards, 1 for a standalone server
+==============================================================================*/
+void metrics_init( uint32_t shard, uint32_t count )
+{
+    std::string prefix = DSV_STATS_PREFIX;
+    if( count > 1 )
+    {
+        prefix += std::to_string( shard ) + "/";
+    }
+
+    for( int i = 0; i <= DSV_MSG_MAX; i++ )
+    {
+        if( g_type_names[i] == NULL )
+        {
+            continue;
+        }
+
+        metrics_type_t &t = g_metrics.types[i];
+        std::string name = std::string( g_type_names[i] ) + "/";
+        t.dsv_count = metrics_dsv( prefix, name + "COUNT", DSV_TYPE_UINT64 );
+        t.dsv_errors = metrics_dsv( prefix, name + "ERRORS", DSV_TYPE_UINT64 );
+        t.dsv_latency = metrics_dsv( prefix,
+                                     name + "LATENCY",
+                                     DSV_TYPE_UINT64_ARRAY );
+    }
+
+    g_metrics.dsv_dsvs = metrics_dsv( prefix, "DSVS", DSV_TYPE_UINT32 );
+    g_metrics.dsv_queue_depth = metrics_dsv( prefix,
+                                             "QUEUE_DEPTH",
+                                             DSV_TYPE_UINT32 );
+    g_metrics.dsv_rejects = metrics_dsv( prefix, "REJECTS", DSV_TYPE_UINT64 );
+}
+
+/*!=============================================================================
+
+    Get the time a request is taken, to be passed to metrics_record()
+
+@return
+    CLOCK_MONOTONIC in ns
+==============================================================================*/
+int64_t metrics_clock( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*!=============================================================================
+
+    Count a handled message and its latency
+
+@param[in]
+    type
+        one of dsv_msg_type_t, DSV_MSG_MAX for a subscription
+@param[in]
+    start
+        metrics_clock() when the message was received
+@param[in]
+    result
+        0 for success, others for an error
+==============================================================================*/
+void metrics_record( int type, int64_t start, int result )
+{
+    if( type <= DSV_MSG_START || type > DSV_MSG_MAX )
+    {
+        return;
+    }
+
+    metrics_type_t &t = g_metrics.types[type];
+    uint64_t us = (uint64_t)( metrics_clock() - start ) / 1000;
+    int bucket = us == 0 ? 0 : 64 - __builtin_clzll( us );
+
+    t.count++;
+    t.errors += result != 0;
+    t.latency[std::min( bucket, METRICS_BUCKETS - 1 )]++;
+    g_metrics.run++;
+}
+
+/*!=============================================================================
+
+    Note that no message was waiting, which ends the run of messages
+    handled back to back, the depth of the queues the server worked through
+==============================================================================*/
+void metrics_idle( void )
+{
+    g_metrics.depth = std::max( g_metrics.depth, g_metrics.run );
+    g_metrics.run = 0;
+}
+
+/*!=============================================================================
+
+    Publish the metrics every METRICS_INTERVAL, the ones of a request type
+    only after it was handled again. Called by the main loop at least every
+    DSV_HEARTBEAT_INTERVAL.
+
+@param[in]
+    now
+        CLOCK_MONOTONIC in ms
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback invoked with the notification of each changed metric
+==============================================================================*/
+void metrics_tick( int64_t now,
+                   char *fwd_buf,
+                   void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    if( now < g_metrics.next )
+    {
+        return;
+    }
+    g_metrics.next = now + METRICS_INTERVAL;
+
+    for( metrics_type_t &t : g_metrics.types )
+    {
+        if( t.count == t.published )
+        {
+            continue;
+        }
+        t.published = t.count;
+        metrics_publish( t.dsv_count, &t.count, sizeof(t.count), fwd_buf, cb );
+        metrics_publish( t.dsv_errors, &t.errors, sizeof(t.errors), fwd_buf, cb );
+        metrics_publish( t.dsv_latency,
+                         t.latency,
+                         sizeof(t.latency),
+                         fwd_buf,
+                         cb );
+    }
+
+    uint32_t dsvs = var_count();
+    uint32_t depth = std::max( g_metrics.depth, g_metrics.run );
+    uint64_t rejects = var_rejects();
+    g_metrics.depth = 0;
+
+    metrics_publish( g_metrics.dsv_dsvs, &dsvs, sizeof(dsvs), fwd_buf, cb );
+    metrics_publish( g_metrics.dsv_queue_depth,
+                     &depth,
+                     sizeof(depth),
+                     fwd_buf,
+                     cb );
+    metrics_publish( g_metrics.dsv_rejects,
+                     &rejects,
+                     sizeof(rejects),
+                     fwd_buf,
+                     cb );
+}
@@ -0,0 +1,48 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+
+#ifndef DSV_METRICS_H
+#define DSV_METRICS_H
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdint.h>
+#include "dsv.h"
+#include "dsv_msg.h"
+
+/*==============================================================================
+                              Functions
+==============================================================================*/
+void metrics_init( uint32_t shard, uint32_t count );
+int64_t metrics_clock( void );
+void metrics_record( int type, int64_t start, int result );
+void metrics_idle( void );
+void metrics_tick( int64_t now,
+                   char *fwd_buf,
+                   void (*cb)( const dsv_msg_forward_t *fwd ) );
+
+#endif // DSV_METRICS_H
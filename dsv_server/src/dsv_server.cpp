@@ -34,21 +34,40 @@ SOFTWARE.
 #include <assert.h>
 #include <signal.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unordered_set>
+#include <vector>
 #include "zmq.h"
 #include "czmq.h"
 #include "dsv.h"
 #include "dsv_msg.h"
 #include "dsv_var.h"
+#include "dsv_metrics.h"
 #include "dsv_log.h"
 
 /*==============================================================================
                               Defines
 ==============================================================================*/
 
-/*! zmq endpoint for tcp to cross node */
-#define DSV_FRONTEND            ( "tcp://*:56789" )
-#define DSV_BACKEND             ( "tcp://*:56788" )
-#define DSV_REPLY               ( "tcp://*:56787" )
+/*! zmq routing id is at most 255 bytes */
+#define DSV_ROUTING_ID_SIZE_MAX ( 256 )
+
+/*! handshake tokens of clients that never checked them are dropped */
+#define DSV_HELLO_TOKENS_MAX    ( 1024 )
+
+/*! milliseconds between heartbeats of the primary on the replication stream */
+#define DSV_HEARTBEAT_INTERVAL  ( 100 )
+
+/*! milliseconds without any message before a standby takes over */
+#define DSV_FAILOVER_TIMEOUT    ( 300 )
+
+/*! milliseconds between the replication lag reports of a standby */
+#define DSV_LAG_REPORT_INTERVAL ( 5000 )
+
+/*! no high water mark on the replication stream, a message dropped from the
+    snapshot would leave the standby without the dsv until the next gap */
+#define DSV_REPLICA_HWM         ( 0 )
 
 struct dsv_state
 {
@@ -61,14 +80,46 @@ struct dsv_state
     /*! zmq backend socket */
     void *sock_backend;
 
-    /*! zmq reply socket */
+    /*! zmq reply socket, ROUTER to serve pipelined DEALER clients */
     void *sock_reply;
 
+    /*! zmq replication socket, XPUB to see the standby subscribing */
+    void *sock_replica;
+
+    /*! sequence number of the last replication message */
+    uint64_t replica_seq;
+
+    /*! time of the next heartbeat, in ms of CLOCK_MONOTONIC */
+    int64_t heartbeat;
+
+    /*! ip address of the primary when running as its standby */
+    char primary[64];
+
+    /*! milliseconds without the primary before the standby takes over */
+    int failover_timeout;
+
     /*! zactor for speaker */
     void *speaker;
 
+    /*! index of the shard served and number of shards in the cluster */
+    uint8_t shard;
+    uint8_t shard_count;
+
+    /*! port of the reply socket, the backend and frontend ports follow it */
+    uint16_t port;
+
+    /*! request, reply, forward and replication messages of DSV_MSG_SIZE_MAX
+     *  bytes, allocated once as the server handles one message at a time */
+    char *req_buf;
+    char *rep_buf;
+    char *fwd_buf;
+    char *replica_buf;
+
 }g_state;
 
+/*! handshake tokens received on the frontend, not checked by the client yet */
+static std::unordered_set< uint64_t > g_hello_tokens;
+
 /*!=============================================================================
     Termination handlings
 ==============================================================================*/
@@ -129,10 +180,417 @@ static void s_create_pipe()
     s_catch_signals( pipefds[1] );
 }
 
+/*!=============================================================================
+
+    A client publishes DSV_MSG_HELLO with a token on the frontend, and asks
+    through the request socket whether the token has arrived. Once it has,
+    the publish path of the client is known to be connected.
+
+@param[in]
+    req_buf
+        DSV_MSG_HELLO request received on the frontend
+==============================================================================*/
+static void dsv_hello_record( const char *req_buf )
+{
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+
+    if( g_hello_tokens.size() >= DSV_HELLO_TOKENS_MAX )
+    {
+        g_hello_tokens.clear();
+    }
+    g_hello_tokens.insert( *(uint64_t *)req->data );
+}
+
+/*!=============================================================================
+
+    Check whether the handshake token of the client arrived on the frontend
+
+@param[in]
+    req_buf
+        DSV_MSG_HELLO request received on the reply socket
+@return
+    0 - the token arrived
+    ENOENT - not yet
+==============================================================================*/
+static int dsv_hello_check( const char *req_buf )
+{
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+
+    return g_hello_tokens.erase( *(uint64_t *)req->data ) == 1 ? 0 : ENOENT;
+}
+
+/*!=============================================================================
+
+    Get the time of CLOCK_MONOTONIC in ms, or CLOCK_REALTIME in ns
+
+==============================================================================*/
+static int64_t dsv_now_ms( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int64_t dsv_realtime_ns( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_REALTIME, &ts );
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*!=============================================================================
+
+    Send the bytes of a blob as the last frame of a message. zmq holds a
+    reference to the blob until the frame is sent instead of copying it.
+
+@param[in]
+    sock
+        zmq socket
+@param[in]
+    blob
+        value of a BLOB dsv
+@return
+    0 for success, -1 for failure
+==============================================================================*/
+static int dsv_send_blob( void *sock, dsv_blob_t *blob )
+{
+    zmq_msg_t msg;
+
+    blob->refs++;
+    if( zmq_msg_init_data( &msg,
+                           blob->data,
+                           blob->len,
+                           DSV_BlobRelease,
+                           blob ) == -1 )
+    {
+        DSV_BlobRelease( NULL, blob );
+        return -1;
+    }
+    if( zmq_msg_send( &msg, sock, 0 ) == -1 )
+    {
+        zmq_msg_close( &msg );
+        return -1;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Send the forward data of an operation, followed by the bytes of a blob in
+    a frame of their own. The receivers get them as one message.
+
+@param[in]
+    sock
+        zmq socket
+@param[in]
+    fwd
+        forward message of the operation
+@return
+    0 for success, -1 for failure
+==============================================================================*/
+static int dsv_send_forward( void *sock, const dsv_msg_forward_t *fwd )
+{
+    int rc = DSV_SendChunks( sock,
+                             fwd->data,
+                             fwd->length,
+                             fwd->blob != NULL ? ZMQ_SNDMORE : 0 );
+    if( rc != -1 && fwd->blob != NULL )
+    {
+        rc = dsv_send_blob( sock, fwd->blob );
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Send a message on the replication stream. Nothing is queued when no
+    standby is connected.
+
+@param[in]
+    type
+        one of dsv_replica_type_t
+@param[in]
+    data
+        data of the message
+@param[in]
+    len
+        length of data
+@param[in]
+    blob
+        bytes following the data, NULL if none
+==============================================================================*/
+static void dsv_replica_send( int type,
+                              const void *data,
+                              size_t len,
+                              dsv_blob_t *blob )
+{
+    dsv_msg_replica_t msg;
+    int rc;
+
+    if( g_state.sock_replica == NULL )
+    {
+        return;
+    }
+
+    msg.type = type;
+    msg.seq = ++g_state.replica_seq;
+    msg.stamp = dsv_realtime_ns();
+    msg.length = sizeof(dsv_msg_replica_t) + len +
+                 ( blob != NULL ? blob->len : 0 );
+
+    /* the header, then the data in frames, received as one message */
+    rc = zmq_send( g_state.sock_replica,
+                   &msg,
+                   sizeof(msg),
+                   ZMQ_DONTWAIT |
+                   ( len != 0 || blob != NULL ? ZMQ_SNDMORE : 0 ) );
+    if( rc != -1 && len != 0 )
+    {
+        rc = DSV_SendChunks( g_state.sock_replica,
+                             data,
+                             len,
+                             blob != NULL ? ZMQ_SNDMORE : 0 );
+    }
+    if( rc != -1 && blob != NULL )
+    {
+        rc = dsv_send_blob( g_state.sock_replica, blob );
+    }
+    if( rc == -1 && errno != EAGAIN )
+    {
+        dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
+    }
+}
+
+/*!=============================================================================
+
+    Send a dsv with its current value on the replication stream
+
+@param[in]
+    full_name
+        full dsv name
+@param[in]
+    arg
+        unused
+==============================================================================*/
+static void dsv_replica_create( const char *full_name, void *arg )
+{
+    int len = var_fill_replica( full_name, g_state.replica_buf );
+    if( len > 0 )
+    {
+        dsv_replica_send( DSV_REPLICA_CREATE, g_state.replica_buf, len, NULL );
+    }
+}
+
+/*!=============================================================================
+
+    Replicate a successful frontend operation to the standby
+
+@param[in]
+    type
+        type of the request
+@param[in]
+    fwd
+        forward message of the operation
+==============================================================================*/
+static void dsv_replicate( int type, const dsv_msg_forward_t *fwd )
+{
+    switch( type )
+    {
+    case DSV_MSG_CREATE:
+        /* the forward data has no description, tags nor flags */
+        dsv_replica_create( fwd->data, NULL );
+        break;
+
+    case DSV_MSG_ALIAS:
+        /* the standby takes the aliases with the dsv again */
+        dsv_replica_create( fwd->data, NULL );
+        break;
+
+    case DSV_MSG_DELETE:
+        dsv_replica_send( DSV_REPLICA_DELETE,
+                          fwd->data,
+                          fwd->length,
+                          NULL );
+        break;
+
+    case DSV_MSG_SAVE:
+    case DSV_MSG_RESTORE:
+        /* a restore replicates every restored dsv as an update by itself */
+        break;
+
+    default:
+        dsv_replica_send( DSV_REPLICA_UPDATE,
+                          fwd->data,
+                          fwd->length,
+                          fwd->blob );
+        break;
+    }
+}
+
+/*!=============================================================================
+
+    Handle the subscription of a standby, it gets every dsv first
+
+@return
+    0 for success, non-zero for failure
+==============================================================================*/
+static int dsv_handle_replica()
+{
+    char sub_buf[BUFSIZE];
+
+    int rc = zmq_recv( g_state.sock_replica, sub_buf, sizeof(sub_buf), 0 );
+    if( rc == -1 )
+    {
+        dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
+        return rc;
+    }
+
+    /* byte 0 is the subscription flag */
+    if( rc > 0 && sub_buf[0] == 1 )
+    {
+        dsvlog( LOG_NOTICE, "standby connected, sending snapshot" );
+        var_for_each( dsv_replica_create, NULL );
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Forward the new value of a successful operation to the subscribers and
+    the standby
+
+@param[in]
+    type
+        type of the request
+@param[in]
+    fwd
+        forward message of the operation
+@return
+    0 for success, non-zero for failure
+==============================================================================*/
+static int dsv_forward( int type, const dsv_msg_forward_t *fwd )
+{
+    dsv_replicate( type, fwd );
+
+    /* a save changes no value, a restore forwards each dsv by itself */
+    if( fwd->length == 0 )
+    {
+        return 0;
+    }
+
+    int rc = dsv_send_forward( g_state.sock_backend, fwd );
+    if( rc == -1 )
+    {
+        dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
+        return rc;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Forward the value of a dsv derived by the server, a statistic published
+    by var_stats_tick() or a calculated dsv evaluated by var_calc_run()
+
+@param[in]
+    fwd
+        forward message of the dsv
+==============================================================================*/
+static void dsv_forward_derived( const dsv_msg_forward_t *fwd )
+{
+    dsv_forward( DSV_MSG_SET, fwd );
+}
+
+/*!=============================================================================
+
+    Forward a dsv created by var_create_batch(), like a single create
+
+@param[in]
+    fwd
+        forward message of the dsv
+==============================================================================*/
+static void dsv_forward_created( const dsv_msg_forward_t *fwd )
+{
+    dsv_forward( DSV_MSG_CREATE, fwd );
+}
+
+/*!=============================================================================
+
+    Forward the deletion of a dsv to the subscribers and the standby
+
+@param[in]
+    fwd
+        notification of the deleted dsv
+==============================================================================*/
+static void dsv_forward_deleted( const dsv_msg_forward_t *fwd )
+{
+    dsv_forward( DSV_MSG_DELETE, fwd );
+}
+
+/*!=============================================================================
+
+    Publish a notification to the subscribers only, eg a rejected write to
+    its writer, nothing is replicated
+
+@param[in]
+    fwd
+        forward message of the notification
+==============================================================================*/
+static void dsv_publish( const dsv_msg_forward_t *fwd )
+{
+    if( dsv_send_forward( g_state.sock_backend, fwd ) == -1 )
+    {
+        dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
+    }
+}
+
+/*!=============================================================================
+
+    Send a reply on the ROUTER socket, with the envelope of its request
+
+@param[in]
+    sock
+        reply socket
+@param[in]
+    routing_id
+        routing id of the client
+@param[in]
+    id_len
+        length of the routing id
+@param[in]
+    rep
+        reply message
+@return
+    0 for success, -1 for failure
+==============================================================================*/
+static int dsv_send_reply( void *sock,
+                           const char *routing_id,
+                           int id_len,
+                           const dsv_msg_reply_t *rep )
+{
+    int rc = zmq_send( sock, routing_id, id_len, ZMQ_SNDMORE );
+    if( rc != -1 )
+    {
+        rc = zmq_send( sock, "", 0, ZMQ_SNDMORE );
+    }
+    if( rc != -1 )
+    {
+        rc = DSV_SendChunks( sock, rep, rep->length, 0 );
+    }
+    if( rc == -1 )
+    {
+        dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
+        return rc;
+    }
+    return 0;
+}
+
 /*!=============================================================================
 
     Handle request messages from client, including dsv get_xxx APIs that need
-    feedback
+    feedback. The request arrives on the ROUTER socket as
+    [routing id][empty delimiter][request], and the reply goes back with the
+    same envelope and the correlation id of the request.
 
 @return
     0 for success, non-zero for failure
@@ -143,17 +601,48 @@ static int dsv_handle_reply()
     assert( rep_sock );
 
     int rc = 0;
-    char req_buf[BUFSIZE];
-    char rep_buf[BUFSIZE];
+    int id_len;
+    char routing_id[DSV_ROUTING_ID_SIZE_MAX];
+    char *req_buf = g_state.req_buf;
+    char *rep_buf = g_state.rep_buf;
+    char *fwd_buf = g_state.fwd_buf;
+    bool forward = false;
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
 
-    rc = zmq_recv( rep_sock, req_buf, BUFSIZE, 0 );
+    id_len = zmq_recv( rep_sock, routing_id, sizeof(routing_id), 0 );
+    if( id_len == -1 )
+    {
+        dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
+        return id_len;
+    }
+
+    /* empty delimiter, then the request itself */
+    rc = zmq_recv( rep_sock, routing_id, 0, 0 );
+    if( rc != -1 )
+    {
+        rc = DSV_RecvChunksInto( rep_sock, req_buf, DSV_MSG_SIZE_MAX, 0 );
+        if( rc == -1 && errno == EMSGSIZE )
+        {
+            /* the first frame with the request id is kept, the client
+               waits for the reply of that id */
+            rep->length = sizeof(dsv_msg_reply_t);
+            rep->result = EMSGSIZE;
+            rep->id = req->id;
+            return dsv_send_reply( rep_sock, routing_id, id_len, rep );
+        }
+    }
     if( rc == -1 )
     {
         dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
         return rc;
     }
+    int64_t start = metrics_clock();
+
+    /* every request gets a reply, or the pipelined client waits forever */
+    rep->length = sizeof(dsv_msg_reply_t);
+    rep->result = EINVAL;
 
     switch( req->type )
     {
@@ -182,29 +671,91 @@ static int dsv_handle_reply()
         rep->result = rc;
         break;
 
+    case DSV_MSG_QUERY_TAG:
+        rc = var_query_tag( req_buf, rep_buf );
+        rep->result = rc;
+        break;
+
+    case DSV_MSG_QUERY_FILTER:
+        rc = var_query_filter( req_buf, rep_buf );
+        rep->result = rc;
+        break;
+
     case DSV_MSG_GET_ITEM:
         rc = var_get_item( req_buf, rep_buf );
         rep->result = rc;
         break;
 
+    case DSV_MSG_GET_RANGE:
+        rc = var_get_range( req_buf, rep_buf );
+        rep->result = rc;
+        break;
+
+    case DSV_MSG_RESYNC:
+        rc = var_resync( req_buf, rep_buf );
+        rep->result = rc;
+        break;
+
+    case DSV_MSG_GET_HISTORY:
+        rc = var_get_history( req_buf, rep_buf );
+        rep->result = rc;
+        break;
+
     case DSV_MSG_TRACK:
         rc = var_track( req_buf, rep_buf );
         rep->result = rc;
         break;
 
+    case DSV_MSG_HELLO:
+        rc = dsv_hello_check( req_buf );
+        rep->result = rc;
+        break;
+
+    case DSV_MSG_FETCH_ADD:
+        rc = var_fetch_add( req_buf, rep_buf, fwd_buf );
+        rep->result = rc;
+        forward = rc == 0;
+        break;
+
+    case DSV_MSG_CAS:
+        rc = var_cas( req_buf, rep_buf, fwd_buf );
+        rep->result = rc;
+        forward = rc == 0;
+        break;
+
+    case DSV_MSG_ALIAS:
+        rc = var_alias( req_buf, rep_buf, fwd_buf );
+        rep->result = rc;
+        forward = rc == 0;
+        break;
+
+    case DSV_MSG_DELETE:
+        /* every deleted dsv is forwarded by itself */
+        rc = var_delete( req_buf, rep_buf, fwd_buf, dsv_forward_deleted );
+        rep->result = rc;
+        break;
+
+    case DSV_MSG_DELETE_PREFIX:
+        rc = var_delete_prefix( req_buf, rep_buf, fwd_buf, dsv_forward_deleted );
+        rep->result = rc;
+        break;
+
     default:
         dsvlog( LOG_ERR, "Unsupported request type!" );
         break;
     }
+    rep->id = req->id;
 
-    rc = zmq_send( rep_sock, rep_buf, rep->length, 0 );
+    rc = dsv_send_reply( rep_sock, routing_id, id_len, rep );
     if( rc == -1 )
     {
-        dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
         return rc;
     }
 
-    return 0;
+    /* atomic operations change the value, the subscribers need it too */
+    rc = forward ? dsv_forward( req->type, fwd ) : 0;
+    metrics_record( req->type, start, rep->result );
+    return rc;
 }
 
 /*!=============================================================================
@@ -224,16 +775,19 @@ static int dsv_handle_frontend()
     assert( backend );
 
     int rc = 0;
-    char req_buf[BUFSIZE];
-    char fwd_buf[BUFSIZE];
+    char *req_buf = g_state.req_buf;
+    char *fwd_buf = g_state.fwd_buf;
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
-    rc = zmq_recv( frontend, req_buf, BUFSIZE, 0 );
+    rc = DSV_RecvChunksInto( frontend, req_buf, DSV_MSG_SIZE_MAX, 0 );
     if( rc == -1 )
     {
         dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
         return rc;
     }
+    int64_t start = metrics_clock();
+    fwd->length = 0;
+    fwd->blob = NULL;
 
     switch( req->type )
     {
@@ -241,10 +795,20 @@ static int dsv_handle_frontend()
         rc = var_create( req_buf, fwd_buf );
         break;
 
+    case DSV_MSG_CREATE_BATCH:
+        /* every new dsv is forwarded by itself */
+        rc = var_create_batch( req_buf, fwd_buf, dsv_forward_created );
+        metrics_record( req->type, start, rc );
+        return 0;
+
     case DSV_MSG_SET:
         rc = var_set( req_buf, fwd_buf );
         break;
 
+    case DSV_MSG_INCR:
+        rc = var_fetch_add( req_buf, NULL, fwd_buf );
+        break;
+
     case DSV_MSG_ADD_ITEM:
         rc = var_add_item( req_buf, fwd_buf );
         break;
@@ -261,31 +825,45 @@ static int dsv_handle_frontend()
         rc = var_set_item( req_buf, fwd_buf );
         break;
 
+    case DSV_MSG_SET_RANGE:
+        rc = var_set_range( req_buf, fwd_buf );
+        break;
+
+    case DSV_MSG_APPEND_ITEMS:
+        rc = var_append_items( req_buf, fwd_buf );
+        break;
+
+    case DSV_MSG_DEL_RANGE:
+        rc = var_del_range( req_buf, fwd_buf );
+        break;
+
     case DSV_MSG_SAVE:
         rc = var_save();
         break;
 
     case DSV_MSG_RESTORE:
-        rc = var_restore();
+        /* every restored dsv is forwarded by itself, nothing left to forward */
+        rc = var_restore( fwd_buf, dsv_forward_derived );
+        fwd->length = 0;
         break;
 
+    case DSV_MSG_HELLO:
+        /* connection handshake, nothing to forward */
+        dsv_hello_record( req_buf );
+        metrics_record( req->type, start, 0 );
+        return 0;
+
     default:
         dsvlog( LOG_ERR, "Unsupported request type!" );
+        rc = EINVAL;
         break;
     }
 
     /* success operation needs forward the value to downstream */
-    if( rc == 0 )
-    {
-        rc = zmq_send( backend, fwd->data, fwd->length, 0 );
-        if( rc == -1 )
-        {
-            dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
-            return rc;
-        }
-    }
-
-    return 0;
+    int result = rc;
+    rc = result == 0 ? dsv_forward( req->type, fwd ) : 0;
+    metrics_record( req->type, start, result );
+    return rc;
 }
 
 /*!=============================================================================
@@ -302,9 +880,8 @@ static int dsv_handle_backend()
 
     int rc = 0;
     char sub_buf[BUFSIZE];
-    char fwd_buf[BUFSIZE];
+    char *fwd_buf = g_state.fwd_buf;
     dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
-    char *fwd_data = fwd->data;
 
     rc = zmq_recv( backend, sub_buf, BUFSIZE, 0 );
     if( rc == -1 )
@@ -312,17 +889,20 @@ static int dsv_handle_backend()
         dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
         return rc;
     }
+    int64_t start = metrics_clock();
 
     rc = var_notify( sub_buf, fwd_buf );
     if( rc == 0 )
     {
-        rc = zmq_send( backend, fwd_data, fwd->length, 0 );
+        rc = dsv_send_forward( backend, fwd );
         if( rc == -1 )
         {
             dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
-            return rc;
         }
     }
+
+    /* an unsubscription or an unknown name is no error of the server */
+    metrics_record( DSV_MSG_MAX, start, rc == -1 ? EIO : 0 );
     return rc;
 }
 
@@ -338,22 +918,43 @@ static int mainloop()
     void *frontend = g_state.sock_frontend;
     void *backend = g_state.sock_backend;
     void *reply = g_state.sock_reply;
+    void *replica = g_state.sock_replica;
 
     assert( frontend );
     assert( backend );
     assert( reply );
+    assert( replica );
 
     zmq_pollitem_t items[] = {
         { 0, pipefds[0], ZMQ_POLLIN, 0 },
         { frontend, 0, ZMQ_POLLIN, 0 },
         { backend, 0, ZMQ_POLLIN, 0 },
-        { reply, 0, ZMQ_POLLIN, 0 }
+        { reply, 0, ZMQ_POLLIN, 0 },
+        { replica, 0, ZMQ_POLLIN, 0 }
     };
 
+    g_state.heartbeat = dsv_now_ms();
     while( 1 )
     {
-        /* zmq_poll provides level-triggered fashion */
-        if( zmq_poll( items, 4, -1 ) == -1 )
+        /* the standby takes over when the heartbeats stop */
+        int64_t now = dsv_now_ms();
+        if( now >= g_state.heartbeat )
+        {
+            dsv_replica_send( DSV_REPLICA_HEARTBEAT, NULL, 0, NULL );
+            g_state.heartbeat = now + DSV_HEARTBEAT_INTERVAL;
+        }
+        var_stats_tick( now, g_state.fwd_buf, dsv_forward_derived );
+        metrics_tick( now, g_state.fwd_buf, dsv_publish );
+
+        /* zmq_poll provides level-triggered fashion, the queues are empty
+           when nothing is ready without waiting */
+        int ready = zmq_poll( items, 5, 0 );
+        if( ready == 0 )
+        {
+            metrics_idle();
+            ready = zmq_poll( items, 5, g_state.heartbeat - now );
+        }
+        if( ready == -1 )
         {
             dsvlog( LOG_ERR, "zmq_poll failed: %s", strerror( errno ) );
             break;
@@ -388,6 +989,16 @@ static int mainloop()
             /* Failure could be caused by client, don't exit proxy */
             dsv_handle_reply();
         }
+
+        /* a standby subscribed, send the snapshot */
+        if( items[4].revents & ZMQ_POLLIN )
+        {
+            dsv_handle_replica();
+        }
+
+        /* the calculated dsvs whose inputs changed in this round */
+        var_calc_run( g_state.fwd_buf, dsv_forward_derived );
+        var_reject_run( g_state.fwd_buf, dsv_publish );
     }
 
     var_save();
@@ -421,10 +1032,19 @@ static void dsv_server_destroy()
     {
         zmq_close( g_state.sock_reply );
     }
+    if( g_state.sock_replica != NULL )
+    {
+        zmq_close( g_state.sock_replica );
+    }
     if( g_state.zmq_ctx != NULL )
     {
         zmq_ctx_destroy( g_state.zmq_ctx );
     }
+
+    free( g_state.req_buf );
+    free( g_state.rep_buf );
+    free( g_state.fwd_buf );
+    free( g_state.replica_buf );
 }
 
 /*!=============================================================================
@@ -439,6 +1059,44 @@ static int dsv_server_run()
     return mainloop();
 }
 
+/*!=============================================================================
+
+    Bind the socket to the tcp endpoint of the port, and to the unix domain
+    endpoint as well, so the clients on this host can skip the tcp/ip stack.
+    The clients on this host only use the latter, so both must be bound.
+
+@param[in]
+    sock
+        socket to bind
+@param[in]
+    port
+        one of DSV_PORT_REPLY, DSV_PORT_BACKEND and DSV_PORT_FRONTEND
+@return
+    0 for success, non-zero for failure
+==============================================================================*/
+static int dsv_bind( void *sock, uint16_t port )
+{
+    char endpoint[DSV_STRING_SIZE_MAX];
+
+    DSV_EndpointUrl( endpoint, sizeof(endpoint), "*", g_state.port + port, false );
+    int rc = zmq_bind( sock, endpoint );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+
+    DSV_EndpointUrl( endpoint, sizeof(endpoint), "*", g_state.port + port, true );
+    rc = zmq_bind( sock, endpoint );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR,
+                "Error calling zmq_bind %s: %s",
+                endpoint,
+                strerror( errno ) );
+    }
+    return rc;
+}
+
 /*!=============================================================================
 
     Bind the socket to server endpoint, used for dsv read and write
@@ -454,7 +1112,7 @@ static int dsv_setup_frontend()
     void *sock = zmq_socket( g_state.zmq_ctx, ZMQ_SUB );
     assert( sock );
 
-    rc = zmq_bind( sock, DSV_FRONTEND );
+    rc = dsv_bind( sock, DSV_PORT_FRONTEND );
     if( rc == 0 )
     {
         g_state.sock_frontend = sock;
@@ -487,7 +1145,7 @@ static int dsv_setup_backend()
     assert( sock );
 
     /* Bind PUB that subscribers need to connect to */
-    rc = zmq_bind( sock, DSV_BACKEND );
+    rc = dsv_bind( sock, DSV_PORT_BACKEND );
     if( rc  == 0 )
     {
         g_state.sock_backend = sock;
@@ -504,7 +1162,7 @@ static int dsv_setup_backend()
 
 /*!=============================================================================
 
-    Bind the socket to an req/rep endpoint, used for client request
+    Bind the ROUTER socket to the request endpoint, used for client request
 
 @return
     0 for success, non-zero for failure
@@ -514,11 +1172,11 @@ static int dsv_setup_reply()
     assert( g_state.zmq_ctx );
 
     int rc = 0;
-    void *sock = zmq_socket( g_state.zmq_ctx, ZMQ_REP );
+    void *sock = zmq_socket( g_state.zmq_ctx, ZMQ_ROUTER );
     assert( sock );
 
     /* Bind PUB that subscribers need to connect to */
-    rc = zmq_bind( sock, DSV_REPLY );
+    rc = dsv_bind( sock, DSV_PORT_REPLY );
     if( rc  == 0 )
     {
         g_state.sock_reply = sock;
@@ -533,6 +1191,202 @@ static int dsv_setup_reply()
     return rc;
 }
 
+/*!=============================================================================
+
+    Bind the XPUB socket of the replication stream, used by the standby.
+    Every subscription is passed up, so that each standby gets a snapshot.
+
+@return
+    0 for success, non-zero for failure
+==============================================================================*/
+static int dsv_setup_replica()
+{
+    assert( g_state.zmq_ctx );
+
+    int rc = 0;
+    int verbose = 1;
+    int hwm = DSV_REPLICA_HWM;
+    void *sock = zmq_socket( g_state.zmq_ctx, ZMQ_XPUB );
+    assert( sock );
+
+    rc = zmq_setsockopt( sock, ZMQ_XPUB_VERBOSE, &verbose, sizeof(verbose) );
+    assert( rc == 0 );
+
+    /* the whole snapshot is queued at once, keep all of it */
+    rc = zmq_setsockopt( sock, ZMQ_SNDHWM, &hwm, sizeof(hwm) );
+    assert( rc == 0 );
+
+    rc = dsv_bind( sock, DSV_PORT_REPLICA );
+    if( rc == 0 )
+    {
+        g_state.sock_replica = sock;
+    }
+    else
+    {
+        dsvlog( LOG_ERR, "Error calling zmq_bind: %s", strerror( errno ) );
+        zmq_close( sock );
+        g_state.sock_replica = NULL;
+    }
+
+    return rc;
+}
+
+/*!=============================================================================
+
+    Run as the standby of the primary: keep the same store from the
+    replication stream until the primary is silent for failover_timeout.
+    A gap in the sequence numbers subscribes again for a new snapshot.
+
+@return
+    0 - the primary is gone, take over
+    -1 - interrupted
+==============================================================================*/
+static int dsv_standby_run()
+{
+    int rc = -1;
+    char url[DSV_STRING_SIZE_MAX];
+    std::vector< char > buf;
+    dsv_msg_replica_t *msg;
+    int hwm = DSV_REPLICA_HWM;
+    uint64_t last_seq = 0;
+    uint64_t gaps = 0;
+    uint64_t lag_count = 0;
+    int64_t lag_sum = 0;
+    int64_t lag_max = 0;
+
+    void *zmq_ctx = zmq_ctx_new();
+    assert( zmq_ctx );
+    void *sock = zmq_socket( zmq_ctx, ZMQ_SUB );
+    assert( sock );
+
+    /* the snapshot of the primary arrives at once, keep all of it */
+    if( zmq_setsockopt( sock, ZMQ_RCVHWM, &hwm, sizeof(hwm) ) != 0 )
+    {
+        dsvlog( LOG_ERR, "zmq_setsockopt failed: %s", strerror( errno ) );
+    }
+
+    DSV_EndpointUrl( url,
+                     sizeof(url),
+                     g_state.primary,
+                     g_state.port + DSV_PORT_REPLICA,
+                     DSV_IsLocalIP( g_state.primary ) );
+    if( zmq_connect( sock, url ) != 0 ||
+        zmq_setsockopt( sock, ZMQ_SUBSCRIBE, "", 0 ) != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to follow %s: %s", url, strerror( errno ) );
+        zmq_close( sock );
+        zmq_ctx_destroy( zmq_ctx );
+        return -1;
+    }
+    dsvlog( LOG_NOTICE, "standby of %s", url );
+
+    zmq_pollitem_t items[] = {
+        { 0, pipefds[0], ZMQ_POLLIN, 0 },
+        { sock, 0, ZMQ_POLLIN, 0 }
+    };
+
+    int64_t last_seen = dsv_now_ms();
+    int64_t last_report = last_seen;
+    while( 1 )
+    {
+        if( zmq_poll( items, 2, DSV_HEARTBEAT_INTERVAL ) == -1 )
+        {
+            dsvlog( LOG_ERR, "zmq_poll failed: %s", strerror( errno ) );
+            break;
+        }
+
+        /* Signal pipe FD */
+        if( items[0].revents & ZMQ_POLLIN )
+        {
+            char buffer[1];
+            /* clear notifying byte */
+            if( read( pipefds[0], buffer, 1 ) == -1 )
+            {
+                dsvlog( LOG_ERR, "read failed: %s", strerror( errno ) );
+            }
+            dsvlog( LOG_WARNING, "interrupt received, killing server...\n" );
+            break;
+        }
+
+        while( DSV_RecvChunks( sock, buf, ZMQ_DONTWAIT ) != -1 )
+        {
+            last_seen = dsv_now_ms();
+            if( buf.size() < sizeof(dsv_msg_replica_t) )
+            {
+                continue;
+            }
+            msg = (dsv_msg_replica_t *)buf.data();
+
+            int64_t lag = dsv_realtime_ns() - msg->stamp;
+            lag_sum += lag;
+            lag_max = lag > lag_max ? lag : lag_max;
+            ++lag_count;
+
+            if( last_seq != 0 && msg->seq != last_seq + 1 )
+            {
+                /* subscribing again makes the primary send a snapshot */
+                dsvlog( LOG_WARNING,
+                        "replication gap %" PRIu64 " -> %" PRIu64 ", resync",
+                        last_seq, msg->seq );
+                ++gaps;
+                zmq_setsockopt( sock, ZMQ_UNSUBSCRIBE, "", 0 );
+                zmq_setsockopt( sock, ZMQ_SUBSCRIBE, "", 0 );
+                last_seq = 0;
+            }
+            else
+            {
+                last_seq = msg->seq;
+            }
+
+            switch( msg->type )
+            {
+            case DSV_REPLICA_CREATE:
+                var_replica_create( msg->data );
+                break;
+
+            case DSV_REPLICA_UPDATE:
+                var_replica_update( msg->data );
+                break;
+
+            case DSV_REPLICA_DELETE:
+                var_replica_delete( msg->data );
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        int64_t now = dsv_now_ms();
+        if( now - last_report >= DSV_LAG_REPORT_INTERVAL && lag_count != 0 )
+        {
+            dsvlog( LOG_NOTICE,
+                    "replication lag avg %" PRId64 " us, max %" PRId64
+                    " us, seq %" PRIu64 ", gaps %" PRIu64,
+                    lag_sum / (int64_t)lag_count / 1000,
+                    lag_max / 1000,
+                    last_seq,
+                    gaps );
+            lag_sum = lag_max = 0;
+            lag_count = 0;
+            last_report = now;
+        }
+
+        if( now - last_seen > g_state.failover_timeout )
+        {
+            dsvlog( LOG_WARNING,
+                    "primary silent for %" PRId64 " ms, taking over",
+                    now - last_seen );
+            rc = 0;
+            break;
+        }
+    }
+
+    zmq_close( sock );
+    zmq_ctx_destroy( zmq_ctx );
+    return rc;
+}
+
 /*!=============================================================================
 
     Initialize discovery server for dsv server
@@ -542,17 +1396,38 @@ static int dsv_setup_reply()
 ==============================================================================*/
 static int dsv_server_init_discovery()
 {
+    dsv_server_t servers[DSV_SHARD_MAX];
+
     /**
      *  Try to discover the existing dsv server on the network.
-     *  If there is one, don't run the server.
+     *  If there is one serving the same shard, or a cluster of other size,
+     *  don't run the server. A standby taking over knows the primary is gone.
      */
-    if( DSV_FindDiscoveryServer( NULL, 0 ) )
+    if( g_state.primary[0] == '\0' &&
+        DSV_DiscoverServers( servers, DSV_SHARD_MAX ) != 0 )
     {
-        return -1;
+        if( servers[0].count != g_state.shard_count )
+        {
+            dsvlog( LOG_ERR,
+                    "A dsv cluster of %u shards is running",
+                    servers[0].count );
+            return -1;
+        }
+        if( servers[g_state.shard].count != 0 )
+        {
+            dsvlog( LOG_ERR,
+                    "Shard %u is served by %s:%u",
+                    g_state.shard,
+                    servers[g_state.shard].ip,
+                    servers[g_state.shard].port );
+            return -1;
+        }
     }
 
     /*! run discovery server if there is not */
-    g_state.speaker = DSV_RunDiscoveryServer();
+    g_state.speaker = DSV_RunDiscoveryServer( g_state.shard,
+                                              g_state.shard_count,
+                                              g_state.port );
     if( g_state.speaker == NULL )
     {
         return -1;
@@ -572,10 +1447,11 @@ static int dsv_server_init_zmq()
 {
     int rc = 0;
 
-    memset( &g_state, 0, sizeof(g_state) );
-
-    /* create a self-pipe to get the exit signal */
-    s_create_pipe();
+    /* the unix domain endpoints are bound in a directory of the server */
+    if( DSV_IpcPrepare() != 0 )
+    {
+        return -1;
+    }
 
     /* Create zmq context */
     g_state.zmq_ctx = zmq_ctx_new();
@@ -588,6 +1464,10 @@ static int dsv_server_init_zmq()
             if( rc == 0 )
             {
                 rc = dsv_setup_reply();
+                if( rc == 0 )
+                {
+                    rc = dsv_setup_replica();
+                }
                 if( rc != 0 )
                 {
                     dsvlog( LOG_ERR, "Failed to setup dsv reply" );
@@ -658,23 +1538,103 @@ int main( int argc, char **argv )
 {
     int rc;
     int c;
+    int port = -1;
+    char *sep;
+
+    g_state.shard = 0;
+    g_state.shard_count = 1;
+    g_state.failover_timeout = DSV_FAILOVER_TIMEOUT;
 
     /* parse the command line options */
-    while( (c = getopt( argc, argv, "v" )) != -1 )
+    while( (c = getopt( argc, argv, "vs:n:p:r:t:" )) != -1 )
     {
         switch( c )
         {
         case 'v':
             break;
 
+        case 's':
+            g_state.shard = atoi( optarg );
+            break;
+
+        case 'n':
+            g_state.shard_count = atoi( optarg );
+            break;
+
+        case 'p':
+            port = atoi( optarg );
+            break;
+
+        case 'r':
+            /* standby of the primary at ip[:port] */
+            strncpy( g_state.primary, optarg, sizeof(g_state.primary) - 1 );
+            sep = strchr( g_state.primary, ':' );
+            if( sep != NULL )
+            {
+                *sep = '\0';
+                port = atoi( sep + 1 );
+            }
+            break;
+
+        case 't':
+            g_state.failover_timeout = atoi( optarg );
+            break;
+
         default:
             break;
         }
     }
 
+    if( g_state.shard_count == 0 ||
+        g_state.shard_count > DSV_SHARD_MAX ||
+        g_state.shard >= g_state.shard_count )
+    {
+        fprintf( stderr,
+                 "usage: %s [-s shard -n count] [-p port] "
+                 "[-r primary[:port] [-t timeout]], count <= %d\n",
+                 argv[0], DSV_SHARD_MAX );
+        exit( 1 );
+    }
+
+    /* shards on one host need their own ports */
+    g_state.port = port != -1 ? port :
+                   DSV_PORT_BASE + g_state.shard * DSV_PORT_STRIDE;
+
+    /* untouched pages of the buffers are never backed by memory */
+    g_state.req_buf = (char *)malloc( DSV_MSG_SIZE_MAX );
+    g_state.rep_buf = (char *)malloc( DSV_MSG_SIZE_MAX );
+    g_state.fwd_buf = (char *)malloc( DSV_MSG_SIZE_MAX );
+    g_state.replica_buf = (char *)malloc( DSV_MSG_SIZE_MAX );
+    if( g_state.req_buf == NULL ||
+        g_state.rep_buf == NULL ||
+        g_state.fwd_buf == NULL ||
+        g_state.replica_buf == NULL )
+    {
+        fprintf( stderr, "Unable to allocate the message buffers\n" );
+        exit( 1 );
+    }
+
+    /* create a self-pipe to get the exit signal */
+    s_create_pipe();
+
     /* initialize dsv module */
     DSV_LogInit( NULL, NULL );
-    rc = dsv_server_init();
+    var_set_shard( g_state.shard, g_state.shard_count );
+
+    /* a standby takes over the endpoints of the primary once it is gone, so
+       the clients on this host reconnect to it without noticing */
+    rc = 0;
+    if( g_state.primary[0] != '\0' )
+    {
+        var_use_handle_map();
+        rc = dsv_standby_run();
+    }
+
+    if( rc == 0 )
+    {
+        metrics_init( g_state.shard, g_state.shard_count );
+        rc = dsv_server_init();
+    }
     if( rc == 0 )
     {
         /* Run dsv server mainloop */
@@ -31,6 +31,8 @@ SOFTWARE.
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <ctype.h>
+#include <fnmatch.h>
 #include <unordered_map>
 #include <vector>
 #include <memory>
@@ -38,16 +40,81 @@ SOFTWARE.
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <type_traits>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
+#include <unordered_set>
+#include <regex>
 #include "zmq.h"
 #include "dsv.h"
 #include "dsv_msg.h"
 #include "dsv_log.h"
+#include "dsv_calc.h"
+#include "cjson/cJSON.h"
 
 /*! hasp table to hold the dsv name and dsv info data */
 std::unordered_map< std::string, void * > g_map;
 using dsv_array_t = std::vector< int >;
 
 #define DSV_SAVE_FILE       ("/var/run/dsv.save")
+
+/*! saved dsvs of a shard of a cluster, the shards of a host have their own */
+#define DSV_SHARD_SAVE_FILE ("/var/run/dsv.%u.save")
+
+/*! shard served by this server, tagged in the handles given to the clients */
+static uint32_t g_shard = 0;
+
+/*! consistent hash ring of the cluster, NULL for a standalone server */
+static void *g_ring = NULL;
+
+/*! a standby keeps giving out the handles of its primary after taking over,
+ * so the handles are mapped instead of being the dsv_info_t pointers */
+static bool g_handle_map = false;
+static std::unordered_map< void *, dsv_info_t * > g_handle_dsv;
+static std::unordered_map< dsv_info_t *, void * > g_dsv_handle;
+
+/*! the dsvs are allocated with their slot in the handle table */
+typedef struct var_dsv
+{
+    dsv_info_t info;
+
+    uint32_t slot;
+
+    /*! creation sequence number, the cursor of the paged queries */
+    uint32_t seq;
+
+}var_dsv_t;
+
+/*! slot of the handle table, gen changes when the dsv in the slot is
+ * deleted, so a handle kept by a client never reaches the next dsv */
+typedef struct var_slot
+{
+    dsv_info_t *dsv;
+
+    uint32_t gen;
+
+}var_slot_t;
+
+static std::vector< var_slot_t > g_slots;
+static std::vector< uint32_t > g_free_slots;
+
+/*! last creation sequence number, 0 is the cursor of the first page */
+static uint32_t g_seq = 0;
+
+/*! dsvs published by the server itself, see var_builtin() */
+static std::unordered_set< dsv_info_t * > g_builtin;
+
+/*! a handle is ( gen << VAR_SLOT_BITS | slot ) above the bits of the shard */
+#define VAR_SHARD_BITS      ( 3 )
+#define VAR_SLOT_BITS       ( sizeof(void *) == 8 ? 32 : 20 )
+#define VAR_SLOT_MASK       ( ( (uintptr_t)1 << VAR_SLOT_BITS ) - 1 )
+#define VAR_GEN_MASK        ( ( (uintptr_t)1 << ( sizeof(void *) * 8 - \
+                                VAR_SLOT_BITS - VAR_SHARD_BITS ) ) - 1 )
+
+static_assert( ( 1 << VAR_SHARD_BITS ) == DSV_SHARD_MAX,
+               "the shard takes the low bits of a handle" );
 /*==============================================================================
                               Defines
 ==============================================================================*/
@@ -96,365 +163,3122 @@ char *get_proc_name( pid_t pid )
 
 /*!=============================================================================
 
-    This function fills the forward buffer with the information in
-    dsv_info_t structure.
+    Get the file of the saved dsvs, each shard of a cluster saves only its
+    own dsvs, so it writes a file of its own
 
-@param[in]
-    dest
-        destination buffer
-@param[in]
-    dsv
-        pointer of dsv information structure, holding type, len and value
 @return
-    positive number - number of bytes copied
-    -1 - failed
-
+    file name
 ==============================================================================*/
-void fill_fwd_buf( const char *full_name, dsv_info_t *dsv, char *fwd_buf )
+static std::string var_save_file( void )
 {
-    assert( dsv );
-    assert( fwd_buf );
-    assert( full_name );
+    if( g_ring == NULL )
+    {
+        return DSV_SAVE_FILE;
+    }
 
-    dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
-    char *fwd_data = fwd->data;
-    fwd->length = 0;
+    char filename[64];
+    snprintf( filename, sizeof(filename), DSV_SHARD_SAVE_FILE, g_shard );
+    return filename;
+}
 
-    strcpy( fwd_data, full_name );
-    fwd->length += strlen( full_name ) + 1;
-    fwd_data += strlen( full_name ) + 1;
+/*!=============================================================================
 
-    *(dsv_info_t **)fwd_data = dsv;
-    fwd_data += sizeof(dsv);
-    fwd->length += sizeof(dsv);
+    Set the shard served by this server in a sharded cluster
 
-    fwd->length += DSV_Memcpy( fwd_data, dsv );
+@param[in]
+    shard
+        index of the shard
+@param[in]
+    count
+        number of shards, 1 for a standalone server
+==============================================================================*/
+void var_set_shard( uint32_t shard, uint32_t count )
+{
+    g_shard = shard;
+    DSV_ShardRingFree( g_ring );
+    g_ring = count > 1 ? DSV_ShardRingNew( count ) : NULL;
 }
 
-/**
- * hash map has full dsv name as key, and dsv_info_t as value
- * the memory should never be released as the dsv server never terminates
- */
-int var_create( const char *req_buf, char *fwd_buf )
+/*!=============================================================================
+
+    Map the handles given to the clients instead of using the pointers, must
+    be called before any dsv is created. Used by a standby server.
+==============================================================================*/
+void var_use_handle_map( void )
 {
-    assert( req_buf );
-    assert( fwd_buf );
-    printf( "Enter %s\n", __func__ );
+    g_handle_map = true;
+}
 
-    int rc = EINVAL;
-    struct timespec now = { 0 };
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+/*!=============================================================================
 
-    /* full_name and dsv will be put into hash table */
-    dsv_info_t *dsv = (dsv_info_t *)malloc( sizeof(dsv_info_t) );
-    if( dsv != NULL )
+    Allocate a dsv, with room for its slot in the handle table
+
+@return
+    zeroed dsv information
+    NULL - out of memory
+==============================================================================*/
+static dsv_info_t *var_alloc( void )
+{
+    return (dsv_info_t *)calloc( 1, sizeof(var_dsv_t) );
+}
+
+/*!=============================================================================
+
+    Free a dsv with its strings and value
+
+@param[in]
+    dsv
+        dsv allocated by var_alloc()
+==============================================================================*/
+static void var_free( dsv_info_t *dsv )
+{
+    free( dsv->pName );
+    free( dsv->pDesc );
+    free( dsv->pTags );
+    free( dsv->pCalc );
+    free( dsv->pRules );
+    free( dsv->pAliases );
+    if( dsv->type == DSV_TYPE_STR )
     {
-        /* fill dsv */
-        memcpy( dsv, req_data, sizeof(dsv_info_t) );
-        clock_gettime( CLOCK_REALTIME, &now );
-        dsv->timestamp = now;
+        free( dsv->value.pStr );
+    }
+    if( dsv->type == DSV_TYPE_INT_ARRAY )
+    {
+        delete (dsv_array_t *)dsv->value.pArray;
+    }
+    if( DSV_TYPE_IS_BLOB( dsv->type ) )
+    {
+        DSV_BlobRelease( NULL, dsv->value.pBlob );
+    }
+    free( dsv );
+}
 
-        req_data += sizeof(dsv_info_t);
-        dsv->pName = strdup( req_data );
+/*!=============================================================================
 
-        req_data += strlen( req_data ) + 1;
-        dsv->pDesc = strdup( req_data );
+    Check whether the handle table has room for another dsv, it only runs
+    out with the 20 bits of slot of a 32 bits handle
 
-        req_data += strlen( req_data ) + 1;
-        dsv->pTags = strdup( req_data );
+@return
+    true if no slot is left
+==============================================================================*/
+static bool var_slots_full( void )
+{
+    return g_free_slots.empty() && g_slots.size() > VAR_SLOT_MASK;
+}
 
-        req_data += strlen( req_data ) + 1;
-        if( dsv->type == DSV_TYPE_STR )
-        {
-            dsv->value.pStr = strdup( req_data );
-        }
-        else if( dsv->type == DSV_TYPE_INT_ARRAY )
-        {
-            dsv->value.pArray = static_cast<void *>(
-                                new dsv_array_t( (int *)req_data,
-                                                 (int *)( req_data + dsv->len ) ) );
-        }
+/*!=============================================================================
 
-        std::string full_name( dsv->pName );
-        auto e = g_map.find( full_name );
-        if( e == g_map.end() )
-        {
-            g_map.insert( std::make_pair( full_name, (void *)dsv ) );
-            fill_fwd_buf( full_name.c_str(), dsv, fwd_buf );
-            rc = 0;
-        }
-        else
-        {
-            dsvlog( LOG_ERR, "dsv existed: %s", full_name.c_str() );
-            rc = EEXIST;
-        }
-    }
+    Put a new dsv in a free slot of the handle table
+
+@param[in]
+    dsv
+        dsv allocated by var_alloc()
+==============================================================================*/
+static void var_slot_alloc( dsv_info_t *dsv )
+{
+    var_dsv_t *v = (var_dsv_t *)dsv;
 
-    if( rc == EEXIST )
+    if( g_free_slots.empty() )
     {
-        free( dsv->pName );
-        free( dsv->pDesc );
-        free( dsv->pTags );
-        if( dsv->type == DSV_TYPE_STR )
-        {
-            free( dsv->value.pStr );
-        }
-        if( dsv->type == DSV_TYPE_INT_ARRAY )
-        {
-            free( dsv->value.pArray );
-        }
-        free( dsv );
+        v->slot = g_slots.size();
+        g_slots.push_back( { dsv, 1 } );
     }
-    return rc;
+    else
+    {
+        v->slot = g_free_slots.back();
+        g_free_slots.pop_back();
+        g_slots[v->slot].dsv = dsv;
+    }
+    v->seq = ++g_seq;
 }
 
-/**
-*/
-int var_set( const char *req_buf, char *fwd_buf )
+/*!=============================================================================
+
+    Free the slot of a deleted dsv, the handles given out for it become
+    stale
+
+@param[in]
+    dsv
+        dsv information
+==============================================================================*/
+static void var_slot_free( dsv_info_t *dsv )
 {
-    assert( req_buf );
-    assert( fwd_buf );
-    printf( "Enter %s\n", __func__ );
+    uint32_t slot = ( (var_dsv_t *)dsv )->slot;
+    var_slot_t &s = g_slots[slot];
 
-    int rc = EINVAL;
-    struct timespec now = { 0 };
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+    s.dsv = NULL;
+    /* gen 0 would make a NULL handle of slot 0 in shard 0 */
+    s.gen = ( s.gen + 1 ) & VAR_GEN_MASK;
+    s.gen = s.gen != 0 ? s.gen : 1;
+    g_free_slots.push_back( slot );
+}
 
-    dsv_info_t *dsv = *(dsv_info_t **)req_data;
-    req_data += sizeof(dsv);
-    dsv->pid = *(pid_t *)req_data;
-    req_data += sizeof(pid_t);
-    if( dsv != NULL )
-    {
-        clock_gettime( CLOCK_REALTIME, &now );
-        dsv->timestamp = now;
-        dsv->dirty = 1;
-        if( dsv->type == DSV_TYPE_STR )
-        {
-            free( dsv->value.pStr );
-            dsv->value.pStr = strdup( req_data );
-        }
-        else if( dsv->type == DSV_TYPE_INT_ARRAY )
-        {
-            delete (dsv_array_t *)dsv->value.pArray;
-            dsv->value.pArray = static_cast<void *>
-                                ( new dsv_array_t( (int *)req_data,
-                                                   (int *)( req_data + dsv->len ) ) );
-        }
-        else
-        {
-            memcpy( &dsv->value, req_data, sizeof(dsv_value_t) );
-        }
+/*!=============================================================================
 
-        if( dsv->flags & DSV_FLAG_TRACK )
-        {
-            char buf[DSV_STRING_SIZE_MAX];
-            char *proc_name = get_proc_name( dsv->pid );
-            DSV_Value2Str( buf, DSV_STRING_SIZE_MAX, dsv );
-            dsvlog( LOG_NOTICE,
-                    "%s is changed to %s by %s",
-                    dsv->pName, buf, proc_name );
-            free( proc_name );
-        }
+    Find where a paged query resumes in a list of dsvs in the order of their
+    creation. The cursor is the sequence number of the next dsv, so it stays
+    valid while dsvs are created or deleted.
 
+@param[in]
+    dsvs
+        dsvs in the order of their creation
+@param[in]
+    cursor
+        cursor of the page, 0 for the first page
+@return
+    index of the first dsv of the page
+==============================================================================*/
+static size_t var_cursor_index( const std::vector< dsv_info_t * > &dsvs,
+                                uint32_t cursor )
+{
+    auto it = std::lower_bound( dsvs.begin(),
+                                dsvs.end(),
+                                cursor,
+                                []( dsv_info_t *dsv, uint32_t c ) {
+                                    return ( (var_dsv_t *)dsv )->seq < c;
+                                } );
+    return it - dsvs.begin();
+}
 
-        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
-        rc = 0;
-    }
-    return rc;
+/*!=============================================================================
+
+    Get the cursor of the page starting at a dsv of a list
+
+@param[in]
+    dsvs
+        dsvs in the order of their creation
+@param[in]
+    index
+        index of the first dsv of the page
+@return
+    cursor of the page, 0 after the last page
+==============================================================================*/
+static uint32_t var_cursor_next( const std::vector< dsv_info_t * > &dsvs,
+                                 size_t index )
+{
+    return index < dsvs.size() ? ( (var_dsv_t *)dsvs[index] )->seq : 0;
 }
 
+/*!=============================================================================
+
+    Get the handle of the slot of a dsv
 
-int var_add_item( const char *req_buf, char *fwd_buf )
+@param[in]
+    dsv
+        dsv information
+@return
+    handle
+==============================================================================*/
+static void *var_slot_handle( dsv_info_t *dsv )
 {
-    assert( req_buf );
-    assert( fwd_buf );
-    printf( "Enter %s\n", __func__ );
+    uint32_t slot = ( (var_dsv_t *)dsv )->slot;
+    uintptr_t id = (uintptr_t)g_slots[slot].gen << VAR_SLOT_BITS | slot;
+    return DSV_HANDLE_TAG( id << VAR_SHARD_BITS, g_shard );
+}
 
-    int rc = EINVAL;
-    struct timespec now = { 0 };
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+/*!=============================================================================
 
-    dsv_info_t *dsv = *(dsv_info_t **)req_data;
-    req_data += sizeof(dsv);
-    dsv->pid = *(pid_t *)req_data;
-    req_data += sizeof(pid_t);
-    int value = *(int *)req_data;
-    if( dsv != NULL && dsv->type == DSV_TYPE_INT_ARRAY )
-    {
-        clock_gettime( CLOCK_REALTIME, &now );
-        dsv->timestamp = now;
-        dsv->dirty = 1;
+    Assign the handle of a dsv in the handle map
 
-        dsv_array_t *ai =  (dsv_array_t *)dsv->value.pArray;
-        ai->push_back( value );
-        dsv->len = ai->size() * sizeof(int);
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    hndl
+        handle given by the primary, NULL to allocate a new one
+==============================================================================*/
+static void var_map_handle( dsv_info_t *dsv, void *hndl )
+{
+    auto e = g_dsv_handle.find( dsv );
+    if( e != g_dsv_handle.end() )
+    {
+        g_handle_dsv.erase( e->second );
+    }
 
-        if( dsv->flags & DSV_FLAG_TRACK )
+    if( hndl == NULL )
+    {
+        /* the slot is unique among local dsvs, but may collide with a
+           handle of the primary */
+        hndl = var_slot_handle( dsv );
+        while( g_handle_dsv.find( hndl ) != g_handle_dsv.end() )
         {
-            char buf[DSV_STRING_SIZE_MAX];
-            DSV_Value2Str( buf, DSV_STRING_SIZE_MAX, dsv );
-            dsvlog( LOG_NOTICE, "%s is changed to %s", dsv->pName, buf );
+            hndl = (char *)hndl + DSV_SHARD_MAX;
         }
-
-        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
-        rc = 0;
     }
-    return rc;
+
+    g_handle_dsv[hndl] = dsv;
+    g_dsv_handle[dsv] = hndl;
 }
 
-int var_set_item( const char *req_buf, char *fwd_buf )
-{
-    assert( req_buf );
-    assert( fwd_buf );
-    printf( "Enter %s\n", __func__ );
+/*!=============================================================================
 
-    int rc = EINVAL;
-    struct timespec now = { 0 };
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+    Get the handle of a dsv given to the clients
 
-    dsv_info_t *dsv = *(dsv_info_t **)req_data;
-    req_data += sizeof(dsv);
+@param[in]
+    dsv
+        dsv information
+@return
+    handle
+==============================================================================*/
+static void *var_handle( dsv_info_t *dsv )
+{
+    if( g_handle_map )
+    {
+        return g_dsv_handle[dsv];
+    }
+    return var_slot_handle( dsv );
+}
+
+/*!=============================================================================
+
+    Get the dsv from the handle at the beginning of the request data. The
+    handle is tagged with the shard which created it, a handle of another
+    shard or of a deleted dsv finds nothing.
+
+@param[in]
+    req_data
+        request data starting with the handle
+@return
+    dsv information
+    NULL - invalid handle
+==============================================================================*/
+static dsv_info_t *var_from_handle( const char *req_data )
+{
+    void *hndl = *(void **)req_data;
+
+    if( g_handle_map )
+    {
+        auto e = g_handle_dsv.find( hndl );
+        return e != g_handle_dsv.end() ? e->second : NULL;
+    }
+
+    if( DSV_HANDLE_SHARD( hndl ) != g_shard )
+    {
+        dsvlog( LOG_ERR, "handle %p is not from shard %u", hndl, g_shard );
+        return NULL;
+    }
+
+    uintptr_t id = DSV_HANDLE_ID( hndl ) >> VAR_SHARD_BITS;
+    uintptr_t slot = id & VAR_SLOT_MASK;
+    if( slot >= g_slots.size() || g_slots[slot].gen != id >> VAR_SLOT_BITS )
+    {
+        dsvlog( LOG_ERR, "stale handle %p", hndl );
+        return NULL;
+    }
+    return g_slots[slot].dsv;
+}
+
+/*!=============================================================================
+
+    Fill a delta of an INT_ARRAY dsv, the items are taken from the array after
+    the change
+
+@param[out]
+    dest
+        destination buffer
+@param[in]
+    dsv
+        pointer of dsv information
+@param[in]
+    op
+        delta operation, see dsv_delta_op_t
+@param[in]
+    index
+        index of the first item changed
+@param[in]
+    count
+        number of items changed
+@return
+    number of bytes filled
+==============================================================================*/
+static size_t var_fill_delta( char *dest,
+                              dsv_info_t *dsv,
+                              int op,
+                              int index,
+                              int count )
+{
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    dsv_delta_t *delta = (dsv_delta_t *)dest;
+
+    delta->mark = DSV_DELTA_MARK;
+    delta->version = dsv->version;
+    delta->op = op;
+    delta->index = index;
+    delta->count = count;
+    if( op == DSV_DELTA_DEL )
+    {
+        return sizeof(dsv_delta_t);
+    }
+
+    memcpy( delta->items, ai->data() + index, count * sizeof(int) );
+    return sizeof(dsv_delta_t) + count * sizeof(int);
+}
+
+/*!=============================================================================
+
+    This function fills the forward buffer with the information in
+    dsv_info_t structure. An INT_ARRAY with DSV_FLAG_DELTA is sent as a
+    DSV_DELTA_FULL delta, so the subscribers learn its version.
+
+@param[in]
+    dest
+        destination buffer
+@param[in]
+    dsv
+        pointer of dsv information structure, holding type, len and value
+@return
+    positive number - number of bytes copied
+    -1 - failed
+
+==============================================================================*/
+void fill_fwd_buf( const char *full_name, dsv_info_t *dsv, char *fwd_buf )
+{
+    assert( dsv );
+    assert( fwd_buf );
+    assert( full_name );
+
+    dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
+    char *fwd_data = fwd->data;
+    fwd->length = 0;
+    fwd->blob = NULL;
+
+    strcpy( fwd_data, full_name );
+    fwd->length += strlen( full_name ) + 1;
+    fwd_data += strlen( full_name ) + 1;
+
+    *(void **)fwd_data = var_handle( dsv );
+    fwd_data += sizeof(dsv);
+    fwd->length += sizeof(dsv);
+
+    if( dsv->type == DSV_TYPE_INT_ARRAY && ( dsv->flags & DSV_FLAG_DELTA ) )
+    {
+        dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+        fwd->length += var_fill_delta( fwd_data,
+                                       dsv,
+                                       DSV_DELTA_FULL,
+                                       0,
+                                       ai->size() );
+    }
+    else if( DSV_TYPE_IS_BLOB( dsv->type ) )
+    {
+        /* only the length, the bytes are sent from the blob itself */
+        fwd->blob = (dsv_blob_t *)dsv->value.pBlob;
+        *(size_t *)fwd_data = fwd->blob->len;
+        fwd->length += sizeof(size_t);
+    }
+    else
+    {
+        fwd->length += DSV_Memcpy( fwd_data, dsv );
+    }
+}
+
+/*!=============================================================================
+
+    Replace the value of a BLOB dsv, the notifications in flight keep the
+    old value until they are sent
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    data
+        bytes of the new value
+@param[in]
+    len
+        number of bytes
+@return
+    0 for success, ENOMEM if out of memory
+==============================================================================*/
+static int var_set_blob( dsv_info_t *dsv, const void *data, size_t len )
+{
+    dsv_blob_t *blob = DSV_BlobNew( data, len );
+    if( blob == NULL )
+    {
+        return ENOMEM;
+    }
+
+    DSV_BlobRelease( NULL, dsv->value.pBlob );
+    dsv->value.pBlob = blob;
+    dsv->len = len;
+    return 0;
+}
+
+/*!=============================================================================
+
+    Check that a value of a typed array holds whole items
+
+@param[in]
+    type
+        dsv type
+@param[in]
+    size
+        size of the value in bytes
+@return
+    true if size is a multiple of the size of the items, or type is not a
+    typed array
+==============================================================================*/
+static bool var_items_fit( int type, size_t size )
+{
+    int item = DSV_ItemType( type );
+
+    return !DSV_TYPE_IS_BLOB( type ) || item == DSV_TYPE_INVALID ||
+           size % DSV_GetSizeFromType( item ) == 0;
+}
+
+/*!=============================================================================
+
+    History of a numeric dsv: a ring of samples kept in columns, the stamps
+    in one array and the values packed in the type of the dsv in another
+
+==============================================================================*/
+typedef struct var_history
+{
+    /*! index of the next sample to write */
+    uint32_t head;
+
+    uint32_t count;
+
+    /*! size of a value */
+    size_t size;
+
+    /*! CLOCK_REALTIME in ns */
+    std::vector< int64_t > stamps;
+
+    std::vector< char > values;
+
+}var_history_t;
+
+static std::unordered_map< dsv_info_t *, var_history_t > g_history;
+
+/*!=============================================================================
+
+    Add the current value of a dsv to its history, if it has one
+
+@param[in]
+    dsv
+        dsv information
+==============================================================================*/
+static void var_history_record( dsv_info_t *dsv )
+{
+    if( dsv->history == 0 )
+    {
+        return;
+    }
+
+    auto e = g_history.find( dsv );
+    if( e == g_history.end() )
+    {
+        return;
+    }
+
+    var_history_t &h = e->second;
+    h.stamps[h.head] = (int64_t)dsv->timestamp.tv_sec * 1000000000 +
+                       dsv->timestamp.tv_nsec;
+    memcpy( &h.values[h.head * h.size], &dsv->value, h.size );
+    h.head = ( h.head + 1 ) % h.stamps.size();
+    if( h.count < h.stamps.size() )
+    {
+        h.count++;
+    }
+}
+
+/*!=============================================================================
+
+    Allocate the history of a new dsv, numeric dsvs only, and record the
+    initial value
+
+@param[in]
+    dsv
+        dsv information
+==============================================================================*/
+static void var_history_create( dsv_info_t *dsv )
+{
+    if( dsv->history == 0 )
+    {
+        return;
+    }
+    if( dsv->type < DSV_TYPE_UINT16 || dsv->type > DSV_TYPE_SINT8 )
+    {
+        dsvlog( LOG_ERR, "history of a non numeric dsv: %s", dsv->pName );
+        dsv->history = 0;
+        return;
+    }
+
+    dsv->history = std::min( dsv->history, (uint32_t)DSV_HISTORY_MAX );
+    var_history_t &h = g_history[dsv];
+    h.head = 0;
+    h.count = 0;
+    h.size = DSV_GetSizeFromType( dsv->type );
+    h.stamps.assign( dsv->history, 0 );
+    h.values.assign( dsv->history * h.size, 0 );
+    var_history_record( dsv );
+}
+
+/*!=============================================================================
+
+    Get the samples of the history of a dsv between t0 and t1, oldest first
+    request data: [handle][t0 ns][t1 ns]
+    reply data: [count][count stamps][count values]
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    rep_buf
+        reply buffer
+@return
+    0 for success, EINVAL for a bad dsv, ENOENT for a dsv without history
+==============================================================================*/
+int var_get_history( const char *req_buf, char *rep_buf )
+{
+    assert( req_buf );
+    assert( rep_buf );
+
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    const char *req_data = req->data;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    dsv_info_t *dsv = var_from_handle( req_data );
+    req_data += sizeof(dsv);
+    int64_t t0 = *(int64_t *)req_data;
+    req_data += sizeof(t0);
+    int64_t t1 = *(int64_t *)req_data;
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
+
+    auto e = g_history.find( dsv );
+    if( e == g_history.end() )
+    {
+        return ENOENT;
+    }
+
+    /* the stamps first, the values go after them once they are counted */
+    var_history_t &h = e->second;
+    uint32_t *count = (uint32_t *)rep->data;
+    int64_t *stamps = (int64_t *)( rep->data + sizeof(uint32_t) );
+    uint32_t first = ( h.head + h.stamps.size() - h.count ) % h.stamps.size();
+    std::vector< uint32_t > slots;
+
+    slots.reserve( h.count );
+    for( uint32_t i = 0; i < h.count; i++ )
+    {
+        uint32_t slot = ( first + i ) % h.stamps.size();
+        if( h.stamps[slot] >= t0 && h.stamps[slot] <= t1 )
+        {
+            stamps[slots.size()] = h.stamps[slot];
+            slots.push_back( slot );
+        }
+    }
+
+    char *values = (char *)( stamps + slots.size() );
+    for( size_t i = 0; i < slots.size(); i++ )
+    {
+        memcpy( values + i * h.size, &h.values[slots[i] * h.size], h.size );
+    }
+
+    *count = slots.size();
+    rep->length += sizeof(uint32_t) + slots.size() * ( sizeof(int64_t) + h.size );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Call f with the value field of a numeric dsv
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    f
+        generic callable taking the value field by reference
+@return
+    0 for success
+    EINVAL - not a numeric dsv
+==============================================================================*/
+template< typename F >
+static int var_numeric( dsv_info_t *dsv, F f )
+{
+    switch( dsv->type )
+    {
+    case DSV_TYPE_UINT8:  f( dsv->value.u8 );  break;
+    case DSV_TYPE_SINT8:  f( dsv->value.s8 );  break;
+    case DSV_TYPE_UINT16: f( dsv->value.u16 ); break;
+    case DSV_TYPE_SINT16: f( dsv->value.s16 ); break;
+    case DSV_TYPE_UINT32: f( dsv->value.u32 ); break;
+    case DSV_TYPE_SINT32: f( dsv->value.s32 ); break;
+    case DSV_TYPE_UINT64: f( dsv->value.u64 ); break;
+    case DSV_TYPE_SINT64: f( dsv->value.s64 ); break;
+    case DSV_TYPE_FLOAT:  f( dsv->value.f32 ); break;
+    case DSV_TYPE_DOUBLE: f( dsv->value.f64 ); break;
+    default:
+        return EINVAL;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Rolling statistics of a numeric dsv over a window of stats=W seconds, kept
+    in DSV_STATS_BUCKETS buckets. A change is added to the open bucket only,
+    and the statistics are published as read-only DOUBLE dsvs named
+    <name>#min, #max, #avg, #stddev and #rate when a bucket is closed
+
+==============================================================================*/
+#define DSV_STATS_BUCKETS       ( 10 )
+
+/*! suffixes of the dsvs holding the statistics, in var_stats_t order */
+static const char *g_stats_suffix[] =
+{
+    "#min", "#max", "#avg", "#stddev", "#rate"
+};
+
+#define DSV_STATS_NUM   ( sizeof(g_stats_suffix) / sizeof(g_stats_suffix[0]) )
+
+/*! samples of one bucket, mean and m2 are merged with Chan's formula */
+typedef struct var_bucket
+{
+    uint64_t count;
+
+    double mean;
+
+    /*! sum of squares of differences from the mean */
+    double m2;
+
+    double min;
+
+    double max;
+
+}var_bucket_t;
+
+typedef struct var_stats
+{
+    /*! milliseconds of a bucket */
+    int64_t period;
+
+    /*! CLOCK_MONOTONIC ms when the open bucket is closed */
+    int64_t next;
+
+    var_bucket_t open;
+
+    /*! closed buckets, oldest overwritten first */
+    var_bucket_t closed[DSV_STATS_BUCKETS];
+
+    uint32_t head;
+
+    uint32_t filled;
+
+    dsv_info_t *out[DSV_STATS_NUM];
+
+}var_stats_t;
+
+static std::unordered_map< dsv_info_t *, var_stats_t > g_stats;
+
+static void var_calc_touch( dsv_info_t *dsv );
+
+/*!=============================================================================
+
+    Merge the samples of bucket b into bucket a
+
+@param[in,out]
+    a
+        bucket to merge into
+@param[in]
+    b
+        bucket to merge
+==============================================================================*/
+static void var_bucket_merge( var_bucket_t &a, const var_bucket_t &b )
+{
+    if( b.count == 0 )
+    {
+        return;
+    }
+    if( a.count == 0 )
+    {
+        a = b;
+        return;
+    }
+
+    uint64_t count = a.count + b.count;
+    double delta = b.mean - a.mean;
+    a.mean += delta * b.count / count;
+    a.m2 += b.m2 + delta * delta * a.count * b.count / count;
+    a.min = std::min( a.min, b.min );
+    a.max = std::max( a.max, b.max );
+    a.count = count;
+}
+
+/*!=============================================================================
+
+    Add the current value of a dsv to the open bucket of its statistics, if
+    it has any
+
+@param[in]
+    dsv
+        dsv information
+==============================================================================*/
+static void var_stats_record( dsv_info_t *dsv )
+{
+    if( dsv->stats == 0 )
+    {
+        return;
+    }
+
+    auto e = g_stats.find( dsv );
+    if( e == g_stats.end() )
+    {
+        return;
+    }
+
+    double x = 0;
+    var_numeric( dsv, [&x]( auto &v ) { x = (double)v; } );
+
+    /* Welford's update */
+    var_bucket_t &b = e->second.open;
+    if( b.count == 0 )
+    {
+        b.min = x;
+        b.max = x;
+    }
+    b.count++;
+    double delta = x - b.mean;
+    b.mean += delta / b.count;
+    b.m2 += delta * ( x - b.mean );
+    b.min = std::min( b.min, x );
+    b.max = std::max( b.max, x );
+}
+
+/*!=============================================================================
+
+    Create a read-only dsv owned by the server, with a zero value. It is in
+    the hash table but not in the creation order, nor in the shard check.
+
+@param[in]
+    full_name
+        full dsv name
+@param[in]
+    instID
+        instance ID of the dsv
+@param[in]
+    type
+        type of the dsv, numeric or a typed array
+@return
+    dsv information
+    NULL - out of memory
+==============================================================================*/
+static dsv_info_t *var_derived_new( const std::string &full_name,
+                                    uint32_t instID,
+                                    int type )
+{
+    dsv_info_t *dsv = var_slots_full() ? NULL : var_alloc();
+    if( dsv == NULL )
+    {
+        return NULL;
+    }
+
+    dsv->pName = strdup( full_name.c_str() );
+    dsv->pDesc = strdup( "" );
+    dsv->pTags = strdup( "" );
+    dsv->pCalc = strdup( "" );
+    dsv->pRules = strdup( "" );
+    dsv->pAliases = strdup( "" );
+    dsv->instID = instID;
+    clock_gettime( CLOCK_REALTIME, &dsv->timestamp );
+    dsv->flags = DSV_FLAG_READONLY;
+    dsv->type = type;
+    if( DSV_TYPE_IS_BLOB( type ) && var_set_blob( dsv, NULL, 0 ) != 0 )
+    {
+        var_free( dsv );
+        return NULL;
+    }
+    if( !DSV_TYPE_IS_BLOB( type ) )
+    {
+        dsv->len = DSV_GetSizeFromType( type );
+    }
+
+    g_map.insert( std::make_pair( full_name, (void *)dsv ) );
+    var_slot_alloc( dsv );
+    if( g_handle_map )
+    {
+        var_map_handle( dsv, NULL );
+    }
+    return dsv;
+}
+
+/*!=============================================================================
+
+    Get the read-only DOUBLE dsv holding one statistic of a dsv, creating it
+    if a standby has not got it from the primary yet
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    suffix
+        suffix of the statistic, eg "#avg"
+@return
+    dsv information of the statistic
+    NULL - out of memory
+==============================================================================*/
+static dsv_info_t *var_stats_output( dsv_info_t *dsv, const char *suffix )
+{
+    std::string full_name = std::string( dsv->pName ) + suffix;
+    auto e = g_map.find( full_name );
+    if( e != g_map.end() )
+    {
+        return (dsv_info_t *)e->second;
+    }
+
+    dsv_info_t *out = var_derived_new( full_name,
+                                       dsv->instID,
+                                       DSV_TYPE_DOUBLE );
+    if( out != NULL )
+    {
+        out->timestamp = dsv->timestamp;
+        out->value.f64 = NAN;
+    }
+    return out;
+}
+
+/*!=============================================================================
+
+    Create the statistics of a new dsv, numeric dsvs only
+
+@param[in]
+    dsv
+        dsv information
+==============================================================================*/
+static void var_stats_create( dsv_info_t *dsv )
+{
+    if( dsv->stats == 0 )
+    {
+        return;
+    }
+    if( dsv->type < DSV_TYPE_UINT16 || dsv->type > DSV_TYPE_SINT8 )
+    {
+        dsvlog( LOG_ERR, "stats of a non numeric dsv: %s", dsv->pName );
+        dsv->stats = 0;
+        return;
+    }
+
+    struct timespec now = { 0 };
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    dsv->stats = std::min( dsv->stats, (uint32_t)DSV_STATS_WINDOW_MAX );
+    var_stats_t &s = g_stats[dsv];
+    memset( &s, 0, sizeof(s) );
+    s.period = (int64_t)dsv->stats * 1000 / DSV_STATS_BUCKETS;
+    s.next = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000 + s.period;
+    for( size_t i = 0; i < DSV_STATS_NUM; i++ )
+    {
+        s.out[i] = var_stats_output( dsv, g_stats_suffix[i] );
+        if( s.out[i] == NULL )
+        {
+            dsvlog( LOG_ERR, "no memory for stats of %s", dsv->pName );
+            g_stats.erase( dsv );
+            dsv->stats = 0;
+            return;
+        }
+    }
+    var_stats_record( dsv );
+}
+
+/*!=============================================================================
+
+    Close the open buckets which are due, and publish the statistics over the
+    closed buckets. Called by the main loop at least every
+    DSV_HEARTBEAT_INTERVAL, which is below the shortest bucket.
+
+@param[in]
+    now
+        CLOCK_MONOTONIC in ms
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback invoked with the forward message of each statistic
+==============================================================================*/
+void var_stats_tick( int64_t now,
+                     char *fwd_buf,
+                     void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    assert( fwd_buf );
+    assert( cb );
+
+    struct timespec stamp = { 0 };
+    clock_gettime( CLOCK_REALTIME, &stamp );
+
+    for( auto &e : g_stats )
+    {
+        var_stats_t &s = e.second;
+        if( now < s.next )
+        {
+            continue;
+        }
+
+        /* the buckets missed while the server was busy, or a standby, are
+           empty, at most a whole window of them */
+        for( int i = 0; now >= s.next; i++ )
+        {
+            if( i < DSV_STATS_BUCKETS )
+            {
+                s.closed[s.head] = s.open;
+                s.head = ( s.head + 1 ) % DSV_STATS_BUCKETS;
+                s.filled = std::min( s.filled + 1, (uint32_t)DSV_STATS_BUCKETS );
+                memset( &s.open, 0, sizeof(s.open) );
+            }
+            s.next += s.period;
+        }
+
+        var_bucket_t w = { 0 };
+        for( uint32_t i = 0; i < s.filled; i++ )
+        {
+            var_bucket_merge( w, s.closed[i] );
+        }
+
+        double values[DSV_STATS_NUM] =
+        {
+            w.count ? w.min : NAN,
+            w.count ? w.max : NAN,
+            w.count ? w.mean : NAN,
+            w.count ? sqrt( w.m2 / w.count ) : NAN,
+            w.count * 1000.0 / ( s.filled * s.period )
+        };
+
+        for( size_t i = 0; i < DSV_STATS_NUM; i++ )
+        {
+            dsv_info_t *out = s.out[i];
+            out->value.f64 = values[i];
+            out->timestamp = stamp;
+            out->version++;
+            fill_fwd_buf( out->pName, out, fwd_buf );
+            cb( (const dsv_msg_forward_t *)fwd_buf );
+            var_calc_touch( out );
+        }
+    }
+}
+
+/*!=============================================================================
+
+    Calculated dsvs: the expression is compiled once when the dsv is created,
+    a change of an input queues the dsvs using it, and var_calc_run()
+    evaluates the queued ones, each input before the dsvs using it
+
+==============================================================================*/
+typedef struct var_calc
+{
+    calc_program_t prog;
+
+    /*! dsvs of prog.inputs */
+    std::vector< dsv_info_t * > inputs;
+
+    /*! values of the inputs while evaluating */
+    std::vector< double > values;
+
+    /*! 0 if no input is calculated, else 1 + the highest rank of them */
+    uint32_t rank;
+
+}var_calc_t;
+
+static std::unordered_map< dsv_info_t *, var_calc_t > g_calc;
+
+/*! calculated dsvs using each dsv */
+static std::unordered_map< dsv_info_t *, std::vector< dsv_info_t * > > g_calc_users;
+
+/*! calculated dsvs to evaluate, ordered by rank */
+static std::set< std::pair< uint32_t, dsv_info_t * > > g_calc_pending;
+
+/*!=============================================================================
+
+    Queue the calculated dsvs using a dsv after it changed
+
+@param[in]
+    dsv
+        dsv information
+==============================================================================*/
+static void var_calc_touch( dsv_info_t *dsv )
+{
+    auto e = g_calc_users.find( dsv );
+    if( e == g_calc_users.end() )
+    {
+        return;
+    }
+
+    for( dsv_info_t *user : e->second )
+    {
+        g_calc_pending.insert( std::make_pair( g_calc[user].rank, user ) );
+    }
+}
+
+/*!=============================================================================
+
+    Evaluate the expression of a calculated dsv into its value. A result out
+    of the range of an integer dsv leaves the value as it is.
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    calc
+        compiled expression and inputs of the dsv
+@return
+    true if the value changed
+==============================================================================*/
+static bool var_calc_eval( dsv_info_t *dsv, var_calc_t &calc )
+{
+    for( size_t i = 0; i < calc.inputs.size(); i++ )
+    {
+        double &x = calc.values[i];
+        var_numeric( calc.inputs[i], [&x]( auto &v ) { x = (double)v; } );
+    }
+
+    double x = calc_eval( &calc.prog, calc.values.data() );
+    dsv_value_t old = dsv->value;
+    var_numeric( dsv, [x]( auto &v ) {
+        using T = std::remove_reference_t< decltype( v ) >;
+        if constexpr( std::is_integral_v< T > )
+        {
+            if( x >= (double)std::numeric_limits< T >::min() &&
+                x < (double)std::numeric_limits< T >::max() + 1.0 )
+            {
+                v = (T)x;
+            }
+        }
+        else
+        {
+            v = (T)x;
+        }
+    } );
+
+    return memcmp( &old, &dsv->value, sizeof(dsv_value_t) ) != 0;
+}
+
+/*!=============================================================================
+
+    Compile the expression of a new calculated dsv, and bind it to its inputs,
+    which must exist already. The dsv gets DSV_FLAG_READONLY.
+
+@param[in]
+    dsv
+        dsv information, not in the hash map yet
+@return
+    0 for success, or a dsv without expression
+    EINVAL - not numeric, syntax error, or a non numeric input
+    ENOENT - an input doesn't exist
+    ENAMETOOLONG - the expression is longer than CALC_EXPR_SIZE_MAX
+==============================================================================*/
+static int var_calc_create( dsv_info_t *dsv )
+{
+    if( dsv->pCalc[0] == '\0' )
+    {
+        return 0;
+    }
+    if( strlen( dsv->pCalc ) > CALC_EXPR_SIZE_MAX )
+    {
+        dsvlog( LOG_ERR, "calc too long: %s", dsv->pName );
+        return ENAMETOOLONG;
+    }
+    if( dsv->type < DSV_TYPE_UINT16 || dsv->type > DSV_TYPE_SINT8 )
+    {
+        dsvlog( LOG_ERR, "calc of a non numeric dsv: %s", dsv->pName );
+        return EINVAL;
+    }
+
+    var_calc_t calc;
+    int rc = calc_compile( dsv->pCalc, dsv->instID, &calc.prog );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+
+    calc.rank = 0;
+    for( auto &name : calc.prog.inputs )
+    {
+        auto e = g_map.find( name );
+        if( e == g_map.end() )
+        {
+            dsvlog( LOG_ERR, "input of %s not found: %s",
+                    dsv->pName, name.c_str() );
+            return ENOENT;
+        }
+
+        dsv_info_t *input = (dsv_info_t *)e->second;
+        if( input->type < DSV_TYPE_UINT16 || input->type > DSV_TYPE_SINT8 )
+        {
+            dsvlog( LOG_ERR, "non numeric input of %s: %s",
+                    dsv->pName, name.c_str() );
+            return EINVAL;
+        }
+
+        auto c = g_calc.find( input );
+        if( c != g_calc.end() )
+        {
+            calc.rank = std::max( calc.rank, c->second.rank + 1 );
+        }
+        calc.inputs.push_back( input );
+    }
+    calc.values.resize( calc.inputs.size() );
+
+    for( dsv_info_t *input : calc.inputs )
+    {
+        g_calc_users[input].push_back( dsv );
+    }
+    dsv->flags |= DSV_FLAG_READONLY;
+    var_calc_eval( dsv, g_calc[dsv] = std::move( calc ) );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Evaluate the calculated dsvs whose inputs changed, and forward the ones
+    whose value changed. A dsv is evaluated once, after all its inputs.
+
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback invoked with the forward message of each changed dsv
+==============================================================================*/
+void var_calc_run( char *fwd_buf, void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    assert( fwd_buf );
+    assert( cb );
+
+    struct timespec now = { 0 };
+
+    while( !g_calc_pending.empty() )
+    {
+        dsv_info_t *dsv = g_calc_pending.begin()->second;
+        g_calc_pending.erase( g_calc_pending.begin() );
+        if( !var_calc_eval( dsv, g_calc[dsv] ) )
+        {
+            continue;
+        }
+
+        clock_gettime( CLOCK_REALTIME, &now );
+        dsv->timestamp = now;
+        dsv->dirty = 1;
+        dsv->version++;
+        var_history_record( dsv );
+        var_stats_record( dsv );
+        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
+        cb( (const dsv_msg_forward_t *)fwd_buf );
+
+        /* the users have a higher rank, so they come later */
+        var_calc_touch( dsv );
+    }
+}
+
+/*!=============================================================================
+
+    Validation rules of a dsv, compiled from the "min", "max", "enum" and
+    "regex" of its schema. A numeric value, or every item of an INT_ARRAY,
+    is checked against min, max and the numbers of enum, a string against
+    the strings of enum and the regex. A rejected write is not applied nor
+    forwarded, the writer gets a notification instead, see DSV_SubRejects()
+
+==============================================================================*/
+typedef struct var_rules
+{
+    bool has_min;
+
+    double min;
+
+    bool has_max;
+
+    double max;
+
+    std::vector< double > numbers;
+
+    std::vector< std::string > strings;
+
+    bool has_regex;
+
+    std::regex regex;
+
+    /*! number of writes rejected */
+    uint64_t rejects;
+
+}var_rules_t;
+
+/*! a rejected write, waiting for var_reject_run() to notify the writer */
+typedef struct var_reject
+{
+    dsv_info_t *dsv;
+
+    pid_t pid;
+
+    int rule;
+
+}var_reject_t;
+
+static std::unordered_map< dsv_info_t *, var_rules_t > g_rules;
+static std::vector< var_reject_t > g_rejected;
+
+/*! writes rejected since the start, including those of deleted dsvs */
+static uint64_t g_rejects = 0;
+
+/*!=============================================================================
+
+    Compile the validation rules of a new dsv
+
+@param[in]
+    dsv
+        dsv information, not in the hash map yet
+@return
+    0 for success, or a dsv without rules
+    EINVAL - malformed rules, or rules not applicable to the type
+==============================================================================*/
+static int var_rules_create( dsv_info_t *dsv )
+{
+    if( dsv->pRules[0] == '\0' )
+    {
+        return 0;
+    }
+
+    bool numeric = ( dsv->type >= DSV_TYPE_UINT16 &&
+                     dsv->type <= DSV_TYPE_SINT8 ) ||
+                   dsv->type == DSV_TYPE_INT_ARRAY;
+    if( !numeric && dsv->type != DSV_TYPE_STR )
+    {
+        dsvlog( LOG_ERR, "rules of an unsupported type: %s", dsv->pName );
+        return EINVAL;
+    }
+
+    cJSON *root = cJSON_Parse( dsv->pRules );
+    if( root == NULL )
+    {
+        dsvlog( LOG_ERR, "malformed rules of %s", dsv->pName );
+        return EINVAL;
+    }
+
+    int rc = 0;
+    var_rules_t rules{};
+    cJSON *m = cJSON_GetObjectItem( root, "min" );
+    if( cJSON_IsNumber( m ) && numeric )
+    {
+        rules.has_min = true;
+        rules.min = m->valuedouble;
+    }
+    else if( m != NULL )
+    {
+        rc = EINVAL;
+    }
+
+    m = cJSON_GetObjectItem( root, "max" );
+    if( cJSON_IsNumber( m ) && numeric )
+    {
+        rules.has_max = true;
+        rules.max = m->valuedouble;
+    }
+    else if( m != NULL )
+    {
+        rc = EINVAL;
+    }
+
+    m = cJSON_GetObjectItem( root, "enum" );
+    if( m != NULL && !cJSON_IsArray( m ) )
+    {
+        rc = EINVAL;
+    }
+
+    cJSON *item;
+    cJSON_ArrayForEach( item, m )
+    {
+        if( cJSON_IsNumber( item ) && numeric )
+        {
+            rules.numbers.push_back( item->valuedouble );
+        }
+        else if( cJSON_IsString( item ) && !numeric )
+        {
+            rules.strings.push_back( item->valuestring );
+        }
+        else
+        {
+            rc = EINVAL;
+        }
+    }
+
+    m = cJSON_GetObjectItem( root, "regex" );
+    if( cJSON_IsString( m ) && !numeric )
+    {
+        try
+        {
+            rules.regex.assign( m->valuestring, std::regex::optimize );
+            rules.has_regex = true;
+        }
+        catch( const std::regex_error & )
+        {
+            rc = EINVAL;
+        }
+    }
+    else if( m != NULL )
+    {
+        rc = EINVAL;
+    }
+
+    cJSON_Delete( root );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "invalid rules of %s: %s", dsv->pName, dsv->pRules );
+        return rc;
+    }
+
+    g_rules[dsv] = std::move( rules );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Check a number against the rules
+
+@param[in]
+    rules
+        validation rules
+@param[in]
+    x
+        value, or item of an INT_ARRAY
+@return
+    0 if valid, else the dsv_rule_t broken
+==============================================================================*/
+static int var_rules_number( const var_rules_t &rules, double x )
+{
+    if( rules.has_min && x < rules.min )
+    {
+        return DSV_RULE_MIN;
+    }
+    if( rules.has_max && x > rules.max )
+    {
+        return DSV_RULE_MAX;
+    }
+    if( !rules.numbers.empty() &&
+        std::find( rules.numbers.begin(), rules.numbers.end(), x ) ==
+        rules.numbers.end() )
+    {
+        return DSV_RULE_ENUM;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Check a string against the rules
+
+@param[in]
+    rules
+        validation rules
+@param[in]
+    str
+        null terminated string
+@return
+    0 if valid, else the dsv_rule_t broken
+==============================================================================*/
+static int var_rules_string( const var_rules_t &rules, const char *str )
+{
+    if( !rules.strings.empty() &&
+        std::find( rules.strings.begin(), rules.strings.end(), str ) ==
+        rules.strings.end() )
+    {
+        return DSV_RULE_ENUM;
+    }
+    if( rules.has_regex && !std::regex_match( str, rules.regex ) )
+    {
+        return DSV_RULE_REGEX;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Validate a new value of a dsv before it is applied. A rejected write is
+    counted and queued for var_reject_run().
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    pid
+        pid of the writer
+@param[in]
+    value
+        a null terminated string for a STR dsv, ints for an INT_ARRAY, or a
+        dsv_value_t for a numeric dsv
+@param[in]
+    size
+        number of bytes of value
+@return
+    0 - valid, or the dsv has no rules
+    EDOM - rejected
+==============================================================================*/
+static int var_validate( dsv_info_t *dsv,
+                         pid_t pid,
+                         const void *value,
+                         size_t size )
+{
+    auto e = g_rules.find( dsv );
+    if( e == g_rules.end() )
+    {
+        return 0;
+    }
+
+    int rule = 0;
+    if( dsv->type == DSV_TYPE_STR )
+    {
+        rule = var_rules_string( e->second, (const char *)value );
+    }
+    else if( dsv->type == DSV_TYPE_INT_ARRAY )
+    {
+        const int *items = (const int *)value;
+        for( size_t i = 0; i < size / sizeof(int) && rule == 0; i++ )
+        {
+            rule = var_rules_number( e->second, items[i] );
+        }
+    }
+    else
+    {
+        dsv_info_t tmp = *dsv;
+        double x = 0;
+        memcpy( &tmp.value, value, sizeof(dsv_value_t) );
+        var_numeric( &tmp, [&x]( auto &v ) { x = (double)v; } );
+        rule = var_rules_number( e->second, x );
+    }
+
+    if( rule == 0 )
+    {
+        return 0;
+    }
+
+    e->second.rejects++;
+    g_rejects++;
+    g_rejected.push_back( var_reject_t{ dsv, pid, rule } );
+    return EDOM;
+}
+
+/*!=============================================================================
+
+    Notify the writers of the writes rejected since the last call. The
+    notification is named DSV_REJECT_TOPIC followed by the pid of the writer
+    and holds a dsv_reject_t.
+
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback invoked with the forward message of each reject
+==============================================================================*/
+void var_reject_run( char *fwd_buf, void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    assert( fwd_buf );
+    assert( cb );
+
+    dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
+
+    for( auto &r : g_rejected )
+    {
+        char *fwd_data = fwd->data;
+        fwd->blob = NULL;
+        fwd->length = sprintf( fwd_data, DSV_REJECT_TOPIC "%d", r.pid ) + 1;
+        fwd_data += fwd->length;
+
+        *(void **)fwd_data = var_handle( r.dsv );
+        fwd_data += sizeof(void *);
+        fwd->length += sizeof(void *);
+
+        dsv_reject_t *reject = (dsv_reject_t *)fwd_data;
+        reject->rejects = g_rules[r.dsv].rejects;
+        reject->rule = r.rule;
+        strcpy( reject->name, r.dsv->pName );
+        fwd->length += sizeof(dsv_reject_t) + strlen( r.dsv->pName ) + 1;
+
+        cb( fwd );
+    }
+    g_rejected.clear();
+}
+
+/*!=============================================================================
+
+    Tag index: every tag in the pTags of the dsvs gets an integer ID, and
+    the ID indexes the posting list of the dsvs having the tag, in the order
+    of their creation
+
+==============================================================================*/
+static std::unordered_map< std::string, uint32_t > g_tag_ids;
+static std::vector< std::vector< dsv_info_t * > > g_tag_dsvs;
+
+/*! all the dsvs in the order of their creation, walked by filtered queries */
+static std::vector< dsv_info_t * > g_order;
+
+/*!=============================================================================
+
+    Call back for each item of a comma separated list, without the spaces
+    around it
+
+@param[in]
+    list
+        comma separated list, eg "sys.cfg, sys.sts"
+@param[in]
+    f
+        callback invoked with a std::string of each non empty item
+==============================================================================*/
+template< typename F >
+static void var_split( const char *list, F f )
+{
+    const char *p = list;
+
+    while( *p != '\0' )
+    {
+        size_t len = strcspn( p, "," );
+        const char *end = p + len;
+        while( p < end && isspace( (unsigned char)*p ) )
+        {
+            p++;
+        }
+        const char *last = end;
+        while( last > p && isspace( (unsigned char)last[-1] ) )
+        {
+            last--;
+        }
+
+        if( last > p )
+        {
+            f( std::string( p, last - p ) );
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+/*!=============================================================================
+
+    Add a new dsv to the posting lists of its tags, eg "sys.cfg, sys.sts"
+
+@param[in]
+    dsv
+        dsv information
+==============================================================================*/
+static void var_tags_index( dsv_info_t *dsv )
+{
+    var_split( dsv->pTags, [dsv]( std::string &&tag ) {
+        auto e = g_tag_ids.emplace( std::move( tag ), g_tag_dsvs.size() );
+        if( e.second )
+        {
+            g_tag_dsvs.emplace_back();
+        }
+
+        std::vector< dsv_info_t * > &dsvs = g_tag_dsvs[e.first->second];
+        /* a tag repeated in pTags lists the dsv once */
+        if( dsvs.empty() || dsvs.back() != dsv )
+        {
+            dsvs.push_back( dsv );
+        }
+    } );
+}
+
+/*!=============================================================================
+
+    Split the comma separated aliases of a new dsv, eg "/OLD/NAME, [5]/X",
+    into full names, an alias without an instance ID taking the one of the
+    dsv, and check that each one is free
+
+@param[in]
+    dsv
+        dsv information
+@param[out]
+    names
+        full names of the aliases
+@return
+    0 for success
+    EINVAL - an alias is the name of the dsv
+    EEXIST - an alias is the name or alias of another dsv
+    EXDEV - an alias is owned by another shard
+    ENOSPC - the aliases are longer than DSV_STRING_SIZE_MAX
+==============================================================================*/
+static int var_aliases_parse( dsv_info_t *dsv, std::vector< std::string > &names )
+{
+    const char *p = dsv->pAliases;
+    size_t total = 0;
+
+    while( *p != '\0' )
+    {
+        size_t len = strcspn( p, "," );
+        const char *end = p + len;
+        while( p < end && isspace( (unsigned char)*p ) )
+        {
+            p++;
+        }
+        const char *last = end;
+        while( last > p && isspace( (unsigned char)last[-1] ) )
+        {
+            last--;
+        }
+
+        if( last > p )
+        {
+            std::string name( p, last - p );
+            if( name[0] != '[' )
+            {
+                name = "[" + std::to_string( dsv->instID ) + "]" + name;
+            }
+
+            if( name == dsv->pName )
+            {
+                return EINVAL;
+            }
+            if( g_ring != NULL && DSV_ShardOf( g_ring, name.c_str() ) != g_shard )
+            {
+                return EXDEV;
+            }
+            auto e = g_map.find( name );
+            if( e != g_map.end() && e->second != dsv )
+            {
+                return EEXIST;
+            }
+
+            if( std::find( names.begin(), names.end(), name ) == names.end() )
+            {
+                total += name.size() + 1;
+                names.push_back( name );
+            }
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return total < DSV_STRING_SIZE_MAX ? 0 : ENOSPC;
+}
+
+/*!=============================================================================
+
+    Add the aliases of a dsv to the hash table, they point to the dsv like
+    its name, and keep their full names in pAliases for the replication
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    names
+        full names of the aliases checked by var_aliases_parse()
+==============================================================================*/
+static void var_aliases_index( dsv_info_t *dsv,
+                               const std::vector< std::string > &names )
+{
+    std::string list;
+    for( auto &name : names )
+    {
+        g_map.emplace( name, (void *)dsv );
+        list += list.empty() ? name : "," + name;
+    }
+
+    free( dsv->pAliases );
+    dsv->pAliases = strdup( list.c_str() );
+}
+
+/*!=============================================================================
+
+    Check whether an entry of the hash table is an alias of its dsv
+
+@param[in]
+    name
+        key of the entry
+@param[in]
+    dsv
+        value of the entry
+@return
+    true for an alias, false for the name of the dsv
+==============================================================================*/
+static bool var_is_alias( const std::string &name, void *dsv )
+{
+    return name != ( (dsv_info_t *)dsv )->pName;
+}
+
+/**
+ * hash map has full dsv name as key, and dsv_info_t as value,
+ * var_delete() releases the memory
+ */
+int var_create( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+    printf( "Enter %s\n", __func__ );
+
+    int rc = EINVAL;
+    struct timespec now = { 0 };
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    const char *req_end = req_buf + req->length;
+    char *req_data = req->data;
+    std::vector< std::string > aliases;
+
+    if( req->length < sizeof(dsv_msg_request_t) + sizeof(dsv_info_t) ||
+        req->length > DSV_MSG_SIZE_MAX )
+    {
+        dsvlog( LOG_ERR, "malformed create request" );
+        return EINVAL;
+    }
+
+    /* full_name and dsv will be put into hash table */
+    dsv_info_t *dsv = var_alloc();
+    if( dsv != NULL )
+    {
+        /* fill dsv, the pointers of the client mean nothing here */
+        memcpy( dsv, req_data, sizeof(dsv_info_t) );
+        dsv->pName = dsv->pDesc = dsv->pTags = NULL;
+        dsv->pCalc = dsv->pRules = dsv->pAliases = NULL;
+        memset( &dsv->value, 0, sizeof(dsv->value) );
+        clock_gettime( CLOCK_REALTIME, &now );
+        dsv->timestamp = now;
+        dsv->version = 0;
+
+        /* each string must end inside the request */
+        char **strs[] = { &dsv->pName,
+                          &dsv->pDesc,
+                          &dsv->pTags,
+                          &dsv->pCalc,
+                          &dsv->pRules,
+                          &dsv->pAliases };
+        req_data += sizeof(dsv_info_t);
+        rc = 0;
+        for( auto str : strs )
+        {
+            const char *nul = (const char *)memchr( req_data,
+                                                    '\0',
+                                                    req_end - req_data );
+            if( nul == NULL )
+            {
+                rc = EINVAL;
+                break;
+            }
+            *str = strdup( req_data );
+            req_data += nul - req_data + 1;
+        }
+
+        /* the value is checked before any memory is taken for it */
+        size_t left = req_end - req_data;
+        if( rc != 0 )
+        {
+            dsvlog( LOG_ERR, "malformed create request" );
+        }
+        else if( dsv->len > DSV_VALUE_SIZE_MAX )
+        {
+            dsvlog( LOG_ERR, "value too large: %s", dsv->pName );
+            rc = EMSGSIZE;
+        }
+        else if( dsv->len > left ||
+                 ( dsv->type == DSV_TYPE_STR &&
+                   memchr( req_data, '\0', left ) == NULL ) )
+        {
+            dsvlog( LOG_ERR, "value beyond the request: %s", dsv->pName );
+            rc = EINVAL;
+        }
+        else if( !var_items_fit( dsv->type, dsv->len ) )
+        {
+            dsvlog( LOG_ERR, "partial item in value: %s", dsv->pName );
+            rc = EINVAL;
+        }
+        else if( dsv->type == DSV_TYPE_STR )
+        {
+            dsv->value.pStr = strdup( req_data );
+        }
+        else if( dsv->type == DSV_TYPE_INT_ARRAY )
+        {
+            dsv->value.pArray = static_cast<void *>(
+                                new dsv_array_t( (int *)req_data,
+                                                 (int *)( req_data + dsv->len ) ) );
+        }
+        else if( DSV_TYPE_IS_BLOB( dsv->type ) &&
+                 ( rc = var_set_blob( dsv, req_data, dsv->len ) ) != 0 )
+        {
+            dsvlog( LOG_ERR, "no memory for the value of %s", dsv->pName );
+        }
+
+        if( rc != 0 )
+        {
+            var_free( dsv );
+            return rc;
+        }
+
+        std::string full_name( dsv->pName );
+        auto e = g_map.find( full_name );
+        if( g_ring != NULL && DSV_ShardOf( g_ring, dsv->pName ) != g_shard )
+        {
+            /* the client has a stale shard map */
+            dsvlog( LOG_ERR, "dsv not owned by shard %u: %s",
+                    g_shard, full_name.c_str() );
+            rc = EXDEV;
+        }
+        else if( e != g_map.end() )
+        {
+            dsvlog( LOG_ERR, "dsv existed: %s", full_name.c_str() );
+            rc = EEXIST;
+        }
+        else if( var_slots_full() )
+        {
+            dsvlog( LOG_ERR, "no handle left for %s", full_name.c_str() );
+            rc = ENOSPC;
+        }
+        else if( ( rc = var_aliases_parse( dsv, aliases ) ) != 0 )
+        {
+            dsvlog( LOG_ERR, "invalid aliases of %s: %s",
+                    full_name.c_str(), dsv->pAliases );
+        }
+        else if( ( rc = var_rules_create( dsv ) ) == 0 &&
+                 ( rc = var_calc_create( dsv ) ) == 0 )
+        {
+            g_map.insert( std::make_pair( full_name, (void *)dsv ) );
+            var_slot_alloc( dsv );
+            if( g_handle_map )
+            {
+                var_map_handle( dsv, NULL );
+            }
+            var_history_create( dsv );
+            var_stats_create( dsv );
+            var_tags_index( dsv );
+            var_aliases_index( dsv, aliases );
+            g_order.push_back( dsv );
+            fill_fwd_buf( full_name.c_str(), dsv, fwd_buf );
+        }
+    }
+
+    if( dsv != NULL && rc != 0 )
+    {
+        g_rules.erase( dsv );
+        var_free( dsv );
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Create the dsvs of a DSV_MSG_CREATE_BATCH request, each one like
+    var_create(), in order. The hash table and the creation order get room
+    for the whole batch first, so they grow once per batch instead of
+    rehashing while a device registers thousands of dsvs.
+
+@param[in]
+    req_buf
+        request: count, then the aligned create requests
+@param[in]
+    fwd_buf
+        forward buffer, filled for each new dsv
+@param[in]
+    cb
+        callback forwarding each new dsv
+@return
+    0 for success
+    EINVAL - malformed request, or a count the request cannot hold
+    the error of the last dsv failed to create, the others are created
+==============================================================================*/
+int var_create_batch( const char *req_buf,
+                      char *fwd_buf,
+                      void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+    assert( cb );
+
+    int rc = 0;
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    const char *req_data = req->data + sizeof(uint32_t);
+    const char *req_end = req_buf + req->length;
+    uint32_t count = *(const uint32_t *)req->data;
+
+    /* the count is checked before making room for it */
+    if( req->length < sizeof(dsv_msg_request_t) + sizeof(uint32_t) ||
+        req->length > DSV_MSG_SIZE_MAX ||
+        count > req->length / ( sizeof(dsv_msg_request_t) +
+                                sizeof(dsv_info_t) ) )
+    {
+        dsvlog( LOG_ERR, "malformed batch of %u dsvs", count );
+        return EINVAL;
+    }
+
+    g_map.reserve( g_map.size() + count );
+    g_order.reserve( g_order.size() + count );
+    if( g_handle_map )
+    {
+        g_handle_dsv.reserve( g_handle_dsv.size() + count );
+        g_dsv_handle.reserve( g_dsv_handle.size() + count );
+    }
+
+    for( uint32_t i = 0; i < count; i++ )
+    {
+        const dsv_msg_request_t *one = (const dsv_msg_request_t *)req_data;
+        if( req_end - req_data < (ptrdiff_t)sizeof(dsv_msg_request_t) ||
+            one->length < sizeof(dsv_msg_request_t) + sizeof(dsv_info_t) ||
+            one->length > (size_t)( req_end - req_data ) )
+        {
+            dsvlog( LOG_ERR, "malformed batch, %u of %u created", i, count );
+            return EINVAL;
+        }
+
+        int r = var_create( req_data, fwd_buf );
+        if( r == 0 )
+        {
+            cb( (const dsv_msg_forward_t *)fwd_buf );
+        }
+        else
+        {
+            rc = r;
+        }
+        req_data += one->length;
+    }
+
+    return rc;
+}
+
+/*!=============================================================================
+
+    Get the dsv whose statistic is a dsv, eg "/SYS/T" of "/SYS/T#avg"
+
+@param[in]
+    dsv
+        dsv information
+@return
+    dsv having the statistic
+    NULL - not a statistic
+==============================================================================*/
+static dsv_info_t *var_stats_source( dsv_info_t *dsv )
+{
+    const char *suffix = strrchr( dsv->pName, '#' );
+    if( suffix == NULL )
+    {
+        return NULL;
+    }
+
+    auto e = g_map.find( std::string( dsv->pName, suffix - dsv->pName ) );
+    if( e == g_map.end() )
+    {
+        return NULL;
+    }
+
+    dsv_info_t *source = (dsv_info_t *)e->second;
+    auto s = g_stats.find( source );
+    if( s == g_stats.end() ||
+        std::find( s->second.out, s->second.out + DSV_STATS_NUM, dsv ) ==
+        s->second.out + DSV_STATS_NUM )
+    {
+        return NULL;
+    }
+    return source;
+}
+
+/*!=============================================================================
+
+    Fill the notification of a deleted dsv: its name, a NULL handle, and the
+    handle it had as the value
+
+@param[in]
+    dsv
+        dsv information
+@param[out]
+    fwd_buf
+        forward buffer
+==============================================================================*/
+static void var_fill_removal( dsv_info_t *dsv, char *fwd_buf )
+{
+    dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
+    char *fwd_data = fwd->data;
+
+    fwd->blob = NULL;
+    fwd->length = strlen( dsv->pName ) + 1;
+    strcpy( fwd_data, dsv->pName );
+    fwd_data += fwd->length;
+
+    *(void **)fwd_data = NULL;
+    fwd_data += sizeof(void *);
+    *(void **)fwd_data = var_handle( dsv );
+    fwd->length += 2 * sizeof(void *);
+}
+
+/*!=============================================================================
+
+    Delete dsvs and release their memory. The statistics of a dsv go with
+    it, and a dsv is removed from every table before it is freed, so nothing
+    refers to it afterwards. Each one is forwarded by var_fill_removal(), the
+    calculated dsvs before their inputs and the statistics after their dsv,
+    so a standby deleting them in that order passes the same checks.
+
+@param[in,out]
+    dsvs
+        dsvs to delete, extended with their statistics and sorted in the
+        order of the notifications
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback invoked with the notification of each deleted dsv, NULL
+        for none
+@return
+    0 for success, nothing is deleted otherwise
+    EPERM - a statistic without its dsv, or a built-in dsv
+    EBUSY - an input of a calculated dsv which is not deleted
+==============================================================================*/
+static int var_delete_dsvs( std::vector< dsv_info_t * > &dsvs,
+                            char *fwd_buf,
+                            void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    std::unordered_set< dsv_info_t * > gone( dsvs.begin(), dsvs.end() );
+
+    for( size_t i = 0, n = dsvs.size(); i < n; i++ )
+    {
+        auto s = g_stats.find( dsvs[i] );
+        if( s == g_stats.end() )
+        {
+            continue;
+        }
+        for( dsv_info_t *out : s->second.out )
+        {
+            if( gone.insert( out ).second )
+            {
+                dsvs.push_back( out );
+            }
+        }
+    }
+
+    for( dsv_info_t *dsv : dsvs )
+    {
+        if( g_builtin.count( dsv ) != 0 )
+        {
+            dsvlog( LOG_ERR, "built-in dsv not deleted: %s", dsv->pName );
+            return EPERM;
+        }
+
+        dsv_info_t *source = var_stats_source( dsv );
+        if( source != NULL && gone.count( source ) == 0 )
+        {
+            dsvlog( LOG_ERR, "statistic deleted without %s", source->pName );
+            return EPERM;
+        }
+
+        auto u = g_calc_users.find( dsv );
+        if( u == g_calc_users.end() )
+        {
+            continue;
+        }
+        for( dsv_info_t *user : u->second )
+        {
+            if( gone.count( user ) == 0 )
+            {
+                dsvlog( LOG_ERR, "%s is an input of %s",
+                        dsv->pName, user->pName );
+                return EBUSY;
+            }
+        }
+    }
+
+    /* the higher the rank, the earlier, the others keep their order */
+    auto rank = []( dsv_info_t *dsv ) {
+        auto c = g_calc.find( dsv );
+        return c != g_calc.end() ? c->second.rank + 1 : 0;
+    };
+    std::stable_sort( dsvs.begin(), dsvs.end(),
+                      [&rank]( dsv_info_t *a, dsv_info_t *b ) {
+                          return rank( a ) > rank( b );
+                      } );
+
+    auto is_gone = [&gone]( dsv_info_t *dsv ) { return gone.count( dsv ) != 0; };
+    g_order.erase( std::remove_if( g_order.begin(), g_order.end(), is_gone ),
+                   g_order.end() );
+    g_rejected.erase( std::remove_if( g_rejected.begin(),
+                                      g_rejected.end(),
+                                      [&is_gone]( const var_reject_t &r ) {
+                                          return is_gone( r.dsv );
+                                      } ),
+                      g_rejected.end() );
+
+    for( dsv_info_t *dsv : dsvs )
+    {
+        if( cb != NULL )
+        {
+            var_fill_removal( dsv, fwd_buf );
+            cb( (const dsv_msg_forward_t *)fwd_buf );
+        }
+
+        g_map.erase( dsv->pName );
+        var_split( dsv->pAliases, [dsv]( std::string &&alias ) {
+            auto e = g_map.find( alias );
+            if( e != g_map.end() && e->second == dsv )
+            {
+                g_map.erase( e );
+            }
+        } );
+
+        var_split( dsv->pTags, [&is_gone]( std::string &&tag ) {
+            auto e = g_tag_ids.find( tag );
+            if( e != g_tag_ids.end() )
+            {
+                std::vector< dsv_info_t * > &list = g_tag_dsvs[e->second];
+                list.erase( std::remove_if( list.begin(), list.end(), is_gone ),
+                            list.end() );
+            }
+        } );
+
+        auto c = g_calc.find( dsv );
+        if( c != g_calc.end() )
+        {
+            for( dsv_info_t *input : c->second.inputs )
+            {
+                auto u = g_calc_users.find( input );
+                if( u != g_calc_users.end() )
+                {
+                    std::vector< dsv_info_t * > &users = u->second;
+                    users.erase( std::remove( users.begin(), users.end(), dsv ),
+                                 users.end() );
+                }
+            }
+            g_calc_pending.erase( std::make_pair( c->second.rank, dsv ) );
+            g_calc.erase( c );
+        }
+        g_calc_users.erase( dsv );
+
+        g_history.erase( dsv );
+        g_stats.erase( dsv );
+        g_rules.erase( dsv );
+
+        if( g_handle_map )
+        {
+            auto h = g_dsv_handle.find( dsv );
+            if( h != g_dsv_handle.end() )
+            {
+                g_handle_dsv.erase( h->second );
+                g_dsv_handle.erase( h );
+            }
+        }
+    }
+
+    /* freed last, the tag lists above still compare the pointers */
+    for( dsv_info_t *dsv : dsvs )
+    {
+        var_slot_free( dsv );
+        var_free( dsv );
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Delete a dsv with its statistics. The subscribers get a notification
+    with a NULL handle and the old handle as the value, then the handle is
+    stale: a request with it fails instead of reaching another dsv.
+
+@param[in]
+    req_buf
+        request: handle
+@param[out]
+    rep_buf
+        reply, no data
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback forwarding the notification of each deleted dsv
+@return
+    0 for success
+    ENOENT - bad handle
+    any other value returned by var_delete_dsvs()
+==============================================================================*/
+int var_delete( const char *req_buf,
+                char *rep_buf,
+                char *fwd_buf,
+                void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    assert( req_buf );
+    assert( rep_buf );
+    assert( fwd_buf );
+    assert( cb );
+
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    dsv_info_t *dsv = var_from_handle( req->data );
+    if( dsv == NULL )
+    {
+        return ENOENT;
+    }
+
+    std::vector< dsv_info_t * > dsvs( 1, dsv );
+    return var_delete_dsvs( dsvs, fwd_buf, cb );
+}
+
+/*!=============================================================================
+
+    Delete all the dsvs whose name starts with a prefix, eg "[123]" for the
+    dsvs of a device which is gone, all of them or none
+
+@param[in]
+    req_buf
+        request: prefix
+@param[out]
+    rep_buf
+        reply: number of deleted dsvs
+@param[in]
+    fwd_buf
+        forward buffer passed to cb
+@param[in]
+    cb
+        callback forwarding the notification of each deleted dsv
+@return
+    0 for success, including no dsv deleted
+    EINVAL - empty prefix
+    any other value returned by var_delete_dsvs()
+==============================================================================*/
+int var_delete_prefix( const char *req_buf,
+                       char *rep_buf,
+                       char *fwd_buf,
+                       void (*cb)( const dsv_msg_forward_t *fwd ) )
+{
+    assert( req_buf );
+    assert( rep_buf );
+    assert( fwd_buf );
+    assert( cb );
+
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    const char *prefix = req->data;
+    size_t len = strlen( prefix );
+    if( len == 0 )
+    {
+        return EINVAL;
+    }
+
+    /* the statistics are not in g_order, they come with their dsv */
+    std::vector< dsv_info_t * > dsvs;
+    for( dsv_info_t *dsv : g_order )
+    {
+        if( strncmp( dsv->pName, prefix, len ) == 0 )
+        {
+            dsvs.push_back( dsv );
+        }
+    }
+
+    int rc = var_delete_dsvs( dsvs, fwd_buf, cb );
+    if( rc == 0 )
+    {
+        *(uint32_t *)rep->data = dsvs.size();
+        rep->length += sizeof(uint32_t);
+    }
+    return rc;
+}
+
+/**
+*/
+int var_set( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+    printf( "Enter %s\n", __func__ );
+
+    int rc = EINVAL;
+    struct timespec now = { 0 };
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    dsv_info_t *dsv = var_from_handle( req_data );
+    if( dsv == NULL )
+    {
+        return rc;
+    }
+    if( dsv->flags & DSV_FLAG_READONLY )
+    {
+        dsvlog( LOG_ERR, "dsv is read-only: %s", dsv->pName );
+        return EPERM;
+    }
+    req_data += sizeof(dsv);
     dsv->pid = *(pid_t *)req_data;
     req_data += sizeof(pid_t);
+
+    /* the value is the rest of the request */
+    size_t size = req_buf + req->length - req_data;
+    if( size > DSV_VALUE_SIZE_MAX )
+    {
+        return EMSGSIZE;
+    }
+    if( !var_items_fit( dsv->type, size ) )
+    {
+        return EINVAL;
+    }
+    rc = var_validate( dsv, dsv->pid, req_data, size );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+    if( dsv != NULL )
+    {
+        clock_gettime( CLOCK_REALTIME, &now );
+        dsv->timestamp = now;
+        dsv->dirty = 1;
+        dsv->version++;
+        if( dsv->type == DSV_TYPE_STR )
+        {
+            free( dsv->value.pStr );
+            dsv->value.pStr = strdup( req_data );
+        }
+        else if( dsv->type == DSV_TYPE_INT_ARRAY )
+        {
+            dsv->len = size - size % sizeof(int);
+            delete (dsv_array_t *)dsv->value.pArray;
+            dsv->value.pArray = static_cast<void *>
+                                ( new dsv_array_t( (int *)req_data,
+                                                   (int *)( req_data + dsv->len ) ) );
+        }
+        else if( DSV_TYPE_IS_BLOB( dsv->type ) )
+        {
+            rc = var_set_blob( dsv, req_data, size );
+            if( rc != 0 )
+            {
+                return rc;
+            }
+        }
+        else
+        {
+            memcpy( &dsv->value, req_data, sizeof(dsv_value_t) );
+            var_history_record( dsv );
+            var_stats_record( dsv );
+            var_calc_touch( dsv );
+        }
+
+        if( dsv->flags & DSV_FLAG_TRACK )
+        {
+            char buf[DSV_STRING_SIZE_MAX];
+            char *proc_name = get_proc_name( dsv->pid );
+            DSV_Value2Str( buf, DSV_STRING_SIZE_MAX, dsv );
+            dsvlog( LOG_NOTICE,
+                    "%s is changed to %s by %s",
+                    dsv->pName, buf, proc_name );
+            free( proc_name );
+        }
+
+
+        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
+        rc = 0;
+    }
+    return rc;
+}
+
+
+/*!=============================================================================
+
+    Add delta to a numeric dsv atomically, as the server handles one request
+    at a time. Integers wrap around like unsigned arithmetic.
+    The request is: handle, pid, type of the client, delta ( dsv_value_t ).
+    The reply, if any, holds the value before the add ( dsv_value_t ).
+
+@param[in]
+    req_buf
+        DSV_MSG_INCR or DSV_MSG_FETCH_ADD request
+@param[out]
+    rep_buf
+        reply buffer, NULL for DSV_MSG_INCR
+@param[out]
+    fwd_buf
+        forward buffer with the new value
+@return
+    0 for success
+    EINVAL - invalid handle, not numeric, or the type doesn't match
+==============================================================================*/
+int var_fetch_add( const char *req_buf, char *rep_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+
+    struct timespec now = { 0 };
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    dsv_info_t *dsv = var_from_handle( req_data );
+    req_data += sizeof(dsv);
+    pid_t pid = *(pid_t *)req_data;
+    req_data += sizeof(pid_t);
+    int type = *(int *)req_data;
+    req_data += sizeof(int);
+    const dsv_value_t *delta = (const dsv_value_t *)req_data;
+
+    if( dsv == NULL || dsv->type != type )
+    {
+        return EINVAL;
+    }
+    if( dsv->flags & DSV_FLAG_READONLY )
+    {
+        return EPERM;
+    }
+
+    dsv_value_t old = dsv->value;
+    int rc = var_numeric( dsv, [&]( auto &v ) {
+        using T = std::remove_reference_t< decltype( v ) >;
+        T d;
+        memcpy( &d, delta, sizeof(T) );
+        if constexpr( std::is_integral_v< T > )
+        {
+            using U = std::make_unsigned_t< T >;
+            v = (T)( (U)v + (U)d );
+        }
+        else
+        {
+            v += d;
+        }
+    } );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+    if( var_validate( dsv, pid, &dsv->value, sizeof(dsv_value_t) ) != 0 )
+    {
+        dsv->value = old;
+        return EDOM;
+    }
+
+    if( rep_buf != NULL )
+    {
+        dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+        memcpy( rep->data, &old, sizeof(dsv_value_t) );
+        rep->length = sizeof(dsv_msg_reply_t) + sizeof(dsv_value_t);
+    }
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    dsv->timestamp = now;
+    dsv->dirty = 1;
+    dsv->pid = pid;
+    var_history_record( dsv );
+    var_stats_record( dsv );
+    var_calc_touch( dsv );
+    fill_fwd_buf( dsv->pName, dsv, fwd_buf );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Set a numeric dsv to desired only if it equals expected.
+    The request is: handle, pid, type of the client, expected and desired
+    ( dsv_value_t ). The reply holds the value before ( dsv_value_t ).
+
+@param[in]
+    req_buf
+        DSV_MSG_CAS request
+@param[out]
+    rep_buf
+        reply buffer
+@param[out]
+    fwd_buf
+        forward buffer with the new value when it is set
+@return
+    0 - set to desired
+    EAGAIN - the value is not expected, nothing changed
+    EINVAL - invalid handle, not numeric, or the type doesn't match
+==============================================================================*/
+int var_cas( const char *req_buf, char *rep_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( rep_buf );
+    assert( fwd_buf );
+
+    struct timespec now = { 0 };
+    bool equal = false;
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+
+    dsv_info_t *dsv = var_from_handle( req_data );
+    req_data += sizeof(dsv);
+    pid_t pid = *(pid_t *)req_data;
+    req_data += sizeof(pid_t);
+    int type = *(int *)req_data;
+    req_data += sizeof(int);
+    const dsv_value_t *expected = (const dsv_value_t *)req_data;
+    const dsv_value_t *desired = expected + 1;
+
+    if( dsv == NULL || dsv->type != type )
+    {
+        return EINVAL;
+    }
+    if( dsv->flags & DSV_FLAG_READONLY )
+    {
+        return EPERM;
+    }
+
+    memcpy( rep->data, &dsv->value, sizeof(dsv_value_t) );
+    rep->length = sizeof(dsv_msg_reply_t) + sizeof(dsv_value_t);
+
+    int rc = var_numeric( dsv, [&]( auto &v ) {
+        using T = std::remove_reference_t< decltype( v ) >;
+        T e;
+        memcpy( &e, expected, sizeof(T) );
+        if( v == e )
+        {
+            memcpy( &v, desired, sizeof(T) );
+            equal = true;
+        }
+    } );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+    if( !equal )
+    {
+        return EAGAIN;
+    }
+    if( var_validate( dsv, pid, &dsv->value, sizeof(dsv_value_t) ) != 0 )
+    {
+        memcpy( &dsv->value, rep->data, sizeof(dsv_value_t) );
+        return EDOM;
+    }
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    dsv->timestamp = now;
+    dsv->dirty = 1;
+    dsv->pid = pid;
+    var_history_record( dsv );
+    var_stats_record( dsv );
+    var_calc_touch( dsv );
+    fill_fwd_buf( dsv->pName, dsv, fwd_buf );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Get the INT_ARRAY dsv of an array range request, and record the pid of
+    the process changing it
+    +-----------------------+
+    | handle (dsv_info_t *) |
+    +-----------------------+
+    | pid                   |
+    +-----------------------+
+    | operands (int)        |
+    +-----------------------+
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    req_data
+        pointer to the first operand
+@return
+    pointer of dsv information, NULL if not an INT_ARRAY dsv
+==============================================================================*/
+static dsv_info_t *var_array_of( const char *req_buf, const char **req_data )
+{
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    const char *data = req->data;
+
+    dsv_info_t *dsv = var_from_handle( data );
+    if( dsv == NULL || dsv->type != DSV_TYPE_INT_ARRAY )
+    {
+        return NULL;
+    }
+    data += sizeof(dsv);
+    dsv->pid = *(pid_t *)data;
+    data += sizeof(pid_t);
+
+    *req_data = data;
+    return dsv;
+}
+
+/*!=============================================================================
+
+    Check count items starting at req_data are all inside the request
+
+@param[in]
+    req_buf
+        request buffer
+@param[in]
+    req_data
+        pointer to the first item
+@param[in]
+    count
+        number of items
+@return
+    true if the items are inside the request
+==============================================================================*/
+static bool var_array_fits( const char *req_buf,
+                            const char *req_data,
+                            int count )
+{
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    size_t left = req_buf + req->length - req_data;
+
+    return count >= 0 && (size_t)count <= left / sizeof(int);
+}
+
+/*!=============================================================================
+
+    Check that an INT_ARRAY can hold size items within DSV_VALUE_SIZE_MAX
+
+@param[in]
+    size
+        number of items after the change
+@return
+    true if the array may grow to size items
+==============================================================================*/
+static bool var_array_room( size_t size )
+{
+    return size <= DSV_VALUE_SIZE_MAX / sizeof(int);
+}
+
+/*!=============================================================================
+
+    Finish a change on an INT_ARRAY dsv: update the length, version and
+    timestamp, track it and fill the forward buffer once for the whole change.
+    A dsv with DSV_FLAG_DELTA forwards the changed items only.
+
+@param[in]
+    dsv
+        pointer of dsv information
+@param[in]
+    op
+        delta operation, see dsv_delta_op_t
+@param[in]
+    index
+        index of the first item changed
+@param[in]
+    count
+        number of items changed
+@param[out]
+    fwd_buf
+        forward buffer
+==============================================================================*/
+static void var_array_changed( dsv_info_t *dsv,
+                               int op,
+                               int index,
+                               int count,
+                               char *fwd_buf )
+{
+    struct timespec now = { 0 };
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    dsv->timestamp = now;
+    dsv->dirty = 1;
+    dsv->version++;
+    dsv->len = ai->size() * sizeof(int);
+
+    if( dsv->flags & DSV_FLAG_TRACK )
+    {
+        char buf[DSV_STRING_SIZE_MAX];
+        DSV_Value2Str( buf, DSV_STRING_SIZE_MAX, dsv );
+        dsvlog( LOG_NOTICE, "%s is changed to %s", dsv->pName, buf );
+    }
+
+    if( dsv->flags & DSV_FLAG_DELTA )
+    {
+        dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
+        char *fwd_data = fwd->data;
+
+        strcpy( fwd_data, dsv->pName );
+        fwd->length = strlen( dsv->pName ) + 1;
+        fwd->blob = NULL;
+        fwd_data += strlen( dsv->pName ) + 1;
+
+        *(void **)fwd_data = var_handle( dsv );
+        fwd_data += sizeof(dsv);
+        fwd->length += sizeof(dsv);
+
+        fwd->length += var_fill_delta( fwd_data, dsv, op, index, count );
+    }
+    else
+    {
+        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
+    }
+}
+
+int var_add_item( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+    printf( "Enter %s\n", __func__ );
+
+    const char *req_data;
+    dsv_info_t *dsv = var_array_of( req_buf, &req_data );
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
+    int value = *(int *)req_data;
+    if( var_validate( dsv, dsv->pid, &value, sizeof(value) ) != 0 )
+    {
+        return EDOM;
+    }
+
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( !var_array_room( ai->size() + 1 ) )
+    {
+        return EMSGSIZE;
+    }
+    ai->push_back( value );
+
+    var_array_changed( dsv, DSV_DELTA_INS, ai->size() - 1, 1, fwd_buf );
+    return 0;
+}
+
+int var_set_item( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+    printf( "Enter %s\n", __func__ );
+
+    const char *req_data;
+    dsv_info_t *dsv = var_array_of( req_buf, &req_data );
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
     int index = *(int *)req_data;
     req_data += sizeof(index);
     int value = *(int *)req_data;
-    if( dsv != NULL && dsv->type == DSV_TYPE_INT_ARRAY )
+    if( var_validate( dsv, dsv->pid, &value, sizeof(value) ) != 0 )
     {
-        clock_gettime( CLOCK_REALTIME, &now );
-        dsv->timestamp = now;
-        dsv->dirty = 1;
+        return EDOM;
+    }
 
-        dsv_array_t *ai =  (dsv_array_t *)dsv->value.pArray;
-        (*ai)[index] = value;
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( index < 0 || (size_t)index >= ai->size() )
+    {
+        return EINVAL;
+    }
+    (*ai)[index] = value;
 
-        if( dsv->flags & DSV_FLAG_TRACK )
+    var_array_changed( dsv, DSV_DELTA_SET, index, 1, fwd_buf );
+    return 0;
+}
+
+int var_ins_item( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+    printf( "Enter %s\n", __func__ );
+
+    const char *req_data;
+    dsv_info_t *dsv = var_array_of( req_buf, &req_data );
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
+    int index = *(int *)req_data;
+    req_data += sizeof(index);
+    int value = *(int *)req_data;
+    if( var_validate( dsv, dsv->pid, &value, sizeof(value) ) != 0 )
+    {
+        return EDOM;
+    }
+
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( index < 0 || (size_t)index > ai->size() )
+    {
+        return EINVAL;
+    }
+    if( !var_array_room( ai->size() + 1 ) )
+    {
+        return EMSGSIZE;
+    }
+    ai->insert( std::next( ai->begin(), index ), value );
+
+    var_array_changed( dsv, DSV_DELTA_INS, index, 1, fwd_buf );
+    return 0;
+}
+
+int var_del_item( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+    printf( "Enter %s\n", __func__ );
+
+    const char *req_data;
+    dsv_info_t *dsv = var_array_of( req_buf, &req_data );
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
+    int index = *(int *)req_data;
+
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( index < 0 || (size_t)index >= ai->size() )
+    {
+        return EINVAL;
+    }
+    ai->erase( std::next( ai->begin(), index ) );
+
+    var_array_changed( dsv, DSV_DELTA_DEL, index, 1, fwd_buf );
+    return 0;
+}
+
+int var_get_item( const char *req_buf, char *rep_buf )
+{
+    assert( req_buf );
+    assert( rep_buf );
+    printf( "Enter %s\n", __func__ );
+
+    int rc = EINVAL;
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    dsv_info_t *dsv = var_from_handle( req_data );
+    int index = *(int *)(req_data + sizeof(dsv_info_t *));
+    if( dsv != NULL && dsv->type == DSV_TYPE_INT_ARRAY )
+    {
+        dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+        if( index < ai->size() )
         {
-            char buf[DSV_STRING_SIZE_MAX];
-            DSV_Value2Str( buf, DSV_STRING_SIZE_MAX, dsv );
-            dsvlog( LOG_NOTICE, "%s is changed to %s", dsv->pName, buf );
+            *(int *)rep_data = (*ai)[index];
+            rep->length += sizeof(int);
+            rc = 0;
         }
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Set count items from index of an INT_ARRAY dsv, the array grows when the
+    range goes beyond its end
+    request data: [handle][pid][index][count][count * int]
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    fwd_buf
+        forward buffer
+@return
+    0 for success, EINVAL for a bad dsv or range,
+    EMSGSIZE if the array would outgrow DSV_VALUE_SIZE_MAX
+==============================================================================*/
+int var_set_range( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+
+    const char *req_data;
+    dsv_info_t *dsv = var_array_of( req_buf, &req_data );
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
+
+    int index = *(int *)req_data;
+    req_data += sizeof(index);
+    int count = *(int *)req_data;
+    req_data += sizeof(count);
+
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( index < 0 || (size_t)index > ai->size() ||
+        !var_array_fits( req_buf, req_data, count ) )
+    {
+        return EINVAL;
+    }
+
+    if( !var_array_room( (size_t)index + count ) )
+    {
+        return EMSGSIZE;
+    }
+    if( var_validate( dsv, dsv->pid, req_data, count * sizeof(int) ) != 0 )
+    {
+        return EDOM;
+    }
+    if( (size_t)( index + count ) > ai->size() )
+    {
+        ai->resize( index + count );
+    }
+    memcpy( ai->data() + index, req_data, count * sizeof(int) );
+
+    var_array_changed( dsv, DSV_DELTA_SET, index, count, fwd_buf );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Append count items to the end of an INT_ARRAY dsv
+    request data: [handle][pid][count][count * int]
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    fwd_buf
+        forward buffer
+@return
+    0 for success, EINVAL for a bad dsv or count,
+    EMSGSIZE if the array would outgrow DSV_VALUE_SIZE_MAX
+==============================================================================*/
+int var_append_items( const char *req_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( fwd_buf );
+
+    const char *req_data;
+    dsv_info_t *dsv = var_array_of( req_buf, &req_data );
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
 
-        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
-        rc = 0;
+    int count = *(int *)req_data;
+    req_data += sizeof(count);
+    if( !var_array_fits( req_buf, req_data, count ) )
+    {
+        return EINVAL;
     }
-    return rc;
+
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( !var_array_room( ai->size() + count ) )
+    {
+        return EMSGSIZE;
+    }
+    if( var_validate( dsv, dsv->pid, req_data, count * sizeof(int) ) != 0 )
+    {
+        return EDOM;
+    }
+    int index = ai->size();
+    ai->insert( ai->end(), (int *)req_data, (int *)req_data + count );
+
+    var_array_changed( dsv, DSV_DELTA_INS, index, count, fwd_buf );
+    return 0;
 }
 
-int var_ins_item( const char *req_buf, char *fwd_buf )
+/*!=============================================================================
+
+    Delete count items from index of an INT_ARRAY dsv, a range going beyond
+    the end deletes up to the end
+    request data: [handle][pid][index][count]
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    fwd_buf
+        forward buffer
+@return
+    0 for success, EINVAL for a bad dsv or range
+==============================================================================*/
+int var_del_range( const char *req_buf, char *fwd_buf )
 {
     assert( req_buf );
     assert( fwd_buf );
-    printf( "Enter %s\n", __func__ );
 
-    int rc = EINVAL;
-    struct timespec now = { 0 };
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+    const char *req_data;
+    dsv_info_t *dsv = var_array_of( req_buf, &req_data );
+    if( dsv == NULL )
+    {
+        return EINVAL;
+    }
 
-    dsv_info_t *dsv = *(dsv_info_t **)req_data;
-    req_data += sizeof(dsv);
-    dsv->pid = *(pid_t *)req_data;
-    req_data += sizeof(pid_t);
     int index = *(int *)req_data;
     req_data += sizeof(index);
-    int value = *(int *)req_data;
-    if( dsv != NULL && dsv->type == DSV_TYPE_INT_ARRAY )
-    {
-        clock_gettime( CLOCK_REALTIME, &now );
-        dsv->timestamp = now;
-        dsv->dirty = 1;
+    int count = *(int *)req_data;
 
-        dsv_array_t *ai =  (dsv_array_t *)dsv->value.pArray;
-        auto it = ai->begin();
-        ai->insert( std::next( it, index ), value );
-        dsv->len = ai->size() * sizeof(int);
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( index < 0 || count < 0 || (size_t)index > ai->size() )
+    {
+        return EINVAL;
+    }
 
-        if( dsv->flags & DSV_FLAG_TRACK )
-        {
-            char buf[DSV_STRING_SIZE_MAX];
-            DSV_Value2Str( buf, DSV_STRING_SIZE_MAX, dsv );
-            dsvlog( LOG_NOTICE, "%s is changed to %s", dsv->pName, buf );
-        }
+    size_t end = std::min( (size_t)index + count, ai->size() );
+    ai->erase( ai->begin() + index, ai->begin() + end );
 
-        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
-        rc = 0;
-    }
-    return rc;
+    var_array_changed( dsv, DSV_DELTA_DEL, index, end - index, fwd_buf );
+    return 0;
 }
 
-int var_del_item( const char *req_buf, char *fwd_buf )
+/*!=============================================================================
+
+    Get up to count items from index of an INT_ARRAY dsv
+    request data: [handle][index][count]
+    reply data: [count got][count got * int]
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    rep_buf
+        reply buffer
+@return
+    0 for success, EINVAL for a bad dsv or range
+==============================================================================*/
+int var_get_range( const char *req_buf, char *rep_buf )
 {
     assert( req_buf );
-    assert( fwd_buf );
-    printf( "Enter %s\n", __func__ );
+    assert( rep_buf );
 
-    int rc = EINVAL;
-    struct timespec now = { 0 };
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     char *req_data = req->data;
 
-    dsv_info_t *dsv = *(dsv_info_t **)req_data;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    dsv_info_t *dsv = var_from_handle( req_data );
+    if( dsv == NULL || dsv->type != DSV_TYPE_INT_ARRAY )
+    {
+        return EINVAL;
+    }
     req_data += sizeof(dsv);
-    dsv->pid = *(pid_t *)req_data;
-    req_data += sizeof(pid_t);
     int index = *(int *)req_data;
-    if( dsv != NULL && dsv->type == DSV_TYPE_INT_ARRAY )
+    req_data += sizeof(index);
+    int count = *(int *)req_data;
+
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    if( index < 0 || count < 0 || (size_t)index > ai->size() )
     {
-        clock_gettime( CLOCK_REALTIME, &now );
-        dsv->timestamp = now;
-        dsv->dirty = 1;
+        return EINVAL;
+    }
 
-        dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
-        auto it = ai->begin();
-        ai->erase( std::next( it, index ) );
-        dsv->len = ai->size() * sizeof(int);
+    /* what fits in one reply, the client asks again for the rest */
+    size_t max = ( BUFSIZE - sizeof(dsv_msg_reply_t) - sizeof(int) ) / sizeof(int);
+    int got = (int)std::min( { (size_t)count, ai->size() - index, max } );
 
-        if( dsv->flags & DSV_FLAG_TRACK )
-        {
-            char buf[DSV_STRING_SIZE_MAX];
-            DSV_Value2Str( buf, DSV_STRING_SIZE_MAX, dsv );
-            dsvlog( LOG_NOTICE, "%s is changed to %s", dsv->pName, buf );
-        }
+    *(int *)rep_data = got;
+    rep_data += sizeof(got);
+    memcpy( rep_data, ai->data() + index, got * sizeof(int) );
+    rep->length += sizeof(got) + got * sizeof(int);
 
-        fill_fwd_buf( dsv->pName, dsv, fwd_buf );
-        rc = 0;
-    }
-    return rc;
+    return 0;
 }
 
-int var_get_item( const char *req_buf, char *rep_buf )
+/*!=============================================================================
+
+    Get the whole INT_ARRAY dsv with its version, as a DSV_DELTA_FULL delta,
+    for a subscriber which missed a delta
+    request data: [handle]
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    rep_buf
+        reply buffer
+@return
+    0 for success, EINVAL for a bad dsv
+==============================================================================*/
+int var_resync( const char *req_buf, char *rep_buf )
 {
     assert( req_buf );
     assert( rep_buf );
-    printf( "Enter %s\n", __func__ );
 
-    int rc = EINVAL;
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
-
     dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
     rep->length = sizeof(dsv_msg_reply_t);
 
-    dsv_info_t *dsv = *(dsv_info_t **)req_data;
-    int index = *(int *)(req_data + sizeof(dsv_info_t *));
-    if( dsv != NULL && dsv->type == DSV_TYPE_INT_ARRAY )
+    dsv_info_t *dsv = var_from_handle( req->data );
+    if( dsv == NULL || dsv->type != DSV_TYPE_INT_ARRAY )
     {
-        dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
-        if( index < ai->size() )
-        {
-            *(int *)rep_data = (*ai)[index];
-            rep->length += sizeof(int);
-            rc = 0;
-        }
+        return EINVAL;
     }
-    return rc;
+
+    dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+    rep->length += var_fill_delta( rep->data,
+                                   dsv,
+                                   DSV_DELTA_FULL,
+                                   0,
+                                   ai->size() );
+    return 0;
 }
 
 /**
@@ -478,13 +3302,76 @@ int var_get_handle( const char *req_buf, char *rep_buf )
     auto e = g_map.find( full_name );
     if( e != g_map.end() )
     {
-        *(void **)rep_data = e->second;
+        *(void **)rep_data = var_handle( (dsv_info_t *)e->second );
         rc = 0;
         rep->length += sizeof(void *);
     }
     return rc;
 }
 
+/*!=============================================================================
+
+    Add an alias to a dsv, eg the name of a dsv before it was renamed.
+    DSV_Handle() of the alias gives the handle of the dsv, so the clients
+    using either name read and write the same dsv. The forward buffer gets
+    the name of the dsv with no value, to replicate the dsv without
+    notifying the subscribers.
+
+@param[in]
+    req_buf
+        request: handle and alias, with or without the instance ID
+@param[out]
+    rep_buf
+        reply, no data
+@param[out]
+    fwd_buf
+        forward buffer
+@return
+    0 for success
+    ENOENT - bad handle
+    any other value returned by var_aliases_parse()
+==============================================================================*/
+int var_alias( const char *req_buf, char *rep_buf, char *fwd_buf )
+{
+    assert( req_buf );
+    assert( rep_buf );
+    assert( fwd_buf );
+
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    dsv_msg_forward_t *fwd = (dsv_msg_forward_t *)fwd_buf;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    dsv_info_t *dsv = var_from_handle( req->data );
+    if( dsv == NULL )
+    {
+        return ENOENT;
+    }
+
+    const char *alias = req->data + sizeof(void *);
+    std::string list( dsv->pAliases );
+    list += list.empty() ? alias : std::string( "," ) + alias;
+
+    /* parsed with the new alias appended, the old ones pass again */
+    char *old = dsv->pAliases;
+    std::vector< std::string > aliases;
+    dsv->pAliases = (char *)list.c_str();
+    int rc = var_aliases_parse( dsv, aliases );
+    dsv->pAliases = old;
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "invalid alias of %s: %s", dsv->pName, alias );
+        return rc;
+    }
+
+    var_aliases_index( dsv, aliases );
+
+    strcpy( fwd->data, dsv->pName );
+    fwd->length = 0;
+    fwd->blob = NULL;
+    return 0;
+}
+
 /**
  *
  */
@@ -502,7 +3389,7 @@ int var_get_type( const char *req_buf, char *rep_buf )
     char *rep_data = rep->data;
     rep->length = sizeof(dsv_msg_reply_t);
 
-    dsv_info_t *pDsv = *(dsv_info_t **)req_data;
+    dsv_info_t *pDsv = var_from_handle( req_data );
     if( pDsv != NULL )
     {
         *(int *)rep_data = pDsv->type;
@@ -529,37 +3416,341 @@ int var_get_len( const char *req_buf, char *rep_buf )
     char *rep_data = rep->data;
     rep->length = sizeof(dsv_msg_reply_t);
 
-    dsv_info_t *pDsv = *(dsv_info_t **)req_data;
-    if( pDsv != NULL )
+    dsv_info_t *pDsv = var_from_handle( req_data );
+    if( pDsv != NULL )
+    {
+        *(size_t *)rep_data = pDsv->len;
+        rc = 0;
+        rep->length += sizeof(size_t);
+    }
+    return rc;
+}
+
+int var_get( const char *req_buf, char *rep_buf )
+{
+    assert( req_buf );
+    assert( rep_buf );
+    printf( "Enter %s\n", __func__ );
+
+    int rc = EINVAL;
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    dsv_info_t *pDsv = var_from_handle( req_data );
+    if( pDsv != NULL )
+    {
+        rep->length += DSV_Memcpy( rep_data, pDsv );
+        rc = 0;
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Append a dsv to a page of a query: handle, type, length, name and the
+    value in the layout of DSV_Memcpy(). The entry is dropped if it takes
+    the page beyond DSV_PAGE_SIZE, unless the page is empty.
+
+@param[in,out]
+    rep_data
+        end of the page, moved after the entry
+@param[in]
+    page
+        start of the page
+@param[in]
+    dsv
+        dsv information
+@return
+    true if the dsv is in the page
+==============================================================================*/
+static bool var_page_add( char **rep_data, const char *page, dsv_info_t *dsv )
+{
+    char *p = *rep_data;
+
+    *(void **)p = var_handle( dsv );
+    p += sizeof(void *);
+    *(int *)p = dsv->type;
+    p += sizeof(int);
+    uint32_t *len = (uint32_t *)p;
+    p += sizeof(uint32_t);
+    strcpy( p, dsv->pName );
+    p += strlen( dsv->pName ) + 1;
+    *len = DSV_Memcpy( p, dsv );
+    p += *len;
+
+    if( *rep_data > page && p - page > DSV_PAGE_SIZE )
+    {
+        return false;
+    }
+    *rep_data = p;
+    return true;
+}
+
+/*!=============================================================================
+
+    Check the value of a dsv against the value predicate of a filter.
+    A numeric value is compared as a number, a string as a string, and other
+    values never match.
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    match
+        dsv_value_match_t
+@param[in]
+    value
+        value to compare with, in string form
+@return
+    true if the value matches
+==============================================================================*/
+static bool var_value_matches( dsv_info_t *dsv, int match, const char *value )
+{
+    int cmp;
+
+    if( match == DSV_VALUE_ANY )
+    {
+        return true;
+    }
+
+    if( dsv->type == DSV_TYPE_STR )
+    {
+        cmp = strcmp( dsv->value.pStr, value );
+    }
+    else
+    {
+        double x = 0;
+        double y = strtod( value, NULL );
+        if( var_numeric( dsv, [&x]( auto &v ) { x = (double)v; } ) != 0 )
+        {
+            return false;
+        }
+        cmp = ( x > y ) - ( x < y );
+    }
+
+    switch( match )
+    {
+    case DSV_VALUE_EQ: return cmp == 0;
+    case DSV_VALUE_NE: return cmp != 0;
+    case DSV_VALUE_LT: return cmp < 0;
+    case DSV_VALUE_LE: return cmp <= 0;
+    case DSV_VALUE_GT: return cmp > 0;
+    case DSV_VALUE_GE: return cmp >= 0;
+    default:
+        return false;
+    }
+}
+
+/*!=============================================================================
+
+    Check a dsv against a filter
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    filter
+        filter, its strings are in name, value
+@param[in]
+    name
+        name to match, the full name without the [instID] prefix
+@param[in]
+    value
+        value of the value predicate
+@param[in]
+    now
+        CLOCK_REALTIME
+@return
+    true if the dsv passes the filter
+==============================================================================*/
+static bool var_filter_matches( dsv_info_t *dsv,
+                                const dsv_msg_filter_t *filter,
+                                const char *name,
+                                const char *value,
+                                const struct timespec *now )
+{
+    if( filter->instID != DSV_INSTID_ANY && dsv->instID != filter->instID )
+    {
+        return false;
+    }
+    if( ( dsv->flags & filter->flags ) != filter->flags ||
+        ( dsv->flags & filter->no_flags ) != 0 )
+    {
+        return false;
+    }
+    if( filter->age != 0 &&
+        now->tv_sec - dsv->timestamp.tv_sec > (time_t)filter->age )
+    {
+        return false;
+    }
+
+    const char *path = strchr( dsv->pName, ']' );
+    path = path != NULL ? path + 1 : dsv->pName;
+    switch( filter->name_match )
+    {
+    case DSV_MATCH_ANY:
+        break;
+    case DSV_MATCH_EXACT:
+        if( strcmp( path, name ) != 0 )
+        {
+            return false;
+        }
+        break;
+    case DSV_MATCH_PREFIX:
+        if( strncmp( path, name, strlen( name ) ) != 0 )
+        {
+            return false;
+        }
+        break;
+    case DSV_MATCH_SUBSTR:
+        if( strstr( path, name ) == NULL )
+        {
+            return false;
+        }
+        break;
+    case DSV_MATCH_GLOB:
+        if( fnmatch( name, path, 0 ) != 0 )
+        {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    return var_value_matches( dsv, filter->value_match, value );
+}
+
+/*!=============================================================================
+
+    Get a page of the dsvs passing a filter. The dsvs are walked in the order
+    of their creation, or of the posting list of the tag of the filter, so
+    the cursor stays valid while dsvs are created or deleted.
+    request data: [cursor][dsv_msg_filter_t][name][tag][value]
+    reply data: as var_query_tag()
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    rep_buf
+        reply buffer of DSV_MSG_SIZE_MAX
+@return
+    0 for success
+==============================================================================*/
+int var_query_filter( const char *req_buf, char *rep_buf )
+{
+    assert( req_buf );
+    assert( rep_buf );
+
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    rep->length = sizeof(dsv_msg_reply_t);
+
+    const char *req_data = req->data;
+    uint32_t cursor = *(const uint32_t *)req_data;
+    req_data += sizeof(uint32_t);
+    const dsv_msg_filter_t *filter = (const dsv_msg_filter_t *)req_data;
+    req_data += sizeof(dsv_msg_filter_t);
+    const char *name = req_data;
+    req_data += strlen( req_data ) + 1;
+    const char *tag = req_data;
+    req_data += strlen( req_data ) + 1;
+    const char *value = req_data;
+
+    uint32_t *next = (uint32_t *)rep->data;
+    uint32_t *count = next + 1;
+    char *page = (char *)( count + 1 );
+    char *rep_data = page;
+    *count = 0;
+
+    static const std::vector< dsv_info_t * > none;
+    const std::vector< dsv_info_t * > *dsvs = &g_order;
+    if( tag[0] != '\0' )
     {
-        *(size_t *)rep_data = pDsv->len;
-        rc = 0;
-        rep->length += sizeof(size_t);
+        auto e = g_tag_ids.find( tag );
+        dsvs = e != g_tag_ids.end() ? &g_tag_dsvs[e->second] : &none;
     }
-    return rc;
+
+    struct timespec now = { 0 };
+    clock_gettime( CLOCK_REALTIME, &now );
+    size_t i = var_cursor_index( *dsvs, cursor );
+    for( ; i < dsvs->size(); i++ )
+    {
+        dsv_info_t *dsv = (*dsvs)[i];
+        if( var_filter_matches( dsv, filter, name, value, &now ) )
+        {
+            if( !var_page_add( &rep_data, page, dsv ) )
+            {
+                break;
+            }
+            (*count)++;
+        }
+    }
+
+    *next = var_cursor_next( *dsvs, i );
+    rep->length += rep_data - rep->data;
+    return 0;
 }
 
-int var_get( const char *req_buf, char *rep_buf )
+/*!=============================================================================
+
+    Get a page of the dsvs having a tag, from the posting list of the tag.
+    A page holds at least one dsv, and up to DSV_PAGE_SIZE bytes of them.
+    request data: [cursor][tag]
+    reply data: [next cursor, 0 after the last page][count]
+                count * [handle][type][len][name][value of len bytes]
+    The value is in the layout of DSV_Memcpy().
+
+@param[in]
+    req_buf
+        request buffer
+@param[out]
+    rep_buf
+        reply buffer of DSV_MSG_SIZE_MAX
+@return
+    0 for success, ENOENT for a tag no dsv has
+==============================================================================*/
+int var_query_tag( const char *req_buf, char *rep_buf )
 {
     assert( req_buf );
     assert( rep_buf );
-    printf( "Enter %s\n", __func__ );
 
-    int rc = EINVAL;
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
-
     dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
     rep->length = sizeof(dsv_msg_reply_t);
 
-    dsv_info_t *pDsv = *(dsv_info_t **)req_data;
-    if( pDsv != NULL )
+    uint32_t cursor = *(uint32_t *)req->data;
+    auto e = g_tag_ids.find( req->data + sizeof(uint32_t) );
+    if( e == g_tag_ids.end() )
     {
-        rep->length += DSV_Memcpy( rep_data, pDsv );
-        rc = 0;
+        return ENOENT;
     }
-    return rc;
+
+    const std::vector< dsv_info_t * > &dsvs = g_tag_dsvs[e->second];
+    uint32_t *next = (uint32_t *)rep->data;
+    uint32_t *count = next + 1;
+    char *page = (char *)( count + 1 );
+    char *rep_data = page;
+    *count = 0;
+
+    size_t i = var_cursor_index( dsvs, cursor );
+    for( ; i < dsvs.size(); i++ )
+    {
+        if( !var_page_add( &rep_data, page, dsvs[i] ) )
+        {
+            break;
+        }
+        (*count)++;
+    }
+
+    *next = var_cursor_next( dsvs, i );
+    rep->length += rep_data - rep->data;
+    return 0;
 }
 
 int var_get_next( const char *req_buf, char *rep_buf )
@@ -581,6 +3772,10 @@ int var_get_next( const char *req_buf, char *rep_buf )
     std::string search_name( req_data + sizeof( int ) );
     for( auto[dsv_name, dsv_info]: g_map )
     {
+        if( var_is_alias( dsv_name, dsv_info ) )
+        {
+            continue;
+        }
         if( dsv_name.find( search_name ) != -1 )
         {
             if( ++index > last_index )
@@ -623,7 +3818,8 @@ int var_notify( char *sub_buf, char *fwd_buf )
         /* fill the forward buffer */
         char *full_name( &sub_buf[1] );
         auto e = g_map.find( full_name );
-        if( e != g_map.end() )
+        /* notifications are published under the name of the dsv only */
+        if( e != g_map.end() && !var_is_alias( e->first, e->second ) )
         {
             dsv_info_t *pDsv = (dsv_info_t *)e->second;
             printf( "Subscribe %s\n", full_name );
@@ -643,7 +3839,7 @@ int var_save()
     int rc = -1;
     printf( "Enter %s\n", __func__ );
 
-    std::string filename{ DSV_SAVE_FILE };
+    std::string filename = var_save_file();
     std::fstream s{ filename, s.binary | s.in | s.out | s.app };
     char value_buf[DSV_STRING_SIZE_MAX];
 
@@ -656,6 +3852,10 @@ int var_save()
     dsv_info_t *pDsv;
     for( auto[dsv_name, dsv_info]: g_map )
     {
+        if( var_is_alias( dsv_name, dsv_info ) )
+        {
+            continue;
+        }
         dsv_info_t *pDsv = (dsv_info_t *)dsv_info;
         if( pDsv->dirty && (pDsv->flags & DSV_FLAG_SAVE) )
         {
@@ -679,15 +3879,20 @@ int var_save()
  * This function should be called after all dsvs are created
  * the dsv.save file should be like this
  * [123]/SYS/TEST/U16=16;[123]/SYS/TEST/U32=32;
+ * every restored dsv is forwarded by cb, so the subscribers and the standby
+ * get the restored value
  * @return
  * -1: fail
  */
-int var_restore()
+int var_restore( char *fwd_buf, void (*cb)( const dsv_msg_forward_t *fwd ) )
 {
+    assert( fwd_buf );
+    assert( cb );
+
     int rc = -1;
     printf( "Enter %s\n", __func__ );
 
-    std::string filename{ DSV_SAVE_FILE };
+    std::string filename = var_save_file();
 
     /* read entire file into string */
     if( std::ifstream ifs{ filename, ifs.binary | ifs.ate } )
@@ -713,8 +3918,29 @@ int var_restore()
             if( e != g_map.end() )
             {
                 dsv_info_t *pDsv = (dsv_info_t *)e->second;
-                DSV_Str2Value( sv_value.c_str(), pDsv );
+                void *data;
+                size_t size;
+                if( !DSV_TYPE_IS_BLOB( pDsv->type ) )
+                {
+                    DSV_Str2Value( sv_value.c_str(), pDsv );
+                }
+                else if( ( pDsv->type == DSV_TYPE_BLOB ?
+                           DSV_Str2Blob( sv_value.c_str(), &data, &size ) :
+                           DSV_Str2Items( pDsv->type,
+                                          sv_value.c_str(),
+                                          &data,
+                                          &size ) ) == 0 )
+                {
+                    /* the server keeps a blob reference counted */
+                    var_set_blob( pDsv, data, size );
+                    free( data );
+                }
                 pDsv->dirty = 1;
+                pDsv->version++;
+                clock_gettime( CLOCK_REALTIME, &pDsv->timestamp );
+                var_calc_touch( pDsv );
+                fill_fwd_buf( pDsv->pName, pDsv, fwd_buf );
+                cb( (const dsv_msg_forward_t *)fwd_buf );
             }
         }
 
@@ -759,6 +3985,10 @@ int var_track( const char *req_buf, const char *rep_buf )
 
     for( auto[dsv_name, dsv_info]: g_map )
     {
+        if( var_is_alias( dsv_name, dsv_info ) )
+        {
+            continue;
+        }
         if( dsv_name.find( search_name ) != -1 )
         {
             if( ++index > last_index )
@@ -787,3 +4017,439 @@ int var_track( const char *req_buf, const char *rep_buf )
 
 }
 
+/*!=============================================================================
+
+    Fill the DSV_REPLICA_CREATE data of a dsv, which is the handle and a
+    DSV_MSG_CREATE request carrying the current value, the same as
+    DSV_Create() sends.
+
+@param[in]
+    full_name
+        full dsv name
+@param[out]
+    data
+        buffer of DSV_MSG_SIZE_MAX to hold the data, the value alone may
+        take DSV_VALUE_SIZE_MAX
+@return
+    length of the data
+    -1 - dsv not found, or larger than DSV_MSG_SIZE_MAX
+==============================================================================*/
+int var_fill_replica( const char *full_name, char *data )
+{
+    assert( full_name );
+    assert( data );
+
+    auto e = g_map.find( full_name );
+    if( e == g_map.end() )
+    {
+        return -1;
+    }
+    dsv_info_t *dsv = (dsv_info_t *)e->second;
+
+    const char *strs[] = { dsv->pName,
+                           dsv->pDesc,
+                           dsv->pTags,
+                           dsv->pCalc,
+                           dsv->pRules,
+                           dsv->pAliases };
+    size_t size = sizeof(void *) + sizeof(dsv_msg_request_t) +
+                  sizeof(dsv_info_t) +
+                  ( dsv->type == DSV_TYPE_STR ? strlen( dsv->value.pStr ) + 1 :
+                                                dsv->len );
+    for( auto str : strs )
+    {
+        size += strlen( str ) + 1;
+    }
+    if( size > DSV_MSG_SIZE_MAX )
+    {
+        dsvlog( LOG_ERR, "too large to replicate: %s", full_name );
+        return -1;
+    }
+
+    *(void **)data = var_handle( dsv );
+    dsv_msg_request_t *req = (dsv_msg_request_t *)( data + sizeof(void *) );
+    char *req_data = req->data;
+    req->type = DSV_MSG_CREATE;
+    req->length = sizeof(dsv_msg_request_t);
+
+    memcpy( req_data, dsv, sizeof(dsv_info_t) );
+    req_data += sizeof(dsv_info_t);
+    req->length += sizeof(dsv_info_t);
+
+    for( auto str : strs )
+    {
+        strcpy( req_data, str );
+        req_data += strlen( str ) + 1;
+        req->length += strlen( str ) + 1;
+    }
+
+    if( dsv->type == DSV_TYPE_STR )
+    {
+        strcpy( req_data, dsv->value.pStr );
+        req->length += strlen( dsv->value.pStr ) + 1;
+    }
+    else if( dsv->type == DSV_TYPE_INT_ARRAY )
+    {
+        memcpy( req_data, ( (dsv_array_t *)dsv->value.pArray )->data(), dsv->len );
+        req->length += dsv->len;
+    }
+    else if( DSV_TYPE_IS_BLOB( dsv->type ) )
+    {
+        memcpy( req_data, ( (dsv_blob_t *)dsv->value.pBlob )->data, dsv->len );
+        req->length += dsv->len;
+    }
+
+    return sizeof(void *) + req->length;
+}
+
+/*!=============================================================================
+
+    Walk all the dsvs but the built-in ones, eg, to send a snapshot to a
+    new standby. The calculated dsvs come last, each one after its inputs.
+
+@param[in]
+    cb
+        callback invoked with the full name of each dsv
+@param[in]
+    arg
+        opaque argument passed to cb
+==============================================================================*/
+void var_for_each( void (*cb)( const char *full_name, void *arg ), void *arg )
+{
+    assert( cb );
+
+    std::vector< std::pair< uint32_t, const char * > > calcs;
+    for( auto &e : g_map )
+    {
+        /* a standby has built-in dsvs of its own */
+        if( var_is_alias( e.first, e.second ) ||
+            g_builtin.count( (dsv_info_t *)e.second ) != 0 )
+        {
+            continue;
+        }
+        auto c = g_calc.find( (dsv_info_t *)e.second );
+        if( c == g_calc.end() )
+        {
+            cb( e.first.c_str(), arg );
+        }
+        else
+        {
+            calcs.push_back( std::make_pair( c->second.rank, e.first.c_str() ) );
+        }
+    }
+
+    std::sort( calcs.begin(), calcs.end() );
+    for( auto &c : calcs )
+    {
+        cb( c.second, arg );
+    }
+}
+
+/*!=============================================================================
+
+    Replace the value of a dsv with the value in DSV_Memcpy() layout, or
+    apply the delta of an INT_ARRAY with DSV_FLAG_DELTA
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    value
+        value copied by DSV_Memcpy()
+==============================================================================*/
+static void var_apply_value( dsv_info_t *dsv, const char *value )
+{
+    struct timespec now = { 0 };
+
+    if( dsv->type == DSV_TYPE_STR )
+    {
+        free( dsv->value.pStr );
+        dsv->value.pStr = strdup( value );
+    }
+    else if( dsv->type == DSV_TYPE_INT_ARRAY &&
+             *(size_t *)value == DSV_DELTA_MARK )
+    {
+        /* the primary forwards deltas in order, no resync needed */
+        const dsv_delta_t *delta = (const dsv_delta_t *)value;
+        dsv_array_t *ai = (dsv_array_t *)dsv->value.pArray;
+        DSV_ApplyDelta( ai,
+                        delta,
+                        sizeof(dsv_delta_t) + delta->count * sizeof(int) );
+        dsv->version = delta->version;
+        dsv->len = ai->size() * sizeof(int);
+    }
+    else if( dsv->type == DSV_TYPE_INT_ARRAY )
+    {
+        dsv->len = *(size_t *)value;
+        value += sizeof(size_t);
+        delete (dsv_array_t *)dsv->value.pArray;
+        dsv->value.pArray = static_cast<void *>
+                            ( new dsv_array_t( (int *)value,
+                                               (int *)( value + dsv->len ) ) );
+    }
+    else if( DSV_TYPE_IS_BLOB( dsv->type ) )
+    {
+        var_set_blob( dsv, value + sizeof(size_t), *(size_t *)value );
+    }
+    else
+    {
+        memcpy( &dsv->value, value, sizeof(dsv_value_t) );
+    }
+
+    clock_gettime( CLOCK_REALTIME, &now );
+    dsv->timestamp = now;
+    dsv->dirty = 1;
+    var_history_record( dsv );
+    var_stats_record( dsv );
+}
+
+/*!=============================================================================
+
+    Apply DSV_REPLICA_CREATE on a standby. The dsv keeps the handle given by
+    the primary, and an existing dsv takes the value, as the primary sends
+    every dsv again when a standby resynchronizes.
+
+@param[in]
+    data
+        DSV_REPLICA_CREATE data filled by var_fill_replica()
+@return
+    0 for success, non-zero for failure
+==============================================================================*/
+int var_replica_create( const char *data )
+{
+    assert( data );
+
+    int rc;
+    void *hndl = *(void **)data;
+    const char *req_buf = data + sizeof(void *);
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    const dsv_info_t *info = (const dsv_info_t *)req->data;
+    const char *full_name = req->data + sizeof(dsv_info_t);
+
+    auto e = g_map.find( full_name );
+    if( e == g_map.end() )
+    {
+        /* nothing is forwarded by a standby, only sized for the value */
+        std::vector< char > fwd_buf( sizeof(dsv_msg_forward_t) +
+                                     strlen( full_name ) + 1 +
+                                     sizeof(void *) +
+                                     sizeof(dsv_delta_t) +
+                                     info->len );
+        rc = var_create( req_buf, fwd_buf.data() );
+        if( rc != 0 )
+        {
+            return rc;
+        }
+        e = g_map.find( full_name );
+    }
+    else
+    {
+        /* the value follows name, desc, tags, calc, rules and aliases */
+        const char *value = full_name;
+        for( int i = 0; i < 5; i++ )
+        {
+            value += strlen( value ) + 1;
+        }
+
+        /* the primary sends the dsv again after adding an alias */
+        dsv_info_t *dsv = (dsv_info_t *)e->second;
+        std::vector< std::string > aliases;
+        free( dsv->pAliases );
+        dsv->pAliases = strdup( value );
+        if( var_aliases_parse( dsv, aliases ) == 0 )
+        {
+            var_aliases_index( dsv, aliases );
+        }
+        value += strlen( value ) + 1;
+
+        if( DSV_TYPE_IS_BLOB( dsv->type ) )
+        {
+            var_set_blob( dsv, value, info->len );
+        }
+        else if( dsv->type == DSV_TYPE_INT_ARRAY )
+        {
+            /* in DSV_Memcpy() layout, length first */
+            std::vector< char > buf( sizeof(size_t) + info->len );
+            *(size_t *)buf.data() = info->len;
+            memcpy( buf.data() + sizeof(size_t), value, info->len );
+            var_apply_value( dsv, buf.data() );
+        }
+        else if( dsv->type == DSV_TYPE_STR )
+        {
+            var_apply_value( dsv, value );
+        }
+        else
+        {
+            var_apply_value( dsv, (const char *)&info->value );
+        }
+        dsv->flags = info->flags;
+    }
+
+    var_map_handle( (dsv_info_t *)e->second, hndl );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Apply DSV_REPLICA_UPDATE on a standby
+
+@param[in]
+    data
+        forward data filled by fill_fwd_buf(): name, handle and value
+@return
+    0 for success
+    ENOENT - the dsv is not created yet
+==============================================================================*/
+int var_replica_update( const char *data )
+{
+    assert( data );
+
+    auto e = g_map.find( data );
+    if( e == g_map.end() )
+    {
+        return ENOENT;
+    }
+
+    var_apply_value( (dsv_info_t *)e->second,
+                     data + strlen( data ) + 1 + sizeof(void *) );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Apply DSV_REPLICA_DELETE on a standby
+
+@param[in]
+    data
+        forward data filled by var_fill_removal(): name, NULL and handle
+@return
+    0 for success
+    ENOENT - the dsv is deleted already, eg with its dsv for a statistic
+    any other value returned by var_delete_dsvs()
+==============================================================================*/
+int var_replica_delete( const char *data )
+{
+    assert( data );
+
+    auto e = g_map.find( data );
+    if( e == g_map.end() || var_is_alias( e->first, e->second ) )
+    {
+        return ENOENT;
+    }
+
+    std::vector< dsv_info_t * > dsvs( 1, (dsv_info_t *)e->second );
+    return var_delete_dsvs( dsvs, NULL, NULL );
+}
+
+/*!=============================================================================
+
+    Get a read-only dsv published by the server itself, eg a metric of the
+    server, creating it on first use. Its value changes by var_builtin_set()
+    only, and it cannot be deleted.
+
+@param[in]
+    full_name
+        full dsv name, eg "[0]/SYS/DSV/STATS/DSVS"
+@param[in]
+    type
+        type of the dsv, numeric or a typed array
+@return
+    dsv information
+    NULL - out of memory
+==============================================================================*/
+dsv_info_t *var_builtin( const char *full_name, int type )
+{
+    assert( full_name );
+
+    dsv_info_t *dsv;
+    auto e = g_map.find( full_name );
+    if( e != g_map.end() )
+    {
+        dsv = (dsv_info_t *)e->second;
+    }
+    else
+    {
+        uint32_t instID = full_name[0] == '[' ?
+                          strtoul( full_name + 1, NULL, 10 ) : 0;
+        dsv = var_derived_new( full_name, instID, type );
+    }
+
+    if( dsv != NULL )
+    {
+        g_builtin.insert( dsv );
+    }
+    return dsv;
+}
+
+/*!=============================================================================
+
+    Set the value of a dsv of var_builtin() and fill its notification
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    value
+        new value, in the type of the dsv
+@param[in]
+    len
+        length of the value, the number of bytes of a typed array
+@param[out]
+    fwd_buf
+        forward buffer
+@return
+    0 for success
+    ENOMEM - out of memory
+==============================================================================*/
+int var_builtin_set( dsv_info_t *dsv,
+                     const void *value,
+                     size_t len,
+                     char *fwd_buf )
+{
+    assert( dsv );
+    assert( value );
+    assert( fwd_buf );
+
+    if( DSV_TYPE_IS_BLOB( dsv->type ) )
+    {
+        if( var_set_blob( dsv, value, len ) != 0 )
+        {
+            return ENOMEM;
+        }
+    }
+    else
+    {
+        memcpy( &dsv->value, value, std::min( len, sizeof(dsv_value_t) ) );
+    }
+
+    clock_gettime( CLOCK_REALTIME, &dsv->timestamp );
+    dsv->version++;
+    fill_fwd_buf( dsv->pName, dsv, fwd_buf );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Get the number of dsvs in the server, including the statistics and the
+    built-in dsvs
+
+@return
+    number of dsvs
+==============================================================================*/
+size_t var_count( void )
+{
+    return g_slots.size() - g_free_slots.size();
+}
+
+/*!=============================================================================
+
+    Get the number of writes rejected by the validation rules since the
+    server started
+
+@return
+    number of rejected writes
+==============================================================================*/
+uint64_t var_rejects( void )
+{
+    return g_rejects;
+}
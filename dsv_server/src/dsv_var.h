@@ -25,17 +25,55 @@ SOFTWARE.
 #ifndef DSV_VAR_H
 #define DSV_VAR_H
 
+void var_set_shard( uint32_t shard, uint32_t count );
+void var_use_handle_map( void );
+
+int var_fill_replica( const char *full_name, char *data );
+void var_for_each( void (*cb)( const char *full_name, void *arg ), void *arg );
+int var_replica_create( const char *data );
+int var_replica_update( const char *data );
+int var_replica_delete( const char *data );
+void var_stats_tick( int64_t now,
+                     char *fwd_buf,
+                     void (*cb)( const dsv_msg_forward_t *fwd ) );
+void var_calc_run( char *fwd_buf, void (*cb)( const dsv_msg_forward_t *fwd ) );
+void var_reject_run( char *fwd_buf, void (*cb)( const dsv_msg_forward_t *fwd ) );
+
+dsv_info_t *var_builtin( const char *full_name, int type );
+int var_builtin_set( dsv_info_t *dsv,
+                     const void *value,
+                     size_t len,
+                     char *fwd_buf );
+size_t var_count( void );
+uint64_t var_rejects( void );
+
 int var_create( const char *req_buf, char *fwd_buf );
+int var_create_batch( const char *req_buf,
+                      char *fwd_buf,
+                      void (*cb)( const dsv_msg_forward_t *fwd ) );
+int var_delete( const char *req_buf,
+                char *rep_buf,
+                char *fwd_buf,
+                void (*cb)( const dsv_msg_forward_t *fwd ) );
+int var_delete_prefix( const char *req_buf,
+                       char *rep_buf,
+                       char *fwd_buf,
+                       void (*cb)( const dsv_msg_forward_t *fwd ) );
 int var_set( const char *req_buf, char *fwd_buf );
+int var_fetch_add( const char *req_buf, char *rep_buf, char *fwd_buf );
+int var_cas( const char *req_buf, char *rep_buf, char *fwd_buf );
 
 int var_get( const char *req_buf, char *rep_buf );
 int var_get_handle( const char *req_buf, char *rep_buf );
+int var_alias( const char *req_buf, char *rep_buf, char *fwd_buf );
 int var_get_type( const char *req_buf, char *rep_buf );
 int var_get_len( const char *req_buf, char *rep_buf );
 int var_get_next( const char *req_buf, char *rep_buf );
+int var_query_tag( const char *req_buf, char *rep_buf );
+int var_query_filter( const char *req_buf, char *rep_buf );
 int var_notify( char *sub_buf, char *fwd_buf );
 int var_save();
-int var_restore();
+int var_restore( char *fwd_buf, void (*cb)( const dsv_msg_forward_t *fwd ) );
 int var_track( const char *req_buf, const char *rep_buf );
 
 int var_get_item( const char *req_buf, char *rep_buf );
@@ -43,4 +81,11 @@ int var_set_item( const char *req_buf, char *fwd_buf );
 int var_ins_item( const char *req_buf, char *fwd_buf );
 int var_add_item( const char *req_buf, char *fwd_buf );
 int var_del_item( const char *req_buf, char *fwd_buf );
+
+int var_set_range( const char *req_buf, char *fwd_buf );
+int var_append_items( const char *req_buf, char *fwd_buf );
+int var_del_range( const char *req_buf, char *fwd_buf );
+int var_get_range( const char *req_buf, char *rep_buf );
+int var_resync( const char *req_buf, char *rep_buf );
+int var_get_history( const char *req_buf, char *rep_buf );
 #endif // DSV_VAR_H
@@ -32,25 +32,79 @@ SOFTWARE.
 #include <time.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <future>
+#include <vector>
+#include <atomic>
 
 #ifndef BUFSIZE
     #define BUFSIZE                 (64 * 1024)
 #endif
 
+/*! largest frame of a message, larger messages are sent in several frames */
+#define DSV_CHUNK_SIZE              BUFSIZE
+
+/*! the maximum length of a STR, INT_ARRAY or BLOB value in bytes */
+#define DSV_VALUE_SIZE_MAX          (16 * 1024 * 1024)
+
+/*! the maximum length of any message, a value and its name and headers */
+#define DSV_MSG_SIZE_MAX            ( DSV_VALUE_SIZE_MAX + BUFSIZE )
+
 /*! the maximum length of any string in dsv, eg name, desc, tags, value, ... */
 #define DSV_STRING_SIZE_MAX         (128)
 
 /*! maximum number of dsv supported */
 #define DSV_VRAS_NUM_MAX            (16 * 1024)
 
-/*! maximum jason file size */
-#define DSV_JSON_FILE_SIZE_MAX      (2 * 1024 * 1024)
-
 /*! dsv flags */
 #define DSV_FLAG_SAVE               (1)
 
 #define DSV_FLAG_TRACK              (1 << 1)
 
+/*! INT_ARRAY notifications carry the changed items only, see dsv_delta_t */
+#define DSV_FLAG_DELTA              (1 << 2)
+
+/*! set by the server only, eg on the statistics of a dsv with stats=W */
+#define DSV_FLAG_READONLY           (1 << 3)
+
+/*! name of the notifications of rejected writes, followed by the pid of the
+ *  writer, see DSV_SubRejects() */
+#define DSV_REJECT_TOPIC            "!REJECT/"
+
+/*! first chunk of an INT_ARRAY value holding a dsv_delta_t, instead of the
+ *  data length in bytes */
+#define DSV_DELTA_MARK              ( (size_t)-1 )
+
+/*! maximum number of INT_ARRAY items in one range message */
+#define DSV_ARRAY_RANGE_MAX         ( (int)( ( BUFSIZE - 256 ) / sizeof(int) ) )
+
+/*! the value is kept as bytes in a dsv_blob_t by the server */
+#define DSV_TYPE_IS_BLOB( t )       ( (t) == DSV_TYPE_BLOB || \
+                                      ( (t) >= DSV_TYPE_UINT8_ARRAY && \
+                                        (t) < DSV_TYPE_MAX ) )
+
+/*! maximum number of samples in the history of a dsv */
+#define DSV_HISTORY_MAX             (64 * 1024)
+
+/*! maximum seconds of the window of the statistics of a dsv */
+#define DSV_STATS_WINDOW_MAX        (24 * 3600)
+
+/*! bytes of the dsvs in one reply of a paged query, eg DSV_QueryByTag(),
+ *  so that a page fits in one frame */
+#define DSV_PAGE_SIZE               ( BUFSIZE - 256 )
+
+/*! bytes of the create requests packed in one message by DSV_CreateBatch() */
+#define DSV_BATCH_SIZE              ( 16 * BUFSIZE )
+
+/*! instance ID of dsv_filter_t matching any instance */
+#define DSV_INSTID_ANY              ( 0xFFFFFFFFu )
+
+/*! the metrics of the server are built-in dsvs under this name, those of
+ *  shard n of a cluster under DSV_STATS_PREFIX "n/" */
+#define DSV_STATS_PREFIX            "[0]/SYS/DSV/STATS/"
+
+/*! maximum number of dsv servers in a sharded cluster */
+#define DSV_SHARD_MAX               (8)
+
 
 typedef enum dsv_type
 {
@@ -80,7 +134,29 @@ typedef enum dsv_type
 
     DSV_TYPE_SINT8 = 12,
 
-    DSV_TYPE_MAX = 13
+    /*! raw bytes, may hold NUL */
+    DSV_TYPE_BLOB = 13,
+
+    /*! arrays of the numeric types, kept as a BLOB in the server */
+    DSV_TYPE_UINT8_ARRAY = 14,
+
+    DSV_TYPE_SINT8_ARRAY = 15,
+
+    DSV_TYPE_UINT16_ARRAY = 16,
+
+    DSV_TYPE_SINT16_ARRAY = 17,
+
+    DSV_TYPE_UINT32_ARRAY = 18,
+
+    DSV_TYPE_UINT64_ARRAY = 19,
+
+    DSV_TYPE_SINT64_ARRAY = 20,
+
+    DSV_TYPE_FLOAT_ARRAY = 21,
+
+    DSV_TYPE_DOUBLE_ARRAY = 22,
+
+    DSV_TYPE_MAX = 23
 
 } dsv_type_t;
 
@@ -98,6 +174,57 @@ typedef enum dsv_notification
 
 } dsv_notification_t;
 
+/*! how the name of dsv_filter_t matches the names of the dsvs, without
+ *  their [instID] prefix */
+typedef enum dsv_match
+{
+    DSV_MATCH_ANY = 0,
+
+    DSV_MATCH_EXACT = 1,
+
+    DSV_MATCH_PREFIX = 2,
+
+    DSV_MATCH_SUBSTR = 3,
+
+    /*! shell wildcards, see fnmatch(3) */
+    DSV_MATCH_GLOB = 4
+
+} dsv_match_t;
+
+/*! how the values of the dsvs compare with the value of dsv_filter_t */
+typedef enum dsv_value_match
+{
+    DSV_VALUE_ANY = 0,
+
+    DSV_VALUE_EQ = 1,
+
+    DSV_VALUE_NE = 2,
+
+    DSV_VALUE_LT = 3,
+
+    DSV_VALUE_LE = 4,
+
+    DSV_VALUE_GT = 5,
+
+    DSV_VALUE_GE = 6
+
+} dsv_value_match_t;
+
+/*! validation rule broken by a rejected write */
+typedef enum dsv_rule
+{
+    DSV_RULE_NONE = 0,
+
+    DSV_RULE_MIN = 1,
+
+    DSV_RULE_MAX = 2,
+
+    DSV_RULE_ENUM = 3,
+
+    DSV_RULE_REGEX = 4
+
+} dsv_rule_t;
+
 
 typedef union dsv_value
 {
@@ -107,6 +234,10 @@ typedef union dsv_value
     /*! used for array */
     void *pArray;
 
+    /*! used for blob, the bytes given to DSV_Create, a dsv_blob_t in the
+     *  server */
+    void *pBlob;
+
     uint16_t u16;
 
     int16_t s16;
@@ -129,6 +260,142 @@ typedef union dsv_value
 
 }dsv_value_t;
 
+typedef enum dsv_delta_op
+{
+    /*! replace the whole array by the items */
+    DSV_DELTA_FULL = 0,
+
+    /*! set count items from index, the array grows beyond its end */
+    DSV_DELTA_SET = 1,
+
+    /*! insert count items at index */
+    DSV_DELTA_INS = 2,
+
+    /*! delete count items from index */
+    DSV_DELTA_DEL = 3
+
+} dsv_delta_op_t;
+
+/*! change of an INT_ARRAY dsv with DSV_FLAG_DELTA. version is incremented by
+ *  every change, a receiver missing one must resynchronize with a full copy */
+typedef struct dsv_delta
+{
+    /*! DSV_DELTA_MARK */
+    size_t mark;
+
+    uint32_t version;
+
+    int op;
+
+    int index;
+
+    int count;
+
+    /*! count items, none for DSV_DELTA_DEL */
+    int items[0];
+
+} dsv_delta_t;
+
+/*! value of a BLOB dsv in the server. The notifications in flight hold a
+ *  reference to it, so a fan-out never copies the bytes */
+typedef struct dsv_blob
+{
+    std::atomic< int > refs;
+
+    size_t len;
+
+    /*! aligned for the items of a typed array */
+    alignas( 16 ) char data[0];
+
+} dsv_blob_t;
+
+/*! notification received by DSV_RecvNotification(), pointing into the
+ *  message received from the server */
+typedef struct dsv_notice
+{
+    /*! name of the dsv */
+    const char *name;
+
+    /*! handle of the dsv, NULL when the dsv is deleted, then value holds
+     *  the handle it had, see DSV_Delete() */
+    void *hndl;
+
+    /*! the bytes of a BLOB, any other value in the layout of DSV_Memcpy() */
+    const void *value;
+
+    size_t len;
+
+    /*! message holding the notification, see DSV_ReleaseNotification() */
+    void *msg;
+
+} dsv_notice_t;
+
+/*! samples of the history of a numeric dsv got by DSV_GetHistory(), oldest
+ *  first. The values are packed in the type of the dsv, eg a float * */
+typedef struct dsv_history
+{
+    /*! dsv type of the values */
+    int type;
+
+    /*! number of samples */
+    size_t count;
+
+    /*! CLOCK_REALTIME of the samples in ns */
+    std::vector< int64_t > stamps;
+
+    std::vector< char > values;
+
+} dsv_history_t;
+
+/*! value of the notification of a write rejected by the validation rules of
+ *  a dsv, see DSV_SubRejects() */
+typedef struct dsv_reject
+{
+    /*! writes of the dsv rejected so far, by any writer */
+    uint64_t rejects;
+
+    /*! dsv_rule_t broken */
+    int rule;
+
+    /*! full name of the dsv */
+    char name[0];
+
+} dsv_reject_t;
+
+/*! filter of DSV_QueryByFilter(), a dsv must pass all the conditions */
+typedef struct dsv_filter
+{
+    /*! DSV_INSTID_ANY for any instance */
+    uint32_t instID;
+
+    /*! dsv_match_t */
+    int name_match;
+
+    /*! name without [instID], or pattern, eg the /SYS/ prefix or a glob of
+     *  the names under /SYS/ */
+    const char *name;
+
+    /*! one tag, NULL for any */
+    const char *tag;
+
+    /*! flags the dsv has all of */
+    uint32_t flags;
+
+    /*! flags the dsv has none of */
+    uint32_t no_flags;
+
+    /*! dsv_value_match_t. A numeric value is compared as a number, a string
+     *  as a string, other values never match */
+    int value_match;
+
+    /*! value in string form */
+    const char *value;
+
+    /*! changed within the last age seconds, 0 for any time */
+    uint32_t age;
+
+} dsv_filter_t;
+
 typedef struct dsv_info
 {
     /*! pointer of the dsv name */
@@ -140,6 +407,18 @@ typedef struct dsv_info
     /*! pointer of dsv tags, delimiter with , */
     char *pTags;
 
+    /*! expression of a calculated dsv, eg "[123]/P1 * [123]/V1", empty or
+     *  NULL for none */
+    char *pCalc;
+
+    /*! validation rules as a JSON object with any of "min", "max", "enum"
+     *  and "regex", empty or NULL for none */
+    char *pRules;
+
+    /*! other names of the dsv, delimiter with , eg names used by older
+     *  releases, empty or NULL for none */
+    char *pAliases;
+
     /*! 32-bit instance identifier */
     uint32_t instID;
 
@@ -152,6 +431,15 @@ typedef struct dsv_info
     /*! dsv flags, like save, track, hide... */
     uint32_t flags;
 
+    /*! incremented by every change of a dsv with DSV_FLAG_DELTA */
+    uint32_t version;
+
+    /*! number of samples kept in the history of a numeric dsv, 0 for none */
+    uint32_t history;
+
+    /*! seconds of the window of the statistics of a numeric dsv, 0 for none */
+    uint32_t stats;
+
     /*! consider using bit fileds to indicate it */
     struct
     {
@@ -170,16 +458,82 @@ typedef struct dsv_info
 }dsv_info_t;
 
 /*! internal structure maintained by the library to manage connections with
- * the dsv server */
+ * the dsv server. The context can be shared by threads: each thread gets its
+ * own request and publish sockets on the shared zmq_ctx the first time it
+ * uses the context. Notifications are received by one thread only. */
 typedef struct dsv_context
 {
     void *zmq_ctx;
-    void *sock_request;
-    void *sock_publish;
     void *sock_subscribe;
 
+    /*! serial number, tells a context apart from a freed one at same address */
+    uint64_t serial;
+
+    /*! endpoints the per-thread sockets connect to */
+    char reply_url[DSV_STRING_SIZE_MAX];
+    char frontend_url[DSV_STRING_SIZE_MAX];
+
+    /*! sockets of all threads using the context */
+    void *pool;
+
+    /*! index of the shard this context is connected to */
+    uint32_t shard;
+
+    /*! number of shards, only set in the context returned by DSV_Open */
+    uint32_t shard_count;
+
+    /*! contexts of all the shards indexed by shard, the first one is the
+     *  context returned by DSV_Open and owns the others */
+    struct dsv_context **shards;
+
+    /*! consistent hash ring mapping instance IDs to shards */
+    void *ring;
+
+    /*! local copies of DSV_FLAG_DELTA arrays the deltas are applied to */
+    void *mirrors;
+
 } dsv_context_t;
 
+/*! a dsv server announced by the discovery beacon, one shard of a cluster.
+ * A standalone server is shard 0 of 1 */
+typedef struct dsv_server
+{
+    char ip[64];
+
+    /*! port of the reply socket, the backend and frontend ports follow it */
+    uint16_t port;
+
+    /*! index of the shard in the cluster */
+    uint8_t shard;
+
+    /*! number of shards in the cluster */
+    uint8_t count;
+
+} dsv_server_t;
+
+/*! callback invoked when the reply of an asynchronous request arrives.
+ * value has the same layout as the reply of DSV_Get and is only valid
+ * during the callback. result is ECANCELED if the context is closed first */
+typedef void (*dsv_reply_cb_t)( uint32_t id,
+                                int result,
+                                const void *value,
+                                size_t len,
+                                void *arg );
+
+/*! callback invoked for each dsv found by a query, eg DSV_QueryByTag().
+ * value is in the layout of DSV_Memcpy() and is only valid during the
+ * callback. Returning non-zero stops the query */
+typedef int (*dsv_query_cb_t)( void *hndl,
+                               const char *name,
+                               int type,
+                               const void *value,
+                               size_t len,
+                               void *arg );
+
+/*! callback invoked for each dsv parsed by DSV_ParseJson(), which owns the
+ * strings and the value of the dsv. Returning non-zero stops the parsing */
+typedef int (*dsv_parse_cb_t)( dsv_info_t *dsv, void *arg );
+
 /*==============================================================================
                            Function Declarations
 ==============================================================================*/
@@ -190,12 +544,44 @@ void DSV_Close( void *ctx );
 /* create a single dsv with dsv_info_t */
 int DSV_Create( void *ctx, uint32_t instID, dsv_info_t *pDsv );
 
+/* create many dsvs with few messages */
+int DSV_CreateBatch( void *ctx, dsv_info_t *dsvs, size_t count );
+
+/* parse a JSON schema one entry at a time, cb frees each dsv by
+ * DSV_FreeInfo */
+int DSV_ParseJson( uint32_t instID,
+                   const char *buf,
+                   size_t size,
+                   dsv_parse_cb_t cb,
+                   void *arg );
+void DSV_FreeInfo( dsv_info_t *pDsv );
+
+/* compile a JSON schema into a binary schema, see dsv_schemac */
+int DSV_CompileSchema( const char *json_file, const char *schema_file );
+
+/* create the dsvs of a binary schema, mapped instead of parsed */
+int DSV_CreateWithSchema( void *ctx, uint32_t instID, const char *file );
+
 /* create a batch of dsv with JSON file */
 int DSV_CreateWithJson( void *ctx, uint32_t instID, const char *file );
 
 /* query the handle of dsv */
 void *DSV_Handle( void *ctx, const char *name );
 
+/* add another name to a dsv, its handle is the handle of the dsv */
+int DSV_Alias( void *ctx, void *hndl, const char *alias );
+
+/* delete dsvs and release their memory in the server, the subscribers get a
+ * notification with a NULL handle */
+int DSV_Delete( void *ctx, void *hndl );
+int DSV_DeleteByPrefix( void *ctx, const char *prefix, size_t *count );
+
+/* pipelined handle query, the reply value passed to cb holds the handle */
+uint32_t DSV_HandleAsync( void *ctx,
+                          const char *name,
+                          dsv_reply_cb_t cb,
+                          void *arg );
+
 /* query the type of dsv */
 int DSV_Type( void *ctx, void *hndl );
 
@@ -228,6 +614,50 @@ int DSV_Get( void *ctx, void *hndl, void *value, size_t size );
 template<typename T>
 int DSV_Get( void *ctx, void *hndl, T *value );
 
+/* dsv is numeric type, add delta inside the server without waiting */
+template<typename T>
+int DSV_Incr( void *ctx, void *hndl, T delta );
+
+/* dsv is numeric type, add delta inside the server, get the value before */
+template<typename T>
+int DSV_FetchAdd( void *ctx, void *hndl, T delta, T *old );
+
+/* dsv is numeric type, set desired only if the value equals expected */
+template<typename T>
+int DSV_CompareAndSet( void *ctx, void *hndl, T *expected, T desired );
+
+/* dsv is numeric type, get the samples of its history between t0 and t1 */
+int DSV_GetHistory( void *ctx,
+                    void *hndl,
+                    const struct timespec *t0,
+                    const struct timespec *t1,
+                    dsv_history_t *out );
+
+/* get the handles and values of the dsvs having a tag, in pages */
+int DSV_QueryByTag( void *ctx, const char *tag, dsv_query_cb_t cb, void *arg );
+
+/* get the handles and values of the dsvs passing a filter, in pages */
+int DSV_QueryByFilter( void *ctx,
+                       const dsv_filter_t *filter,
+                       dsv_query_cb_t cb,
+                       void *arg );
+
+/* pipelined get, return request id, the reply is passed to cb by DSV_Dispatch */
+uint32_t DSV_GetAsync( void *ctx, void *hndl, dsv_reply_cb_t cb, void *arg );
+
+/* dsv is numeric type, pipelined get, the future waits for the reply */
+template<typename T>
+std::future<T> DSV_GetAsync( void *ctx, void *hndl );
+
+/* receive replies of asynchronous requests and invoke their callbacks */
+int DSV_Dispatch( void *ctx, int timeout );
+
+/* request socket of the calling thread, to be polled before DSV_Dispatch */
+void *DSV_RequestSocket( void *ctx );
+
+/* request sockets of the calling thread to every shard */
+int DSV_RequestSockets( void *ctx, void **socks, int max );
+
 /* get notifications of subscribed dsvs*/
 int DSV_GetNotification( void *ctx,
                          void **hndl,
@@ -235,6 +665,11 @@ int DSV_GetNotification( void *ctx,
                          size_t nlen,
                          void *value,
                          size_t vlen );
+/* get a notification without copying it, release it once used */
+int DSV_RecvNotification( void *ctx, dsv_notice_t *notice );
+void DSV_ReleaseNotification( dsv_notice_t *notice );
+/* apply a delta notification in place, for readers of the subscribe socket */
+int DSV_DecodeNotification( void *ctx, std::vector< char > &msg );
 /* persist changed dsvs */
 int DSV_Save( void *ctx );
 
@@ -248,11 +683,26 @@ int DSV_DelItemFromArray( void *ctx, void *hndl, int index );
 int DSV_AddItemToArray( void *ctx, void *hndl, int value );
 int DSV_GetItemFromArray( void *ctx, void *hndl, int index, int *value );
 
+/* range operations, applied by the server in one message and notification */
+int DSV_SetArrayRange( void *ctx,
+                       void *hndl,
+                       int index,
+                       const int *values,
+                       int count );
+int DSV_AppendItems( void *ctx, void *hndl, const int *values, int count );
+int DSV_DeleteRange( void *ctx, void *hndl, int index, int count );
+int DSV_GetArrayRange( void *ctx,
+                       void *hndl,
+                       int index,
+                       int *values,
+                       int *count );
+
 /* helper functions */
 /* TODO: provide helper funtions to support set by name, but with real value */
 int DSV_SetByName( void *ctx, const char *name, char *value );
 int DSV_GetByName( void *ctx, const char *name, char *value, size_t size );
 int DSV_SubByName( void *ctx, const char *name );
+int DSV_SubRejects( void *ctx );
 int DSV_GetByNameFuzzy( void *ctx,
                         const char *search_name,
                         int last_index,
@@ -270,20 +720,55 @@ void strtoupper(char *str);
 void *memdup( const void *buf, size_t count );
 void DSV_PrintArray( void *value, char *buffer, size_t size );
 int DSV_Memcpy( void *dest, dsv_info_t *dsv );
+int DSV_ApplyDelta( void *array, const dsv_delta_t *delta, size_t len );
 int DSV_Str2Value( const char *str, dsv_info_t *pDsv );
 int DSV_Str2Array( const char *input, void **data, size_t *size );
+int DSV_Str2Blob( const char *input, void **data, size_t *size );
+void DSV_PrintBlob( const void *value, char *buffer, size_t size );
+int DSV_ItemType( int type );
+int DSV_Str2Items( int type, const char *input, void **data, size_t *size );
+int DSV_Items2Str( int type,
+                   const void *items,
+                   size_t len,
+                   char *buffer,
+                   size_t size );
+void DSV_PrintItems( int type, const void *value, char *buffer, size_t size );
+dsv_blob_t *DSV_BlobNew( const void *data, size_t len );
+void DSV_BlobRelease( void *data, void *hint );
 int DSV_Array2Str( char *buf, size_t len, const dsv_info_t *pDsv );
 int DSV_Value2Str( char *buf, size_t len, const dsv_info_t *pDsv );
 int DSV_Double2Value( double df, dsv_info_t *pDsv );
 dsv_type_t DSV_GetTypeFromStr( const char *type_str );
 uint32_t DSV_GetFlagsFromStr( const char *flags_str );
+uint32_t DSV_GetHistoryFromStr( const char *flags_str );
+uint32_t DSV_GetStatsFromStr( const char *flags_str );
 int DSV_GetSizeFromType( int type );
 void DSV_Print( const dsv_info_t *pDsv );
 
+/* messages of any size, sent in frames of DSV_CHUNK_SIZE */
+int DSV_SendChunks( void *sock, const void *buf, size_t len, int flags );
+int DSV_RecvChunks( void *sock, std::vector< char > &msg, int flags );
+int DSV_RecvChunksInto( void *sock, char *buf, size_t size, int flags );
+
 /* dsv discovery */
 int DSV_FindDiscoveryServer( char *server_ip, size_t size );
-void *DSV_RunDiscoveryServer();
+int DSV_DiscoverServers( dsv_server_t *servers, size_t max );
+int DSV_FindServer( dsv_server_t *servers, size_t max, bool use_cache );
+void DSV_ForgetServer( void );
+void *DSV_RunDiscoveryServer( uint8_t shard, uint8_t count, uint16_t port );
+void DSV_EndpointUrl( char *url,
+                      size_t size,
+                      const char *host,
+                      uint16_t port,
+                      bool ipc );
+int DSV_IpcPrepare( void );
 uint32_t DSV_GetInstID( const char *if_name );
+int DSV_IsLocalIP( const char *ip );
+
+/* dsv sharding */
+void *DSV_ShardRingNew( uint32_t count );
+void DSV_ShardRingFree( void *ring );
+uint32_t DSV_ShardOf( const void *ring, const char *name );
 
 #if 0
 
@@ -0,0 +1,351 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+#ifndef DSV_CORO_H
+#define DSV_CORO_H
+
+/*==============================================================================
+ Includes
+ =============================================================================*/
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <system_error>
+#include "dsv.h"
+
+/*==============================================================================
+                              Coroutine API
+
+    A reactor drives one dsv context from the thread that constructs it. The
+    awaitables below send pipelined requests and suspend, the reactor resumes
+    them from its own thread when the reply or the notification arrives:
+
+        dsv::task driver()
+        {
+            void *h = co_await dsv::handle( "[123]/SYS/TEST/U32" );
+            uint32_t u32 = co_await dsv::get<uint32_t>( h );
+            dsv::change c = co_await dsv::next_change( h );
+            ...
+        }
+
+        dsv::reactor r( DSV_Open() );
+        driver();
+        r.run();
+
+    Errors are thrown as std::system_error from co_await.
+==============================================================================*/
+namespace dsv
+{
+
+/*! fire-and-forget coroutine, started eagerly and freed when it finishes */
+struct task
+{
+    struct promise_type
+    {
+        task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+/*! a notification of a subscribed dsv */
+struct change
+{
+    void *hndl;
+    std::string name;
+
+    /*! raw value, same layout as the value of DSV_GetNotification */
+    std::vector< char > value;
+
+    /*! value of numeric type of dsv */
+    template< typename T >
+    T as() const
+    {
+        T v{};
+        memcpy( &v, value.data(), value.size() < sizeof(T) ? value.size() : sizeof(T) );
+        return v;
+    }
+
+    /*! value of string type of dsv */
+    const char *str() const { return value.data(); }
+};
+
+class reactor
+{
+public:
+    /*! bind the reactor to ctx and to the calling thread */
+    explicit reactor( void *ctx );
+    ~reactor();
+
+    reactor( const reactor & ) = delete;
+    reactor &operator=( const reactor & ) = delete;
+
+    /*! reactor of the calling thread, NULL if there is none */
+    static reactor *current();
+
+    void *context() const { return m_ctx; }
+
+    /*! wait up to timeout ms and resume whatever is ready, -1 on failure */
+    int run_once( int timeout );
+
+    /*! resume coroutines until stop() is called, -1 on failure */
+    int run();
+
+    /*! make run() return, normally called by a coroutine */
+    void stop() { m_stop = true; }
+
+    /*! remember the name of a handle, so next_change can subscribe it */
+    void watch( void *hndl, const char *name );
+
+    /*! park h until the next notification of hndl is stored into out */
+    int wait_change( void *hndl, std::coroutine_handle<> h, change *out );
+
+private:
+    struct waiter
+    {
+        std::coroutine_handle<> h;
+        change *out;
+    };
+
+    int handle_notifications();
+
+    void *m_ctx;
+    bool m_stop;
+    reactor *m_prev;
+    std::unordered_map< void *, std::string > m_names;
+    std::unordered_set< void * > m_subscribed;
+    std::unordered_multimap< void *, waiter > m_waiters;
+};
+
+/*! base of the awaitables completed by a dsv reply callback */
+class reply_awaiter
+{
+public:
+    explicit reply_awaiter( reactor *r )
+        : m_reactor( r ), m_result( EINVAL ), m_value{}
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+protected:
+    static void on_reply( uint32_t id,
+                          int result,
+                          const void *value,
+                          size_t len,
+                          void *arg )
+    {
+        reply_awaiter *self = (reply_awaiter *)arg;
+        self->m_result = result;
+        if( result == 0 && value != NULL )
+        {
+            memcpy( &self->m_value,
+                    value,
+                    len < sizeof(dsv_value_t) ? len : sizeof(dsv_value_t) );
+        }
+        self->m_handle.resume();
+    }
+
+    /*! resume immediately when the request cannot be sent */
+    bool suspend_on( uint32_t id )
+    {
+        if( id == 0 )
+        {
+            m_result = EFAULT;
+            return false;
+        }
+        return true;
+    }
+
+    void check() const
+    {
+        if( m_reactor == NULL )
+        {
+            throw std::system_error( ENXIO, std::generic_category() );
+        }
+        if( m_result != 0 )
+        {
+            throw std::system_error( m_result, std::generic_category() );
+        }
+    }
+
+    reactor *m_reactor;
+    std::coroutine_handle<> m_handle;
+    int m_result;
+    dsv_value_t m_value;
+};
+
+/*! co_await dsv::get<T>( hndl ) */
+template< typename T >
+class get_awaiter : public reply_awaiter
+{
+public:
+    get_awaiter( reactor *r, void *hndl ) : reply_awaiter( r ), m_hndl( hndl )
+    {
+    }
+
+    bool await_suspend( std::coroutine_handle<> h )
+    {
+        if( m_reactor == NULL )
+        {
+            return false;
+        }
+        m_handle = h;
+        return suspend_on( DSV_GetAsync( m_reactor->context(),
+                                         m_hndl,
+                                         on_reply,
+                                         this ) );
+    }
+
+    T await_resume()
+    {
+        check();
+        T v;
+        memcpy( &v, &m_value, sizeof(T) );
+        return v;
+    }
+
+private:
+    void *m_hndl;
+};
+
+/*! co_await dsv::handle( name ) */
+class handle_awaiter : public reply_awaiter
+{
+public:
+    handle_awaiter( reactor *r, const char *name )
+        : reply_awaiter( r ), m_name( name )
+    {
+    }
+
+    bool await_suspend( std::coroutine_handle<> h )
+    {
+        if( m_reactor == NULL )
+        {
+            return false;
+        }
+        m_handle = h;
+        return suspend_on( DSV_HandleAsync( m_reactor->context(),
+                                            m_name.c_str(),
+                                            on_reply,
+                                            this ) );
+    }
+
+    void *await_resume()
+    {
+        check();
+        m_reactor->watch( m_value.pArray, m_name.c_str() );
+        return m_value.pArray;
+    }
+
+private:
+    std::string m_name;
+};
+
+/*! co_await dsv::next_change( hndl ) */
+class change_awaiter
+{
+public:
+    change_awaiter( reactor *r, void *hndl )
+        : m_reactor( r ), m_hndl( hndl ), m_result( 0 )
+    {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend( std::coroutine_handle<> h )
+    {
+        if( m_reactor == NULL )
+        {
+            m_result = ENXIO;
+            return false;
+        }
+        m_result = m_reactor->wait_change( m_hndl, h, &m_change );
+        return m_result == 0;
+    }
+
+    change await_resume()
+    {
+        if( m_result != 0 )
+        {
+            throw std::system_error( m_result, std::generic_category() );
+        }
+        return std::move( m_change );
+    }
+
+private:
+    reactor *m_reactor;
+    void *m_hndl;
+    int m_result;
+    change m_change;
+};
+
+/*! get the value of numeric type of dsv */
+template< typename T >
+get_awaiter<T> get( void *hndl )
+{
+    return get_awaiter<T>( reactor::current(), hndl );
+}
+
+template< typename T >
+get_awaiter<T> get( reactor &r, void *hndl )
+{
+    return get_awaiter<T>( &r, hndl );
+}
+
+/*! query the handle of dsv, it can be used by next_change afterwards */
+inline handle_awaiter handle( const char *name )
+{
+    return handle_awaiter( reactor::current(), name );
+}
+
+inline handle_awaiter handle( reactor &r, const char *name )
+{
+    return handle_awaiter( &r, name );
+}
+
+/*! wait for the next change of dsv. The first change after the dsv is
+ * subscribed is its current value */
+inline change_awaiter next_change( void *hndl )
+{
+    return change_awaiter( reactor::current(), hndl );
+}
+
+inline change_awaiter next_change( reactor &r, void *hndl )
+{
+    return change_awaiter( &r, hndl );
+}
+
+} // namespace dsv
+
+#endif // DSV_CORO_H
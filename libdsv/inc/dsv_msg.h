@@ -28,11 +28,42 @@ SOFTWARE.
 /*==============================================================================
  Includes
  =============================================================================*/
+#include <stdint.h>
 #include <stdbool.h>
 
 /*==============================================================================
                               Defines
 ==============================================================================*/
+/*! tcp ports of dsv server, shard n of a cluster adds n * DSV_PORT_STRIDE
+ * to the base port, so the shards can run on one host */
+#define DSV_PORT_BASE           ( 56787 )
+#define DSV_PORT_REPLY          ( 0 )
+#define DSV_PORT_BACKEND        ( 1 )
+#define DSV_PORT_FRONTEND       ( 2 )
+#define DSV_PORT_REPLICA        ( 3 )
+#define DSV_PORT_STRIDE         ( 4 )
+
+/*! unix domain endpoint of a port in a directory of the server, bound by
+ * dsv server besides tcp and preferred by the clients on the same host */
+#define DSV_IPC_FMT             ( "ipc://%s/dsv_%u.ipc" )
+
+/*! directory of the unix domain endpoints, $XDG_RUNTIME_DIR/dsv if set,
+ * private to the user of the server */
+#define DSV_IPC_DIR             ( "/run/dsv" )
+
+/*! discovery beacon: 0xCA 0xFE, shard index, shard count and the base port
+ * in network order. The 2 bytes beacon of older servers is a standalone one */
+#define DSV_BEACON_SIZE         ( 6 )
+
+/*! handles given to the clients are not pointers, but the slot and the
+ * generation of the dsv in the handle table of the server, shifted above
+ * the low bits carrying the shard owning the dsv */
+#define DSV_HANDLE_SHARD( h )   ( (uint32_t)( (uintptr_t)(h) & \
+                                              ( DSV_SHARD_MAX - 1 ) ) )
+#define DSV_HANDLE_TAG( id, s ) ( (void *)( (uintptr_t)(id) | (s) ) )
+#define DSV_HANDLE_ID( h )      ( (uintptr_t)(h) & \
+                                  ~(uintptr_t)( DSV_SHARD_MAX - 1 ) )
+
 typedef enum DSV_MSG_TYPE
 {
     DSV_MSG_START,
@@ -52,16 +83,53 @@ typedef enum DSV_MSG_TYPE
     DSV_MSG_SAVE,
     DSV_MSG_RESTORE,
     DSV_MSG_TRACK,
+    DSV_MSG_HELLO,
+    DSV_MSG_INCR,
+    DSV_MSG_FETCH_ADD,
+    DSV_MSG_CAS,
+    DSV_MSG_SET_RANGE,
+    DSV_MSG_APPEND_ITEMS,
+    DSV_MSG_DEL_RANGE,
+    DSV_MSG_GET_RANGE,
+    DSV_MSG_RESYNC,
+    DSV_MSG_GET_HISTORY,
+    DSV_MSG_QUERY_TAG,
+    DSV_MSG_QUERY_FILTER,
+    DSV_MSG_ALIAS,
+    DSV_MSG_CREATE_BATCH,
+    DSV_MSG_DELETE,
+    DSV_MSG_DELETE_PREFIX,
     DSV_MSG_MAX
 }dsv_msg_type_t;
 
+/*! messages of the replication stream from a primary server to its standby */
+typedef enum DSV_REPLICA_TYPE
+{
+    /*! no data, tells the standby the primary is alive */
+    DSV_REPLICA_HEARTBEAT,
+
+    /*! data is the handle, then a DSV_MSG_CREATE request with the value */
+    DSV_REPLICA_CREATE,
+
+    /*! data is the forward data: name, handle and value */
+    DSV_REPLICA_UPDATE,
+
+    /*! data is the notification of the deletion: name, NULL and handle */
+    DSV_REPLICA_DELETE,
+
+    DSV_REPLICA_MAX
+}dsv_replica_type_t;
+
 /*=============================================================================
                               Structures
 ==============================================================================*/
-/*! The dsv_reply_msg_t message is used to reply message from server. */
+/*! The dsv_reply_msg_t message is used to reply message from server.
+ * id is the correlation id chosen by the client, the server echoes it in the
+ * reply so that many requests can be in flight on one DEALER socket */
 typedef struct dsv_msg_request
 {
     int         type;
+    uint32_t    id;
     size_t      length;
     char        data[0];
 }dsv_msg_request_t;
@@ -70,13 +138,40 @@ typedef struct dsv_msg_reply
 {
     size_t      length;
     int         result;
+    uint32_t    id;
     char        data[0];
 }dsv_msg_reply_t;
 
+/*! data is sent to the subscribers, followed by the bytes of blob in a
+ * frame of their own when blob is not NULL */
 typedef struct dsv_msg_forward
 {
     size_t      length;
+    dsv_blob_t  *blob;
     char        data[0];
 }dsv_msg_forward_t;
 
+/*! fixed part of a DSV_MSG_QUERY_FILTER request, see dsv_filter_t. The
+ * name, tag and value strings follow it */
+typedef struct dsv_msg_filter
+{
+    uint32_t    instID;
+    int         name_match;
+    uint32_t    flags;
+    uint32_t    no_flags;
+    int         value_match;
+    uint32_t    age;
+}dsv_msg_filter_t;
+
+/*! seq increases by one for every message, so the standby can detect lost
+ * ones. stamp is CLOCK_REALTIME of the primary in ns, to measure the lag */
+typedef struct dsv_msg_replica
+{
+    int         type;
+    uint64_t    seq;
+    int64_t     stamp;
+    size_t      length;
+    char        data[0];
+}dsv_msg_replica_t;
+
 #endif // DSV_MSG_H
@@ -0,0 +1,219 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+#include "zmq.h"
+#include "dsv.h"
+#include "dsv_log.h"
+
+/*!=============================================================================
+
+    Send a message as frames of at most DSV_CHUNK_SIZE bytes. zmq delivers
+    the frames of one message together or not at all, so a large value needs
+    neither a contiguous copy in zmq nor a buffer of its size on the stack.
+
+@param[in]
+    sock
+        zmq socket
+@param[in]
+    buf
+        message
+@param[in]
+    len
+        length of the message
+@param[in]
+    flags
+        flags of the first frame, eg ZMQ_DONTWAIT
+@return
+    0 - success
+    -1 - failed, errno is set
+
+==============================================================================*/
+int DSV_SendChunks( void *sock, const void *buf, size_t len, int flags )
+{
+    assert( sock );
+    assert( buf || len == 0 );
+
+    const char *data = (const char *)buf;
+    do
+    {
+        size_t n = std::min( len, (size_t)DSV_CHUNK_SIZE );
+        int more = ( len > n ) ? ZMQ_SNDMORE : 0;
+
+        if( zmq_send( sock, data, n, flags | more ) == -1 )
+        {
+            return -1;
+        }
+
+        /* the following frames never block once the first one is queued */
+        flags &= ~ZMQ_DONTWAIT;
+        data += n;
+        len -= n;
+    } while( len > 0 );
+
+    return 0;
+}
+
+/*!=============================================================================
+
+    Receive all the frames of a message into a buffer sized to the message
+
+@param[in]
+    sock
+        zmq socket
+@param[out]
+    msg
+        message, resized to its length
+@param[in]
+    flags
+        flags of the first frame, eg ZMQ_DONTWAIT
+@return
+    length of the message
+    -1 - failed, errno is set, EMSGSIZE if beyond DSV_MSG_SIZE_MAX
+
+==============================================================================*/
+int DSV_RecvChunks( void *sock, std::vector< char > &msg, int flags )
+{
+    assert( sock );
+
+    int more;
+    size_t more_size = sizeof(more);
+    size_t len = 0;
+    bool too_big = false;
+
+    do
+    {
+        zmq_msg_t frame;
+        zmq_msg_init( &frame );
+        if( zmq_msg_recv( &frame, sock, flags ) == -1 )
+        {
+            zmq_msg_close( &frame );
+            return -1;
+        }
+        flags &= ~ZMQ_DONTWAIT;
+
+        /* the rest of a message too big is still drained from the socket */
+        size_t n = zmq_msg_size( &frame );
+        if( len + n > DSV_MSG_SIZE_MAX )
+        {
+            too_big = true;
+        }
+        if( !too_big )
+        {
+            msg.resize( len + n );
+            memcpy( msg.data() + len, zmq_msg_data( &frame ), n );
+            len += n;
+        }
+        zmq_msg_close( &frame );
+
+        zmq_getsockopt( sock, ZMQ_RCVMORE, &more, &more_size );
+    } while( more );
+
+    if( too_big )
+    {
+        dsvlog( LOG_ERR, "message beyond %d bytes dropped", DSV_MSG_SIZE_MAX );
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    msg.resize( len );
+    return (int)len;
+}
+
+/*!=============================================================================
+
+    Receive all the frames of a message into a buffer allocated by the caller,
+    without clearing the rest of it
+
+@param[in]
+    sock
+        zmq socket
+@param[out]
+    buf
+        message buffer
+@param[in]
+    size
+        size of the buffer
+@param[in]
+    flags
+        flags of the first frame, eg ZMQ_DONTWAIT
+@return
+    length of the message
+    -1 - failed, errno is set, EMSGSIZE if beyond size
+
+==============================================================================*/
+int DSV_RecvChunksInto( void *sock, char *buf, size_t size, int flags )
+{
+    assert( sock );
+    assert( buf );
+
+    int more;
+    size_t more_size = sizeof(more);
+    size_t len = 0;
+    bool too_big = false;
+
+    do
+    {
+        zmq_msg_t frame;
+        zmq_msg_init( &frame );
+        if( zmq_msg_recv( &frame, sock, flags ) == -1 )
+        {
+            zmq_msg_close( &frame );
+            return -1;
+        }
+        flags &= ~ZMQ_DONTWAIT;
+
+        size_t n = zmq_msg_size( &frame );
+        if( len + n > size )
+        {
+            too_big = true;
+        }
+        if( !too_big )
+        {
+            memcpy( buf + len, zmq_msg_data( &frame ), n );
+            len += n;
+        }
+        zmq_msg_close( &frame );
+
+        zmq_getsockopt( sock, ZMQ_RCVMORE, &more, &more_size );
+    } while( more );
+
+    if( too_big )
+    {
+        dsvlog( LOG_ERR, "message beyond %zu bytes dropped", size );
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    return (int)len;
+}
@@ -0,0 +1,257 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <utility>
+#include "zmq.h"
+#include "dsv.h"
+#include "dsv_coro.h"
+#include "dsv_log.h"
+
+namespace dsv
+{
+
+/*! reactor bound to this thread, used by the awaitables without reactor */
+static thread_local reactor *t_current = NULL;
+
+reactor::reactor( void *ctx ) : m_ctx( ctx ), m_stop( false )
+{
+    assert( ctx );
+    m_prev = t_current;
+    t_current = this;
+}
+
+reactor::~reactor()
+{
+    t_current = m_prev;
+}
+
+reactor *reactor::current()
+{
+    return t_current;
+}
+
+void reactor::watch( void *hndl, const char *name )
+{
+    assert( name );
+    if( hndl != NULL )
+    {
+        m_names[hndl] = name;
+    }
+}
+
+/*!=============================================================================
+
+    Park the coroutine until the next notification of the dsv. The dsv is
+    subscribed on first use, its name must be known by watch().
+
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    h
+        coroutine to resume
+@param[out]
+    out
+        change filled before h is resumed
+@return
+    0 - success
+    ENOENT - the name of hndl is unknown
+    EFAULT - failed to subscribe
+
+==============================================================================*/
+int reactor::wait_change( void *hndl, std::coroutine_handle<> h, change *out )
+{
+    assert( out );
+
+    if( m_subscribed.count( hndl ) == 0 )
+    {
+        auto e = m_names.find( hndl );
+        if( e == m_names.end() )
+        {
+            dsvlog( LOG_ERR, "Unknown dsv handle to wait for change" );
+            return ENOENT;
+        }
+        if( DSV_SubByName( m_ctx, e->second.c_str() ) != 0 )
+        {
+            dsvlog( LOG_ERR, "Failed to subscribe dsv: %s", e->second.c_str() );
+            return EFAULT;
+        }
+        m_subscribed.insert( hndl );
+    }
+
+    m_waiters.insert( std::make_pair( hndl, waiter{ h, out } ) );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Receive all queued notifications and resume the coroutines waiting for
+    them
+
+@return
+    number of notifications received
+    -1 - failed
+
+==============================================================================*/
+int reactor::handle_notifications()
+{
+    int rc;
+    int count = 0;
+    std::vector< char > msg;
+    dsv_context_t *dsv_ctx = (dsv_context_t *)m_ctx;
+
+    while( (rc = DSV_RecvChunks( dsv_ctx->sock_subscribe,
+                                 msg,
+                                 ZMQ_DONTWAIT )) != -1 )
+    {
+        ++count;
+
+        /* deltas of arrays are expanded to the whole array */
+        rc = DSV_DecodeNotification( m_ctx, msg );
+        if( rc <= 0 )
+        {
+            continue;
+        }
+
+        /* name, handle, then the value */
+        char *data = msg.data();
+        size_t name_len = strnlen( data, rc ) + 1;
+        if( name_len + sizeof(void *) > (size_t)rc )
+        {
+            continue;
+        }
+        void *hndl = *(void **)( data + name_len );
+
+        /* waiters parked again while resuming wait for the next change */
+        auto range = m_waiters.equal_range( hndl );
+        std::vector< waiter > ready;
+        for( auto it = range.first; it != range.second; ++it )
+        {
+            ready.push_back( it->second );
+        }
+        m_waiters.erase( range.first, range.second );
+
+        for( auto &w : ready )
+        {
+            w.out->hndl = hndl;
+            w.out->name.assign( data, name_len - 1 );
+            w.out->value.assign( data + name_len + sizeof(void *), data + rc );
+            w.h.resume();
+        }
+    }
+
+    if( errno != EAGAIN )
+    {
+        dsvlog( LOG_ERR, "zmq_recv failed: %s", zmq_strerror( errno ) );
+        return -1;
+    }
+    return count;
+}
+
+/*!=============================================================================
+
+    Wait for replies and notifications, and resume the coroutines waiting for
+    them. Must be called from the thread that constructed the reactor.
+
+@param[in]
+    timeout
+        milliseconds to wait, -1 waits forever
+@return
+    number of sockets served
+    -1 - failed
+
+==============================================================================*/
+int reactor::run_once( int timeout )
+{
+    dsv_context_t *dsv_ctx = (dsv_context_t *)m_ctx;
+    int count = 0;
+    void *socks[DSV_SHARD_MAX];
+    zmq_pollitem_t items[DSV_SHARD_MAX + 1];
+
+    /* notifications first, then the request socket of every shard */
+    int n = DSV_RequestSockets( m_ctx, socks, DSV_SHARD_MAX );
+    if( n < 0 )
+    {
+        return -1;
+    }
+    items[0] = { dsv_ctx->sock_subscribe, 0, ZMQ_POLLIN, 0 };
+    for( int i = 0; i < n; i++ )
+    {
+        items[i + 1] = { socks[i], 0, ZMQ_POLLIN, 0 };
+    }
+
+    if( zmq_poll( items, n + 1, timeout ) == -1 )
+    {
+        dsvlog( LOG_ERR, "zmq_poll failed: %s", strerror( errno ) );
+        return -1;
+    }
+
+    for( int i = 1; i <= n; i++ )
+    {
+        if( items[i].revents & ZMQ_POLLIN )
+        {
+            if( DSV_Dispatch( m_ctx, 0 ) < 0 )
+            {
+                return -1;
+            }
+            ++count;
+            break;
+        }
+    }
+
+    if( items[0].revents & ZMQ_POLLIN )
+    {
+        if( handle_notifications() < 0 )
+        {
+            return -1;
+        }
+        ++count;
+    }
+
+    return count;
+}
+
+int reactor::run()
+{
+    m_stop = false;
+    while( !m_stop )
+    {
+        if( run_once( -1 ) < 0 )
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+} // namespace dsv
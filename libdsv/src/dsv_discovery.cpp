@@ -29,26 +29,47 @@ SOFTWARE.
 #include <stdio.h>
 #include <unistd.h>
 #include <assert.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
 #include "zmq.h"
 #include "czmq.h"
+#include "dsv.h"
+#include "dsv_msg.h"
+#include "dsv_log.h"
+
+/*! the server found by discovery is cached here for the other processes of
+ *  the user, under $XDG_RUNTIME_DIR if set */
+#define DSV_SERVER_CACHE_DIR    ( "/run" )
+#define DSV_SERVER_CACHE_FILE   ( "dsv_server.cache" )
+
+/*! seconds the cached server is trusted without discovery */
+#define DSV_SERVER_CACHE_TTL    ( 300 )
 
 /*!=============================================================================
 
-    Discover dsv server using zbeacon
+    Listen to the discovery beacons of the dsv servers. A sharded cluster has
+    one beacon per shard, the listening stops once every shard is heard or
+    after 1/2 second.
 
 @param[out]
-    server_ip
-        buffer to output server ip as string. NULL will ignore output.
+    servers
+        buffer to output the servers found, indexed by shard
 @param[in]
-    size
-        size of buffer
+    max
+        number of entries in servers
 @return
-    0 - No dsv server found,
-    1 - found a dsv server running
+    number of shards found, servers[0..count-1] are all filled only if it
+    equals servers[0].count
 ==============================================================================*/
-int DSV_FindDiscoveryServer( char *server_ip, size_t size )
+int DSV_DiscoverServers( dsv_server_t *servers, size_t max )
 {
-    int rc = 0;
+    assert( servers );
+
+    int found = 0;
+    int count = 0;
     zactor_t *listener = zactor_new( zbeacon, NULL );
     assert( listener );
 //  zstr_sendx (listener, "VERBOSE", NULL);
@@ -60,39 +81,399 @@ int DSV_FindDiscoveryServer( char *server_ip, size_t size )
     //  We will listen to anything (empty subscription)
     zsock_send( listener, "sb", "SUBSCRIBE", "", 0 );
 
-    //  Wait for at most 1/2 second if there's no broadcasting
-    zsock_set_rcvtimeo( listener, 500 );
-    char *ipaddress = zstr_recv( listener );
-    if( ipaddress )
+    memset( servers, 0, sizeof(dsv_server_t) * max );
+    int64_t deadline = zclock_mono() + 500;
+    while( count == 0 || found < count )
     {
+        //  Wait for at most 1/2 second if there's no broadcasting
+        int64_t left = deadline - zclock_mono();
+        if( left <= 0 )
+        {
+            break;
+        }
+        zsock_set_rcvtimeo( listener, (int)left );
+        char *ipaddress = zstr_recv( listener );
+        if( ipaddress == NULL )
+        {
+            break;
+        }
+
         zframe_t *content = zframe_recv( listener );
-        if( zframe_size( content ) == 2 &&
-            zframe_data( content )[0] == 0xCA &&
-            zframe_data( content )[1] == 0xFE )
+        byte *data = zframe_data( content );
+        size_t size = zframe_size( content );
+        if( ( size == 2 || size == DSV_BEACON_SIZE ) &&
+            data[0] == 0xCA &&
+            data[1] == 0xFE )
         {
-            printf( "Found a DSV server, ip=%s\n", ipaddress );
-            if( server_ip != NULL )
+            dsv_server_t server = { 0 };
+            strncpy( server.ip, ipaddress, sizeof(server.ip) - 1 );
+            server.shard = size == 2 ? 0 : data[2];
+            server.count = size == 2 ? 1 : data[3];
+            server.port = size == 2 ? DSV_PORT_BASE :
+                          ( data[4] << 8 ) | data[5];
+
+            if( count == 0 )
             {
-                strncpy( server_ip, ipaddress, size );
+                count = server.count;
+            }
+
+            if( server.count != count ||
+                server.shard >= count ||
+                server.shard >= max )
+            {
+                dsvlog( LOG_WARNING,
+                        "Ignore dsv server %s:%u, shard %u of %u",
+                        server.ip, server.port, server.shard, server.count );
+            }
+            else if( servers[server.shard].count == 0 )
+            {
+                printf( "Found a DSV server, ip=%s port=%u shard=%u/%u\n",
+                        server.ip, server.port, server.shard, server.count );
+                servers[server.shard] = server;
+                ++found;
             }
-            rc = 1;
         }
 
         zframe_destroy( &content );
         zstr_free( &ipaddress );
     }
     zactor_destroy( &listener );
-    return rc;
+    return found;
+}
+
+/*!=============================================================================
+
+    Discover dsv server using zbeacon
+
+@param[out]
+    server_ip
+        buffer to output server ip as string. NULL will ignore output.
+@param[in]
+    size
+        size of buffer
+@return
+    0 - No dsv server found,
+    1 - found a dsv server running
+==============================================================================*/
+int DSV_FindDiscoveryServer( char *server_ip, size_t size )
+{
+    dsv_server_t servers[DSV_SHARD_MAX];
+
+    if( DSV_DiscoverServers( servers, DSV_SHARD_MAX ) == 0 )
+    {
+        return 0;
+    }
+
+    for( auto &server : servers )
+    {
+        if( server.count != 0 && server_ip != NULL && size != 0 )
+        {
+            strncpy( server_ip, server.ip, size - 1 );
+            server_ip[size - 1] = '\0';
+            break;
+        }
+    }
+    return 1;
+}
+
+/*!=============================================================================
+
+    Parse the servers of DSV_SERVER environment variable, a comma separated
+    list of ip[:port] in the order of shards.
+
+@param[out]
+    servers
+        buffer to output the servers, indexed by shard
+@param[in]
+    max
+        number of entries in servers
+@param[in]
+    env
+        value of the environment variable
+@return
+    number of servers
+==============================================================================*/
+static int dsv_ParseServerEnv( dsv_server_t *servers, size_t max, const char *env )
+{
+    char buf[DSV_STRING_SIZE_MAX * 4];
+    char *saveptr = NULL;
+    int count = 0;
+
+    strncpy( buf, env, sizeof(buf) - 1 );
+    buf[sizeof(buf) - 1] = '\0';
+
+    for( char *tok = strtok_r( buf, ",", &saveptr );
+         tok != NULL && (size_t)count < max;
+         tok = strtok_r( NULL, ",", &saveptr ) )
+    {
+        dsv_server_t *server = &servers[count];
+        char *port = strchr( tok, ':' );
+        if( port != NULL )
+        {
+            *port++ = '\0';
+        }
+        strncpy( server->ip, tok, sizeof(server->ip) - 1 );
+        server->ip[sizeof(server->ip) - 1] = '\0';
+        server->port = port != NULL ? (uint16_t)atoi( port ) :
+                       DSV_PORT_BASE + count * DSV_PORT_STRIDE;
+        server->shard = count;
+        ++count;
+    }
+
+    for( int i = 0; i < count; i++ )
+    {
+        servers[i].count = count;
+    }
+    return count;
+}
+
+/*!=============================================================================
+
+    Get the path of the cache file of the discovered servers, private to the
+    user
+
+@param[out]
+    path
+        buffer to output the path
+@param[in]
+    size
+        size of path
+@return
+    0 - success
+    -1 - the path is too long
+==============================================================================*/
+static int dsv_CachePath( char *path, size_t size )
+{
+    const char *dir = getenv( "XDG_RUNTIME_DIR" );
+    if( dir == NULL || dir[0] != '/' )
+    {
+        dir = DSV_SERVER_CACHE_DIR;
+    }
+
+    int n = snprintf( path, size, "%s/%s", dir, DSV_SERVER_CACHE_FILE );
+    return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+/*!=============================================================================
+
+    Read the servers of the cache file, written by the last discovery within
+    DSV_SERVER_CACHE_TTL. The file is ignored unless it is owned by the user
+    and private to it, and every entry is a valid ip address and port.
+
+@param[in]
+    path
+        path of the cache file
+@param[out]
+    servers
+        buffer to output the servers, indexed by shard
+@param[in]
+    max
+        number of entries in servers
+@return
+    number of servers, 0 if the cache can't be used
+==============================================================================*/
+static int dsv_ReadCache( const char *path, dsv_server_t *servers, size_t max )
+{
+    struct stat st;
+    int fd = open( path, O_RDONLY | O_NOFOLLOW );
+    if( fd == -1 )
+    {
+        return 0;
+    }
+
+    if( fstat( fd, &st ) != 0 ||
+        !S_ISREG( st.st_mode ) ||
+        st.st_uid != getuid() ||
+        ( st.st_mode & ( S_IRWXG | S_IRWXO ) ) != 0 ||
+        time( NULL ) - st.st_mtime >= DSV_SERVER_CACHE_TTL )
+    {
+        close( fd );
+        return 0;
+    }
+
+    FILE *fp = fdopen( fd, "r" );
+    if( fp == NULL )
+    {
+        close( fd );
+        return 0;
+    }
+
+    unsigned int port;
+    char ip[sizeof(servers[0].ip)];
+    unsigned char addr[sizeof(struct in6_addr)];
+    int count = 0;
+    while( (size_t)count < max &&
+           fscanf( fp, "%63s %u", ip, &port ) == 2 )
+    {
+        if( ( inet_pton( AF_INET, ip, addr ) != 1 &&
+              inet_pton( AF_INET6, ip, addr ) != 1 ) ||
+            port == 0 ||
+            port > UINT16_MAX )
+        {
+            dsvlog( LOG_WARNING, "Ignore the invalid cache %s", path );
+            count = 0;
+            break;
+        }
+
+        dsv_server_t *server = &servers[count];
+        memset( server, 0, sizeof(*server) );
+        strncpy( server->ip, ip, sizeof(server->ip) - 1 );
+        server->port = port;
+        server->shard = count;
+        ++count;
+    }
+    fclose( fp );
+
+    for( int i = 0; i < count; i++ )
+    {
+        servers[i].count = count;
+    }
+    return count;
+}
+
+/*!=============================================================================
+
+    Write the servers found by discovery to the cache file, readable by the
+    user only. A temp file is renamed, so readers never see a partial file.
+
+@param[in]
+    path
+        path of the cache file
+@param[in]
+    servers
+        servers indexed by shard
+@param[in]
+    count
+        number of servers
+==============================================================================*/
+static void dsv_WriteCache( const char *path,
+                            const dsv_server_t *servers,
+                            int count )
+{
+    char tmp[PATH_MAX];
+    if( snprintf( tmp, sizeof(tmp), "%s.%d", path, getpid() ) >= (int)sizeof(tmp) )
+    {
+        return;
+    }
+
+    /* a file left by a process of the same pid is not reused */
+    unlink( tmp );
+    int fd = open( tmp, O_WRONLY | O_CREAT | O_EXCL, 0600 );
+    if( fd == -1 )
+    {
+        return;
+    }
+
+    FILE *fp = fdopen( fd, "w" );
+    if( fp == NULL )
+    {
+        close( fd );
+        unlink( tmp );
+        return;
+    }
+
+    for( int i = 0; i < count; i++ )
+    {
+        fprintf( fp, "%s %u\n", servers[i].ip, servers[i].port );
+    }
+    if( fclose( fp ) != 0 || rename( tmp, path ) != 0 )
+    {
+        unlink( tmp );
+    }
+}
+
+/*!=============================================================================
+
+    Find the dsv servers for a client without waiting for the beacon if
+    possible. The environment variable DSV_SERVER has the priority, then the
+    cache file written by the last discovery within DSV_SERVER_CACHE_TTL,
+    and at last the beacon discovery, which refreshes the cache.
+
+@param[out]
+    servers
+        buffer to output the servers, indexed by shard
+@param[in]
+    max
+        number of entries in servers
+@param[in]
+    use_cache
+        false to skip the cache, eg, the cached server doesn't answer
+@return
+    number of shards, 1 for a standalone server
+    0 - No dsv server found, or some shards of the cluster are missing
+==============================================================================*/
+int DSV_FindServer( dsv_server_t *servers, size_t max, bool use_cache )
+{
+    assert( servers );
+
+    int count;
+    const char *env = getenv( "DSV_SERVER" );
+    if( env != NULL && env[0] != '\0' )
+    {
+        return dsv_ParseServerEnv( servers, max, env );
+    }
+
+    char path[PATH_MAX];
+    bool cached = dsv_CachePath( path, sizeof(path) ) == 0;
+    if( use_cache && cached )
+    {
+        count = dsv_ReadCache( path, servers, max );
+        if( count > 0 )
+        {
+            return count;
+        }
+    }
+
+    count = DSV_DiscoverServers( servers, max );
+    if( count == 0 )
+    {
+        return 0;
+    }
+    if( count != servers[0].count )
+    {
+        dsvlog( LOG_ERR,
+                "Only %d of %u dsv servers found",
+                count, servers[0].count );
+        return 0;
+    }
+
+    if( cached )
+    {
+        dsv_WriteCache( path, servers, count );
+    }
+    return count;
+}
+
+/*!=============================================================================
+
+    Drop the cached dsv server, eg, when it doesn't answer any more
+==============================================================================*/
+void DSV_ForgetServer( void )
+{
+    char path[PATH_MAX];
+    if( dsv_CachePath( path, sizeof(path) ) == 0 )
+    {
+        unlink( path );
+    }
 }
 
 /*!=============================================================================
 
     Broadcast message using zbeacon
 
+@param[in]
+    shard
+        index of the shard, 0 for a standalone server
+@param[in]
+    count
+        number of shards in the cluster, 1 for a standalone server
+@param[in]
+    port
+        port of the reply socket, the backend and frontend ports follow it
 @return
     speaker for success, null for failure
 ==============================================================================*/
-void* DSV_RunDiscoveryServer()
+void* DSV_RunDiscoveryServer( uint8_t shard, uint8_t count, uint16_t port )
 {
     printf( "!!!Start to run server\n" );
     zactor_t *speaker = zactor_new( zbeacon, NULL );
@@ -103,13 +484,184 @@ void* DSV_RunDiscoveryServer()
     assert( *hostname );
     freen( hostname );
 
-    //  We will broadcast the magic value 0xCAFE
-    byte announcement[2] = { 0xCA, 0xFE };
-    zsock_send( speaker, "sbi", "PUBLISH", announcement, 2, 100 );
+    //  We will broadcast the magic value 0xCAFE with the shard map
+    byte announcement[DSV_BEACON_SIZE] = {
+        0xCA, 0xFE, shard, count, (byte)( port >> 8 ), (byte)( port & 0xFF )
+    };
+    zsock_send( speaker, "sbi", "PUBLISH", announcement, DSV_BEACON_SIZE, 100 );
 
     return speaker;
 }
 
+/*!=============================================================================
+
+    Get the directory of the unix domain endpoints of a server run by the
+    calling user
+
+@param[out]
+    dir
+        buffer to output the directory
+@param[in]
+    size
+        size of dir
+@return
+    0 - success
+    -1 - the path is too long
+==============================================================================*/
+static int dsv_IpcDir( char *dir, size_t size )
+{
+    const char *run = getenv( "XDG_RUNTIME_DIR" );
+    int n = run != NULL && run[0] == '/' ?
+            snprintf( dir, size, "%s/dsv", run ) :
+            snprintf( dir, size, "%s", DSV_IPC_DIR );
+    return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+/*!=============================================================================
+
+    Check that only the owner of a directory of unix domain endpoints can
+    bind in it
+
+@param[in]
+    st
+        status of the directory of the endpoints
+@return
+    true for a directory nobody but its owner can write
+==============================================================================*/
+static bool dsv_IpcPrivate( const struct stat *st )
+{
+    return S_ISDIR( st->st_mode ) &&
+           ( st->st_mode & ( S_IWGRP | S_IWOTH ) ) == 0;
+}
+
+/*!=============================================================================
+
+    Create the directory of the unix domain endpoints of the server, with
+    mode 0700, so no other user can bind the endpoints first
+
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+==============================================================================*/
+int DSV_IpcPrepare( void )
+{
+    char dir[PATH_MAX];
+    struct stat st;
+
+    if( dsv_IpcDir( dir, sizeof(dir) ) != 0 )
+    {
+        return ENAMETOOLONG;
+    }
+    if( mkdir( dir, 0700 ) != 0 && errno != EEXIST )
+    {
+        dsvlog( LOG_ERR, "Failed to create %s: %s", dir, strerror( errno ) );
+        return errno;
+    }
+    if( lstat( dir, &st ) != 0 ||
+        !S_ISDIR( st.st_mode ) ||
+        st.st_uid != geteuid() )
+    {
+        dsvlog( LOG_ERR, "%s is not a directory of the server", dir );
+        return EPERM;
+    }
+    if( ( st.st_mode & 0777 ) != 0700 && chmod( dir, 0700 ) != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to chmod %s: %s", dir, strerror( errno ) );
+        return errno;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Find the unix domain endpoint of a port for a client. It must be in a
+    directory owned by the user or by root that no other user can write, and
+    the user must be allowed to connect to it.
+
+@param[out]
+    url
+        buffer to output the endpoint
+@param[in]
+    size
+        size of buffer
+@param[in]
+    port
+        tcp port naming the endpoint
+@return
+    true if found
+==============================================================================*/
+static bool dsv_IpcFind( char *url, size_t size, uint16_t port )
+{
+    char dirs[2][PATH_MAX];
+    char path[PATH_MAX];
+    struct stat st;
+
+    if( dsv_IpcDir( dirs[0], sizeof(dirs[0]) ) != 0 )
+    {
+        dirs[0][0] = '\0';
+    }
+    snprintf( dirs[1], sizeof(dirs[1]), "%s", DSV_IPC_DIR );
+
+    for( auto &dir : dirs )
+    {
+        int n = snprintf( path, sizeof(path), "%s/dsv_%u.ipc", dir, port );
+        if( dir[0] == '\0' || n <= 0 || (size_t)n >= sizeof(path) ||
+            lstat( dir, &st ) != 0 ||
+            !dsv_IpcPrivate( &st ) ||
+            ( st.st_uid != geteuid() && st.st_uid != 0 ) ||
+            access( path, W_OK ) != 0 )
+        {
+            continue;
+        }
+
+        n = snprintf( url, size, DSV_IPC_FMT, dir, port );
+        return n > 0 && (size_t)n < size;
+    }
+    return false;
+}
+
+/*!=============================================================================
+
+    Compose the zmq endpoint of a dsv server port
+
+@param[out]
+    url
+        buffer to output the endpoint
+@param[in]
+    size
+        size of buffer
+@param[in]
+    host
+        ip address of the server, "*" to bind
+@param[in]
+    port
+        tcp port, also names the unix domain endpoint
+@param[in]
+    ipc
+        true for the unix domain endpoint. To connect, it falls back to tcp
+        unless the endpoint is found in a directory private to the server,
+        see dsv_IpcFind()
+==============================================================================*/
+void DSV_EndpointUrl( char *url,
+                      size_t size,
+                      const char *host,
+                      uint16_t port,
+                      bool ipc )
+{
+    assert( url );
+    assert( host );
+
+    char dir[PATH_MAX];
+    if( ipc && strcmp( host, "*" ) == 0 && dsv_IpcDir( dir, sizeof(dir) ) == 0 )
+    {
+        snprintf( url, size, DSV_IPC_FMT, dir, port );
+    }
+    else if( !ipc || !dsv_IpcFind( url, size, port ) )
+    {
+        snprintf( url, size, "tcp://%s:%u", host, port );
+    }
+}
+
 static uint32_t hash(unsigned char *str)
 {
     assert(str);
@@ -165,6 +717,55 @@ static int localIP(const char *if_name, char *ip, size_t size)
     return rc;
 }
 
+/*!=============================================================================
+
+    Check whether the ip address belongs to this host
+
+@param[in]
+    ip
+        ip address as string, eg, the dsv server found by discovery
+@return
+    1 - the address is local, including loopback
+    0 - the address is remote
+==============================================================================*/
+int DSV_IsLocalIP( const char *ip )
+{
+    assert( ip );
+    struct ifaddrs* ifAddrStruct = NULL;
+    struct ifaddrs* ifa = NULL;
+    char local[64];
+    int rc = 0;
+
+    if( strncmp( ip, "127.", 4 ) == 0 || strcmp( ip, "localhost" ) == 0 )
+    {
+        return 1;
+    }
+
+    if( getifaddrs( &ifAddrStruct ) != 0 )
+    {
+        return 0;
+    }
+
+    for( ifa = ifAddrStruct; ifa != NULL; ifa = ifa->ifa_next )
+    {
+        if( ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_INET )
+        {
+            inet_ntop( AF_INET,
+                       &((struct sockaddr_in*)ifa->ifa_addr)->sin_addr,
+                       local,
+                       sizeof(local) );
+            if( strcmp( local, ip ) == 0 )
+            {
+                rc = 1;
+                break;
+            }
+        }
+    }
+    freeifaddrs( ifAddrStruct );
+
+    return rc;
+}
+
 /**
 * We here use local IP to generate instID from its hash value
 */
@@ -114,7 +114,7 @@ void DSV_LogInit( void *ctx, const char *log_level )
     if( ctx != NULL && log_level != NULL )
     {
         /* create console log mask dsv */
-        dsv_info_t dsv;
+        dsv_info_t dsv = { 0 };
         char name[DSV_STRING_SIZE_MAX];
         sscanf( log_level, "[%d]", &dsv.instID );
         dsv.pName = strdup( log_level );
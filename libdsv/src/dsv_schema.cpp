@@ -0,0 +1,503 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include "dsv.h"
+#include "dsv_log.h"
+
+/*==============================================================================
+                               Macros
+==============================================================================*/
+/*! first bytes of a binary schema */
+#define DSV_SCHEMA_MAGIC        ( "DSVB" )
+
+/*! format version, incremented by any change of the records */
+#define DSV_SCHEMA_VERSION      ( 1 )
+
+/*! written in the byte order of the compiler, tells a foreign one */
+#define DSV_SCHEMA_ENDIAN       ( 0x01020304u )
+
+/*! alignment of the values, so that the arrays are read in place */
+#define DSV_SCHEMA_ALIGN        ( 8 )
+
+/*==============================================================================
+                              Structures
+==============================================================================*/
+/*! header of a binary schema, followed by the records, the string table and
+ *  the values. Offsets are from the start of the file. */
+typedef struct dsv_schema_header
+{
+    char magic[4];
+
+    uint32_t version;
+
+    uint32_t endian;
+
+    /*! number of records */
+    uint32_t count;
+
+    /*! string table, NUL terminated strings, "" at offset 0 */
+    uint32_t strings;
+    uint32_t strings_size;
+
+    /*! values of the strings, arrays and blobs */
+    uint32_t values;
+    uint32_t values_size;
+
+} dsv_schema_header_t;
+
+/*! one dsv, the strings are offsets in the string table, each distinct
+ *  string stored once. The name has no instance ID, it is given at load. */
+typedef struct dsv_schema_record
+{
+    uint32_t name;
+    uint32_t desc;
+    uint32_t tags;
+    uint32_t calc;
+    uint32_t rules;
+    uint32_t aliases;
+
+    int32_t type;
+    uint32_t flags;
+    uint32_t history;
+    uint32_t stats;
+
+    /*! length of the value */
+    uint32_t len;
+
+    /*! offset in the values of a string, array or blob */
+    uint32_t value;
+
+    /*! numeric value in the bits of dsv_value_t */
+    uint64_t bits;
+
+} dsv_schema_record_t;
+
+/*! binary schema being compiled */
+typedef struct dsv_schema_build
+{
+    std::vector< dsv_schema_record_t > records;
+    std::vector< char > values;
+    std::string strings;
+
+    /*! offsets of the strings in the string table */
+    std::unordered_map< std::string, uint32_t > interned;
+
+} dsv_schema_build_t;
+
+static_assert( sizeof(dsv_value_t) == sizeof(uint64_t),
+               "numeric values are stored in 64 bits" );
+
+/*!=============================================================================
+
+    Check whether a type keeps its value in memory of its own
+
+@param[in]
+    type
+        dsv type
+@return
+    true for a string, an array or a blob
+==============================================================================*/
+static bool dsv_SchemaHasBytes( int type )
+{
+    return type == DSV_TYPE_STR ||
+           type == DSV_TYPE_INT_ARRAY ||
+           DSV_TYPE_IS_BLOB( type );
+}
+
+/*!=============================================================================
+
+    Read a whole file
+
+@param[in]
+    file
+        file name
+@param[out]
+    buf
+        contents of the file, NUL terminated
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+==============================================================================*/
+static int dsv_SchemaReadFile( const char *file, std::vector< char > &buf )
+{
+    FILE *fp = fopen( file, "r" );
+    if( fp == NULL )
+    {
+        dsvlog( LOG_ERR, "Failed to open %s: %s", file, strerror( errno ) );
+        return errno;
+    }
+
+    int rc = 0;
+    fseek( fp, 0L, SEEK_END );
+    long size = ftell( fp );
+    rewind( fp );
+
+    buf.assign( size > 0 ? size + 1 : 1, '\0' );
+    if( size < 0 || fread( buf.data(), 1, size, fp ) != (size_t)size )
+    {
+        dsvlog( LOG_ERR, "Failed to read %s", file );
+        rc = EIO;
+    }
+
+    fclose( fp );
+    return rc;
+}
+
+/*!=============================================================================
+
+    Store a string once in the string table of a schema being compiled
+
+@param[in,out]
+    b
+        schema being compiled
+@param[in]
+    str
+        string, NULL for none
+@return
+    offset of the string in the string table
+==============================================================================*/
+static uint32_t dsv_SchemaIntern( dsv_schema_build_t *b, const char *str )
+{
+    if( str == NULL || str[0] == '\0' )
+    {
+        return 0;
+    }
+
+    auto e = b->interned.emplace( str, b->strings.size() );
+    if( e.second )
+    {
+        b->strings.append( str, strlen( str ) + 1 );
+    }
+    return e.first->second;
+}
+
+/*!=============================================================================
+
+    Add a dsv parsed by DSV_ParseJson() to a schema being compiled, and
+    free it
+
+@param[in]
+    dsv
+        dsv information
+@param[in]
+    arg
+        dsv_schema_build_t
+@return
+    0 to continue
+==============================================================================*/
+static int dsv_SchemaAdd( dsv_info_t *dsv, void *arg )
+{
+    dsv_schema_build_t *b = (dsv_schema_build_t *)arg;
+    dsv_schema_record_t r = { 0 };
+
+    const char *name = dsv->pName ? strchr( dsv->pName, ']' ) : NULL;
+    r.name = dsv_SchemaIntern( b, name ? name + 1 : dsv->pName );
+    r.desc = dsv_SchemaIntern( b, dsv->pDesc );
+    r.tags = dsv_SchemaIntern( b, dsv->pTags );
+    r.calc = dsv_SchemaIntern( b, dsv->pCalc );
+    r.rules = dsv_SchemaIntern( b, dsv->pRules );
+    r.aliases = dsv_SchemaIntern( b, dsv->pAliases );
+    r.type = dsv->type;
+    r.flags = dsv->flags;
+    r.history = dsv->history;
+    r.stats = dsv->stats;
+    r.len = dsv->len;
+
+    if( dsv_SchemaHasBytes( dsv->type ) )
+    {
+        r.value = b->values.size();
+        if( dsv->value.pStr != NULL )
+        {
+            b->values.insert( b->values.end(),
+                              dsv->value.pStr,
+                              dsv->value.pStr + dsv->len );
+        }
+        else
+        {
+            r.len = 0;
+        }
+        b->values.resize( ( b->values.size() + DSV_SCHEMA_ALIGN - 1 ) &
+                          ~(size_t)( DSV_SCHEMA_ALIGN - 1 ) );
+    }
+    else
+    {
+        memcpy( &r.bits, &dsv->value, sizeof(r.bits) );
+    }
+
+    b->records.push_back( r );
+    DSV_FreeInfo( dsv );
+    return 0;
+}
+
+/*!=============================================================================
+
+    Compile a JSON schema, eg dsvs.json, into a binary schema loaded by
+    DSV_CreateWithSchema() without parsing. The defaults are converted to
+    their types, the validation rules are kept in the form the server takes,
+    and the strings repeated by the dsvs, eg the tags, are stored once.
+
+@param[in]
+    json_file
+        JSON schema
+@param[in]
+    schema_file
+        binary schema written
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+==============================================================================*/
+int DSV_CompileSchema( const char *json_file, const char *schema_file )
+{
+    assert( json_file );
+    assert( schema_file );
+
+    std::vector< char > json;
+    int rc = dsv_SchemaReadFile( json_file, json );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+
+    /* the instance ID is given at load, the names are kept without it */
+    dsv_schema_build_t b;
+    b.strings.assign( 1, '\0' );
+    rc = DSV_ParseJson( 0, json.data(), json.size() - 1, dsv_SchemaAdd, &b );
+    if( rc != 0 )
+    {
+        return rc;
+    }
+
+    std::vector< dsv_schema_record_t > &records = b.records;
+    std::vector< char > &values = b.values;
+    std::string &strings = b.strings;
+
+    dsv_schema_header_t h = { 0 };
+    memcpy( h.magic, DSV_SCHEMA_MAGIC, sizeof(h.magic) );
+    h.version = DSV_SCHEMA_VERSION;
+    h.endian = DSV_SCHEMA_ENDIAN;
+    h.count = records.size();
+    h.values = sizeof(h) + records.size() * sizeof(dsv_schema_record_t);
+    h.values_size = values.size();
+    h.strings = h.values + h.values_size;
+    h.strings_size = strings.size();
+
+    FILE *fp = fopen( schema_file, "wb" );
+    if( fp == NULL )
+    {
+        dsvlog( LOG_ERR, "Failed to open %s: %s", schema_file, strerror( errno ) );
+        return errno;
+    }
+    if( fwrite( &h, sizeof(h), 1, fp ) != 1 ||
+        fwrite( records.data(),
+                sizeof(dsv_schema_record_t),
+                records.size(),
+                fp ) != records.size() ||
+        fwrite( values.data(), 1, values.size(), fp ) != values.size() ||
+        fwrite( strings.data(), 1, strings.size(), fp ) != strings.size() )
+    {
+        dsvlog( LOG_ERR, "Failed to write %s", schema_file );
+        rc = EIO;
+    }
+    if( fclose( fp ) != 0 && rc == 0 )
+    {
+        rc = EIO;
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Check the header of a binary schema against the size of the file
+
+@param[in]
+    h
+        header at the start of the file
+@param[in]
+    size
+        size of the file
+@return
+    0 - success
+    ENOEXEC - not a binary schema
+    EINVAL - a binary schema of another version or byte order, or truncated
+==============================================================================*/
+static int dsv_SchemaCheck( const dsv_schema_header_t *h, size_t size )
+{
+    if( size < sizeof(dsv_schema_header_t) ||
+        memcmp( h->magic, DSV_SCHEMA_MAGIC, sizeof(h->magic) ) != 0 )
+    {
+        return ENOEXEC;
+    }
+
+    if( h->version != DSV_SCHEMA_VERSION || h->endian != DSV_SCHEMA_ENDIAN )
+    {
+        return EINVAL;
+    }
+
+    uint64_t records = sizeof(dsv_schema_header_t) +
+                       (uint64_t)h->count * sizeof(dsv_schema_record_t);
+    if( records > h->values ||
+        (uint64_t)h->values + h->values_size > size ||
+        (uint64_t)h->strings + h->strings_size > size ||
+        h->strings_size == 0 ||
+        ( (const char *)h )[h->strings + h->strings_size - 1] != '\0' )
+    {
+        return EINVAL;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Create the dsvs of a binary schema compiled by dsv_schemac. The file is
+    mapped and the strings and values are sent from the mapping, so nothing
+    is parsed nor converted.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    instID
+        dsv instance ID passed by the creator, normally device short GUID
+@param[in]
+    file
+        binary schema
+@return
+    0 - success
+    ENOEXEC - not a binary schema
+    any other value specifies an error code (see errno.h)
+==============================================================================*/
+int DSV_CreateWithSchema( void *ctx, uint32_t instID, const char *file )
+{
+    assert( ctx );
+    assert( file );
+
+    int fd = open( file, O_RDONLY );
+    if( fd == -1 )
+    {
+        dsvlog( LOG_ERR, "Failed to open %s: %s", file, strerror( errno ) );
+        return errno;
+    }
+
+    struct stat st = { 0 };
+    void *map = MAP_FAILED;
+    if( fstat( fd, &st ) == 0 && st.st_size > 0 )
+    {
+        map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    close( fd );
+    if( map == MAP_FAILED )
+    {
+        return st.st_size > 0 ? errno : ENOEXEC;
+    }
+
+    const char *base = (const char *)map;
+    const dsv_schema_header_t *h = (const dsv_schema_header_t *)base;
+    int rc = dsv_SchemaCheck( h, st.st_size );
+    if( rc == EINVAL )
+    {
+        dsvlog( LOG_ERR, "Invalid binary schema: %s", file );
+    }
+
+    std::vector< dsv_info_t > dsvs;
+    std::vector< char > names;
+    if( rc == 0 )
+    {
+        const dsv_schema_record_t *r = (const dsv_schema_record_t *)( h + 1 );
+        const char *strings = base + h->strings;
+        char *values = (char *)base + h->values;
+
+        dsvs.resize( h->count );
+        names.resize( (size_t)h->count * DSV_STRING_SIZE_MAX );
+        for( uint32_t i = 0; i < h->count && rc == 0; i++, r++ )
+        {
+            const uint32_t strs[] = { r->name, r->desc, r->tags,
+                                      r->calc, r->rules, r->aliases };
+            for( auto off : strs )
+            {
+                if( off >= h->strings_size )
+                {
+                    rc = EINVAL;
+                }
+            }
+            if( dsv_SchemaHasBytes( r->type ) &&
+                (uint64_t)r->value + r->len > h->values_size )
+            {
+                rc = EINVAL;
+            }
+            if( rc != 0 )
+            {
+                dsvlog( LOG_ERR, "Invalid record %u of %s", i, file );
+                break;
+            }
+
+            dsv_info_t *dsv = &dsvs[i];
+            dsv->pName = &names[(size_t)i * DSV_STRING_SIZE_MAX];
+            snprintf( dsv->pName, DSV_STRING_SIZE_MAX,
+                      "[%u]%s", instID, strings + r->name );
+            dsv->pDesc = (char *)strings + r->desc;
+            dsv->pTags = (char *)strings + r->tags;
+            dsv->pCalc = (char *)strings + r->calc;
+            dsv->pRules = (char *)strings + r->rules;
+            dsv->pAliases = (char *)strings + r->aliases;
+            dsv->instID = instID;
+            dsv->type = r->type;
+            dsv->flags = r->flags;
+            dsv->history = r->history;
+            dsv->stats = r->stats;
+            dsv->len = r->len;
+            if( dsv_SchemaHasBytes( r->type ) )
+            {
+                dsv->value.pStr = r->len != 0 ? values + r->value : NULL;
+            }
+            else
+            {
+                memcpy( &dsv->value, &r->bits, sizeof(r->bits) );
+            }
+        }
+    }
+
+    if( rc == 0 )
+    {
+        rc = DSV_CreateBatch( ctx, dsvs.data(), dsvs.size() );
+    }
+
+    munmap( map, st.st_size );
+    return rc;
+}
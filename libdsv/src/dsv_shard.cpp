@@ -0,0 +1,168 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "dsv.h"
+
+/*==============================================================================
+                               Macros
+==============================================================================*/
+/*! points of each shard on the ring, more points spread the load evenly */
+#define DSV_SHARD_VNODES        ( 64 )
+
+/*==============================================================================
+                              Structures
+==============================================================================*/
+/*! consistent hash ring, sorted points of ( position, shard ) */
+using dsv_ring_t = std::vector< std::pair< uint32_t, uint32_t > >;
+
+/*!=============================================================================
+
+    Mix the bits of the key, so that close instance IDs land far apart on
+    the ring (splitmix64 finalizer)
+
+@param[in]
+    x
+        key
+@return
+    position on the ring
+==============================================================================*/
+static uint32_t dsv_RingHash( uint64_t x )
+{
+    x += 0x9E3779B97F4A7C15ULL;
+    x = ( x ^ ( x >> 30 ) ) * 0xBF58476D1CE4E5B9ULL;
+    x = ( x ^ ( x >> 27 ) ) * 0x94D049BB133111EBULL;
+    x = x ^ ( x >> 31 );
+    return (uint32_t)( x >> 32 );
+}
+
+/*!=============================================================================
+
+    Build the consistent hash ring of a cluster. The servers and the clients
+    build the same ring from the shard count, so only the count needs to be
+    announced. Adding a shard moves only the instance IDs it takes over.
+
+@param[in]
+    count
+        number of shards
+@return
+    ring, released by DSV_ShardRingFree
+==============================================================================*/
+void *DSV_ShardRingNew( uint32_t count )
+{
+    dsv_ring_t *ring = new dsv_ring_t();
+    ring->reserve( count * DSV_SHARD_VNODES );
+
+    for( uint32_t shard = 0; shard < count; shard++ )
+    {
+        for( uint32_t v = 0; v < DSV_SHARD_VNODES; v++ )
+        {
+            uint64_t key = ( (uint64_t)( shard + 1 ) << 32 ) | v;
+            ring->push_back( std::make_pair( dsv_RingHash( key ), shard ) );
+        }
+    }
+    std::sort( ring->begin(), ring->end() );
+
+    return ring;
+}
+
+/*!=============================================================================
+
+    Release the ring built by DSV_ShardRingNew
+
+@param[in]
+    ring
+        ring to release, NULL is ignored
+==============================================================================*/
+void DSV_ShardRingFree( void *ring )
+{
+    delete (dsv_ring_t *)ring;
+}
+
+/*!=============================================================================
+
+    Find the shard owning a dsv. The dsvs of one instance always live
+    together, so the key is the instance ID in the [instID] prefix of the
+    full name. The metrics of shard n, under DSV_STATS_PREFIX "n/", are
+    owned by shard n, if the ring has it.
+
+@param[in]
+    ring
+        ring built by DSV_ShardRingNew
+@param[in]
+    name
+        full dsv name, eg, [123]/SYS/TEST/U32
+@return
+    index of the shard
+==============================================================================*/
+uint32_t DSV_ShardOf( const void *ring, const char *name )
+{
+    assert( ring );
+    assert( name );
+
+    const dsv_ring_t *r = (const dsv_ring_t *)ring;
+    if( r->empty() )
+    {
+        return 0;
+    }
+
+    size_t len = strlen( DSV_STATS_PREFIX );
+    if( strncmp( name, DSV_STATS_PREFIX, len ) == 0 &&
+        isdigit( (unsigned char)name[len] ) )
+    {
+        char *end = NULL;
+        unsigned long shard = strtoul( name + len, &end, 10 );
+        if( *end == '/' && shard < r->size() / DSV_SHARD_VNODES )
+        {
+            return (uint32_t)shard;
+        }
+    }
+
+    /* the instID is printed with %d by the creator */
+    uint32_t instID = 0;
+    if( name[0] == '[' )
+    {
+        instID = (uint32_t)strtol( name + 1, NULL, 10 );
+    }
+
+    uint32_t pos = dsv_RingHash( instID );
+    auto it = std::lower_bound( r->begin(),
+                                r->end(),
+                                std::make_pair( pos, (uint32_t)0 ) );
+    if( it == r->end() )
+    {
+        it = r->begin();
+    }
+    return it->second;
+}
@@ -31,7 +31,21 @@ SOFTWARE.
 #include <errno.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 #include <inttypes.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <memory>
+#include <system_error>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <type_traits>
+#include <algorithm>
+#include <string>
 #include "zmq.h"
 #include "dsv.h"
 #include "dsv_msg.h"
@@ -47,6 +61,21 @@ SOFTWARE.
 #define DSV_BACKEND             ( "tcp://localhost:56788" )
 #define DSV_REPLY               ( "tcp://localhost:56787" )
 
+/*! index of a fuzzy search is the index on a shard, and the shard above
+ * DSV_FUZZY_SHARD_SHIFT bits. -1 starts from the first shard */
+#define DSV_FUZZY_SHARD_SHIFT   ( 24 )
+#define DSV_FUZZY_SHARD( i )    ( (i) < 0 ? 0 : (uint32_t)(i) >> DSV_FUZZY_SHARD_SHIFT )
+#define DSV_FUZZY_LOCAL( i )    ( (i) < 0 ? -1 : \
+                                  (i) & ( ( 1 << DSV_FUZZY_SHARD_SHIFT ) - 1 ) )
+#define DSV_FUZZY_INDEX( s, i ) ( (int)( ( (s) << DSV_FUZZY_SHARD_SHIFT ) | (i) ) )
+
+/*! milliseconds to wait for the server to answer the connection handshake */
+#define DSV_HANDSHAKE_TIMEOUT   ( 1000 )
+
+/*! a create request fits in a DSV_MSG_CREATE_BATCH request by itself */
+#define DSV_CREATE_SIZE_MAX     ( DSV_MSG_SIZE_MAX - \
+                                  sizeof(dsv_msg_request_t) - sizeof(uint32_t) )
+
 /*==============================================================================
                                 Enums
 ==============================================================================*/
@@ -54,647 +83,3110 @@ SOFTWARE.
 /*=============================================================================
                               Structures
 ==============================================================================*/
+/*! an asynchronous request waiting for its reply */
+typedef struct dsv_pending
+{
+    dsv_reply_cb_t cb;
+    void *arg;
+}dsv_pending_t;
+
+using dsv_pending_map_t = std::unordered_map< uint32_t, dsv_pending_t >;
+
+/*! asynchronous requests of closed sockets, cancelled once no lock is held */
+using dsv_cancelled_t = std::vector< std::pair< uint32_t, dsv_pending_t > >;
+
+/*! sockets owned by one thread on a shared context */
+typedef struct dsv_thread_socks
+{
+    void *sock_request;
+    void *sock_publish;
+
+    /*! correlation id of the last request sent through sock_request */
+    uint32_t last_id;
+
+    /*! asynchronous requests waiting for their reply, keyed by id */
+    dsv_pending_map_t pending;
+
+    /*! the whole last reply received, may be larger than BUFSIZE */
+    std::vector< char > reply;
+}dsv_thread_socks_t;
+
+/*! sockets of every thread using a context, released by DSV_Close or at
+ *  the exit of the thread */
+typedef struct dsv_socks_pool
+{
+    std::mutex lock;
+    std::vector< dsv_thread_socks_t * > socks;
+
+    /*! held by the context and by each thread having sockets in the pool */
+    int refs;
+
+    /*! set by DSV_Close once the sockets are closed */
+    bool closed;
+}dsv_socks_pool_t;
+
+/*! thread-local entry mapping a context to the sockets of this thread */
+typedef struct dsv_tls_entry
+{
+    const dsv_context_t *ctx;
+    uint64_t serial;
+    dsv_socks_pool_t *pool;
+    dsv_thread_socks_t *socks;
+}dsv_tls_entry_t;
+
+/*! contexts used by a thread, their sockets are closed at its exit */
+typedef struct dsv_tls
+{
+    std::vector< dsv_tls_entry_t > entries;
+
+    ~dsv_tls();
+}dsv_tls_t;
+
+/*! local copy of a DSV_FLAG_DELTA array, the deltas are applied to */
+typedef struct dsv_mirror
+{
+    bool synced;
+    uint32_t version;
+    std::vector< int > items;
+}dsv_mirror_t;
+
+/*! dsvs parsed by DSV_CreateWithJson() and not sent yet */
+typedef struct dsv_json_batch
+{
+    void *ctx;
+    std::vector< dsv_info_t > dsvs;
+
+    /*! bytes of the create requests of the dsvs */
+    size_t size;
+
+    /*! last error of DSV_CreateBatch() */
+    int rc;
+}dsv_json_batch_t;
+
+/*! mirrors of a context keyed by dsv handle, used by the notification thread */
+using dsv_mirror_map_t = std::unordered_map< void *, dsv_mirror_t >;
+
+/*! message behind a dsv_notice_t: the frames as received, or a copy when
+ *  the message had to be put together or decoded */
+typedef struct dsv_notice_msg
+{
+    zmq_msg_t frames[2];
+    int count;
+    std::vector< char > copy;
+}dsv_notice_msg_t;
+
+/*! reply slot shared by the future of DSV_GetAsync and its callback */
+typedef struct dsv_async_slot
+{
+    bool done;
+    int result;
+    dsv_value_t value;
+}dsv_async_slot_t;
+
+/*==============================================================================
+                        Local/Private Variables
+==============================================================================*/
+/*! source of dsv_context_t serial numbers */
+static std::atomic< uint64_t > g_ctx_serial( 0 );
+
+/*! contexts used by this thread, searched without any lock */
+static thread_local dsv_tls_t t_socks;
+
+/*! source of connection handshake tokens */
+static std::atomic< uint32_t > g_hello_count( 0 );
 
 /*==============================================================================
                         Local/Private Function Protoypes
 ==============================================================================*/
 /*!=============================================================================
 
-    Send a message to the server, and get the feedback from it on demand
+    Allocate the correlation id for the next request of the thread
 
 @param[in]
-    ctx
-        dsv ctx ( returned by DSV_Open() )
-@param[in]
-    req_buf
-        request message buffer
-@param[in]
-    req_len
-        request message buffer length
-@param[in]
-    rep_buf
-        reply message buffer if it is not NULL
+    socks
+        sockets of the calling thread
+@return
+    non-zero correlation id, 0 is reserved for failure
+
+==============================================================================*/
+static uint32_t dsv_NextId( dsv_thread_socks_t *socks )
+{
+    if( ++socks->last_id == 0 )
+    {
+        ++socks->last_id;
+    }
+    return socks->last_id;
+}
+
+static int dsv_SendRequest( dsv_thread_socks_t *socks,
+                            const void *req_buf,
+                            size_t req_len );
+static size_t dsv_CreateSize( const dsv_info_t *pDsv );
+static int dsv_RecvReply( dsv_thread_socks_t *socks,
+                          void *rep_buf,
+                          size_t rep_len,
+                          int flags );
+
+/*!=============================================================================
+
+    Make sure the publish socket is connected before it is used, since
+    messages published earlier are dropped. A token is published to the
+    server repeatedly and the request socket asks whether it has arrived,
+    which also proves the server is alive.
+
 @param[in]
-    rep_len
-        length of the reply message buffer
+    socks
+        sockets of the calling thread, just connected
 @return
     0 - success
+    ETIMEDOUT - the server doesn't answer
     any other value specifies an error code (see errno.h)
 
 ==============================================================================*/
-static int dsv_SendMsg( void *ctx,
-                        const void *req_buf,
-                        size_t req_len,
-                        void *rep_buf,
-                        size_t rep_len )
+static int dsv_Handshake( dsv_thread_socks_t *socks )
 {
-    assert( ctx );
-    assert( req_buf );
-
     int rc;
+    char req_buf[sizeof(dsv_msg_request_t) + sizeof(uint64_t)];
+    char rep_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    struct timespec now;
 
-    if( req->type == DSV_MSG_CREATE ||
-        req->type == DSV_MSG_SET ||
-        req->type == DSV_MSG_INS_ITEM ||
-        req->type == DSV_MSG_DEL_ITEM ||
-        req->type == DSV_MSG_ADD_ITEM ||
-        req->type == DSV_MSG_SET_ITEM ||
-        req->type == DSV_MSG_SAVE ||
-        req->type == DSV_MSG_RESTORE )
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    int64_t deadline = now.tv_sec * 1000 + now.tv_nsec / 1000000 +
+                       DSV_HANDSHAKE_TIMEOUT;
+
+    /* unique enough across the processes and threads of the host */
+    uint64_t token = ( (uint64_t)getpid() << 32 ) ^
+                     ( (uint64_t)now.tv_nsec << 8 ) ^
+                     ++g_hello_count;
+
+    req->type = DSV_MSG_HELLO;
+    req->length = sizeof(req_buf);
+    *(uint64_t *)req->data = token;
+
+    while( 1 )
     {
-        /* create and set only use pub/sub pattern */
-        rc = zmq_send( dsv_ctx->sock_publish, req_buf, req_len, 0 );
+        rc = zmq_send( socks->sock_publish, req_buf, req->length, 0 );
         if( rc == -1 )
         {
             dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
             return EFAULT;
         }
-        else
+
+        req->id = dsv_NextId( socks );
+        rc = dsv_SendRequest( socks, req_buf, req->length );
+        if( rc != 0 )
         {
-            return 0;
+            return rc;
         }
-    }
-    else if( req->type == DSV_MSG_GET_HANDLE ||
-             req->type == DSV_MSG_GET_TYPE   ||
-             req->type == DSV_MSG_GET_LEN ||
-             req->type == DSV_MSG_GET ||
-             req->type == DSV_MSG_GET_NEXT ||
-             req->type == DSV_MSG_GET_ITEM ||
-             req->type == DSV_MSG_TRACK )
-    {
-        if( req_buf != NULL )
+
+        /* wait for the answer of this check */
+        do
         {
-            rc = zmq_send( dsv_ctx->sock_request, req_buf, req_len, 0 );
-            if( rc == -1 )
+            clock_gettime( CLOCK_MONOTONIC, &now );
+            int64_t left = deadline - ( now.tv_sec * 1000 + now.tv_nsec / 1000000 );
+            zmq_pollitem_t items[] = {
+                { socks->sock_request, 0, ZMQ_POLLIN, 0 }
+            };
+            if( left <= 0 || zmq_poll( items, 1, left ) <= 0 )
             {
-                dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
-                return EFAULT;
+                dsvlog( LOG_ERR, "dsv server doesn't answer the handshake" );
+                return ETIMEDOUT;
             }
-            else
+            if( dsv_RecvReply( socks, rep_buf, sizeof(rep_buf), 0 ) == -1 )
             {
-                rc = zmq_recv( dsv_ctx->sock_request, rep_buf, rep_len, 0 );
-                if( rc == -1 )
-                {
-                    dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
-                    return EFAULT;
-                }
-                else
-                {
-                    return rep->result;
-                }
+                dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
+                return EFAULT;
             }
+        } while( rep->id != req->id );
+
+        if( rep->result == 0 )
+        {
+            return 0;
         }
-    }
 
-    return 0;
+        /* the token is not there yet, publish it again shortly */
+        usleep( 1000 );
+    }
 }
 
 /*!=============================================================================
 
-    Recv a message from the server, used in querying the notifications
+    Create the request and publish sockets of the calling thread, and
+    connect them to the server
 
 @param[in]
-    ctx
-        dsv ctx ( returned by DSV_Open() )
-@param[in]
-    sub_buf
-        subscribe message buffer
-@param[in]
-    sub_len
-        subscribe message buffer length
+    dsv_ctx
+        dsv context
 @return
-    0 - success
-    any other value specifies an error code (see errno.h)
+    sockets of the thread
+    NULL - failed
 
 ==============================================================================*/
-static int dsv_RecvMsg( void *ctx,
-                        void *sub_buf,
-                        size_t sub_len )
+static dsv_thread_socks_t *dsv_CreateSocks( dsv_context_t *dsv_ctx )
 {
-    assert( ctx );
-    assert( sub_buf );
-
     int rc;
-    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
-    rc = zmq_recv( dsv_ctx->sock_subscribe, sub_buf, sub_len, 0 );
-    if( rc == -1 )
+    dsv_thread_socks_t *socks = new dsv_thread_socks_t();
+    socks->sock_request = NULL;
+    socks->sock_publish = NULL;
+    socks->last_id = 0;
+
+    /* Request socket, DEALER allows many requests in flight */
+    socks->sock_request = zmq_socket( dsv_ctx->zmq_ctx, ZMQ_DEALER );
+    if( socks->sock_request == NULL )
     {
-        dsvlog( LOG_ERR, "zmq_recv failed: %s", zmq_strerror( errno ) );
-        return EFAULT;
+        dsvlog( LOG_ERR, "Failed to call zmq_socket: %s", strerror( errno ) );
+        goto error;
     }
-    return 0;
+    rc = zmq_connect( socks->sock_request, dsv_ctx->reply_url );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to call zmq_connect: %s", strerror( errno ) );
+        goto error;
+    }
+
+    /* publish socket */
+    socks->sock_publish = zmq_socket( dsv_ctx->zmq_ctx, ZMQ_PUB );
+    if( socks->sock_publish == NULL )
+    {
+        dsvlog( LOG_ERR, "Failed to call zmq_socket: %s", strerror( errno ) );
+        goto error;
+    }
+    rc = zmq_connect( socks->sock_publish, dsv_ctx->frontend_url );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to call zmq_connect: %s", strerror( errno ) );
+        goto error;
+    }
+    if( dsv_Handshake( socks ) != 0 )
+    {
+        goto error;
+    }
+    return socks;
+
+error:
+    if( socks->sock_publish != NULL )
+    {
+        zmq_close( socks->sock_publish );
+    }
+    if( socks->sock_request != NULL )
+    {
+        zmq_close( socks->sock_request );
+    }
+    delete socks;
+    return NULL;
 }
+
 /*!=============================================================================
 
-    Read the file into the buffer
+    Close the sockets of a thread, the asynchronous requests waiting for a
+    reply are taken to be cancelled by dsv_Cancel()
 
 @param[in]
-    file
-        File name
-@param[in]
-    buf
-        buffer to hold the file content
-@param[in]
-    size
-        size of buffer
-@return
-    0 - success
-    others - failed
+    socks
+        sockets of a thread, freed
+@param[in,out]
+    cancelled
+        requests to cancel
+==============================================================================*/
+static void dsv_CloseSocks( dsv_thread_socks_t *socks,
+                            dsv_cancelled_t &cancelled )
+{
+    cancelled.insert( cancelled.end(),
+                      socks->pending.begin(),
+                      socks->pending.end() );
+    zmq_close( socks->sock_publish );
+    zmq_close( socks->sock_request );
+    delete socks;
+}
+
+/*!=============================================================================
+
+    Call back the asynchronous requests of closed sockets with ECANCELED, so
+    they release whatever they hold. No lock may be held, and no
+    thread-local entry may point at the closed sockets any more, as a
+    callback may use the context again.
 
+@param[in]
+    cancelled
+        requests taken by dsv_CloseSocks()
 ==============================================================================*/
-static int dsv_ReadFile( const char *file, char *buf, size_t size )
+static void dsv_Cancel( const dsv_cancelled_t &cancelled )
 {
-    assert( file );
-    assert( buf );
+    for( auto &[id, p] : cancelled )
+    {
+        p.cb( id, ECANCELED, NULL, 0, p.arg );
+    }
+}
 
-    int rc = 0;
-    FILE *fp;
-    int  file_size, read_size;
+/*!=============================================================================
 
-    /* Open the JSON file for reading */
-    fp = fopen( file, "r" );
-    if( fp != NULL )
+    Drop a reference to a pool of sockets, the last one frees it
+
+@param[in]
+    pool
+        pool of sockets of a context
+==============================================================================*/
+static void dsv_PoolRelease( dsv_socks_pool_t *pool )
+{
+    bool last;
     {
-        /* Determine the size of the file */
-        fseek( fp, 0L, SEEK_END );
-        file_size = ftell( fp );
-        rewind( fp );
+        std::lock_guard< std::mutex > guard( pool->lock );
+        last = --pool->refs == 0;
+    }
+    if( last )
+    {
+        delete pool;
+    }
+}
 
-        /* Allocate memory for the file contents */
-        if( file_size < size )
-        {
-            /* Read the file contents into memory */
-            read_size = fread( buf, 1, file_size, fp );
-            if( read_size != file_size )
-            {
-                dsvlog( LOG_ERR, "Failed to read json file: %s", file );
-                rc = EINVAL;
-            }
-        }
-        else
+/*!=============================================================================
+
+    Release a thread-local entry taken out of t_socks, its sockets are
+    closed unless DSV_Close closed them already
+
+@param[in]
+    e
+        entry of the calling thread
+@param[in,out]
+    cancelled
+        requests to cancel
+==============================================================================*/
+static void dsv_ReleaseEntry( const dsv_tls_entry_t &e,
+                              dsv_cancelled_t &cancelled )
+{
+    {
+        std::lock_guard< std::mutex > guard( e.pool->lock );
+        if( !e.pool->closed )
         {
-            dsvlog( LOG_ERR, "Json file exceeds maximum size: %s", file );
-            rc = EINVAL;
+            auto &socks = e.pool->socks;
+            socks.erase( std::remove( socks.begin(), socks.end(), e.socks ),
+                         socks.end() );
+            dsv_CloseSocks( e.socks, cancelled );
         }
-        fclose( fp );
     }
-    else
+    dsv_PoolRelease( e.pool );
+}
+
+/*!=============================================================================
+
+    Release the thread-local entries matching a predicate, then cancel the
+    requests of their sockets
+
+@param[in]
+    drop
+        predicate on dsv_tls_entry_t
+==============================================================================*/
+template< typename F >
+static void dsv_ReleaseEntries( F drop )
+{
+    std::vector< dsv_tls_entry_t > &entries = t_socks.entries;
+    auto first = std::partition( entries.begin(),
+                                 entries.end(),
+                                 [&drop]( const dsv_tls_entry_t &e ) {
+                                     return !drop( e );
+                                 } );
+    std::vector< dsv_tls_entry_t > dropped( first, entries.end() );
+    entries.erase( first, entries.end() );
+
+    dsv_cancelled_t cancelled;
+    for( auto &e : dropped )
     {
-        dsvlog( LOG_ERR, "Failed to open json file: %s.", file );
-        rc = EINVAL;
+        dsv_ReleaseEntry( e, cancelled );
     }
+    dsv_Cancel( cancelled );
+}
 
-    return rc;
+/*!=============================================================================
+
+    Close the sockets of the exiting thread on the contexts still open
+==============================================================================*/
+dsv_tls::~dsv_tls()
+{
+    /* a callback may open sockets again */
+    while( !entries.empty() )
+    {
+        dsv_ReleaseEntries( []( const dsv_tls_entry_t & ) { return true; } );
+    }
 }
 
 /*!=============================================================================
 
-    Parse the JSON buffer and call DSV_Create to create dsv
+    Find the sockets of the calling thread on the context, creating them on
+    first use. The lookup is thread-local and takes no lock, only creation
+    registers the sockets in the pool of the context.
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
-@param[in]
-    instID
-        dsv instance ID passed by the creator, normally device GUID
-@param[in]
-    buf
-        pointer to the JSON string
 @return
-    0 - success
-    others - failed
+    sockets of the thread
+    NULL - failed
 
 ==============================================================================*/
-static int dsv_ParseJsonStr( void *ctx, uint32_t instID, const char *buf )
+static dsv_thread_socks_t *dsv_GetSocks( void *ctx )
 {
     assert( ctx );
-    assert( buf );
 
-    dsv_info_t dsv = { 0 };
-    int rc = EINVAL;
-    int array_size;
-    int i;
-    cJSON *e;
-    cJSON *m;
-    cJSON *root = cJSON_Parse( buf );
-    array_size = cJSON_GetArraySize( root );
-    dsv.instID = instID;
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    std::vector< dsv_tls_entry_t > &entries = t_socks.entries;
 
-    for( i = 0; i < array_size; i++ )
+    for( auto &e : entries )
     {
-        e = cJSON_GetArrayItem( root, i );
-
-        /* handle dsv name */
-        m = cJSON_GetObjectItem( e, "name" );
-        if( cJSON_IsString( m ) && m->valuestring != NULL )
+        if( e.ctx == dsv_ctx && e.serial == dsv_ctx->serial )
         {
-            //printf("name:%s\n",m->valuestring);
-            dsv.pName = (char *)malloc( DSV_STRING_SIZE_MAX );
-            snprintf( dsv.pName, DSV_STRING_SIZE_MAX,
-                      "[%d]%s", instID, m->valuestring );
+            return e.socks;
         }
+    }
 
-        /* handle dsv description */
-        m = cJSON_GetObjectItem( e, "description" );
-        if( cJSON_IsString( m ) && m->valuestring != NULL )
-        {
-            //printf("desc:%s\n",m->valuestring);
-            dsv.pDesc = strdup( m->valuestring );
-        }
+    /* forget the contexts closed since, eg, the address is used again */
+    dsv_ReleaseEntries( []( const dsv_tls_entry_t &e ) {
+        std::lock_guard< std::mutex > guard( e.pool->lock );
+        return e.pool->closed;
+    } );
 
-        /* handle dsv tags */
-        m = cJSON_GetObjectItem( e, "tags" );
-        if( cJSON_IsString( m ) && m->valuestring != NULL )
+    /* a callback cancelled by DSV_Close gets no new sockets */
+    dsv_socks_pool_t *pool = (dsv_socks_pool_t *)dsv_ctx->pool;
+    if( pool == NULL )
+    {
+        return NULL;
+    }
+    {
+        std::lock_guard< std::mutex > guard( pool->lock );
+        if( pool->closed )
         {
-            //printf("tags:%s\n",m->valuestring);
-            dsv.pTags = strdup( m->valuestring );
+            return NULL;
         }
+    }
 
-        /* handle dsv type first */
-        m = cJSON_GetObjectItem( e, "type" );
-        if( cJSON_IsString( m ) && m->valuestring != NULL )
-        {
-            //printf("type:%s\n",m->valuestring);
-            dsv.type = DSV_GetTypeFromStr( m->valuestring );
-            dsv.len = DSV_GetSizeFromType( dsv.type );
-        }
+    dsv_thread_socks_t *socks = dsv_CreateSocks( dsv_ctx );
+    if( socks == NULL )
+    {
+        return NULL;
+    }
 
-        /* handle dsv default value */
-        m = cJSON_GetObjectItem( e, "value" );
-        if( cJSON_IsString( m ) && m->valuestring != NULL )
-        {
-            DSV_Str2Value( m->valuestring, &dsv );
-        }
-        else if( cJSON_IsNumber( m ) || cJSON_IsBool( m ) )
+    {
+        std::lock_guard< std::mutex > guard( pool->lock );
+        if( pool->closed )
         {
-            if( DSV_Double2Value( m->valuedouble, &dsv ) != 0 )
-            {
-                dsvlog( LOG_ERR,
-                        "The dsv type doesn't match the value: %s",
-                        dsv.pName  );
-                continue;
-            }
+            dsv_cancelled_t cancelled;
+            dsv_CloseSocks( socks, cancelled );
+            return NULL;
         }
+        pool->socks.push_back( socks );
+        pool->refs++;
+    }
 
-        /* handle dsv flags */
-        m = cJSON_GetObjectItem( e, "flags" );
-        if( cJSON_IsString( m ) && m->valuestring != NULL )
-        {
-            //printf("flags:%s\n",m->valuestring);
-            dsv.flags |= DSV_GetFlagsFromStr( m->valuestring );;
-        }
-        rc = DSV_Create( ctx, instID, &dsv );
-        if( rc != 0 )
-        {
-            /* continue even fail one dsv */
-            dsvlog( LOG_ERR, "Failed to create dsv: %s", dsv.pName );
-        }
-
-        if( dsv.pName )
-        {
-            free( dsv.pName );
-        }
-        if( dsv.pDesc )
-        {
-            free( dsv.pDesc );
-        }
-        if( dsv.pTags )
-        {
-            free( dsv.pTags );
-        }
-        if( dsv.type == DSV_TYPE_STR && dsv.value.pStr != NULL )
-        {
-            free( dsv.value.pStr );
-        }
-        if( dsv.type == DSV_TYPE_INT_ARRAY && dsv.value.pArray != NULL )
-        {
-            free( dsv.value.pArray );
-        }
-
-    }
-    return rc;
-}
+    entries.push_back( { dsv_ctx, dsv_ctx->serial, pool, socks } );
+    return socks;
+}
 
 /*!=============================================================================
 
-    This function fills the request buffer with hndl
-    The request buffer is a data structure:
-    +-----------------------+
-    | type: DSV_MSG_SET     |
-    +-----------------------+
-    | length                |
-    +-----------------------+
-    | handle (dsv_info_t *) |
-    +-----------------------+
+    Find the context of the shard serving the request. Name based requests
+    go to the shard owning the instance ID by the consistent hash ring,
+    handle based ones to the shard tagged in the handle, the others to the
+    given context.
 
 @param[in]
-    dest
-        destination buffer
-
+    ctx
+        dsv ctx ( returned by DSV_Open() )
 @param[in]
-    dsv
-        pointer of dsv information structure, holding type, len and value
-
+    req_buf
+        request message buffer
 @return
-    positive number - number of bytes copied
-    -1 - failed
+    context of the shard
 
 ==============================================================================*/
-static int fill_req_buf( char *req_buf, int type, const void *hndl )
+static dsv_context_t *dsv_Route( void *ctx, const void *req_buf )
 {
-    assert( req_buf );
-    assert( hndl );
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    const dsv_msg_request_t *req = (const dsv_msg_request_t *)req_buf;
+    uint32_t shard = 0;
 
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+    if( dsv_ctx->shard_count <= 1 )
+    {
+        return dsv_ctx;
+    }
 
-    req->type = type;
-    req->length = sizeof(dsv_msg_request_t);
+    switch( req->type )
+    {
+    case DSV_MSG_CREATE:
+        shard = DSV_ShardOf( dsv_ctx->ring, req->data + sizeof(dsv_info_t) );
+        break;
 
-    memcpy( req_data, &hndl, sizeof(hndl) );
-    req->length += sizeof(hndl);
+    case DSV_MSG_GET_HANDLE:
+        shard = DSV_ShardOf( dsv_ctx->ring, req->data );
+        break;
 
-    return sizeof(hndl);
+    case DSV_MSG_GET_TYPE:
+    case DSV_MSG_GET_LEN:
+    case DSV_MSG_SET:
+    case DSV_MSG_GET:
+    case DSV_MSG_ADD_ITEM:
+    case DSV_MSG_DEL_ITEM:
+    case DSV_MSG_INS_ITEM:
+    case DSV_MSG_SET_ITEM:
+    case DSV_MSG_GET_ITEM:
+    case DSV_MSG_INCR:
+    case DSV_MSG_FETCH_ADD:
+    case DSV_MSG_CAS:
+    case DSV_MSG_SET_RANGE:
+    case DSV_MSG_APPEND_ITEMS:
+    case DSV_MSG_DEL_RANGE:
+    case DSV_MSG_GET_RANGE:
+    case DSV_MSG_RESYNC:
+    case DSV_MSG_GET_HISTORY:
+    case DSV_MSG_ALIAS:
+    case DSV_MSG_DELETE:
+        shard = DSV_HANDLE_SHARD( *(void **)req->data );
+        break;
+
+    default:
+        return dsv_ctx;
+    }
+
+    return shard < dsv_ctx->shard_count ? dsv_ctx->shards[shard] : dsv_ctx;
 }
+
 /*!=============================================================================
 
-    As a client, it creates zmq client and subscriber socket and connect them
-    to the dsv server endpoint
+    Get the number of shards of the context, 1 for a standalone server
 
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
 @return
-    dsv ctx pointer
-    NULL for fail
+    number of shards
+
 ==============================================================================*/
-void* DSV_Open( void )
+static uint32_t dsv_ShardCount( void *ctx )
 {
-    dsv_context_t *ctx = NULL;
-    int rc;
-    char server_ip[64] = { 0 };
-    char reply_url[DSV_STRING_SIZE_MAX];
-    char frontend_url[DSV_STRING_SIZE_MAX];
-    char backend_url[DSV_STRING_SIZE_MAX];
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    return dsv_ctx->shard_count > 1 ? dsv_ctx->shard_count : 1;
+}
 
-    if( !DSV_FindDiscoveryServer( server_ip, 64 ) )
-    {
-        dsvlog( LOG_ERR, "Error: No DSV server found!" );
-        return NULL;
-    }
+/*!=============================================================================
 
-    assert( server_ip[0] );
-    snprintf( frontend_url, DSV_STRING_SIZE_MAX, "tcp://%s:56789", server_ip );
-    snprintf( backend_url, DSV_STRING_SIZE_MAX, "tcp://%s:56788", server_ip );
-    snprintf( reply_url, DSV_STRING_SIZE_MAX, "tcp://%s:56787", server_ip );
+    Get the context of a shard
 
-    /* allocate memory for the System Variable Resource Manager interface
-       structure */
-    ctx = (dsv_context_t *)calloc( sizeof(dsv_context_t), 1 );
-    if( ctx == NULL )
-    {
-        dsvlog( LOG_ERR, "Unable to alloc memory for dsv_context_t" );
-        goto error;
-    }
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    shard
+        index of the shard, less than dsv_ShardCount()
+@return
+    context of the shard
 
-    ctx->zmq_ctx = zmq_ctx_new();
-    if( ctx == NULL )
-    {
-        dsvlog( LOG_ERR, "Failed to call zmq_ctx_new: %s", strerror( errno ) );
-        goto error;
-    }
+==============================================================================*/
+static dsv_context_t *dsv_Shard( void *ctx, uint32_t shard )
+{
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    return dsv_ctx->shard_count > 1 ? dsv_ctx->shards[shard] : dsv_ctx;
+}
 
-    /* Request socket */
-    ctx->sock_request = zmq_socket( ctx->zmq_ctx, ZMQ_REQ );
-    if( ctx->sock_request == NULL )
-    {
-        dsvlog( LOG_ERR, "Failed to call zmq_socket: %s", strerror( errno ) );
-        goto error;
-    }
-    rc = zmq_connect( ctx->sock_request, reply_url );
-    if( rc != 0 )
-    {
-        dsvlog( LOG_ERR, "Failed to call zmq_connect: %s", strerror( errno ) );
-        goto error;
-    }
+/*!=============================================================================
 
-    /* publish socket */
-    ctx->sock_publish = zmq_socket( ctx->zmq_ctx, ZMQ_PUB );
-    if( ctx->sock_publish == NULL )
-    {
-        dsvlog( LOG_ERR, "Failed to call zmq_socket: %s", strerror( errno ) );
-        goto error;
-    }
-    rc = zmq_connect( ctx->sock_publish, frontend_url );
-    if( rc != 0 )
-    {
-        dsvlog( LOG_ERR, "Failed to call zmq_connect: %s", strerror( errno ) );
-        goto error;
-    }
-    /*now just wait 100ms for publisher connected to endpoint */
-    usleep( 100000 );
+    Send a request to the server through the DEALER socket. The empty
+    delimiter frame keeps the same envelope as a REQ socket.
 
-    /* subscribe socket */
-    ctx->sock_subscribe = zmq_socket( ctx->zmq_ctx, ZMQ_SUB );
-    if( ctx->sock_subscribe == NULL )
+@param[in]
+    socks
+        sockets of the calling thread
+@param[in]
+    req_buf
+        request message buffer
+@param[in]
+    req_len
+        request message buffer length
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+static int dsv_SendRequest( dsv_thread_socks_t *socks,
+                            const void *req_buf,
+                            size_t req_len )
+{
+    int rc = zmq_send( socks->sock_request, "", 0, ZMQ_SNDMORE );
+    if( rc != -1 )
     {
-        dsvlog( LOG_ERR, "Failed to call zmq_socket: %s", strerror( errno ) );
-        goto error;
+        rc = DSV_SendChunks( socks->sock_request, req_buf, req_len, 0 );
     }
-    rc = zmq_connect( ctx->sock_subscribe, backend_url );
-    if( rc != 0 )
+    if( rc == -1 )
     {
-        dsvlog( LOG_ERR, "Failed to call zmq_connect: %s", strerror( errno ) );
-        goto error;
+        dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
+        return EFAULT;
     }
-    return (void *)ctx;
-
-error:
-    DSV_Close( ctx );
-
-    return NULL;
+    return 0;
 }
 
 /*!=============================================================================
 
-    Release all the resource of the client
+    Receive one reply from the DEALER socket. The whole reply is kept in the
+    sockets of the thread, rep_buf gets the part that fits.
 
 @param[in]
-    ctx
-        dsv ctx holding all the resource pointer
+    socks
+        sockets of the calling thread
+@param[out]
+    rep_buf
+        reply message buffer
+@param[in]
+    rep_len
+        length of the reply message buffer
+@param[in]
+    flags
+        0 to block, ZMQ_DONTWAIT to return immediately if nothing is queued
+@return
+    number of bytes of the whole reply
+    -1 - failed, errno is set
 
 ==============================================================================*/
-void DSV_Close( void *ctx )
+static int dsv_RecvReply( dsv_thread_socks_t *socks,
+                          void *rep_buf,
+                          size_t rep_len,
+                          int flags )
 {
-    assert( ctx );
-
-    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
-
-    if( dsv_ctx->sock_subscribe != NULL )
+    /* skip the empty delimiter frame, the payload is in the same message */
+    int rc = zmq_recv( socks->sock_request, rep_buf, rep_len, flags );
+    if( rc != -1 )
     {
-        zmq_close( dsv_ctx->sock_subscribe );
-    }
-
-    if( dsv_ctx->sock_publish != NULL )
-    {
-        zmq_close( dsv_ctx->sock_publish );
-    }
-
-    if( dsv_ctx->sock_request != NULL )
-    {
-        zmq_close( dsv_ctx->sock_request );
-    }
-
-    if( dsv_ctx->zmq_ctx != NULL )
-    {
-        zmq_ctx_destroy( dsv_ctx->zmq_ctx );
+        rc = DSV_RecvChunks( socks->sock_request, socks->reply, 0 );
     }
-
-    if( dsv_ctx != NULL )
+    if( rc != -1 )
     {
-        free( dsv_ctx );
+        memcpy( rep_buf, socks->reply.data(), std::min( (size_t)rc, rep_len ) );
     }
+    return rc;
 }
 
 /*!=============================================================================
 
-    This function request dsv server to create one or multiple dsv with
-    information provided.
+    Hand the reply over to the callback of its asynchronous request
 
 @param[in]
-    ctx
-        dsv ctx ( returned by DSV_Open() )
-@param[in]
-    instID
-        dsv instance ID passed by the creator, normally device short GUID
+    socks
+        sockets of the calling thread
 @param[in]
-    file
-        JSON file name
+    rep_buf
+        reply message buffer
 @return
     0 - success
-    any other value specifies an error code (see errno.h)
+    ENOENT - no request is waiting for this reply
 
 ==============================================================================*/
-int DSV_CreateWithJson( void *ctx, uint32_t instID, const char *file )
+static int dsv_DispatchReply( dsv_thread_socks_t *socks, const void *rep_buf )
 {
-    assert( ctx );
-    assert( file );
-
-    int rc;
-    char *json_buf = (char *)malloc( DSV_JSON_FILE_SIZE_MAX );
-    if( json_buf == NULL )
-    {
-        dsvlog( LOG_ERR, "Unable to allocate memory\n" );
-        return EINVAL;
-    }
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    dsv_pending_map_t *pending = &socks->pending;
 
-    rc = dsv_ReadFile( file, json_buf, DSV_JSON_FILE_SIZE_MAX );
-    if( rc == 0 )
+    auto e = pending->find( rep->id );
+    if( e == pending->end() )
     {
-        rc = dsv_ParseJsonStr( ctx, instID, json_buf );
+        dsvlog( LOG_WARNING, "Drop the reply of unknown request %u", rep->id );
+        return ENOENT;
     }
 
-    free( json_buf );
-    return rc;
+    /* remove it first, so the callback is free to send new requests */
+    dsv_pending_t p = e->second;
+    pending->erase( e );
+    p.cb( rep->id,
+          rep->result,
+          rep->data,
+          rep->length - sizeof(dsv_msg_reply_t),
+          p.arg );
+    return 0;
 }
 
 /*!=============================================================================
 
-    This function requests dsv server to create one dsv with dsv_info_t
-    structure.
+    Send a request without waiting for the reply. The reply is passed to the
+    callback later by DSV_Dispatch or any synchronous request.
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
 @param[in]
-    instID
-        dsv instance ID passed by the creator, normally device instance ID
+    req_buf
+        request message buffer
 @param[in]
-    pDsv
-        pointer to the dsv information of dsv_info_t structure
+    req_len
+        request message buffer length
+@param[in]
+    cb
+        callback to invoke with the reply
+@param[in]
+    arg
+        opaque argument passed to cb
 @return
-    0 - success
-    any other value specifies an error code (see errno.h)
+    correlation id of the request
+    0 - failed
 
 ==============================================================================*/
-int DSV_Create( void *ctx, uint32_t instID, dsv_info_t *pDsv )
+static uint32_t dsv_SendAsync( void *ctx,
+                               void *req_buf,
+                               size_t req_len,
+                               dsv_reply_cb_t cb,
+                               void *arg )
 {
     assert( ctx );
-    assert( pDsv );
+    assert( req_buf );
+    assert( cb );
 
-    int rc = EINVAL;
-    char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
-    int len = 0;
-
-    pDsv->pid = getpid();
-
-    req->type = DSV_MSG_CREATE;
-    req->length = sizeof(dsv_msg_request_t);
-
-    memcpy( req_data, pDsv, sizeof(dsv_info_t) );
-    len = sizeof(dsv_info_t);
-    req->length += len;
-    req_data += len;
-
-    strncpy( req_data, pDsv->pName ? pDsv->pName : "", DSV_STRING_SIZE_MAX );
-    len = strlen( req_data ) + 1;
-    req->length += len;
-    req_data += len;
-
-    strncpy( req_data, pDsv->pDesc ? pDsv->pDesc : "", DSV_STRING_SIZE_MAX );
-    len = strlen( req_data ) + 1;
-    req->length += len;
-    req_data += len;
-
-    strncpy( req_data, pDsv->pTags ? pDsv->pTags : "", DSV_STRING_SIZE_MAX );
-    len = strlen( req_data ) + 1;
-    req->length += len;
-    req_data += len;
-
-    if( pDsv->type == DSV_TYPE_STR || pDsv->type == DSV_TYPE_INT_ARRAY )
+    dsv_thread_socks_t *socks = dsv_GetSocks( dsv_Route( ctx, req_buf ) );
+    if( socks == NULL )
     {
-        if( pDsv->value.pStr != NULL && pDsv->len != 0 )
-        {
-            memcpy( req_data, pDsv->value.pStr, pDsv->len );
-            req->length += pDsv->len;
-        }
+        return 0;
     }
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
+    req->id = dsv_NextId( socks );
+
+    if( dsv_SendRequest( socks, req_buf, req_len ) != 0 )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server: %s", pDsv->pName );
-        return EFAULT;
+        return 0;
     }
 
-    return rc;
+    socks->pending[req->id] = { cb, arg };
+    return req->id;
 }
 
 /*!=============================================================================
 
-    Query the dsv handle from dsv server database by dsv name
+    Send a message to the server, and get the feedback from it on demand
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
 @param[in]
-    name
-        pointer to a NULL terminated dsv namne string
-@return
-    a handle to the dsv in the dsv server,
-    NULL if not found.
+    req_buf
+        request message buffer
+@param[in]
+    req_len
+        request message buffer length
+@param[in]
+    rep_buf
+        reply message buffer if it is not NULL
+@param[in]
+    rep_len
+        length of the reply message buffer
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+static int dsv_SendMsg( void *ctx,
+                        const void *req_buf,
+                        size_t req_len,
+                        void *rep_buf,
+                        size_t rep_len )
+{
+    assert( ctx );
+    assert( req_buf );
+
+    int rc;
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    dsv_thread_socks_t *socks = dsv_GetSocks( dsv_Route( ctx, req_buf ) );
+    if( socks == NULL )
+    {
+        return EFAULT;
+    }
+
+    if( req->type == DSV_MSG_CREATE ||
+        req->type == DSV_MSG_CREATE_BATCH ||
+        req->type == DSV_MSG_SET ||
+        req->type == DSV_MSG_INS_ITEM ||
+        req->type == DSV_MSG_DEL_ITEM ||
+        req->type == DSV_MSG_ADD_ITEM ||
+        req->type == DSV_MSG_SET_ITEM ||
+        req->type == DSV_MSG_INCR ||
+        req->type == DSV_MSG_SET_RANGE ||
+        req->type == DSV_MSG_APPEND_ITEMS ||
+        req->type == DSV_MSG_DEL_RANGE ||
+        req->type == DSV_MSG_SAVE ||
+        req->type == DSV_MSG_RESTORE )
+    {
+        /* create and set only use pub/sub pattern */
+        rc = DSV_SendChunks( socks->sock_publish, req_buf, req_len, 0 );
+        if( rc == -1 )
+        {
+            dsvlog( LOG_ERR, "zmq_send failed: %s", strerror( errno ) );
+            return EFAULT;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    else if( req->type == DSV_MSG_GET_HANDLE ||
+             req->type == DSV_MSG_GET_TYPE   ||
+             req->type == DSV_MSG_GET_LEN ||
+             req->type == DSV_MSG_GET ||
+             req->type == DSV_MSG_GET_NEXT ||
+             req->type == DSV_MSG_GET_ITEM ||
+             req->type == DSV_MSG_TRACK ||
+             req->type == DSV_MSG_FETCH_ADD ||
+             req->type == DSV_MSG_CAS ||
+             req->type == DSV_MSG_GET_RANGE ||
+             req->type == DSV_MSG_RESYNC ||
+             req->type == DSV_MSG_GET_HISTORY ||
+             req->type == DSV_MSG_QUERY_TAG ||
+             req->type == DSV_MSG_QUERY_FILTER ||
+             req->type == DSV_MSG_ALIAS ||
+             req->type == DSV_MSG_DELETE ||
+             req->type == DSV_MSG_DELETE_PREFIX )
+    {
+        req->id = dsv_NextId( socks );
+
+        rc = dsv_SendRequest( socks, req_buf, req_len );
+        if( rc != 0 )
+        {
+            return rc;
+        }
+
+        /* replies of earlier asynchronous requests may arrive first */
+        while( 1 )
+        {
+            rc = dsv_RecvReply( socks, rep_buf, rep_len, 0 );
+            if( rc == -1 )
+            {
+                dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
+                return EFAULT;
+            }
+
+            if( rep->id == req->id )
+            {
+                return rep->result;
+            }
+            dsv_DispatchReply( socks, rep_buf );
+        }
+    }
+
+    return 0;
+}
+
+/*!=============================================================================
+
+    Send a request to the server and get the whole reply, which may be larger
+    than BUFSIZE
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    req_buf
+        request message buffer
+@param[in]
+    req_len
+        request message buffer length
+@param[out]
+    rep
+        whole reply message
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+static int dsv_Query( void *ctx,
+                      const void *req_buf,
+                      size_t req_len,
+                      std::vector< char > &rep )
+{
+    dsv_msg_reply_t head;
+
+    int rc = dsv_SendMsg( ctx, req_buf, req_len, &head, sizeof(head) );
+    if( rc == 0 )
+    {
+        /* the reply of the request is the last one received by the thread */
+        dsv_thread_socks_t *socks = dsv_GetSocks( dsv_Route( ctx, req_buf ) );
+        rep.swap( socks->reply );
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Recv a message from the server, used in querying the notifications
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[out]
+    msg
+        notification, resized to its length
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+static int dsv_RecvMsg( void *ctx, std::vector< char > &msg )
+{
+    assert( ctx );
+
+    int rc;
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    /* a stale delta is dropped, wait for the next notification */
+    do
+    {
+        rc = DSV_RecvChunks( dsv_ctx->sock_subscribe, msg, 0 );
+        if( rc == -1 )
+        {
+            dsvlog( LOG_ERR, "zmq_recv failed: %s", zmq_strerror( errno ) );
+            return EFAULT;
+        }
+        rc = DSV_DecodeNotification( ctx, msg );
+    } while( rc == 0 );
+
+    return rc < 0 ? EFAULT : 0;
+}
+/*!=============================================================================
+
+    Free the strings and the value of a dsv parsed from JSON
+
+@param[in]
+    pDsv
+        pointer to the dsv information filled by DSV_ParseJson()
+
+==============================================================================*/
+void DSV_FreeInfo( dsv_info_t *pDsv )
+{
+    free( pDsv->pName );
+    free( pDsv->pDesc );
+    free( pDsv->pTags );
+    free( pDsv->pCalc );
+    cJSON_free( pDsv->pRules );
+    free( pDsv->pAliases );
+    if( pDsv->type == DSV_TYPE_STR ||
+        pDsv->type == DSV_TYPE_INT_ARRAY ||
+        DSV_TYPE_IS_BLOB( pDsv->type ) )
+    {
+        free( pDsv->value.pStr );
+    }
+}
+
+/*!=============================================================================
+
+    Convert one entry of a JSON schema into the information of a dsv
+
+@param[in]
+    e
+        JSON object of the entry
+@param[in]
+    instID
+        dsv instance ID passed by the creator, normally device GUID
+@param[out]
+    pDsv
+        dsv information, freed by DSV_FreeInfo()
+@return
+    0 - success
+    EINVAL - the value doesn't match the type
+
+==============================================================================*/
+static int dsv_ParseJsonEntry( const cJSON *e, uint32_t instID, dsv_info_t *pDsv )
+{
+    cJSON *m;
+    dsv_info_t dsv = { 0 };
+    dsv.instID = instID;
+
+    /* handle dsv name */
+    m = cJSON_GetObjectItem( e, "name" );
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        //printf("name:%s\n",m->valuestring);
+        dsv.pName = (char *)malloc( DSV_STRING_SIZE_MAX );
+        snprintf( dsv.pName, DSV_STRING_SIZE_MAX,
+                  "[%d]%s", instID, m->valuestring );
+    }
+
+    /* handle dsv description */
+    m = cJSON_GetObjectItem( e, "description" );
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        //printf("desc:%s\n",m->valuestring);
+        dsv.pDesc = strdup( m->valuestring );
+    }
+
+    /* handle dsv tags */
+    m = cJSON_GetObjectItem( e, "tags" );
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        //printf("tags:%s\n",m->valuestring);
+        dsv.pTags = strdup( m->valuestring );
+    }
+
+    /* handle dsv expression of a calculated dsv */
+    m = cJSON_GetObjectItem( e, "calc" );
+    dsv.pCalc = NULL;
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        dsv.pCalc = strdup( m->valuestring );
+    }
+
+    /* handle dsv validation rules, passed to the server as one object */
+    cJSON *rules = cJSON_CreateObject();
+    for( const char *key : { "min", "max", "enum", "regex" } )
+    {
+        m = cJSON_GetObjectItem( e, key );
+        if( m != NULL )
+        {
+            cJSON_AddItemToObject( rules, key, cJSON_Duplicate( m, 1 ) );
+        }
+    }
+    dsv.pRules = rules->child ? cJSON_PrintUnformatted( rules ) : NULL;
+    cJSON_Delete( rules );
+
+    /* handle dsv aliases, a string or an array of strings */
+    m = cJSON_GetObjectItem( e, "aliases" );
+    dsv.pAliases = NULL;
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        dsv.pAliases = strdup( m->valuestring );
+    }
+    else if( cJSON_IsArray( m ) )
+    {
+        std::string aliases;
+        const cJSON *a;
+        cJSON_ArrayForEach( a, m )
+        {
+            if( cJSON_IsString( a ) && a->valuestring != NULL )
+            {
+                aliases += aliases.empty() ? "" : ",";
+                aliases += a->valuestring;
+            }
+        }
+        dsv.pAliases = strdup( aliases.c_str() );
+    }
+
+    /* handle dsv type first */
+    m = cJSON_GetObjectItem( e, "type" );
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        //printf("type:%s\n",m->valuestring);
+        dsv.type = DSV_GetTypeFromStr( m->valuestring );
+        dsv.len = DSV_GetSizeFromType( dsv.type );
+    }
+
+    /* handle dsv default value */
+    m = cJSON_GetObjectItem( e, "value" );
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        DSV_Str2Value( m->valuestring, &dsv );
+    }
+    else if( cJSON_IsNumber( m ) || cJSON_IsBool( m ) )
+    {
+        if( DSV_Double2Value( m->valuedouble, &dsv ) != 0 )
+        {
+            dsvlog( LOG_ERR,
+                    "The dsv type doesn't match the value: %s",
+                    dsv.pName  );
+            DSV_FreeInfo( &dsv );
+            return EINVAL;
+        }
+    }
+
+    /* handle dsv flags */
+    m = cJSON_GetObjectItem( e, "flags" );
+    dsv.flags = 0;
+    dsv.history = 0;
+    dsv.stats = 0;
+    if( cJSON_IsString( m ) && m->valuestring != NULL )
+    {
+        //printf("flags:%s\n",m->valuestring);
+        dsv.flags |= DSV_GetFlagsFromStr( m->valuestring );;
+        dsv.history = DSV_GetHistoryFromStr( m->valuestring );
+        dsv.stats = DSV_GetStatsFromStr( m->valuestring );
+    }
+
+    *pDsv = dsv;
+    return 0;
+}
+
+/*!=============================================================================
+
+    Find the end of the JSON object or array starting at p, without parsing
+    its members
+
+@param[in]
+    p
+        '{' or '['
+@param[in]
+    end
+        end of the buffer
+@return
+    next byte after the object
+    NULL - the object is not closed
+
+==============================================================================*/
+static const char *dsv_JsonEnd( const char *p, const char *end )
+{
+    int depth = 0;
+    bool in_str = false;
+
+    for( ; p < end; p++ )
+    {
+        if( in_str )
+        {
+            if( *p == '\\' )
+            {
+                p++;
+            }
+            else if( *p == '"' )
+            {
+                in_str = false;
+            }
+        }
+        else if( *p == '"' )
+        {
+            in_str = true;
+        }
+        else if( *p == '{' || *p == '[' )
+        {
+            depth++;
+        }
+        else if( ( *p == '}' || *p == ']' ) && --depth == 0 )
+        {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+/*!=============================================================================
+
+    Parse a JSON schema, an array of dsv objects, one entry at a time. Only
+    the entry being converted is held as a cJSON tree, so the memory does
+    not grow with the schema, and cb may create the dsvs parsed so far while
+    the parsing continues.
+
+@param[in]
+    instID
+        dsv instance ID passed by the creator, normally device GUID
+@param[in]
+    buf
+        JSON schema, need not be NUL terminated
+@param[in]
+    size
+        bytes of the schema
+@param[in]
+    cb
+        callback taking each dsv, freed by DSV_FreeInfo(), returning
+        non-zero stops the parsing
+@param[in]
+    arg
+        opaque argument passed to cb
+@return
+    0 - success
+    EINVAL - not a JSON array of objects
+    non-zero returned by cb
+
+==============================================================================*/
+int DSV_ParseJson( uint32_t instID,
+                   const char *buf,
+                   size_t size,
+                   dsv_parse_cb_t cb,
+                   void *arg )
+{
+    assert( buf );
+    assert( cb );
+
+    int rc = 0;
+    const char *p = buf;
+    const char *end = buf + size;
+
+    while( p < end && isspace( (unsigned char)*p ) )
+    {
+        p++;
+    }
+    if( p == end || *p != '[' )
+    {
+        dsvlog( LOG_ERR, "The schema is not a JSON array" );
+        return EINVAL;
+    }
+    p++;
+
+    while( rc == 0 )
+    {
+        while( p < end && ( isspace( (unsigned char)*p ) || *p == ',' ) )
+        {
+            p++;
+        }
+        if( p < end && *p == ']' )
+        {
+            break;
+        }
+
+        const char *q = p < end && *p == '{' ? dsv_JsonEnd( p, end ) : NULL;
+        if( q == NULL )
+        {
+            dsvlog( LOG_ERR, "Malformed schema at byte %zu", (size_t)( p - buf ) );
+            return EINVAL;
+        }
+
+        /* continue even fail one dsv */
+        dsv_info_t dsv;
+        cJSON *e = cJSON_ParseWithLength( p, q - p );
+        if( e == NULL )
+        {
+            dsvlog( LOG_ERR, "Malformed entry at byte %zu", (size_t)( p - buf ) );
+        }
+        else if( dsv_ParseJsonEntry( e, instID, &dsv ) == 0 )
+        {
+            rc = cb( &dsv, arg );
+        }
+        cJSON_Delete( e );
+        p = q;
+    }
+
+    return rc;
+}
+
+/*!=============================================================================
+
+    This function fills the request buffer with hndl
+    The request buffer is a data structure:
+    +-----------------------+
+    | type: DSV_MSG_SET     |
+    +-----------------------+
+    | length                |
+    +-----------------------+
+    | handle (dsv_info_t *) |
+    +-----------------------+
+
+@param[in]
+    dest
+        destination buffer
+
+@param[in]
+    dsv
+        pointer of dsv information structure, holding type, len and value
+
+@return
+    positive number - number of bytes copied
+    -1 - failed
+
+==============================================================================*/
+static int fill_req_buf( char *req_buf, int type, const void *hndl )
+{
+    assert( req_buf );
+    assert( hndl );
+
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    req->type = type;
+    req->length = sizeof(dsv_msg_request_t);
+
+    memcpy( req_data, &hndl, sizeof(hndl) );
+    req->length += sizeof(hndl);
+
+    return sizeof(hndl);
+}
+/*!=============================================================================
+
+    Get the dsv type of a numeric C++ type, the server checks it against the
+    type of the dsv before any atomic operation
+
+@return
+    dsv type
+    DSV_TYPE_INVALID - not a numeric type
+
+==============================================================================*/
+template< typename T >
+static constexpr int dsv_TypeOf( void )
+{
+    if constexpr( std::is_same_v< T, uint8_t > ) return DSV_TYPE_UINT8;
+    else if constexpr( std::is_same_v< T, int8_t > ) return DSV_TYPE_SINT8;
+    else if constexpr( std::is_same_v< T, uint16_t > ) return DSV_TYPE_UINT16;
+    else if constexpr( std::is_same_v< T, int16_t > ) return DSV_TYPE_SINT16;
+    else if constexpr( std::is_same_v< T, uint32_t > ) return DSV_TYPE_UINT32;
+    else if constexpr( std::is_same_v< T, int32_t > ) return DSV_TYPE_SINT32;
+    else if constexpr( std::is_same_v< T, uint64_t > ) return DSV_TYPE_UINT64;
+    else if constexpr( std::is_same_v< T, int64_t > ) return DSV_TYPE_SINT64;
+    else if constexpr( std::is_same_v< T, float > ) return DSV_TYPE_FLOAT;
+    else if constexpr( std::is_same_v< T, double > ) return DSV_TYPE_DOUBLE;
+    else return DSV_TYPE_INVALID;
+}
+
+/*!=============================================================================
+
+    This function fills the request buffer of an atomic operation
+    +-----------------------+
+    | type                  |
+    +-----------------------+
+    | length                |
+    +-----------------------+
+    | handle (dsv_info_t *) |
+    +-----------------------+
+    | pid                   |
+    +-----------------------+
+    | dsv type of T         |
+    +-----------------------+
+    | operands (dsv_value_t)|
+    +-----------------------+
+
+@param[out]
+    req_buf
+        request buffer
+@param[in]
+    type
+        DSV_MSG_INCR, DSV_MSG_FETCH_ADD or DSV_MSG_CAS
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    operands
+        values of the operation
+@param[in]
+    count
+        number of operands
+
+==============================================================================*/
+template< typename T >
+static void fill_atomic_req_buf( char *req_buf,
+                                 int type,
+                                 const void *hndl,
+                                 const T *operands,
+                                 int count )
+{
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    req_data += fill_req_buf( req_buf, type, hndl );
+
+    *(pid_t *)req_data = getpid();
+    req_data += sizeof(pid_t);
+    req->length += sizeof(pid_t);
+
+    *(int *)req_data = dsv_TypeOf< T >();
+    req_data += sizeof(int);
+    req->length += sizeof(int);
+
+    for( int i = 0; i < count; i++ )
+    {
+        dsv_value_t v = { 0 };
+        memcpy( &v, &operands[i], sizeof(T) );
+        memcpy( req_data, &v, sizeof(dsv_value_t) );
+        req_data += sizeof(dsv_value_t);
+        req->length += sizeof(dsv_value_t);
+    }
+}
+
+/*!=============================================================================
+
+    Connect the context of a shard to its dsv server. A server on the same
+    host is reached through the ipc endpoints, the environment variable
+    DSV_TRANSPORT=tcp|ipc overrides the choice.
+
+@param[in]
+    root
+        context returned by DSV_Open, its subscribe socket receives the
+        notifications of every shard
+@param[in]
+    ctx
+        context of the shard
+@param[in]
+    server
+        dsv server of the shard
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+==============================================================================*/
+static int dsv_ConnectShard( dsv_context_t *root,
+                             dsv_context_t *ctx,
+                             const dsv_server_t *server )
+{
+    int rc;
+    char backend_url[DSV_STRING_SIZE_MAX];
+    const char *transport;
+    bool ipc;
+
+    assert( server->ip[0] );
+    transport = getenv( "DSV_TRANSPORT" );
+    if( transport != NULL )
+    {
+        ipc = strcmp( transport, "ipc" ) == 0;
+    }
+    else
+    {
+        /* server on the same host, unix domain sockets skip tcp/ip stack */
+        ipc = DSV_IsLocalIP( server->ip );
+    }
+
+    DSV_EndpointUrl( ctx->frontend_url, DSV_STRING_SIZE_MAX, server->ip,
+                     server->port + DSV_PORT_FRONTEND, ipc );
+    DSV_EndpointUrl( backend_url, DSV_STRING_SIZE_MAX, server->ip,
+                     server->port + DSV_PORT_BACKEND, ipc );
+    DSV_EndpointUrl( ctx->reply_url, DSV_STRING_SIZE_MAX, server->ip,
+                     server->port + DSV_PORT_REPLY, ipc );
+
+    /* request and publish sockets are created by each thread on demand */
+    ctx->serial = ++g_ctx_serial;
+    ctx->pool = new dsv_socks_pool_t();
+    ( (dsv_socks_pool_t *)ctx->pool )->refs = 1;
+    ( (dsv_socks_pool_t *)ctx->pool )->closed = false;
+    ctx->shard = server->shard;
+
+    rc = zmq_connect( root->sock_subscribe, backend_url );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to call zmq_connect: %s", strerror( errno ) );
+        return EFAULT;
+    }
+
+    /* connect the sockets of this thread now, the handshake tells whether
+       the server is really there */
+    if( dsv_GetSocks( ctx ) == NULL )
+    {
+        return ETIMEDOUT;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Create the context connected to the dsv servers, one per shard of the
+    cluster.
+
+@param[in]
+    servers
+        dsv servers indexed by shard
+@param[in]
+    count
+        number of shards
+@return
+    dsv ctx pointer
+    NULL for fail
+==============================================================================*/
+static void *dsv_OpenCluster( const dsv_server_t *servers, int count )
+{
+    dsv_context_t *ctx = NULL;
+
+    assert( count > 0 && count <= DSV_SHARD_MAX );
+
+    /* allocate memory for the System Variable Resource Manager interface
+       structure */
+    ctx = (dsv_context_t *)calloc( sizeof(dsv_context_t), 1 );
+    if( ctx == NULL )
+    {
+        dsvlog( LOG_ERR, "Unable to alloc memory for dsv_context_t" );
+        return NULL;
+    }
+
+    ctx->zmq_ctx = zmq_ctx_new();
+    if( ctx->zmq_ctx == NULL )
+    {
+        dsvlog( LOG_ERR, "Failed to call zmq_ctx_new: %s", strerror( errno ) );
+        goto error;
+    }
+
+    /* subscribe socket, connected to the backend of every shard */
+    ctx->sock_subscribe = zmq_socket( ctx->zmq_ctx, ZMQ_SUB );
+    if( ctx->sock_subscribe == NULL )
+    {
+        dsvlog( LOG_ERR, "Failed to call zmq_socket: %s", strerror( errno ) );
+        goto error;
+    }
+
+    ctx->shards = (dsv_context_t **)calloc( sizeof(dsv_context_t *), count );
+    if( ctx->shards == NULL )
+    {
+        dsvlog( LOG_ERR, "Unable to alloc memory for dsv_context_t" );
+        goto error;
+    }
+    ctx->shard_count = count;
+    ctx->shards[0] = ctx;
+    if( count > 1 )
+    {
+        ctx->ring = DSV_ShardRingNew( count );
+    }
+
+    for( int i = 0; i < count; i++ )
+    {
+        if( i > 0 )
+        {
+            /* the shards share the zmq context and subscribe socket */
+            ctx->shards[i] = (dsv_context_t *)calloc( sizeof(dsv_context_t), 1 );
+            if( ctx->shards[i] == NULL )
+            {
+                dsvlog( LOG_ERR, "Unable to alloc memory for dsv_context_t" );
+                goto error;
+            }
+            ctx->shards[i]->zmq_ctx = ctx->zmq_ctx;
+        }
+
+        if( dsv_ConnectShard( ctx, ctx->shards[i], &servers[i] ) != 0 )
+        {
+            goto error;
+        }
+    }
+    return (void *)ctx;
+
+error:
+    DSV_Close( ctx );
+
+    return NULL;
+}
+
+/*!=============================================================================
+
+    As a client, it creates zmq client and subscriber socket and connect them
+    to the dsv server endpoint. The server comes from DSV_SERVER environment
+    variable, the discovery cache or the discovery beacon, see
+    DSV_FindServer. With a sharded cluster, the context connects to every
+    shard and routes each request to the shard owning the dsv.
+
+@return
+    dsv ctx pointer
+    NULL for fail
+==============================================================================*/
+void* DSV_Open( void )
+{
+    void *ctx = NULL;
+    dsv_server_t servers[DSV_SHARD_MAX];
+    int count;
+
+    count = DSV_FindServer( servers, DSV_SHARD_MAX, true );
+    if( count == 0 )
+    {
+        dsvlog( LOG_ERR, "Error: No DSV server found!" );
+        return NULL;
+    }
+
+    ctx = dsv_OpenCluster( servers, count );
+    if( ctx == NULL && getenv( "DSV_SERVER" ) == NULL )
+    {
+        /* the cached server may be gone, discover it again */
+        DSV_ForgetServer();
+        count = DSV_FindServer( servers, DSV_SHARD_MAX, false );
+        if( count != 0 )
+        {
+            ctx = dsv_OpenCluster( servers, count );
+        }
+    }
+
+    return ctx;
+}
+
+/*!=============================================================================
+
+    Release the sockets of all threads using the context of a shard
+
+@param[in]
+    dsv_ctx
+        context of a shard
+
+==============================================================================*/
+static void dsv_ClosePool( dsv_context_t *dsv_ctx )
+{
+    if( dsv_ctx->pool != NULL )
+    {
+        /* threads must have stopped using the context by now */
+        dsv_socks_pool_t *pool = (dsv_socks_pool_t *)dsv_ctx->pool;
+        dsv_cancelled_t cancelled;
+        {
+            std::lock_guard< std::mutex > guard( pool->lock );
+            for( auto socks : pool->socks )
+            {
+                dsv_CloseSocks( socks, cancelled );
+            }
+            pool->socks.clear();
+            pool->closed = true;
+        }
+
+        /* the entry of the calling thread goes now, the others at the next
+         * socket creation or at the exit of their thread */
+        dsv_ReleaseEntries( [pool]( const dsv_tls_entry_t &e ) {
+            return e.pool == pool;
+        } );
+
+        /* the pool stays until the callbacks are done with the context */
+        dsv_Cancel( cancelled );
+        dsv_PoolRelease( pool );
+        dsv_ctx->pool = NULL;
+    }
+}
+
+/*!=============================================================================
+
+    Release all the resource of the client
+
+@param[in]
+    ctx
+        dsv ctx holding all the resource pointer
+
+==============================================================================*/
+void DSV_Close( void *ctx )
+{
+    assert( ctx );
+
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+
+    /* the cancelled callbacks may still route through every shard */
+    for( uint32_t i = 1; dsv_ctx->shards != NULL && i < dsv_ctx->shard_count; i++ )
+    {
+        if( dsv_ctx->shards[i] != NULL )
+        {
+            dsv_ClosePool( dsv_ctx->shards[i] );
+        }
+    }
+    dsv_ClosePool( dsv_ctx );
+
+    if( dsv_ctx->shards != NULL )
+    {
+        for( uint32_t i = 1; i < dsv_ctx->shard_count; i++ )
+        {
+            free( dsv_ctx->shards[i] );
+        }
+        free( dsv_ctx->shards );
+    }
+    DSV_ShardRingFree( dsv_ctx->ring );
+    delete (dsv_mirror_map_t *)dsv_ctx->mirrors;
+
+    if( dsv_ctx->sock_subscribe != NULL )
+    {
+        zmq_close( dsv_ctx->sock_subscribe );
+    }
+
+    if( dsv_ctx->zmq_ctx != NULL )
+    {
+        zmq_ctx_destroy( dsv_ctx->zmq_ctx );
+    }
+
+    if( dsv_ctx != NULL )
+    {
+        free( dsv_ctx );
+    }
+}
+
+/*!=============================================================================
+
+    Send the dsvs parsed so far with DSV_CreateBatch(), and free them
+
+@param[in,out]
+    batch
+        dsvs parsed by DSV_CreateWithJson()
+
+==============================================================================*/
+static void dsv_FlushParsed( dsv_json_batch_t *batch )
+{
+    if( !batch->dsvs.empty() )
+    {
+        int rc = DSV_CreateBatch( batch->ctx,
+                                  batch->dsvs.data(),
+                                  batch->dsvs.size() );
+        batch->rc = rc != 0 ? rc : batch->rc;
+    }
+
+    for( auto &dsv : batch->dsvs )
+    {
+        DSV_FreeInfo( &dsv );
+    }
+    batch->dsvs.clear();
+    batch->size = 0;
+}
+
+/*!=============================================================================
+
+    Take a dsv parsed by DSV_ParseJson(), and send the batch once it fills a
+    message, so the server creates the first dsvs while the rest of the
+    file is parsed
+
+@param[in]
+    pDsv
+        dsv information
+@param[in]
+    arg
+        dsv_json_batch_t
+@return
+    0 - continue
+    EFAULT - failed to send
+
+==============================================================================*/
+static int dsv_CreateParsed( dsv_info_t *pDsv, void *arg )
+{
+    dsv_json_batch_t *batch = (dsv_json_batch_t *)arg;
+
+    batch->dsvs.push_back( *pDsv );
+    batch->size += dsv_CreateSize( pDsv );
+    if( batch->size >= DSV_BATCH_SIZE )
+    {
+        dsv_FlushParsed( batch );
+    }
+
+    return batch->rc == EFAULT ? EFAULT : 0;
+}
+
+/*!=============================================================================
+
+    This function request dsv server to create one or multiple dsv with
+    information provided.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    instID
+        dsv instance ID passed by the creator, normally device short GUID
+@param[in]
+    file
+        JSON file name, or a binary schema compiled by dsv_schemac
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_CreateWithJson( void *ctx, uint32_t instID, const char *file )
+{
+    assert( ctx );
+    assert( file );
+
+    /* a binary schema skips the JSON parsing */
+    int rc = DSV_CreateWithSchema( ctx, instID, file );
+    if( rc != ENOEXEC )
+    {
+        return rc;
+    }
+
+    int fd = open( file, O_RDONLY );
+    if( fd == -1 )
+    {
+        dsvlog( LOG_ERR, "Failed to open json file: %s.", file );
+        return errno;
+    }
+
+    struct stat st = { 0 };
+    void *map = MAP_FAILED;
+    if( fstat( fd, &st ) == 0 && st.st_size > 0 )
+    {
+        map = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    }
+    close( fd );
+    if( map == MAP_FAILED )
+    {
+        dsvlog( LOG_ERR, "Failed to map json file: %s.", file );
+        return st.st_size > 0 ? errno : EINVAL;
+    }
+    madvise( map, st.st_size, MADV_SEQUENTIAL );
+
+    dsv_json_batch_t batch;
+    batch.ctx = ctx;
+    batch.size = 0;
+    batch.rc = 0;
+
+    rc = DSV_ParseJson( instID,
+                        (const char *)map,
+                        st.st_size,
+                        dsv_CreateParsed,
+                        &batch );
+    dsv_FlushParsed( &batch );
+
+    munmap( map, st.st_size );
+    return rc != 0 ? rc : batch.rc;
+}
+
+/*!=============================================================================
+
+    Get the size of the create request of a dsv, at most
+
+@param[in]
+    pDsv
+        pointer to the dsv information of dsv_info_t structure
+@return
+    bytes of the request
+
+==============================================================================*/
+static size_t dsv_CreateSize( const dsv_info_t *pDsv )
+{
+    size_t calc = pDsv->pCalc != NULL ? strlen( pDsv->pCalc ) + 1 : 1;
+    size_t rules = pDsv->pRules != NULL ? strlen( pDsv->pRules ) + 1 : 1;
+    return sizeof(dsv_msg_request_t) + sizeof(dsv_info_t) +
+           4 * DSV_STRING_SIZE_MAX + calc + rules + pDsv->len;
+}
+
+/*!=============================================================================
+
+    Fill the create request of a dsv, dsv_info_t followed by the name,
+    description, tags, calc, rules and aliases, and the value of a string,
+    array or blob. The calc and rules are sent whole, the other strings are
+    cut to DSV_STRING_SIZE_MAX.
+
+@param[in]
+    pDsv
+        pointer to the dsv information of dsv_info_t structure
+@param[out]
+    req_buf
+        request of dsv_CreateSize() bytes
+@return
+    length of the request
+
+==============================================================================*/
+static size_t dsv_PackCreate( const dsv_info_t *pDsv, char *req_buf )
+{
+    size_t len = 0;
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    req->type = DSV_MSG_CREATE;
+    req->length = sizeof(dsv_msg_request_t);
+
+    memcpy( req_data, pDsv, sizeof(dsv_info_t) );
+    len = sizeof(dsv_info_t);
+    req->length += len;
+    req_data += len;
+
+    const char *strs[] = { pDsv->pName,
+                           pDsv->pDesc,
+                           pDsv->pTags,
+                           pDsv->pCalc,
+                           pDsv->pRules,
+                           pDsv->pAliases };
+    const bool whole[] = { false, false, false, true, true, false };
+    for( size_t i = 0; i < sizeof(strs) / sizeof(strs[0]); i++ )
+    {
+        const char *str = strs[i] ? strs[i] : "";
+        len = whole[i] ? strlen( str ) : strnlen( str, DSV_STRING_SIZE_MAX - 1 );
+        memcpy( req_data, str, len );
+        req_data[len++] = '\0';
+        req->length += len;
+        req_data += len;
+    }
+
+    if( pDsv->type == DSV_TYPE_STR ||
+        pDsv->type == DSV_TYPE_INT_ARRAY ||
+        DSV_TYPE_IS_BLOB( pDsv->type ) )
+    {
+        if( pDsv->value.pStr != NULL && pDsv->len != 0 )
+        {
+            memcpy( req_data, pDsv->value.pStr, pDsv->len );
+            req->length += pDsv->len;
+        }
+    }
+
+    return req->length;
+}
+
+/*!=============================================================================
+
+    This function requests dsv server to create one dsv with dsv_info_t
+    structure.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    instID
+        dsv instance ID passed by the creator, normally device instance ID
+@param[in]
+    pDsv
+        pointer to the dsv information of dsv_info_t structure
+@return
+    0 - success
+    EMSGSIZE - the value, calc or rules of the dsv are too large
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_Create( void *ctx, uint32_t instID, dsv_info_t *pDsv )
+{
+    assert( ctx );
+    assert( pDsv );
+
+    int rc = EINVAL;
+    if( pDsv->len > DSV_VALUE_SIZE_MAX ||
+        dsv_CreateSize( pDsv ) > DSV_CREATE_SIZE_MAX )
+    {
+        dsvlog( LOG_ERR, "%s is too large to create", pDsv->pName );
+        return EMSGSIZE;
+    }
+
+    std::vector< char > msg( dsv_CreateSize( pDsv ) );
+    char *req_buf = msg.data();
+
+    pDsv->pid = getpid();
+    size_t len = dsv_PackCreate( pDsv, req_buf );
+
+    rc = dsv_SendMsg( ctx, req_buf, len, NULL, 0 );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server: %s", pDsv->pName );
+        return EFAULT;
+    }
+
+    return rc;
+}
+
+/*!=============================================================================
+
+    Send the create requests packed for a shard as one message, and start
+    the next batch
+
+@param[in]
+    ctx
+        dsv ctx of the shard
+@param[in,out]
+    batch
+        DSV_MSG_CREATE_BATCH request, left with its header only
+@param[in,out]
+    count
+        number of create requests in the batch, reset to 0
+@return
+    0 - success
+    EFAULT - failed to send
+
+==============================================================================*/
+static int dsv_FlushBatch( void *ctx,
+                           std::vector< char > &batch,
+                           uint32_t &count )
+{
+    if( count == 0 )
+    {
+        return 0;
+    }
+
+    dsv_msg_request_t *req = (dsv_msg_request_t *)batch.data();
+    req->type = DSV_MSG_CREATE_BATCH;
+    req->length = batch.size();
+    *(uint32_t *)req->data = count;
+
+    int rc = dsv_SendMsg( ctx, batch.data(), batch.size(), NULL, 0 );
+    batch.resize( sizeof(dsv_msg_request_t) + sizeof(uint32_t) );
+    count = 0;
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Create many dsvs with few messages, eg all the dsvs of a device. The
+    create requests of the dsvs of each shard are packed into messages of
+    about DSV_BATCH_SIZE bytes, and the server creates them in order, so a
+    calculated dsv may follow its inputs in the same batch.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    dsvs
+        dsv information of dsv_info_t structure, pid is filled
+@param[in]
+    count
+        number of dsvs
+@return
+    0 - success
+    EMSGSIZE - the value, calc or rules of a dsv are too large, the others
+               are created
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_CreateBatch( void *ctx, dsv_info_t *dsvs, size_t count )
+{
+    assert( ctx );
+    assert( dsvs || count == 0 );
+
+    int rc = 0;
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    uint32_t shards = dsv_ShardCount( ctx );
+    const size_t head = sizeof(dsv_msg_request_t) + sizeof(uint32_t);
+    std::vector< std::vector< char > > batches( shards );
+    std::vector< uint32_t > counts( shards, 0 );
+    pid_t pid = getpid();
+
+    for( auto &batch : batches )
+    {
+        batch.reserve( shards == 1 ? DSV_BATCH_SIZE : BUFSIZE );
+        batch.resize( head );
+    }
+
+    for( size_t i = 0; i < count && rc != EFAULT; i++ )
+    {
+        dsv_info_t *pDsv = &dsvs[i];
+        if( pDsv->len > DSV_VALUE_SIZE_MAX ||
+            dsv_CreateSize( pDsv ) > DSV_CREATE_SIZE_MAX )
+        {
+            dsvlog( LOG_ERR, "%s is too large to create", pDsv->pName );
+            rc = EMSGSIZE;
+            continue;
+        }
+
+        uint32_t shard = 0;
+        if( shards > 1 )
+        {
+            shard = DSV_ShardOf( dsv_ctx->ring, pDsv->pName ? pDsv->pName : "" );
+        }
+        std::vector< char > &batch = batches[shard];
+
+        size_t size = dsv_CreateSize( pDsv );
+        if( batch.size() > head && batch.size() + size > DSV_BATCH_SIZE )
+        {
+            int r = dsv_FlushBatch( dsv_Shard( ctx, shard ), batch, counts[shard] );
+            rc = r != 0 ? r : rc;
+        }
+
+        /* each request starts aligned, the server reads them in place */
+        pDsv->pid = pid;
+        size_t offset = batch.size();
+        batch.resize( offset + size );
+        size_t len = dsv_PackCreate( pDsv, batch.data() + offset );
+        len = ( len + sizeof(void *) - 1 ) & ~( sizeof(void *) - 1 );
+        ( (dsv_msg_request_t *)( batch.data() + offset ) )->length = len;
+        batch.resize( offset + len );
+        counts[shard]++;
+    }
+
+    for( uint32_t shard = 0; shard < shards; shard++ )
+    {
+        int r = dsv_FlushBatch( dsv_Shard( ctx, shard ), batches[shard], counts[shard] );
+        rc = r != 0 ? r : rc;
+    }
+
+    return rc;
+}
+
+/*!=============================================================================
+
+    Query the dsv handle from dsv server database by dsv name
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    name
+        pointer to a NULL terminated dsv namne string
+@return
+    a handle to the dsv in the dsv server,
+    NULL if not found.
+
+==============================================================================*/
+void* DSV_Handle( void *ctx, const char *name )
+{
+    assert( ctx );
+    assert( name );
+
+    int rc = EINVAL;
+    void *handle = NULL;
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+
+    req->type = DSV_MSG_GET_HANDLE;
+    req->length = sizeof(dsv_msg_request_t);
+
+    strncpy( req_data, name, DSV_STRING_SIZE_MAX );
+    req->length += strlen( name ) + 1;
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    if( rc != 0 )
+    {
+        if( rc != ENOENT )
+        {
+            dsvlog( LOG_ERR, "Failed to send message to the server: %s", name );
+        }
+        return NULL;
+    }
+    handle = *(void **)rep_data;
+    return handle;
+}
+
+/*!=============================================================================
+
+    Query the dsv handle without waiting for the reply. The value passed to
+    cb holds the handle ( void * ) when result is 0.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    name
+        pointer to a NULL terminated dsv namne string
+@param[in]
+    cb
+        callback to invoke with the reply
+@param[in]
+    arg
+        opaque argument passed to cb
+@return
+    request id
+    0 - failed, cb will never be called
+
+==============================================================================*/
+uint32_t DSV_HandleAsync( void *ctx,
+                          const char *name,
+                          dsv_reply_cb_t cb,
+                          void *arg )
+{
+    assert( ctx );
+    assert( name );
+    assert( cb );
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    req->type = DSV_MSG_GET_HANDLE;
+    req->length = sizeof(dsv_msg_request_t);
+
+    strncpy( req_data, name, DSV_STRING_SIZE_MAX );
+    req->length += strlen( req_data ) + 1;
+
+    uint32_t id = dsv_SendAsync( ctx, req_buf, req->length, cb, arg );
+    if( id == 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server: %s", name );
+    }
+    return id;
+}
+
+/*!=============================================================================
+
+    Add an alias to a dsv, eg the name it had in an older release. The alias
+    is another entry of the server's hash table pointing to the dsv, so
+    DSV_Handle() of either name gives the same handle, and a write through
+    either one is one write with one notification, under the name of the
+    dsv. An alias without "[instID]" takes the instance of the dsv.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    alias
+        other name of the dsv, eg "/SYS/OLD/NAME"
+@return
+    0 - success, including an alias the dsv already has
+    EEXIST - the alias is the name or alias of another dsv
+    EXDEV - the alias belongs to another shard of the cluster
+    ENOSPC - the aliases of the dsv are too long
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_Alias( void *ctx, void *hndl, const char *alias )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( alias );
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    char rep_buf[BUFSIZE];
+
+    if( strlen( alias ) >= DSV_STRING_SIZE_MAX )
+    {
+        return EINVAL;
+    }
+
+    req->type = DSV_MSG_ALIAS;
+    req->length = sizeof(dsv_msg_request_t);
+
+    *(void **)req_data = hndl;
+    req_data += sizeof(void *);
+    req->length += sizeof(void *);
+
+    strcpy( req_data, alias );
+    req->length += strlen( alias ) + 1;
+
+    return dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+}
+
+/*!=============================================================================
+
+    Delete a dsv, with its statistics, and release its memory in the server.
+    The subscribers get a notification with a NULL handle and the handle of
+    the dsv as the value, and requests with the handle fail with ENOENT
+    afterwards, even when another dsv takes its place.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@return
+    0 - success
+    ENOENT - unknown or deleted handle
+    EPERM - the dsv is a statistic, deleted with its dsv only
+    EBUSY - the dsv is an input of a calculated dsv
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_Delete( void *ctx, void *hndl )
+{
+    assert( ctx );
+    assert( hndl );
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+
+    char rep_buf[BUFSIZE];
+
+    fill_req_buf( req_buf, DSV_MSG_DELETE, hndl );
+    return dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+}
+
+/*!=============================================================================
+
+    Delete the dsvs whose name starts with a prefix in every shard, eg
+    "[123]" for the dsvs of a device which is gone. Each shard deletes all
+    its matching dsvs or none of them, see DSV_Delete().
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    prefix
+        prefix of the full names, eg "[123]/SYS/"
+@param[out]
+    count
+        number of deleted dsvs, NULL if not needed
+@return
+    0 - success, including no dsv deleted
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_DeleteByPrefix( void *ctx, const char *prefix, size_t *count )
+{
+    assert( ctx );
+    assert( prefix );
+
+    int rc = 0;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+
+    if( prefix[0] == '\0' || strlen( prefix ) >= DSV_STRING_SIZE_MAX )
+    {
+        return EINVAL;
+    }
+
+    req->type = DSV_MSG_DELETE_PREFIX;
+    req->length = sizeof(dsv_msg_request_t) + strlen( prefix ) + 1;
+    strcpy( req->data, prefix );
+
+    if( count != NULL )
+    {
+        *count = 0;
+    }
+
+    for( uint32_t shard = 0; shard < dsv_ShardCount( ctx ); shard++ )
+    {
+        int r = dsv_SendMsg( dsv_Shard( ctx, shard ),
+                             req_buf,
+                             req->length,
+                             rep_buf,
+                             sizeof(rep_buf) );
+        if( r != 0 )
+        {
+            dsvlog( LOG_ERR, "Failed to delete %s: %s", prefix, strerror( r ) );
+            rc = r;
+        }
+        else if( count != NULL )
+        {
+            *count += *(const uint32_t *)rep->data;
+        }
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Query the dsv type from dsv server by handle.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@return
+    0 or positive number: type
+    -1 if not found.
+
+==============================================================================*/
+int DSV_Type( void *ctx, void *hndl )
+{
+    assert( ctx );
+    assert( hndl );
+
+    int rc = EINVAL;
+    int type = 0;
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+
+    fill_req_buf( req_buf, DSV_MSG_GET_TYPE, hndl );
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+    type = *(int *)rep_data;
+    return type;
+}
+
+/*!=============================================================================
+
+    Query the dsv len from dsv server by handle. (Used for array type of dsv)
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@return
+    0 or positive number: type
+    -1 if not found.
+
+==============================================================================*/
+size_t DSV_Len( void *ctx, void *hndl )
+{
+    assert( ctx );
+    assert( hndl );
+
+    int rc = EINVAL;
+    size_t len = 0;
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+
+    fill_req_buf( req_buf, DSV_MSG_GET_LEN, hndl );
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+    len = *(size_t *)rep_data;
+    return len;
+}
+/*!=============================================================================
+
+    This function request dsv server to update dsv with value.
+    This is a helper function that should not be used in time critical case.
+
+    This function first query the handle from the server then call
+    DSV_SetThruStr function to set the value in string form
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    name
+        dsv name string terminated by NULL byte
+@param[in]
+    value
+        dsv value as string
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_SetByName( void *ctx, const char *name, char *value )
+{
+    assert( ctx );
+    assert( name );
+    assert( value );
+
+    int rc = EINVAL;
+    void *hndl = DSV_Handle( ctx, name );
+    if( hndl == NULL )
+    {
+        dsvlog( LOG_ERR, "Unable to find dsv: %s", name );
+        return rc;
+    }
+
+    rc = DSV_SetThruStr( ctx, hndl, value );
+    return rc;
+}
+
+/*!=============================================================================
+
+    This function requests dsv server to update dsv with value in string form.
+
+    This function first query the type from the server then call the
+    corresponsing DSV_Set function to set the value
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    value
+        dsv value in string form
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_SetThruStr( void *ctx, void *hndl, const char *value )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( value );
+
+    int rc = EINVAL;
+    int type = DSV_Type( ctx, hndl );
+    if( type < 0 )
+    {
+        dsvlog( LOG_ERR, "Unable to get the dsv type" );
+        return rc;
+    }
+
+    dsv_info_t dsv;
+    size_t size;
+    void *data;
+    switch( type )
+    {
+    case DSV_TYPE_STR:
+        rc = DSV_Set( ctx, hndl, value );
+        break;
+    case DSV_TYPE_INT_ARRAY:
+        rc = DSV_Str2Array( value, &data, &size );
+        if( rc == 0 )
+        {
+            rc = DSV_Set( ctx, hndl, data, size );
+            free( data );
+        }
+        break;
+    case DSV_TYPE_BLOB:
+        rc = DSV_Str2Blob( value, &data, &size );
+        if( rc == 0 )
+        {
+            rc = DSV_Set( ctx, hndl, data, size );
+            free( data );
+        }
+        break;
+    case DSV_TYPE_UINT8_ARRAY:
+    case DSV_TYPE_SINT8_ARRAY:
+    case DSV_TYPE_UINT16_ARRAY:
+    case DSV_TYPE_SINT16_ARRAY:
+    case DSV_TYPE_UINT32_ARRAY:
+    case DSV_TYPE_UINT64_ARRAY:
+    case DSV_TYPE_SINT64_ARRAY:
+    case DSV_TYPE_FLOAT_ARRAY:
+    case DSV_TYPE_DOUBLE_ARRAY:
+        rc = DSV_Str2Items( type, value, &data, &size );
+        if( rc == 0 )
+        {
+            rc = DSV_Set( ctx, hndl, data, size );
+            free( data );
+        }
+        break;
+    case DSV_TYPE_UINT16:
+        rc = DSV_Set( ctx, hndl, (uint16_t)strtoul( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_UINT32:
+        rc = DSV_Set( ctx, hndl, (uint32_t)strtoul( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_UINT64:
+        rc = DSV_Set( ctx, hndl, (uint64_t)strtoull( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_UINT8:
+        rc = DSV_Set( ctx, hndl, (uint8_t)strtoul( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_SINT16:
+        rc = DSV_Set( ctx, hndl, (int16_t)strtol( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_SINT32:
+        rc = DSV_Set( ctx, hndl, (int32_t)strtol( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_SINT64:
+        rc = DSV_Set( ctx, hndl, (int64_t)strtoll( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_SINT8:
+        rc = DSV_Set( ctx, hndl, (int8_t)strtol( value, NULL, 10 ) );
+        break;
+
+    case DSV_TYPE_FLOAT:
+        rc = DSV_Set( ctx, hndl, strtof( value, NULL ) );
+        break;
+
+    case DSV_TYPE_DOUBLE:
+        rc = DSV_Set( ctx, hndl, strtod( value, NULL ) );
+        break;
+
+    default:
+        dsvlog( LOG_ERR, "Unsupported type for dsv" );
+        break;
+    }
+
+    return rc;
+}
+
+/**
+ * Set value for string type of dsv, up to DSV_VALUE_SIZE_MAX bytes
+ */
+int DSV_Set( void *ctx, void *hndl, char *value )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( value );
+
+    int rc = EINVAL;
+    size_t size = strlen( value ) + 1;
+    if( size > DSV_VALUE_SIZE_MAX )
+    {
+        dsvlog( LOG_ERR, "Value of %zu bytes is too large", size );
+        return EMSGSIZE;
+    }
+
+    std::vector< char > msg( BUFSIZE + size );
+    char *req_buf = msg.data();
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    rc = fill_req_buf( req_buf, DSV_MSG_SET, hndl );
+
+    req_data += rc;
+    *(pid_t *)req_data = getpid();
+    req->length += sizeof(pid_t);
+
+    req_data += sizeof(pid_t);
+    memcpy( req_data, value, size );
+    req->length += size;
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+
+    return rc;
+}
+
+/**
+ * Set value for array or blob type of dsv, up to DSV_VALUE_SIZE_MAX bytes
+ */
+int DSV_Set( void *ctx, void *hndl, void *data, size_t size )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( data );
+
+    int rc = EINVAL;
+    if( size > DSV_VALUE_SIZE_MAX )
+    {
+        dsvlog( LOG_ERR, "Value of %zu bytes is too large", size );
+        return EMSGSIZE;
+    }
+
+    std::vector< char > msg( BUFSIZE + size );
+    char *req_buf = msg.data();
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    rc = fill_req_buf( req_buf, DSV_MSG_SET, hndl );
+
+    req_data += rc;
+    *(pid_t *)req_data = getpid();
+    req->length += sizeof(pid_t);
+
+    req_data += sizeof(pid_t);
+    memcpy( req_data, data, size );
+    req->length += size;
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+
+    return rc;
+}
+
+/**
+ * Set value for numeric type of dsv
+ */
+template< typename T >
+int DSV_Set( void *ctx, void *hndl, T value )
+{
+    assert( ctx );
+    assert( hndl );
+
+    int rc = EINVAL;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    rc = fill_req_buf( req_buf, DSV_MSG_SET, hndl );
+
+    req_data += rc;
+    *(pid_t *)req_data = getpid();
+    req->length += sizeof(pid_t);
+
+    req_data += sizeof(pid_t);
+    memcpy( req_data, &value, sizeof(value) );
+    req->length += sizeof(value);
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+
+    return rc;
+}
+
+
+/*!=============================================================================
+
+    This function request dsv server to query dsv with value.
+    This is a helper function that should not be used in time critical case.
+    The instID and name must be exactly matched
+
+    This function first query the handle from the server then call
+    DSV_GetThruStr function to set the value in string form
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    name
+        dsv name string terminated by NULL byte
+@param[out]
+    value
+        dsv value as string
+@param[in]
+    size
+        size of value buffer
+
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_GetByName( void *ctx,
+                   const char *name,
+                   char *value,
+                   size_t size )
+{
+
+    assert( ctx );
+    assert( name );
+    assert( value );
+
+    int rc = EINVAL;
+    void *hndl = DSV_Handle( ctx, name );
+    if( hndl == NULL )
+    {
+        dsvlog( LOG_ERR, "Unable to find dsv: %s", name );
+        return rc;
+    }
+
+    rc = DSV_GetThruStr( ctx, hndl, value, size );
+    return rc;
+}
+
+/*!=============================================================================
+
+    This function request dsv server to query dsv with value.
+    This is a helper function that should not be used in time critical case.
+    Partially matched name will also return its value
+
+    This function first query the handle from the server then call
+    DSV_GetThruStr function to set the value in string form
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+
+@param[in]
+    name
+        dsv name string terminated by NULL byte
+
+@param[in]
+    index
+        index of last match
+
+@param[out]
+    value
+        dsv value as string
+
+@param[in]
+    size
+        size of value buffer
+
+@return
+    index of dsv matched this time - success
+    -1 - the end of match
+
+==============================================================================*/
+int DSV_GetByNameFuzzy( void *ctx,
+                        const char *search_name,
+                        int last_index,
+                        char *name,
+                        size_t namesz,
+                        char *value,
+                        size_t valuesz )
+{
+    assert( ctx );
+    assert( name );
+    assert( value );
+
+    int rc = EINVAL;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+
+    req->type = DSV_MSG_GET_NEXT;
+    req->length = sizeof(dsv_msg_request_t);
+    req->length += sizeof(int);
+
+    req_data += sizeof(int);
+    strcpy( req_data, search_name );
+    req->length += strlen( search_name ) + 1;
+
+    /* walk the shards one after another */
+    uint32_t shard = DSV_FUZZY_SHARD( last_index );
+    *(int *)req->data = DSV_FUZZY_LOCAL( last_index );
+    for( ; shard < dsv_ShardCount( ctx ); shard++, *(int *)req->data = -1 )
+    {
+        rc = dsv_SendMsg( dsv_Shard( ctx, shard ),
+                          req_buf,
+                          req->length,
+                          rep_buf,
+                          sizeof(rep_buf) );
+        if( rc == 0 )
+        {
+            rc = DSV_FUZZY_INDEX( shard, *(int *)rep_data );
+            rep_data += sizeof(int);
+            strncpy( name, rep_data, namesz );
+            rep_data += strlen( rep_data ) + 1;
+            strncpy( value, rep_data, valuesz );
+            return rc;
+        }
+
+        if( rc != ENOENT )
+        {
+            dsvlog( LOG_ERR,
+                    "Failed to send message to the server: %s",
+                    search_name );
+            break;
+        }
+    }
+    return -1;
+}
+
+int DSV_TrackByNameFuzzy( void *ctx,
+                          const char *search_name,
+                          int last_index,
+                          int enable )
+{
+    assert( ctx );
+    assert( search_name );
+
+    int rc = EINVAL;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+    char *rep_data = rep->data;
+
+    req->type = DSV_MSG_TRACK;
+    req->length = sizeof(dsv_msg_request_t);
+    req->length += sizeof(int);
+
+    req_data += sizeof(int);
+    strcpy( req_data, search_name );
+    req->length += strlen( search_name ) + 1;
+
+    req_data += strlen( search_name ) + 1;
+    *(int *)req_data = enable;
+    req->length += sizeof(int);
+
+    /* walk the shards one after another */
+    uint32_t shard = DSV_FUZZY_SHARD( last_index );
+    *(int *)req->data = DSV_FUZZY_LOCAL( last_index );
+    for( ; shard < dsv_ShardCount( ctx ); shard++, *(int *)req->data = -1 )
+    {
+        rc = dsv_SendMsg( dsv_Shard( ctx, shard ),
+                          req_buf,
+                          req->length,
+                          rep_buf,
+                          sizeof(rep_buf) );
+        if( rc == 0 )
+        {
+            return DSV_FUZZY_INDEX( shard, *(int *)rep_data );
+        }
+
+        if( rc != ENOENT )
+        {
+            dsvlog( LOG_ERR,
+                    "Failed to send message to the server: %s",
+                    search_name );
+            break;
+        }
+    }
+    return -1;
+}
+/*!=============================================================================
+
+    This function requests dsv server to query dsv with value in string form.
+
+    This function first query the type from the server then call the
+    corresponsing DSV_Get function to set the value
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+
+@param[in]
+    hndl
+        dsv handle in server process
+
+@param[in]
+    value
+        dsv value buffer
+
+ @param[in]
+    size
+        size of buffer
+
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_GetThruStr( void *ctx, void *hndl, char *value, size_t size )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( value );
+
+    int rc = EINVAL;
+    int type = DSV_Type( ctx, hndl );
+    if( type < 0 )
+    {
+        dsvlog( LOG_ERR, "Unable to get the dsv type" );
+        return rc;
+    }
+
+    std::vector< char > data;
+    switch( type )
+    {
+    case DSV_TYPE_STR:
+        rc = DSV_Get( ctx, hndl, value, size );
+        break;
+    case DSV_TYPE_INT_ARRAY:
+        /* the array may have grown since its length is got */
+        data.resize( sizeof(size_t) + DSV_Len( ctx, hndl ) + BUFSIZE );
+        rc = DSV_Get( ctx, hndl, (void *)data.data(), data.size() );
+        if( rc == 0 )
+        {
+            DSV_PrintArray( data.data(), value, size );
+        }
+        break;
+    case DSV_TYPE_BLOB:
+        data.resize( sizeof(size_t) + DSV_Len( ctx, hndl ) + BUFSIZE );
+        rc = DSV_Get( ctx, hndl, (void *)data.data(), data.size() );
+        if( rc == 0 )
+        {
+            DSV_PrintBlob( data.data(), value, size );
+        }
+        break;
+    case DSV_TYPE_UINT8_ARRAY:
+    case DSV_TYPE_SINT8_ARRAY:
+    case DSV_TYPE_UINT16_ARRAY:
+    case DSV_TYPE_SINT16_ARRAY:
+    case DSV_TYPE_UINT32_ARRAY:
+    case DSV_TYPE_UINT64_ARRAY:
+    case DSV_TYPE_SINT64_ARRAY:
+    case DSV_TYPE_FLOAT_ARRAY:
+    case DSV_TYPE_DOUBLE_ARRAY:
+        data.resize( sizeof(size_t) + DSV_Len( ctx, hndl ) + BUFSIZE );
+        rc = DSV_Get( ctx, hndl, (void *)data.data(), data.size() );
+        if( rc == 0 )
+        {
+            DSV_PrintItems( type, data.data(), value, size );
+        }
+        break;
+    case DSV_TYPE_UINT16:
+        uint16_t u16;
+        rc = DSV_Get( ctx, hndl, &u16 );
+        snprintf( value, size, "%" PRIu16, u16 );
+        break;
+    case DSV_TYPE_UINT32:
+        uint32_t u32;
+        rc = DSV_Get( ctx, hndl, &u32 );
+        snprintf( value, size, "%" PRIu32, u32 );
+        break;
+    case DSV_TYPE_UINT64:
+        uint64_t u64;
+        rc = DSV_Get( ctx, hndl, &u64 );
+        snprintf( value, size, "%" PRIu64, u64 );
+        break;
+    case DSV_TYPE_UINT8:
+        uint8_t u8;
+        rc = DSV_Get( ctx, hndl, &u8 );
+        snprintf( value, size, "%" PRIu8, u8 );
+        break;
+
+    case DSV_TYPE_SINT16:
+        int16_t s16;
+        rc = DSV_Get( ctx, hndl, &s16 );
+        snprintf( value, size, "%" PRId16, s16 );
+        break;
+    case DSV_TYPE_SINT32:
+        int32_t s32;
+        rc = DSV_Get( ctx, hndl, &s32 );
+        snprintf( value, size, "%" PRId32, s32 );
+        break;
+    case DSV_TYPE_SINT64:
+        int64_t s64;
+        rc = DSV_Get( ctx, hndl, &s64 );
+        snprintf( value, size, "%" PRId64, s64 );
+        break;
+    case DSV_TYPE_SINT8:
+        int8_t s8;
+        rc = DSV_Get( ctx, hndl, &s8 );
+        snprintf( value, size, "%" PRId8, s8 );
+        break;
+    case DSV_TYPE_FLOAT:
+        float f32;
+        rc = DSV_Get( ctx, hndl, &f32 );
+        snprintf( value, size, "%f", f32 );
+        break;
+    case DSV_TYPE_DOUBLE:
+        double f64;
+        rc = DSV_Get( ctx, hndl, &f64 );
+        snprintf( value, size, "%f", f64 );
+        break;
 
-==============================================================================*/
-void* DSV_Handle( void *ctx, const char *name )
+    default:
+        dsvlog( LOG_ERR, "Unsupported type for dsv" );
+        break;
+    }
+
+    return rc;
+}
+
+/**
+ * Get value for string type of dsv
+ */
+int DSV_Get( void *ctx, void *hndl, char *value, size_t size )
 {
     assert( ctx );
-    assert( name );
+    assert( hndl );
+    assert( value );
 
     int rc = EINVAL;
-    void *handle = NULL;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    std::vector< char > rep_buf;
+
+    fill_req_buf( req_buf, DSV_MSG_GET, hndl );
+
+    rc = dsv_Query( ctx, req_buf, req->length, rep_buf );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf.data();
+    strncpy( value, rep->data, size );
+    return rc;
+}
+
+/**
+ * Get value for array or blob type of dsv, the length comes first
+ */
+int DSV_Get( void *ctx, void *hndl, void *value, size_t size )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( value );
+
+    int rc = EINVAL;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    std::vector< char > rep_buf;
+
+    fill_req_buf( req_buf, DSV_MSG_GET, hndl );
+
+    rc = dsv_Query( ctx, req_buf, req->length, rep_buf );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf.data();
+    char *rep_data = rep->data;
+
+    /* real size should include size itself */
+    size_t real_size = *(size_t *)rep_data + sizeof(size_t);
+    if( real_size > size )
+    {
+        dsvlog( LOG_ERR, "Value buffer is not big enough" );
+        return EFAULT;
+    }
+    memcpy( value, rep_data, real_size );
+    return rc;
+}
+
+
+/**
+ * Get value for numeric type of dsv
+ */
+template< typename T >
+int DSV_Get( void *ctx, void *hndl, T *value )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( value );
 
+    int rc = EINVAL;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     char *req_data = req->data;
@@ -703,28 +3195,23 @@ void* DSV_Handle( void *ctx, const char *name )
     dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
     char *rep_data = rep->data;
 
-    req->type = DSV_MSG_GET_HANDLE;
-    req->length = sizeof(dsv_msg_request_t);
-
-    strncpy( req_data, name, DSV_STRING_SIZE_MAX );
-    req->length += strlen( name ) + 1;
+    fill_req_buf( req_buf, DSV_MSG_GET, hndl );
 
     rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
     if( rc != 0 )
     {
-        if( rc != ENOENT )
-        {
-            dsvlog( LOG_ERR, "Failed to send message to the server: %s", name );
-        }
-        return NULL;
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
     }
-    handle = *(void **)rep_data;
-    return handle;
+    memcpy( value, rep_data, sizeof(dsv_value_t) );
+    return rc;
 }
 
+
 /*!=============================================================================
 
-    Query the dsv type from dsv server by handle.
+    Add delta to a numeric dsv inside the server, without waiting for any
+    reply. Concurrent increments from many producers are never lost.
 
 @param[in]
     ctx
@@ -732,697 +3219,919 @@ void* DSV_Handle( void *ctx, const char *name )
 @param[in]
     hndl
         dsv handle in server process
+@param[in]
+    delta
+        value to add, of the same type as the dsv
 @return
-    0 or positive number: type
-    -1 if not found.
+    0 - success
+    any other value specifies an error code (see errno.h)
 
 ==============================================================================*/
-int DSV_Type( void *ctx, void *hndl )
+template< typename T >
+int DSV_Incr( void *ctx, void *hndl, T delta )
 {
     assert( ctx );
     assert( hndl );
 
-    int rc = EINVAL;
-    int type = 0;
+    int rc;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+
+    fill_atomic_req_buf( req_buf, DSV_MSG_INCR, hndl, &delta, 1 );
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+
+    return rc;
+}
+
+/*!=============================================================================
+
+    Add delta to a numeric dsv inside the server, and get the value before
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    delta
+        value to add, of the same type as the dsv
+@param[out]
+    old
+        value before the add, NULL to ignore
+@return
+    0 - success
+    EINVAL - the dsv is not numeric or of another type
+    any other value specifies an error code (see errno.h)
 
+==============================================================================*/
+template< typename T >
+int DSV_FetchAdd( void *ctx, void *hndl, T delta, T *old )
+{
+    assert( ctx );
+    assert( hndl );
+
+    int rc;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
 
     char rep_buf[BUFSIZE];
     dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
 
-    fill_req_buf( req_buf, DSV_MSG_GET_TYPE, hndl );
+    fill_atomic_req_buf( req_buf, DSV_MSG_FETCH_ADD, hndl, &delta, 1 );
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to fetch and add: %s", strerror( rc ) );
+        return rc;
+    }
+
+    if( old != NULL )
+    {
+        memcpy( old, rep->data, sizeof(T) );
+    }
+    return rc;
+}
+
+/*!=============================================================================
+
+    Set a numeric dsv to desired inside the server, only if its value equals
+    expected. Like std::atomic::compare_exchange_strong, expected gets the
+    current value when they differ.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in,out]
+    expected
+        value expected, updated to the current value on EAGAIN
+@param[in]
+    desired
+        value to set
+@return
+    0 - the value is set
+    EAGAIN - the value differs from expected, nothing changed
+    EINVAL - the dsv is not numeric or of another type
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+template< typename T >
+int DSV_CompareAndSet( void *ctx, void *hndl, T *expected, T desired )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( expected );
+
+    int rc;
+    T operands[2] = { *expected, desired };
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
+
+    fill_atomic_req_buf( req_buf, DSV_MSG_CAS, hndl, operands, 2 );
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    if( rc == EAGAIN )
+    {
+        memcpy( expected, rep->data, sizeof(T) );
+    }
+    else if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to compare and set: %s", strerror( rc ) );
+    }
+    return rc;
+}
+
+#define DSV_ATOMIC_INSTANTIATE( T ) \
+    template int DSV_Incr( void *ctx, void *hndl, T delta ); \
+    template int DSV_FetchAdd( void *ctx, void *hndl, T delta, T *old ); \
+    template int DSV_CompareAndSet( void *ctx, void *hndl, T *expected, T desired );
+
+DSV_ATOMIC_INSTANTIATE( uint8_t )
+DSV_ATOMIC_INSTANTIATE( int8_t )
+DSV_ATOMIC_INSTANTIATE( uint16_t )
+DSV_ATOMIC_INSTANTIATE( int16_t )
+DSV_ATOMIC_INSTANTIATE( uint32_t )
+DSV_ATOMIC_INSTANTIATE( int32_t )
+DSV_ATOMIC_INSTANTIATE( uint64_t )
+DSV_ATOMIC_INSTANTIATE( int64_t )
+DSV_ATOMIC_INSTANTIATE( float )
+DSV_ATOMIC_INSTANTIATE( double )
+
+/*!=============================================================================
+
+    Send a get request without waiting for the reply, so that many requests
+    can be in flight at once. The reply is passed to cb by DSV_Dispatch, or
+    by any synchronous request receiving it first.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    cb
+        callback to invoke with the reply
+@param[in]
+    arg
+        opaque argument passed to cb
+@return
+    request id
+    0 - failed, cb will never be called
+
+==============================================================================*/
+uint32_t DSV_GetAsync( void *ctx, void *hndl, dsv_reply_cb_t cb, void *arg )
+{
+    assert( ctx );
+    assert( hndl );
+    assert( cb );
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+
+    fill_req_buf( req_buf, DSV_MSG_GET, hndl );
+
+    uint32_t id = dsv_SendAsync( ctx, req_buf, req->length, cb, arg );
+    if( id == 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+    }
+    return id;
+}
+
+/**
+ * Store the reply of a future based get into its slot
+ */
+static void dsv_FillAsyncSlot( uint32_t id,
+                               int result,
+                               const void *value,
+                               size_t len,
+                               void *arg )
+{
+    auto slot = (std::shared_ptr< dsv_async_slot_t > *)arg;
+    (*slot)->done = true;
+    (*slot)->result = result;
+    if( result == 0 && len >= sizeof(dsv_value_t) )
+    {
+        memcpy( &(*slot)->value, value, sizeof(dsv_value_t) );
+    }
+    delete slot;
+}
+
+/**
+ * Pipelined get for numeric type of dsv. The request is sent immediately,
+ * the future dispatches replies on get() until its own one arrives.
+ * Errors are reported as std::system_error by the future.
+ */
+template< typename T >
+std::future<T> DSV_GetAsync( void *ctx, void *hndl )
+{
+    assert( ctx );
+    assert( hndl );
+
+    auto slot = std::make_shared< dsv_async_slot_t >();
+    slot->done = false;
+    slot->result = EINVAL;
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
-    if( rc != 0 )
+    auto arg = new std::shared_ptr< dsv_async_slot_t >( slot );
+    if( DSV_GetAsync( ctx, hndl, dsv_FillAsyncSlot, arg ) == 0 )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        delete arg;
+        slot->done = true;
+        slot->result = EFAULT;
     }
-    type = *(int *)rep_data;
-    return type;
+
+    return std::async( std::launch::deferred, [ctx, slot]()
+    {
+        while( !slot->done )
+        {
+            if( DSV_Dispatch( ctx, -1 ) < 0 )
+            {
+                throw std::system_error( EFAULT, std::generic_category() );
+            }
+        }
+        if( slot->result != 0 )
+        {
+            throw std::system_error( slot->result, std::generic_category() );
+        }
+
+        T value;
+        memcpy( &value, &slot->value, sizeof(T) );
+        return value;
+    } );
 }
 
+template std::future<uint8_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<int8_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<uint16_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<int16_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<uint32_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<int32_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<uint64_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<int64_t> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<float> DSV_GetAsync( void *ctx, void *hndl );
+template std::future<double> DSV_GetAsync( void *ctx, void *hndl );
+
 /*!=============================================================================
 
-    Query the dsv len from dsv server by handle. (Used for array type of dsv)
+    Wait for the replies of asynchronous requests, and invoke their callbacks.
+    The request socket can also be polled by the application, then call this
+    function with 0 timeout when it is readable.
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
 @param[in]
-    hndl
-        dsv handle in server process
+    timeout
+        milliseconds to wait for the first reply, -1 waits forever
 @return
-    0 or positive number: type
-    -1 if not found.
+    number of callbacks invoked
+    -1 - failed
 
 ==============================================================================*/
-size_t DSV_Len( void *ctx, void *hndl )
+int DSV_Dispatch( void *ctx, int timeout )
 {
     assert( ctx );
-    assert( hndl );
-
-    int rc = EINVAL;
-    size_t len = 0;
-
-    char req_buf[BUFSIZE];
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
 
+    int rc;
+    int count = 0;
     char rep_buf[BUFSIZE];
-    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
+    uint32_t shards = dsv_ShardCount( ctx );
+    dsv_thread_socks_t *socks[DSV_SHARD_MAX];
+    zmq_pollitem_t items[DSV_SHARD_MAX];
 
-    fill_req_buf( req_buf, DSV_MSG_GET_LEN, hndl );
+    for( uint32_t i = 0; i < shards; i++ )
+    {
+        socks[i] = dsv_GetSocks( dsv_Shard( ctx, i ) );
+        if( socks[i] == NULL )
+        {
+            return -1;
+        }
+        items[i] = { socks[i]->sock_request, 0, ZMQ_POLLIN, 0 };
+    }
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
-    if( rc != 0 )
+    rc = zmq_poll( items, shards, timeout );
+    if( rc == -1 )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        dsvlog( LOG_ERR, "zmq_poll failed: %s", strerror( errno ) );
+        return -1;
     }
-    len = *(size_t *)rep_data;
-    return len;
+
+    /* drain everything queued, so one wakeup serves a whole pipeline */
+    for( uint32_t i = 0; i < shards; i++ )
+    {
+        while( dsv_RecvReply( socks[i],
+                              rep_buf,
+                              sizeof(rep_buf),
+                              ZMQ_DONTWAIT ) != -1 )
+        {
+            if( dsv_DispatchReply( socks[i], rep_buf ) == 0 )
+            {
+                ++count;
+            }
+        }
+        if( errno != EAGAIN )
+        {
+            dsvlog( LOG_ERR, "zmq_recv failed: %s", strerror( errno ) );
+            return -1;
+        }
+    }
+
+    return count;
 }
-/*!=============================================================================
 
-    This function request dsv server to update dsv with value.
-    This is a helper function that should not be used in time critical case.
+/*!=============================================================================
 
-    This function first query the handle from the server then call
-    DSV_SetThruStr function to set the value in string form
+    Get the request socket of the calling thread, so that the application can
+    poll it together with its own sockets and call DSV_Dispatch when it is
+    readable. With a sharded cluster it is the socket to the first shard,
+    see DSV_RequestSockets.
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
-@param[in]
-    name
-        dsv name string terminated by NULL byte
-@param[in]
-    value
-        dsv value as string
 @return
-    0 - success
-    any other value specifies an error code (see errno.h)
+    zmq socket
+    NULL - failed
 
 ==============================================================================*/
-int DSV_SetByName( void *ctx, const char *name, char *value )
+void *DSV_RequestSocket( void *ctx )
 {
     assert( ctx );
-    assert( name );
-    assert( value );
-
-    int rc = EINVAL;
-    void *hndl = DSV_Handle( ctx, name );
-    if( hndl == NULL )
-    {
-        dsvlog( LOG_ERR, "Unable to find dsv: %s", name );
-        return rc;
-    }
 
-    rc = DSV_SetThruStr( ctx, hndl, value );
-    return rc;
+    dsv_thread_socks_t *socks = dsv_GetSocks( ctx );
+    return socks != NULL ? socks->sock_request : NULL;
 }
 
 /*!=============================================================================
 
-    This function requests dsv server to update dsv with value in string form.
-
-    This function first query the type from the server then call the
-    corresponsing DSV_Set function to set the value
+    Get the request sockets of the calling thread to every shard, so that the
+    application can poll them together with its own sockets and call
+    DSV_Dispatch when any of them is readable.
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
+@param[out]
+    socks
+        buffer to output the zmq sockets
 @param[in]
-    hndl
-        dsv handle in server process
-@param[in]
-    value
-        dsv value in string form
+    max
+        number of entries in socks, DSV_SHARD_MAX is always enough
 @return
-    0 - success
-    any other value specifies an error code (see errno.h)
+    number of sockets
+    -1 - failed
 
 ==============================================================================*/
-int DSV_SetThruStr( void *ctx, void *hndl, const char *value )
+int DSV_RequestSockets( void *ctx, void **socks, int max )
 {
     assert( ctx );
-    assert( hndl );
-    assert( value );
-
-    int rc = EINVAL;
-    int type = DSV_Type( ctx, hndl );
-    if( type < 0 )
-    {
-        dsvlog( LOG_ERR, "Unable to get the dsv type" );
-        return rc;
-    }
+    assert( socks );
 
-    dsv_info_t dsv;
-    size_t size;
-    void *data;
-    switch( type )
+    int count = 0;
+    for( uint32_t i = 0; i < dsv_ShardCount( ctx ) && count < max; i++ )
     {
-    case DSV_TYPE_STR:
-        rc = DSV_Set( ctx, hndl, value );
-        break;
-    case DSV_TYPE_INT_ARRAY:
-        rc = DSV_Str2Array( value, &data, &size );
-        if( rc == 0 )
+        dsv_thread_socks_t *s = dsv_GetSocks( dsv_Shard( ctx, i ) );
+        if( s == NULL )
         {
-            rc = DSV_Set( ctx, hndl, data, size );
-            free( data );
+            return -1;
         }
-        break;
-    case DSV_TYPE_UINT16:
-        rc = DSV_Set( ctx, hndl, (uint16_t)strtoul( value, NULL, 10 ) );
-        break;
-
-    case DSV_TYPE_UINT32:
-        rc = DSV_Set( ctx, hndl, (uint32_t)strtoul( value, NULL, 10 ) );
-        break;
-
-    case DSV_TYPE_UINT64:
-        rc = DSV_Set( ctx, hndl, (uint64_t)strtoull( value, NULL, 10 ) );
-        break;
-
-    case DSV_TYPE_UINT8:
-        rc = DSV_Set( ctx, hndl, (uint8_t)strtoul( value, NULL, 10 ) );
-        break;
-
-    case DSV_TYPE_SINT16:
-        rc = DSV_Set( ctx, hndl, (int16_t)strtol( value, NULL, 10 ) );
-        break;
-
-    case DSV_TYPE_SINT32:
-        rc = DSV_Set( ctx, hndl, (int32_t)strtol( value, NULL, 10 ) );
-        break;
+        socks[count++] = s->sock_request;
+    }
+    return count;
+}
 
-    case DSV_TYPE_SINT64:
-        rc = DSV_Set( ctx, hndl, (int64_t)strtoll( value, NULL, 10 ) );
-        break;
+/**
+ * return zero if successful. Otherwise it shall return -1
+ */
+int DSV_SubByName( void *ctx, const char *name )
+{
+    assert( ctx );
+    assert( name );
 
-    case DSV_TYPE_SINT8:
-        rc = DSV_Set( ctx, hndl, (int8_t)strtol( value, NULL, 10 ) );
-        break;
+    int rc;
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    rc = zmq_setsockopt( dsv_ctx->sock_subscribe,
+                         ZMQ_SUBSCRIBE,
+                         name,
+                         strlen( name ) + 1 );
+    return rc;
+}
 
-    case DSV_TYPE_FLOAT:
-        rc = DSV_Set( ctx, hndl, strtof( value, NULL ) );
-        break;
+/*!=============================================================================
 
-    case DSV_TYPE_DOUBLE:
-        rc = DSV_Set( ctx, hndl, strtod( value, NULL ) );
-        break;
+    Subscribe to the notifications of the writes of this process rejected by
+    the validation rules of the dsvs. Such a notification is named
+    DSV_REJECT_TOPIC followed by the pid, and its value is a dsv_reject_t.
 
-    default:
-        dsvlog( LOG_ERR, "Unsupported type for dsv" );
-        break;
-    }
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@return
+    zero if successful. Otherwise it shall return -1
+==============================================================================*/
+int DSV_SubRejects( void *ctx )
+{
+    assert( ctx );
 
-    return rc;
+    char topic[DSV_STRING_SIZE_MAX];
+    snprintf( topic, sizeof(topic), DSV_REJECT_TOPIC "%d", getpid() );
+    return DSV_SubByName( ctx, topic );
 }
 
 /**
- * Set value for string type of dsv
+ *
  */
-int DSV_Set( void *ctx, void *hndl, char *value )
+int DSV_GetNotification( void *ctx,
+                         void **hndl,
+                         char *name,
+                         size_t nlen,
+                         void *value,
+                         size_t vlen )
 {
     assert( ctx );
-    assert( hndl );
+    assert( name );
     assert( value );
+    assert( hndl );
 
-    int rc = EINVAL;
-    char req_buf[BUFSIZE];
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+    std::vector< char > msg;
+    int rc = dsv_RecvMsg( ctx, msg );
+    if( rc == 0 )
+    {
+        char *data = msg.data();
+        char *end = data + msg.size();
 
-    rc = fill_req_buf( req_buf, DSV_MSG_SET, hndl );
+        strncpy( name, data, nlen );
+        data += strnlen( data, msg.size() ) + 1;
 
-    req_data += rc;
-    *(pid_t *)req_data = getpid();
-    req->length += sizeof(pid_t);
+        *hndl = *(void **)data;
+        data += sizeof(hndl);
 
-    req_data += sizeof(pid_t);
-    strncpy( req_data, value, DSV_STRING_SIZE_MAX );
-    req->length += strlen( req_data ) + 1;
+        /* a large value is cut to the buffer, DSV_Get gets all of it */
+        memcpy( value, data, std::min( vlen, (size_t)( end - data ) ) );
+    }
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
+    return rc;
+}
+
+/*!=============================================================================
+
+    Point a notice to the name, handle and value of a notification
+
+@param[in]
+    data
+        notification, or its first frame
+@param[in]
+    size
+        length of data
+@param[out]
+    notice
+        notice to fill
+@return
+    0 - success
+    EFAULT - malformed notification
+==============================================================================*/
+static int dsv_ParseNotice( const char *data, size_t size, dsv_notice_t *notice )
+{
+    size_t head = strnlen( data, size ) + 1 + sizeof(void *);
+    if( head > size )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
         return EFAULT;
     }
 
-    return rc;
+    notice->name = data;
+    notice->hndl = *(void **)( data + head - sizeof(void *) );
+    notice->value = data + head;
+    notice->len = size - head;
+    return 0;
 }
 
-/**
- * Set value for int array type of dsv
- */
-int DSV_Set( void *ctx, void *hndl, void *data, size_t size )
+/*!=============================================================================
+
+    Get a notification without copying it. The server sends a BLOB as the
+    name, handle and length in a frame shorter than DSV_CHUNK_SIZE followed
+    by the bytes in a frame of their own, notice->value points to the bytes
+    in the received frame. Other values of one frame are not copied either,
+    while larger ones and deltas are put together as DSV_GetNotification()
+    does. The notice is valid until DSV_ReleaseNotification().
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[out]
+    notice
+        name, handle and value of the notification
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_RecvNotification( void *ctx, dsv_notice_t *notice )
 {
     assert( ctx );
-    assert( hndl );
-    assert( data );
+    assert( notice );
+
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    void *sock = dsv_ctx->sock_subscribe;
+    dsv_notice_msg_t *m = new dsv_notice_msg_t();
+    int more;
+    size_t more_size = sizeof(more);
+    int rc;
+
+    notice->msg = m;
+    for( ;; )
+    {
+        /* the first two frames are kept as received */
+        do
+        {
+            zmq_msg_t *frame = &m->frames[m->count];
+            zmq_msg_init( frame );
+            if( zmq_msg_recv( frame, sock, 0 ) == -1 )
+            {
+                dsvlog( LOG_ERR, "zmq_recv failed: %s", zmq_strerror( errno ) );
+                zmq_msg_close( frame );
+                DSV_ReleaseNotification( notice );
+                return EFAULT;
+            }
+            m->count++;
+            zmq_getsockopt( sock, ZMQ_RCVMORE, &more, &more_size );
+        } while( more && m->count < 2 );
 
-    int rc = EINVAL;
-    char req_buf[BUFSIZE];
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+        const char *head = (const char *)zmq_msg_data( &m->frames[0] );
+        size_t head_size = zmq_msg_size( &m->frames[0] );
+        if( m->count == 2 && !more && head_size < DSV_CHUNK_SIZE )
+        {
+            rc = dsv_ParseNotice( head, head_size, notice );
+            notice->value = zmq_msg_data( &m->frames[1] );
+            notice->len = zmq_msg_size( &m->frames[1] );
+            break;
+        }
 
-    rc = fill_req_buf( req_buf, DSV_MSG_SET, hndl );
+        rc = dsv_ParseNotice( head, head_size, notice );
+        if( rc == 0 && m->count == 1 &&
+            ( notice->len < sizeof(dsv_delta_t) ||
+              *(const size_t *)notice->value != DSV_DELTA_MARK ) )
+        {
+            break;
+        }
 
-    req_data += rc;
-    *(pid_t *)req_data = getpid();
-    req->length += sizeof(pid_t);
+        /* put the frames together, then the rest of the message */
+        for( int i = 0; i < m->count; i++ )
+        {
+            const char *data = (const char *)zmq_msg_data( &m->frames[i] );
+            m->copy.insert( m->copy.end(),
+                            data,
+                            data + zmq_msg_size( &m->frames[i] ) );
+            zmq_msg_close( &m->frames[i] );
+        }
+        m->count = 0;
+        if( more )
+        {
+            std::vector< char > rest;
+            if( DSV_RecvChunks( sock, rest, 0 ) == -1 )
+            {
+                DSV_ReleaseNotification( notice );
+                return EFAULT;
+            }
+            m->copy.insert( m->copy.end(), rest.begin(), rest.end() );
+        }
 
-    req_data += sizeof(pid_t);
-    memcpy( req_data, data, size );
-    req->length += size;
+        rc = DSV_DecodeNotification( ctx, m->copy );
+        if( rc > 0 )
+        {
+            rc = dsv_ParseNotice( m->copy.data(), m->copy.size(), notice );
+            break;
+        }
+        m->copy.clear();
+        if( rc < 0 )
+        {
+            rc = EFAULT;
+            break;
+        }
+        /* a stale delta is dropped, wait for the next notification */
+    }
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
     if( rc != 0 )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        DSV_ReleaseNotification( notice );
     }
-
     return rc;
 }
 
-/**
- * Set value for numeric type of dsv
- */
-template< typename T >
-int DSV_Set( void *ctx, void *hndl, T value )
-{
-    assert( ctx );
-    assert( hndl );
-
-    int rc = EINVAL;
-    char req_buf[BUFSIZE];
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
-
-    rc = fill_req_buf( req_buf, DSV_MSG_SET, hndl );
+/*!=============================================================================
 
-    req_data += rc;
-    *(pid_t *)req_data = getpid();
-    req->length += sizeof(pid_t);
+    Release the message of a notification got by DSV_RecvNotification()
 
-    req_data += sizeof(pid_t);
-    memcpy( req_data, &value, sizeof(value) );
-    req->length += sizeof(value);
+@param[in]
+    notice
+        the notification
+==============================================================================*/
+void DSV_ReleaseNotification( dsv_notice_t *notice )
+{
+    assert( notice );
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
+    dsv_notice_msg_t *m = (dsv_notice_msg_t *)notice->msg;
+    if( m != NULL )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        for( int i = 0; i < m->count; i++ )
+        {
+            zmq_msg_close( &m->frames[i] );
+        }
+        delete m;
+        notice->msg = NULL;
     }
-
-    return rc;
 }
 
-
 /*!=============================================================================
 
-    This function request dsv server to query dsv with value.
-    This is a helper function that should not be used in time critical case.
-    The instID and name must be exactly matched
-
-    This function first query the handle from the server then call
-    DSV_GetThruStr function to set the value in string form
+    Get a full copy of a DSV_FLAG_DELTA array with its version, after a delta
+    is missed
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
 @param[in]
-    name
-        dsv name string terminated by NULL byte
+    hndl
+        dsv handle in server process
 @param[out]
-    value
-        dsv value as string
-@param[in]
-    size
-        size of value buffer
-
+    mirror
+        local copy of the array
 @return
     0 - success
     any other value specifies an error code (see errno.h)
 
 ==============================================================================*/
-int DSV_GetByName( void *ctx,
-                   const char *name,
-                   char *value,
-                   size_t size )
+static int dsv_Resync( void *ctx, void *hndl, dsv_mirror_t *mirror )
 {
+    int rc;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
 
-    assert( ctx );
-    assert( name );
-    assert( value );
+    /* the whole array, larger than BUFSIZE for more than a few items */
+    std::vector< char > rep_buf;
 
-    int rc = EINVAL;
-    void *hndl = DSV_Handle( ctx, name );
-    if( hndl == NULL )
+    fill_req_buf( req_buf, DSV_MSG_RESYNC, hndl );
+
+    rc = dsv_Query( ctx, req_buf, req->length, rep_buf );
+    if( rc == 0 &&
+        rep_buf.size() < sizeof(dsv_msg_reply_t) + sizeof(dsv_delta_t) )
     {
-        dsvlog( LOG_ERR, "Unable to find dsv: %s", name );
-        return rc;
+        rc = EFAULT;
+    }
+    if( rc == 0 )
+    {
+        const dsv_msg_reply_t *rep = (const dsv_msg_reply_t *)rep_buf.data();
+        const dsv_delta_t *delta = (const dsv_delta_t *)rep->data;
+        rc = DSV_ApplyDelta( &mirror->items,
+                             delta,
+                             std::min( rep->length, rep_buf.size() ) -
+                             sizeof(dsv_msg_reply_t) );
+        if( rc == 0 )
+        {
+            mirror->version = delta->version;
+            mirror->synced = true;
+        }
+    }
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to resync the array: %s", strerror( rc ) );
     }
-
-    rc = DSV_GetThruStr( ctx, hndl, value, size );
     return rc;
 }
 
 /*!=============================================================================
 
-    This function request dsv server to query dsv with value.
-    This is a helper function that should not be used in time critical case.
-    Partially matched name will also return its value
-
-    This function first query the handle from the server then call
-    DSV_GetThruStr function to set the value in string form
+    Apply the delta carried by a notification to the local copy of the array,
+    and rewrite the notification in place with the whole array, in the layout
+    of DSV_Memcpy(). A delta following a missed one resynchronizes the copy
+    with the server. Other notifications are left untouched.
 
 @param[in]
     ctx
         dsv ctx ( returned by DSV_Open() )
-
-@param[in]
-    name
-        dsv name string terminated by NULL byte
-
-@param[in]
-    index
-        index of last match
-
-@param[out]
-    value
-        dsv value as string
-
-@param[in]
-    size
-        size of value buffer
-
+@param[in,out]
+    msg
+        notification received from the subscribe socket, resized to the
+        whole array
 @return
-    index of dsv matched this time - success
-    -1 - the end of match
+    number of bytes of the notification
+    0 - the delta is older than the local copy, drop the notification
+    -1 - failed
 
 ==============================================================================*/
-int DSV_GetByNameFuzzy( void *ctx,
-                        const char *search_name,
-                        int last_index,
-                        char *name,
-                        size_t namesz,
-                        char *value,
-                        size_t valuesz )
+int DSV_DecodeNotification( void *ctx, std::vector< char > &msg )
 {
     assert( ctx );
-    assert( name );
-    assert( value );
-
-    int rc = EINVAL;
-    char req_buf[BUFSIZE];
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
 
-    char rep_buf[BUFSIZE];
-    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
+    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
+    char *buf = msg.data();
+    size_t len = msg.size();
 
-    req->type = DSV_MSG_GET_NEXT;
-    req->length = sizeof(dsv_msg_request_t);
+    size_t head = strnlen( buf, len ) + 1 + sizeof(void *);
+    if( len == head + sizeof(void *) &&
+        *(void **)( buf + head - sizeof(void *) ) == NULL )
+    {
+        /* the dsv is deleted, so is the copy of an array */
+        dsv_mirror_map_t *mirrors = (dsv_mirror_map_t *)dsv_ctx->mirrors;
+        if( mirrors != NULL )
+        {
+            mirrors->erase( *(void **)( buf + head ) );
+        }
+        return len;
+    }
+    if( len < head + sizeof(dsv_delta_t) )
+    {
+        return len;
+    }
 
-    *(int *)req_data = last_index;
-    req->length += sizeof(int);
+    dsv_delta_t *delta = (dsv_delta_t *)( buf + head );
+    if( delta->mark != DSV_DELTA_MARK )
+    {
+        return len;
+    }
 
-    req_data += sizeof(int);
-    strcpy( req_data, search_name );
-    req->length += strlen( search_name ) + 1;
+    if( dsv_ctx->mirrors == NULL )
+    {
+        dsv_ctx->mirrors = new dsv_mirror_map_t();
+    }
+    void *hndl = *(void **)( buf + head - sizeof(void *) );
+    dsv_mirror_t &mirror = ( *(dsv_mirror_map_t *)dsv_ctx->mirrors )[hndl];
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
-    if( rc != 0 )
+    int32_t ahead = (int32_t)( delta->version - mirror.version );
+    if( delta->op == DSV_DELTA_FULL || ( mirror.synced && ahead == 1 ) )
     {
-        if( rc != ENOENT )
+        if( DSV_ApplyDelta( &mirror.items, delta, len - head ) != 0 )
         {
-            dsvlog( LOG_ERR,
-                    "Failed to send message to the server: %s",
-                    search_name );
+            dsvlog( LOG_ERR, "Malformed delta of %s", buf );
+            mirror.synced = false;
+            return -1;
         }
-        rc = -1;
+        mirror.version = delta->version;
+        mirror.synced = true;
     }
-    else
+    else if( mirror.synced && ahead <= 0 )
     {
-        rc = *(int *)rep_data;
-        rep_data += sizeof(int);
-        strncpy( name, rep_data, namesz );
-        rep_data += strlen( rep_data ) + 1;
-        strncpy( value, rep_data, valuesz );
+        /* already in the copy got by a resync */
+        return 0;
     }
-    return rc;
+    else if( dsv_Resync( ctx, hndl, &mirror ) != 0 )
+    {
+        mirror.synced = false;
+        return -1;
+    }
+
+    size_t bytes = mirror.items.size() * sizeof(int);
+    msg.resize( head + sizeof(size_t) + bytes );
+    buf = msg.data();
+    *(size_t *)( buf + head ) = bytes;
+    memcpy( buf + head + sizeof(size_t), mirror.items.data(), bytes );
+
+    return msg.size();
 }
 
-int DSV_TrackByNameFuzzy( void *ctx,
-                          const char *search_name,
-                          int last_index,
-                          int enable )
+int DSV_AddItemToArray( void *ctx, void *hndl, int value )
 {
     assert( ctx );
-    assert( search_name );
+    assert( hndl );
 
     int rc = EINVAL;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     char *req_data = req->data;
 
-    char rep_buf[BUFSIZE];
-    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
-
-    req->type = DSV_MSG_TRACK;
-    req->length = sizeof(dsv_msg_request_t);
-
-    *(int *)req_data = last_index;
-    req->length += sizeof(int);
+    rc = fill_req_buf( req_buf, DSV_MSG_ADD_ITEM, hndl );
 
-    req_data += sizeof(int);
-    strcpy( req_data, search_name );
-    req->length += strlen( search_name ) + 1;
+    req_data += rc;
+    *(pid_t *)req_data = getpid();
+    req->length += sizeof(pid_t);
 
-    req_data += strlen( search_name ) + 1;
-    *(int *)req_data = enable;
-    req->length += sizeof(int);
+    req_data += sizeof(pid_t);
+    *(int *)req_data = value;
+    req->length += sizeof(value);
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
     if( rc != 0 )
     {
-        if( rc != ENOENT )
-        {
-            dsvlog( LOG_ERR,
-                    "Failed to send message to the server: %s",
-                    search_name );
-        }
-        rc = -1;
-    }
-    else
-    {
-        rc = *(int *)rep_data;
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
     }
+
     return rc;
 }
-/*!=============================================================================
-
-    This function requests dsv server to query dsv with value in string form.
-
-    This function first query the type from the server then call the
-    corresponsing DSV_Get function to set the value
-
-@param[in]
-    ctx
-        dsv ctx ( returned by DSV_Open() )
-
-@param[in]
-    hndl
-        dsv handle in server process
-
-@param[in]
-    value
-        dsv value buffer
-
- @param[in]
-    size
-        size of buffer
-
-@return
-    0 - success
-    any other value specifies an error code (see errno.h)
 
-==============================================================================*/
-int DSV_GetThruStr( void *ctx, void *hndl, char *value, size_t size )
+int DSV_InsItemToArray( void *ctx, void *hndl, int index, int value )
 {
     assert( ctx );
     assert( hndl );
-    assert( value );
 
     int rc = EINVAL;
-    int type = DSV_Type( ctx, hndl );
-    if( type < 0 )
-    {
-        dsvlog( LOG_ERR, "Unable to get the dsv type" );
-        return rc;
-    }
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
 
-    char data[DSV_STRING_SIZE_MAX];
-    switch( type )
-    {
-    case DSV_TYPE_STR:
-        rc = DSV_Get( ctx, hndl, value, size );
-        break;
-    case DSV_TYPE_INT_ARRAY:
-        rc = DSV_Get( ctx, hndl, (void *)data, DSV_STRING_SIZE_MAX );
-        DSV_PrintArray( data, value, size );
-        break;
-    case DSV_TYPE_UINT16:
-        uint16_t u16;
-        rc = DSV_Get( ctx, hndl, &u16 );
-        snprintf( value, size, "%" PRIu16, u16 );
-        break;
-    case DSV_TYPE_UINT32:
-        uint32_t u32;
-        rc = DSV_Get( ctx, hndl, &u32 );
-        snprintf( value, size, "%" PRIu32, u32 );
-        break;
-    case DSV_TYPE_UINT64:
-        uint64_t u64;
-        rc = DSV_Get( ctx, hndl, &u64 );
-        snprintf( value, size, "%" PRIu64, u64 );
-        break;
-    case DSV_TYPE_UINT8:
-        uint8_t u8;
-        rc = DSV_Get( ctx, hndl, &u8 );
-        snprintf( value, size, "%" PRIu8, u8 );
-        break;
+    rc = fill_req_buf( req_buf, DSV_MSG_INS_ITEM, hndl );
 
-    case DSV_TYPE_SINT16:
-        int16_t s16;
-        rc = DSV_Get( ctx, hndl, &s16 );
-        snprintf( value, size, "%" PRId16, s16 );
-        break;
-    case DSV_TYPE_SINT32:
-        int32_t s32;
-        rc = DSV_Get( ctx, hndl, &s32 );
-        snprintf( value, size, "%" PRId32, s32 );
-        break;
-    case DSV_TYPE_SINT64:
-        int64_t s64;
-        rc = DSV_Get( ctx, hndl, &s64 );
-        snprintf( value, size, "%" PRId64, s64 );
-        break;
-    case DSV_TYPE_SINT8:
-        int8_t s8;
-        rc = DSV_Get( ctx, hndl, &s8 );
-        snprintf( value, size, "%" PRId8, s8 );
-        break;
-    case DSV_TYPE_FLOAT:
-        float f32;
-        rc = DSV_Get( ctx, hndl, &f32 );
-        snprintf( value, size, "%f", f32 );
-        break;
-    case DSV_TYPE_DOUBLE:
-        double f64;
-        rc = DSV_Get( ctx, hndl, &f64 );
-        snprintf( value, size, "%f", f64 );
-        break;
+    req_data += rc;
+    *(pid_t *)req_data = getpid();
+    req->length += sizeof(pid_t);
 
-    default:
-        dsvlog( LOG_ERR, "Unsupported type for dsv" );
-        break;
+    req_data += sizeof(pid_t);
+    *(int *)req_data = index;
+    req->length += sizeof(index);
+    req_data += sizeof(index);
+
+    *(int *)req_data = value;
+    req->length += sizeof(value);
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
     }
 
     return rc;
 }
 
-/**
- * Get value for string type of dsv
- */
-int DSV_Get( void *ctx, void *hndl, char *value, size_t size )
+int DSV_DelItemFromArray( void *ctx, void *hndl, int index )
 {
     assert( ctx );
     assert( hndl );
-    assert( value );
 
     int rc = EINVAL;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     char *req_data = req->data;
 
-    char rep_buf[BUFSIZE];
-    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
+    rc = fill_req_buf( req_buf, DSV_MSG_DEL_ITEM, hndl );
+    req_data += rc;
+    *(pid_t *)req_data = getpid();
+    req->length += sizeof(pid_t);
 
-    fill_req_buf( req_buf, DSV_MSG_GET, hndl );
+    req_data += sizeof(pid_t);
+    *(int *)req_data = index;
+    req->length += sizeof(index);
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
     if( rc != 0 )
     {
         dsvlog( LOG_ERR, "Failed to send message to the server" );
         return EFAULT;
     }
-    strncpy( value, rep_data, size );
+
     return rc;
 }
 
-/**
- * Get value for array type of dsv
- */
-int DSV_Get( void *ctx, void *hndl, void *value, size_t size )
+int DSV_SetItemInArray( void *ctx, void *hndl, int index, int value )
 {
     assert( ctx );
     assert( hndl );
-    assert( value );
 
     int rc = EINVAL;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     char *req_data = req->data;
 
-    char rep_buf[BUFSIZE];
-    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
+    rc = fill_req_buf( req_buf, DSV_MSG_SET_ITEM, hndl );
+    req_data += rc;
+    *(pid_t *)req_data = getpid();
+    req->length += sizeof(pid_t);
 
-    fill_req_buf( req_buf, DSV_MSG_GET, hndl );
+    req_data += sizeof(pid_t);
+    *(int *)req_data = index;
+    req->length += sizeof(index);
+    req_data += sizeof(index);
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+    *(int *)req_data = value;
+    req->length += sizeof(value);
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
     if( rc != 0 )
     {
         dsvlog( LOG_ERR, "Failed to send message to the server" );
         return EFAULT;
     }
 
-    /* real size should include size itself */
-    size_t real_size = *(size_t *)rep_data + sizeof(size_t);
-    if( real_size > size )
-    {
-        dsvlog( LOG_ERR, "Value buffer is not big enough" );
-        return EFAULT;
-    }
-    memcpy( value, rep_data, real_size );
     return rc;
 }
 
-
-/**
- * Get value for numeric type of dsv
- */
-template< typename T >
-int DSV_Get( void *ctx, void *hndl, T *value )
+int DSV_GetItemFromArray( void *ctx, void *hndl, int index, int *value )
 {
     assert( ctx );
     assert( hndl );
-    assert( value );
 
     int rc = EINVAL;
     char req_buf[BUFSIZE];
@@ -1433,7 +4142,11 @@ int DSV_Get( void *ctx, void *hndl, T *value )
     dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
     char *rep_data = rep->data;
 
-    fill_req_buf( req_buf, DSV_MSG_GET, hndl );
+    rc = fill_req_buf( req_buf, DSV_MSG_GET_ITEM, hndl );
+    req_data += rc;
+
+    *(int *)req_data = index;
+    req->length += sizeof(index);
 
     rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
     if( rc != 0 )
@@ -1441,214 +4154,570 @@ int DSV_Get( void *ctx, void *hndl, T *value )
         dsvlog( LOG_ERR, "Failed to send message to the server" );
         return EFAULT;
     }
-    memcpy( value, rep_data, sizeof(dsv_value_t) );
+    *value = *(int *)rep_data;
     return rc;
 }
 
+/*!=============================================================================
 
-/**
- * return zero if successful. Otherwise it shall return -1
- */
-int DSV_SubByName( void *ctx, const char *name )
+    Send one array range message: [handle][pid][header ints][items]
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    type
+        DSV_MSG_SET_RANGE, DSV_MSG_APPEND_ITEMS or DSV_MSG_DEL_RANGE
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    head
+        index and/or count preceding the items
+@param[in]
+    nhead
+        number of ints in head
+@param[in]
+    items
+        items to send, NULL if none
+@param[in]
+    count
+        number of items
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+static int dsv_SendRange( void *ctx,
+                          int type,
+                          void *hndl,
+                          const int *head,
+                          int nhead,
+                          const int *items,
+                          int count )
+{
+    int rc;
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data;
+
+    req_data += fill_req_buf( req_buf, type, hndl );
+
+    *(pid_t *)req_data = getpid();
+    req_data += sizeof(pid_t);
+    req->length += sizeof(pid_t);
+
+    memcpy( req_data, head, nhead * sizeof(int) );
+    req_data += nhead * sizeof(int);
+    req->length += nhead * sizeof(int);
+
+    if( items != NULL )
+    {
+        memcpy( req_data, items, count * sizeof(int) );
+        req->length += count * sizeof(int);
+    }
+
+    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
+    if( rc != 0 )
+    {
+        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        return EFAULT;
+    }
+
+    return rc;
+}
+
+/*!=============================================================================
+
+    Set count items from index of an INT_ARRAY dsv in one message, so the
+    subscribers get one notification. The array grows when the range goes
+    beyond its end. Ranges larger than DSV_ARRAY_RANGE_MAX take one message
+    per DSV_ARRAY_RANGE_MAX items.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    index
+        index of the first item, no more than the array size
+@param[in]
+    values
+        values of the items
+@param[in]
+    count
+        number of items
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_SetArrayRange( void *ctx,
+                       void *hndl,
+                       int index,
+                       const int *values,
+                       int count )
 {
     assert( ctx );
-    assert( name );
+    assert( hndl );
+    assert( values || count == 0 );
+
+    int rc = 0;
+
+    do
+    {
+        int n = std::min( count, DSV_ARRAY_RANGE_MAX );
+        int head[2] = { index, n };
+
+        rc = dsv_SendRange( ctx, DSV_MSG_SET_RANGE, hndl, head, 2, values, n );
+        index += n;
+        values += n;
+        count -= n;
+    } while( rc == 0 && count > 0 );
 
-    int rc;
-    dsv_context_t *dsv_ctx = (dsv_context_t *)ctx;
-    rc = zmq_setsockopt( dsv_ctx->sock_subscribe,
-                         ZMQ_SUBSCRIBE,
-                         name,
-                         strlen( name ) + 1 );
     return rc;
 }
 
-/**
- *
- */
-int DSV_GetNotification( void *ctx,
-                         void **hndl,
-                         char *name,
-                         size_t nlen,
-                         void *value,
-                         size_t vlen )
+/*!=============================================================================
+
+    Append count items to the end of an INT_ARRAY dsv in one message
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    values
+        values of the items
+@param[in]
+    count
+        number of items
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_AppendItems( void *ctx, void *hndl, const int *values, int count )
 {
     assert( ctx );
-    assert( name );
-    assert( value );
     assert( hndl );
+    assert( values || count == 0 );
 
-    char sub_buf[BUFSIZE];
-    char *data = sub_buf;
-    int rc = dsv_RecvMsg( ctx, sub_buf, sizeof(sub_buf) );
-    if( rc == 0 )
-    {
-        strncpy( name, data, nlen );
-        data += strlen( name ) + 1;
+    int rc = 0;
 
-        *hndl = *(void **)data;
-        data += sizeof(hndl);
+    do
+    {
+        int n = std::min( count, DSV_ARRAY_RANGE_MAX );
 
-        memcpy( value, data, vlen );
-    }
+        rc = dsv_SendRange( ctx, DSV_MSG_APPEND_ITEMS, hndl, &n, 1, values, n );
+        values += n;
+        count -= n;
+    } while( rc == 0 && count > 0 );
 
     return rc;
 }
 
-int DSV_AddItemToArray( void *ctx, void *hndl, int value )
+/*!=============================================================================
+
+    Delete count items from index of an INT_ARRAY dsv in one message, a range
+    going beyond the end deletes up to the end
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    index
+        index of the first item
+@param[in]
+    count
+        number of items
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_DeleteRange( void *ctx, void *hndl, int index, int count )
 {
     assert( ctx );
     assert( hndl );
 
-    int rc = EINVAL;
-    char req_buf[BUFSIZE];
-    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
-
-    rc = fill_req_buf( req_buf, DSV_MSG_ADD_ITEM, hndl );
+    int head[2] = { index, count };
 
-    req_data += rc;
-    *(pid_t *)req_data = getpid();
-    req->length += sizeof(pid_t);
+    return dsv_SendRange( ctx, DSV_MSG_DEL_RANGE, hndl, head, 2, NULL, 0 );
+}
 
-    req_data += sizeof(pid_t);
-    *(int *)req_data = value;
-    req->length += sizeof(value);
+/*!=============================================================================
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
-    {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
-    }
+    Get up to *count items from index of an INT_ARRAY dsv
 
-    return rc;
-}
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    index
+        index of the first item
+@param[out]
+    values
+        buffer of the items
+@param[in,out]
+    count
+        in: size of the values buffer, out: number of items got, less when
+        the array ends first
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
 
-int DSV_InsItemToArray( void *ctx, void *hndl, int index, int value )
+==============================================================================*/
+int DSV_GetArrayRange( void *ctx,
+                       void *hndl,
+                       int index,
+                       int *values,
+                       int *count )
 {
     assert( ctx );
     assert( hndl );
+    assert( count );
+    assert( values || *count == 0 );
 
-    int rc = EINVAL;
+    int rc = 0;
+    int total = 0;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
 
-    rc = fill_req_buf( req_buf, DSV_MSG_INS_ITEM, hndl );
+    char rep_buf[BUFSIZE];
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
 
-    req_data += rc;
-    *(pid_t *)req_data = getpid();
-    req->length += sizeof(pid_t);
+    /* a reply holds part of a large range, ask again for the rest */
+    while( total < *count )
+    {
+        char *req_data = req->data;
+        req_data += fill_req_buf( req_buf, DSV_MSG_GET_RANGE, hndl );
 
-    req_data += sizeof(pid_t);
-    *(int *)req_data = index;
-    req->length += sizeof(index);
-    req_data += sizeof(index);
+        *(int *)req_data = index + total;
+        req_data += sizeof(int);
+        *(int *)req_data = *count - total;
+        req->length += 2 * sizeof(int);
 
-    *(int *)req_data = value;
-    req->length += sizeof(value);
+        rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
+        if( rc != 0 )
+        {
+            dsvlog( LOG_ERR, "Failed to get array range: %s", strerror( rc ) );
+            break;
+        }
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
-    {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        int got = *(int *)rep->data;
+        memcpy( values + total, rep->data + sizeof(int), got * sizeof(int) );
+        total += got;
+        if( got == 0 )
+        {
+            break;
+        }
     }
 
+    *count = total;
     return rc;
 }
 
-int DSV_DelItemFromArray( void *ctx, void *hndl, int index )
+/*!=============================================================================
+
+    Get the samples of the history of a numeric dsv created with the
+    "history=N" flag, in one message
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    hndl
+        dsv handle in server process
+@param[in]
+    t0
+        first time of the samples, NULL for the oldest one
+@param[in]
+    t1
+        last time of the samples, NULL for the newest one
+@param[out]
+    out
+        the samples, oldest first
+@return
+    0 - success
+    ENOENT - the dsv has no history
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_GetHistory( void *ctx,
+                    void *hndl,
+                    const struct timespec *t0,
+                    const struct timespec *t1,
+                    dsv_history_t *out )
 {
     assert( ctx );
     assert( hndl );
+    assert( out );
 
-    int rc = EINVAL;
+    int rc;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
     char *req_data = req->data;
+    std::vector< char > rep_buf;
 
-    rc = fill_req_buf( req_buf, DSV_MSG_DEL_ITEM, hndl );
-    req_data += rc;
-    *(pid_t *)req_data = getpid();
-    req->length += sizeof(pid_t);
-
-    req_data += sizeof(pid_t);
-    *(int *)req_data = index;
-    req->length += sizeof(index);
+    out->type = DSV_Type( ctx, hndl );
+    out->count = 0;
+    out->stamps.clear();
+    out->values.clear();
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
+    rc = fill_req_buf( req_buf, DSV_MSG_GET_HISTORY, hndl );
+    req_data += rc;
+    *(int64_t *)req_data = t0 ? (int64_t)t0->tv_sec * 1000000000 + t0->tv_nsec
+                              : INT64_MIN;
+    req_data += sizeof(int64_t);
+    *(int64_t *)req_data = t1 ? (int64_t)t1->tv_sec * 1000000000 + t1->tv_nsec
+                              : INT64_MAX;
+    req->length += 2 * sizeof(int64_t);
+
+    rc = dsv_Query( ctx, req_buf, req->length, rep_buf );
     if( rc != 0 )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
+        dsvlog( LOG_ERR, "Failed to get history: %s", strerror( rc ) );
+        return rc;
+    }
+
+    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf.data();
+    const char *rep_data = rep->data;
+    const char *rep_end = rep_buf.data() + std::min( rep->length,
+                                                     rep_buf.size() );
+    size_t count = *(const uint32_t *)rep_data;
+    rep_data += sizeof(uint32_t);
+    if( rep_data + count * sizeof(int64_t) > rep_end )
+    {
         return EFAULT;
     }
 
-    return rc;
+    const int64_t *stamps = (const int64_t *)rep_data;
+    out->stamps.assign( stamps, stamps + count );
+    rep_data += count * sizeof(int64_t);
+    out->values.assign( rep_data, rep_end );
+    out->count = count;
+    return 0;
 }
 
-int DSV_SetItemInArray( void *ctx, void *hndl, int index, int value )
-{
-    assert( ctx );
-    assert( hndl );
+/*!=============================================================================
 
-    int rc = EINVAL;
-    char req_buf[BUFSIZE];
+    Send a paged query to every shard, and call back for each dsv of the
+    pages. The request starts with the cursor of the page, and the reply is
+    [next cursor, 0 after the last page][count]
+    count * [handle][type][len][name][value of len bytes]
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in,out]
+    req_buf
+        request, its cursor is overwritten
+@param[in]
+    cb
+        callback invoked for each dsv, returning non-zero stops the query
+@param[in]
+    arg
+        opaque argument passed to cb
+@return
+    0 - success
+    non-zero returned by cb
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+static int dsv_QueryPages( void *ctx,
+                           char *req_buf,
+                           dsv_query_cb_t cb,
+                           void *arg )
+{
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
+    std::vector< char > rep_buf;
 
-    rc = fill_req_buf( req_buf, DSV_MSG_SET_ITEM, hndl );
-    req_data += rc;
-    *(pid_t *)req_data = getpid();
-    req->length += sizeof(pid_t);
+    for( uint32_t shard = 0; shard < dsv_ShardCount( ctx ); shard++ )
+    {
+        uint32_t cursor = 0;
+        do
+        {
+            *(uint32_t *)req->data = cursor;
+            int rc = dsv_Query( dsv_Shard( ctx, shard ),
+                                req_buf,
+                                req->length,
+                                rep_buf );
+            if( rc == ENOENT )
+            {
+                break;
+            }
+            if( rc != 0 )
+            {
+                dsvlog( LOG_ERR, "Failed to query: %s", strerror( rc ) );
+                return rc;
+            }
 
-    req_data += sizeof(pid_t);
-    *(int *)req_data = index;
-    req->length += sizeof(index);
-    req_data += sizeof(index);
+            dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf.data();
+            const char *rep_data = rep->data;
+            const char *rep_end = rep_buf.data() + std::min( rep->length,
+                                                             rep_buf.size() );
+            cursor = *(const uint32_t *)rep_data;
+            uint32_t count = *(const uint32_t *)( rep_data + sizeof(uint32_t) );
+            rep_data += 2 * sizeof(uint32_t);
 
-    *(int *)req_data = value;
-    req->length += sizeof(value);
+            for( uint32_t i = 0; i < count; i++ )
+            {
+                const size_t head = sizeof(void *) + sizeof(int) +
+                                    sizeof(uint32_t);
+                if( rep_data + head > rep_end )
+                {
+                    return EFAULT;
+                }
+                void *hndl = *(void * const *)rep_data;
+                int type = *(const int *)( rep_data + sizeof(void *) );
+                uint32_t len = *(const uint32_t *)( rep_data + head -
+                                                    sizeof(uint32_t) );
+                const char *name = rep_data + head;
+                const char *value = name + strnlen( name, rep_end - name ) + 1;
+                if( value + len > rep_end )
+                {
+                    return EFAULT;
+                }
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
-    {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+                rc = cb( hndl, name, type, value, len, arg );
+                if( rc != 0 )
+                {
+                    return rc;
+                }
+                rep_data = value + len;
+            }
+        } while( cursor != 0 );
     }
 
-    return rc;
+    return 0;
 }
 
-int DSV_GetItemFromArray( void *ctx, void *hndl, int index, int *value )
+/*!=============================================================================
+
+    Get the handles and values of all the dsvs having a tag, eg "sys.cfg".
+    The server keeps a posting list per tag, so the cost is in the number of
+    matches. The dsvs come in pages of about DSV_PAGE_SIZE bytes, from every
+    shard, and cb is invoked for each one as its page arrives.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    tag
+        one tag
+@param[in]
+    cb
+        callback invoked for each dsv, returning non-zero stops the query
+@param[in]
+    arg
+        opaque argument passed to cb
+@return
+    0 - success, including a tag no dsv has
+    non-zero returned by cb
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_QueryByTag( void *ctx, const char *tag, dsv_query_cb_t cb, void *arg )
 {
     assert( ctx );
-    assert( hndl );
+    assert( tag );
+    assert( cb );
 
-    int rc = EINVAL;
     char req_buf[BUFSIZE];
     dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
-    char *req_data = req->data;
 
-    char rep_buf[BUFSIZE];
-    dsv_msg_reply_t *rep = (dsv_msg_reply_t *)rep_buf;
-    char *rep_data = rep->data;
+    if( strlen( tag ) >= DSV_STRING_SIZE_MAX )
+    {
+        return EINVAL;
+    }
 
-    rc = fill_req_buf( req_buf, DSV_MSG_GET_ITEM, hndl );
-    req_data += rc;
+    req->type = DSV_MSG_QUERY_TAG;
+    strcpy( req->data + sizeof(uint32_t), tag );
+    req->length = sizeof(dsv_msg_request_t) + sizeof(uint32_t) +
+                  strlen( tag ) + 1;
 
-    *(int *)req_data = index;
-    req->length += sizeof(index);
+    return dsv_QueryPages( ctx, req_buf, cb, arg );
+}
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, rep_buf, sizeof(rep_buf) );
-    if( rc != 0 )
+/*!=============================================================================
+
+    Get the handles and values of all the dsvs passing a filter, eg the saved
+    dsvs under /SYS changed in the last minute:
+
+        dsv_filter_t f = { DSV_INSTID_ANY, DSV_MATCH_PREFIX, "/SYS/" };
+        f.flags = DSV_FLAG_SAVE;
+        f.age = 60;
+
+    The server walks the dsvs, or the dsvs of the tag of the filter, and
+    returns the ones passing in pages of about DSV_PAGE_SIZE bytes.
+
+@param[in]
+    ctx
+        dsv ctx ( returned by DSV_Open() )
+@param[in]
+    filter
+        conditions a dsv must pass
+@param[in]
+    cb
+        callback invoked for each dsv, returning non-zero stops the query
+@param[in]
+    arg
+        opaque argument passed to cb
+@return
+    0 - success
+    non-zero returned by cb
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_QueryByFilter( void *ctx,
+                       const dsv_filter_t *filter,
+                       dsv_query_cb_t cb,
+                       void *arg )
+{
+    assert( ctx );
+    assert( filter );
+    assert( cb );
+
+    char req_buf[BUFSIZE];
+    dsv_msg_request_t *req = (dsv_msg_request_t *)req_buf;
+    char *req_data = req->data + sizeof(uint32_t);
+
+    dsv_msg_filter_t *f = (dsv_msg_filter_t *)req_data;
+    f->instID = filter->instID;
+    f->name_match = filter->name_match;
+    f->flags = filter->flags;
+    f->no_flags = filter->no_flags;
+    f->value_match = filter->value_match;
+    f->age = filter->age;
+    req_data += sizeof(dsv_msg_filter_t);
+
+    const char *strs[] = { filter->name, filter->tag, filter->value };
+    for( auto str : strs )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        str = str ? str : "";
+        if( strlen( str ) >= DSV_STRING_SIZE_MAX )
+        {
+            return EINVAL;
+        }
+        strcpy( req_data, str );
+        req_data += strlen( str ) + 1;
     }
-    *value = *(int *)rep_data;
-    return rc;
+
+    req->type = DSV_MSG_QUERY_FILTER;
+    req->length = req_data - req_buf;
+
+    return dsv_QueryPages( ctx, req_buf, cb, arg );
 }
 
 int DSV_Save( void *ctx )
@@ -1662,11 +4731,15 @@ int DSV_Save( void *ctx )
     req->type = DSV_MSG_SAVE;
     req->length = sizeof(dsv_msg_request_t);
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
+    /* every shard persists its own dsvs */
+    for( uint32_t shard = 0; shard < dsv_ShardCount( ctx ); shard++ )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        rc = dsv_SendMsg( dsv_Shard( ctx, shard ), req_buf, req->length, NULL, 0 );
+        if( rc != 0 )
+        {
+            dsvlog( LOG_ERR, "Failed to send message to the server" );
+            return EFAULT;
+        }
     }
 
     return rc;
@@ -1683,11 +4756,15 @@ int DSV_Restore( void *ctx )
     req->type = DSV_MSG_RESTORE;
     req->length = sizeof(dsv_msg_request_t);
 
-    rc = dsv_SendMsg( ctx, req_buf, req->length, NULL, 0 );
-    if( rc != 0 )
+    /* every shard persists its own dsvs */
+    for( uint32_t shard = 0; shard < dsv_ShardCount( ctx ); shard++ )
     {
-        dsvlog( LOG_ERR, "Failed to send message to the server" );
-        return EFAULT;
+        rc = dsv_SendMsg( dsv_Shard( ctx, shard ), req_buf, req->length, NULL, 0 );
+        if( rc != 0 )
+        {
+            dsvlog( LOG_ERR, "Failed to send message to the server" );
+            return EFAULT;
+        }
     }
 
     return rc;
@@ -29,6 +29,9 @@ SOFTWARE.
 #include <assert.h>
 #include <inttypes.h>
 #include <vector>
+#include <algorithm>
+#include <new>
+#include <charconv>
 #include <ctype.h>
 #include "dsv.h"
 #include "dsv_msg.h"
@@ -82,7 +85,11 @@ void DSV_PrintArray( void *value, char *buffer, size_t size )
     int arr_size = *(size_t *)value / sizeof(int);
     int *ai = (int *)((intptr_t)value + sizeof(size_t));
     int rc = 0;
-    for(int i = 0; i < arr_size; i++)
+    if( size > 0 )
+    {
+        buffer[0] = '\0';
+    }
+    for(int i = 0; i < arr_size && rc < (int)size; i++)
     {
         if( i !=  arr_size - 1 )
         {
@@ -94,6 +101,125 @@ void DSV_PrintArray( void *value, char *buffer, size_t size )
         }
     }
 }
+
+/*!=============================================================================
+
+    Print bytes in hex, as many as the buffer holds
+
+@param[in]
+    data
+        bytes to print
+@param[in]
+    len
+        number of bytes
+@param[out]
+    buffer
+        string buffer
+@param[in]
+    size
+        size of the string buffer
+@return
+    number of characters printed
+==============================================================================*/
+static int dsv_PrintHex( const void *data, size_t len, char *buffer, size_t size )
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t n = 0;
+
+    if( size == 0 )
+    {
+        return 0;
+    }
+    for( size_t i = 0; i < len && n + 2 < size; i++ )
+    {
+        n += snprintf( buffer + n, size - n, "%02x", bytes[i] );
+    }
+    buffer[n] = '\0';
+    return n;
+}
+
+/*!=============================================================================
+
+    Print a BLOB value got by DSV_Get() or a notification in hex
+
+@param[in]
+    value
+        the value, length first then the bytes
+@param[out]
+    buffer
+        string buffer
+@param[in]
+    size
+        size of the string buffer
+==============================================================================*/
+void DSV_PrintBlob( const void *value, char *buffer, size_t size )
+{
+    assert( value );
+    assert( buffer );
+
+    dsv_PrintHex( (const char *)value + sizeof(size_t),
+                  *(const size_t *)value,
+                  buffer,
+                  size );
+}
+
+/*!=============================================================================
+
+    Allocate the reference counted value of a BLOB dsv, holding one reference
+
+@param[in]
+    data
+        bytes of the value
+@param[in]
+    len
+        number of bytes
+@return
+    the blob, NULL if out of memory
+==============================================================================*/
+dsv_blob_t *DSV_BlobNew( const void *data, size_t len )
+{
+    assert( data || len == 0 );
+
+    void *mem = malloc( sizeof(dsv_blob_t) + len );
+    if( mem == NULL )
+    {
+        return NULL;
+    }
+
+    dsv_blob_t *blob = new ( mem ) dsv_blob_t;
+    blob->refs = 1;
+    blob->len = len;
+    if( len != 0 )
+    {
+        memcpy( blob->data, data, len );
+    }
+    return blob;
+}
+
+/*!=============================================================================
+
+    Release a reference of a BLOB value, freeing it with the last one. The
+    signature is the zmq_free_fn of zmq_msg_init_data(), zmq calls it from
+    its I/O thread once a message is sent.
+
+@param[in]
+    data
+        unused
+@param[in]
+    hint
+        the dsv_blob_t
+==============================================================================*/
+void DSV_BlobRelease( void *data, void *hint )
+{
+    dsv_blob_t *blob = (dsv_blob_t *)hint;
+
+    if( blob != NULL && blob->refs.fetch_sub( 1 ) == 1 )
+    {
+        blob->~dsv_blob_t();
+        free( blob );
+    }
+}
+
 /*!=============================================================================
 
     This function copied dsv value to the destination buffer based on the type
@@ -134,6 +260,14 @@ int DSV_Memcpy( void *dest, dsv_info_t *dsv )
                 dsv->len );
         rc += dsv->len + sizeof(size_t);
     }
+    else if( DSV_TYPE_IS_BLOB( dsv->type ) )
+    {
+        /* same layout as array, length first */
+        dsv_blob_t *blob = (dsv_blob_t *)dsv->value.pBlob;
+        *(size_t *)dest = blob->len;
+        memcpy( (char *)dest + sizeof(size_t), blob->data, blob->len );
+        rc += blob->len + sizeof(size_t);
+    }
     else
     {
         memcpy( dest, &dsv->value, sizeof(dsv_value_t) );
@@ -141,6 +275,78 @@ int DSV_Memcpy( void *dest, dsv_info_t *dsv )
     }
     return rc;
 }
+/*!=============================================================================
+
+    Apply a delta to an INT_ARRAY, the version is not checked here
+
+@param[in,out]
+    array
+        the array, a std::vector<int>
+@param[in]
+    delta
+        delta of a notification
+@param[in]
+    len
+        number of bytes of the delta, including the items
+@return
+    0 - success
+    EINVAL - the delta is malformed or out of the array
+
+==============================================================================*/
+int DSV_ApplyDelta( void *array, const dsv_delta_t *delta, size_t len )
+{
+    assert( array );
+    assert( delta );
+
+    dsv_array_t *ai = (dsv_array_t *)array;
+    size_t index = delta->index;
+    size_t count = delta->count;
+
+    if( len < sizeof(dsv_delta_t) || delta->mark != DSV_DELTA_MARK ||
+        delta->index < 0 || delta->count < 0 )
+    {
+        return EINVAL;
+    }
+    if( delta->op != DSV_DELTA_DEL &&
+        count > ( len - sizeof(dsv_delta_t) ) / sizeof(int) )
+    {
+        return EINVAL;
+    }
+    if( delta->op != DSV_DELTA_FULL && index > ai->size() )
+    {
+        return EINVAL;
+    }
+
+    switch( delta->op )
+    {
+    case DSV_DELTA_FULL:
+        ai->assign( delta->items, delta->items + count );
+        break;
+
+    case DSV_DELTA_SET:
+        if( index + count > ai->size() )
+        {
+            ai->resize( index + count );
+        }
+        memcpy( ai->data() + index, delta->items, count * sizeof(int) );
+        break;
+
+    case DSV_DELTA_INS:
+        ai->insert( ai->begin() + index, delta->items, delta->items + count );
+        break;
+
+    case DSV_DELTA_DEL:
+        ai->erase( ai->begin() + index,
+                   ai->begin() + std::min( index + count, ai->size() ) );
+        break;
+
+    default:
+        return EINVAL;
+    }
+
+    return 0;
+}
+
 /*!=============================================================================
 
     Convert a string into the value based on the dsv type
@@ -167,16 +373,20 @@ int DSV_Str2Array( const char *input, void **data, size_t *size )
 
     int rc = EINVAL;
     std::vector< int > vi;
-    char str[DSV_STRING_SIZE_MAX];
-    strncpy( str, input, DSV_STRING_SIZE_MAX );
-    int len = 0;
+    size_t len = 0;
 
-    /* parse and allocate memory for int array */
-    char *token = strtok( str, "," );
-    while( token )
+    /* parse the whole input, however long, and allocate the int array */
+    const char *str = input;
+    while( *str != '\0' )
     {
-        vi.push_back( atoi( token ) );
-        token = strtok( NULL, "," );
+        char *end;
+        vi.push_back( strtol( str, &end, 10 ) );
+        str = strchr( end, ',' );
+        if( str == NULL )
+        {
+            break;
+        }
+        str++;
     }
     len = vi.size() * sizeof(int);
     *data = memdup( vi.data(), len );
@@ -189,6 +399,342 @@ int DSV_Str2Array( const char *input, void **data, size_t *size )
     return rc;
 }
 
+/*!=============================================================================
+
+    Convert a hex string into the bytes of a BLOB
+
+@param[in]
+    input
+        C string of hex digits, eg "00ff1a"
+@param[out]
+    data
+        pointer to the allocated bytes
+@param[out]
+    size
+        address of the number of bytes
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_Str2Blob( const char *input, void **data, size_t *size )
+{
+    assert( input );
+    assert( data );
+    assert( size );
+
+    size_t len = strlen( input );
+    if( len % 2 != 0 )
+    {
+        return EINVAL;
+    }
+
+    unsigned char *bytes = (unsigned char *)malloc( len / 2 + 1 );
+    if( bytes == NULL )
+    {
+        return ENOMEM;
+    }
+    for( size_t i = 0; i < len / 2; i++ )
+    {
+        char hex[3] = { input[2 * i], input[2 * i + 1], '\0' };
+        char *end;
+        bytes[i] = (unsigned char)strtoul( hex, &end, 16 );
+        if( *end != '\0' )
+        {
+            free( bytes );
+            return EINVAL;
+        }
+    }
+
+    *data = bytes;
+    *size = len / 2;
+    return 0;
+}
+
+/*!=============================================================================
+
+    Get the type of the items of an array
+
+@param[in]
+    type
+        dsv type
+
+@return
+    type of the items, DSV_TYPE_INVALID if type is not an array
+
+==============================================================================*/
+int DSV_ItemType( int type )
+{
+    switch( type )
+    {
+    case DSV_TYPE_INT_ARRAY:
+        return DSV_TYPE_SINT32;
+    case DSV_TYPE_UINT8_ARRAY:
+        return DSV_TYPE_UINT8;
+    case DSV_TYPE_SINT8_ARRAY:
+        return DSV_TYPE_SINT8;
+    case DSV_TYPE_UINT16_ARRAY:
+        return DSV_TYPE_UINT16;
+    case DSV_TYPE_SINT16_ARRAY:
+        return DSV_TYPE_SINT16;
+    case DSV_TYPE_UINT32_ARRAY:
+        return DSV_TYPE_UINT32;
+    case DSV_TYPE_UINT64_ARRAY:
+        return DSV_TYPE_UINT64;
+    case DSV_TYPE_SINT64_ARRAY:
+        return DSV_TYPE_SINT64;
+    case DSV_TYPE_FLOAT_ARRAY:
+        return DSV_TYPE_FLOAT;
+    case DSV_TYPE_DOUBLE_ARRAY:
+        return DSV_TYPE_DOUBLE;
+    default:
+        return DSV_TYPE_INVALID;
+    }
+}
+
+/*!=============================================================================
+
+    Invoke f with a value of the C++ type of the items of an array, so one
+    template serves every type of array
+
+@param[in]
+    type
+        dsv type
+@param[in]
+    invalid
+        returned if type is not an array
+@param[in]
+    f
+        generic lambda taking the item type by value
+@return
+    the result of f
+
+==============================================================================*/
+template< typename F >
+static int dsv_WithItem( int type, int invalid, F f )
+{
+    switch( DSV_ItemType( type ) )
+    {
+    case DSV_TYPE_UINT8:  return f( uint8_t() );
+    case DSV_TYPE_SINT8:  return f( int8_t() );
+    case DSV_TYPE_UINT16: return f( uint16_t() );
+    case DSV_TYPE_SINT16: return f( int16_t() );
+    case DSV_TYPE_UINT32: return f( uint32_t() );
+    case DSV_TYPE_SINT32: return f( int32_t() );
+    case DSV_TYPE_UINT64: return f( uint64_t() );
+    case DSV_TYPE_SINT64: return f( int64_t() );
+    case DSV_TYPE_FLOAT:  return f( float() );
+    case DSV_TYPE_DOUBLE: return f( double() );
+    default:              return invalid;
+    }
+}
+
+/*!=============================================================================
+
+    Format items as "a,b,c" with std::to_chars, which is locale free and
+    needs no format string per item. The output stops at the last item that
+    fits the buffer.
+
+@return
+    number of characters printed
+
+==============================================================================*/
+template< typename T >
+static int dsv_FormatItems( const T *items,
+                            size_t count,
+                            char *buffer,
+                            size_t size )
+{
+    if( size == 0 )
+    {
+        return 0;
+    }
+
+    char *p = buffer;
+    char *end = buffer + size - 1;
+    for( size_t i = 0; i < count; i++ )
+    {
+        char *q = p;
+        if( i != 0 )
+        {
+            if( q == end )
+            {
+                break;
+            }
+            *q++ = ',';
+        }
+        std::to_chars_result r = std::to_chars( q, end, items[i] );
+        if( r.ec != std::errc() )
+        {
+            break;
+        }
+        p = r.ptr;
+    }
+    *p = '\0';
+    return p - buffer;
+}
+
+/*!=============================================================================
+
+    Parse "a,b,c" with std::from_chars straight into the items
+
+@return
+    0 - success
+    EINVAL - not a list of numbers of the type
+
+==============================================================================*/
+template< typename T >
+static int dsv_ParseItems( const char *str, std::vector< T > &items )
+{
+    const char *end = str + strlen( str );
+
+    while( str < end )
+    {
+        T item;
+        while( str < end && ( *str == ' ' || *str == '+' ) )
+        {
+            str++;
+        }
+        std::from_chars_result r = std::from_chars( str, end, item );
+        if( r.ec != std::errc() )
+        {
+            return EINVAL;
+        }
+        items.push_back( item );
+
+        str = r.ptr;
+        while( str < end && *str == ' ' )
+        {
+            str++;
+        }
+        if( str < end && *str++ != ',' )
+        {
+            return EINVAL;
+        }
+    }
+    return 0;
+}
+
+/*!=============================================================================
+
+    Convert a string into the items of a typed array
+
+@param[in]
+    type
+        dsv type of the array
+@param[in]
+    input
+        C string, eg "1.5,2,-3"
+@param[out]
+    data
+        pointer to the allocated items
+@param[out]
+    size
+        address of the size of the items in bytes
+@return
+    0 - success
+    any other value specifies an error code (see errno.h)
+
+==============================================================================*/
+int DSV_Str2Items( int type, const char *input, void **data, size_t *size )
+{
+    assert( input );
+    assert( data );
+    assert( size );
+
+    return dsv_WithItem( type, EINVAL, [&]( auto item )
+    {
+        std::vector< decltype( item ) > items;
+        int rc = dsv_ParseItems( input, items );
+        if( rc == 0 )
+        {
+            *size = items.size() * sizeof(item);
+            /* an empty array still gets a buffer to free */
+            *data = malloc( *size + 1 );
+            if( *data == NULL )
+            {
+                return ENOMEM;
+            }
+            memcpy( *data, items.data(), *size );
+        }
+        return rc;
+    } );
+}
+
+/*!=============================================================================
+
+    Convert the items of a typed array into a string "a,b,c"
+
+@param[in]
+    type
+        dsv type of the array
+@param[in]
+    items
+        the items
+@param[in]
+    len
+        size of the items in bytes
+@param[out]
+    buffer
+        string buffer
+@param[in]
+    size
+        size of the string buffer
+@return
+    number of characters printed
+    -1 - type is not an array
+
+==============================================================================*/
+int DSV_Items2Str( int type,
+                   const void *items,
+                   size_t len,
+                   char *buffer,
+                   size_t size )
+{
+    assert( items || len == 0 );
+    assert( buffer );
+
+    return dsv_WithItem( type, -1, [&]( auto item )
+    {
+        return dsv_FormatItems( (const decltype( item ) *)items,
+                                len / sizeof(item),
+                                buffer,
+                                size );
+    } );
+}
+
+/*!=============================================================================
+
+    Print a typed array got by DSV_Get() or a notification
+
+@param[in]
+    type
+        dsv type of the array
+@param[in]
+    value
+        the value, length first then the items
+@param[out]
+    buffer
+        string buffer
+@param[in]
+    size
+        size of the string buffer
+==============================================================================*/
+void DSV_PrintItems( int type, const void *value, char *buffer, size_t size )
+{
+    assert( value );
+    assert( buffer );
+
+    if( DSV_Items2Str( type,
+                       (const char *)value + sizeof(size_t),
+                       *(const size_t *)value,
+                       buffer,
+                       size ) < 0 && size > 0 )
+    {
+        buffer[0] = '\0';
+    }
+}
+
 /*!=============================================================================
 
     Convert a string into the value based on the dsv type
@@ -225,6 +771,30 @@ int DSV_Str2Value( const char *str, dsv_info_t *pDsv )
             pDsv->value.pArray = data;
         }
         break;
+    case DSV_TYPE_BLOB:
+        rc = DSV_Str2Blob( str, &data, &size );
+        if( rc == 0 )
+        {
+            pDsv->len = size;
+            pDsv->value.pBlob = data;
+        }
+        break;
+    case DSV_TYPE_UINT8_ARRAY:
+    case DSV_TYPE_SINT8_ARRAY:
+    case DSV_TYPE_UINT16_ARRAY:
+    case DSV_TYPE_SINT16_ARRAY:
+    case DSV_TYPE_UINT32_ARRAY:
+    case DSV_TYPE_UINT64_ARRAY:
+    case DSV_TYPE_SINT64_ARRAY:
+    case DSV_TYPE_FLOAT_ARRAY:
+    case DSV_TYPE_DOUBLE_ARRAY:
+        rc = DSV_Str2Items( pDsv->type, str, &data, &size );
+        if( rc == 0 )
+        {
+            pDsv->len = size;
+            pDsv->value.pBlob = data;
+        }
+        break;
     case DSV_TYPE_UINT32:
         pDsv->value.u32 = strtoul( str, NULL, 0 );
         break;
@@ -344,6 +914,27 @@ int DSV_Value2Str( char *buf, size_t len, const dsv_info_t *pDsv )
     case DSV_TYPE_INT_ARRAY:
         rc = DSV_Array2Str( buf, len, pDsv );
         break;
+    case DSV_TYPE_BLOB:
+        rc = dsv_PrintHex( ( (dsv_blob_t *)pDsv->value.pBlob )->data,
+                           ( (dsv_blob_t *)pDsv->value.pBlob )->len,
+                           buf,
+                           len );
+        break;
+    case DSV_TYPE_UINT8_ARRAY:
+    case DSV_TYPE_SINT8_ARRAY:
+    case DSV_TYPE_UINT16_ARRAY:
+    case DSV_TYPE_SINT16_ARRAY:
+    case DSV_TYPE_UINT32_ARRAY:
+    case DSV_TYPE_UINT64_ARRAY:
+    case DSV_TYPE_SINT64_ARRAY:
+    case DSV_TYPE_FLOAT_ARRAY:
+    case DSV_TYPE_DOUBLE_ARRAY:
+        rc = DSV_Items2Str( pDsv->type,
+                            ( (dsv_blob_t *)pDsv->value.pBlob )->data,
+                            ( (dsv_blob_t *)pDsv->value.pBlob )->len,
+                            buf,
+                            len );
+        break;
     case DSV_TYPE_UINT16:
         rc = snprintf( buf, len, "%" PRIu16, pDsv->value.u16 );
         break;
@@ -471,6 +1062,46 @@ dsv_type_t DSV_GetTypeFromStr( const char *type_str )
     {
         return DSV_TYPE_INT_ARRAY;
     }
+    if( strcmp( type_str, "blob" ) == 0 )
+    {
+        return DSV_TYPE_BLOB;
+    }
+    if( strcmp( type_str, "uint8_array" ) == 0 )
+    {
+        return DSV_TYPE_UINT8_ARRAY;
+    }
+    if( strcmp( type_str, "sint8_array" ) == 0 )
+    {
+        return DSV_TYPE_SINT8_ARRAY;
+    }
+    if( strcmp( type_str, "uint16_array" ) == 0 )
+    {
+        return DSV_TYPE_UINT16_ARRAY;
+    }
+    if( strcmp( type_str, "sint16_array" ) == 0 )
+    {
+        return DSV_TYPE_SINT16_ARRAY;
+    }
+    if( strcmp( type_str, "uint32_array" ) == 0 )
+    {
+        return DSV_TYPE_UINT32_ARRAY;
+    }
+    if( strcmp( type_str, "uint64_array" ) == 0 )
+    {
+        return DSV_TYPE_UINT64_ARRAY;
+    }
+    if( strcmp( type_str, "sint64_array" ) == 0 )
+    {
+        return DSV_TYPE_SINT64_ARRAY;
+    }
+    if( strcmp( type_str, "float_array" ) == 0 )
+    {
+        return DSV_TYPE_FLOAT_ARRAY;
+    }
+    if( strcmp( type_str, "double_array" ) == 0 )
+    {
+        return DSV_TYPE_DOUBLE_ARRAY;
+    }
     if( strcmp( type_str, "uint16" ) == 0 )
     {
         return DSV_TYPE_UINT16;
@@ -544,14 +1175,69 @@ uint32_t DSV_GetFlagsFromStr( const char *flags_str )
         flags |= DSV_FLAG_TRACK;
     }
 
+    if( strstr( flags_str, "delta" ) != NULL )
+    {
+        flags |= DSV_FLAG_DELTA;
+    }
+
     return flags;
 }
 
+/*!=============================================================================
+
+    Get the number of samples of the history from a flags string, eg
+    "save,history=600"
+
+@param[in]
+    flags_str
+        flags string
+
+@return
+    number of samples, 0 for no history
+
+==============================================================================*/
+uint32_t DSV_GetHistoryFromStr( const char *flags_str )
+{
+    assert( flags_str );
+
+    const char *history = strstr( flags_str, "history=" );
+    if( history == NULL )
+    {
+        return 0;
+    }
+    return strtoul( history + strlen( "history=" ), NULL, 10 );
+}
+
+/*!=============================================================================
+
+    Get the seconds of the window of the statistics from a flags string, eg
+    "save,stats=60"
+
+@param[in]
+    flags_str
+        flags string
+
+@return
+    seconds of the window, 0 for no statistics
+
+==============================================================================*/
+uint32_t DSV_GetStatsFromStr( const char *flags_str )
+{
+    assert( flags_str );
+
+    const char *stats = strstr( flags_str, "stats=" );
+    if( stats == NULL )
+    {
+        return 0;
+    }
+    return strtoul( stats + strlen( "stats=" ), NULL, 10 );
+}
+
 
 /*!=============================================================================
 
     Get the number of bytes from type enum. Currently we don't need this length.
-    In the future we need this to support blob type
+    The length of a string, array or blob is known from its value only
 
 @param[in]
     type
@@ -574,7 +1260,17 @@ int DSV_GetSizeFromType( int type )
         rc = 1;
         break;
     case DSV_TYPE_INT_ARRAY:
-        /* For array type, update the length later */
+    case DSV_TYPE_BLOB:
+    case DSV_TYPE_UINT8_ARRAY:
+    case DSV_TYPE_SINT8_ARRAY:
+    case DSV_TYPE_UINT16_ARRAY:
+    case DSV_TYPE_SINT16_ARRAY:
+    case DSV_TYPE_UINT32_ARRAY:
+    case DSV_TYPE_UINT64_ARRAY:
+    case DSV_TYPE_SINT64_ARRAY:
+    case DSV_TYPE_FLOAT_ARRAY:
+    case DSV_TYPE_DOUBLE_ARRAY:
+        /* For array and blob type, update the length later */
         rc = 0;
         break;
     case DSV_TYPE_UINT16:
@@ -616,6 +1312,14 @@ void DSV_Print( const dsv_info_t *pDsv )
     printf( "name:  \t%s\n", pDsv->pName );
     printf( "desc:  \t%s\n", pDsv->pDesc );
     printf( "tags:  \t%s\n", pDsv->pTags );
+    if( pDsv->pCalc != NULL && pDsv->pCalc[0] != '\0' )
+    {
+        printf( "calc:  \t%s\n", pDsv->pCalc );
+    }
+    if( pDsv->pAliases != NULL && pDsv->pAliases[0] != '\0' )
+    {
+        printf( "alias: \t%s\n", pDsv->pAliases );
+    }
     printf( "instID:\t%d\n", pDsv->instID );
     printf( "type:  \t%d\n", pDsv->type );
     printf( "ts:    \t%ld\n", pDsv->timestamp.tv_sec );
@@ -0,0 +1,122 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 David Deng
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+
+/*==============================================================================
+                              Includes
+==============================================================================*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include "dsv.h"
+#include "dsv_log.h"
+
+/*!=============================================================================
+    Display the usage information for the command.
+==============================================================================*/
+static void usage( void )
+{
+    fprintf( stderr,
+             "dsv_schemac compiles a JSON schema into a binary schema, created\n"
+             "by DSV_CreateWithJson without parsing\n"
+             "usage: dsv_schemac [-o schema] <json-file>\n"
+             "    -o <schema> - binary schema written, default the JSON file\n"
+             "                  name with .dsvb instead of .json\n"
+             "example:\n"
+             "   dsv_schemac -o dsvs.dsvb dsvs.json\n"
+             "   sv -c -i 123 -f dsvs.dsvb\n"
+           );
+}
+
+/*!=============================================================================
+
+    Entry point for the schema compiler
+
+@param[in]
+    argc
+        number of arguments passed to the process
+
+@param[in]
+    argv
+        array of null terminated argument strings passed to the process
+        The arguments are processed using getopt()
+
+@retval
+    EXIT_SUCCESS - success
+    EXIT_FAILURE - failed
+/*============================================================================*/
+int main( int argc, char *argv[] )
+{
+    int rc;
+    int opt;
+    const char *output = NULL;
+
+    while( (opt = getopt( argc, argv, "o:" )) != -1 )
+    {
+        switch( opt )
+        {
+        case 'o':
+            output = optarg;
+            break;
+
+        default:
+            usage();
+            exit( EXIT_FAILURE );
+        }
+    }
+
+    if( optind != argc - 1 )
+    {
+        usage();
+        exit( EXIT_FAILURE );
+    }
+
+    std::string input( argv[optind] );
+    std::string schema;
+    if( output != NULL )
+    {
+        schema = output;
+    }
+    else
+    {
+        size_t dot = input.rfind( ".json" );
+        schema = input.substr( 0, dot == input.size() - 5 ? dot : input.size() );
+        schema += ".dsvb";
+    }
+
+    DSV_LogInit( NULL, NULL );
+
+    rc = DSV_CompileSchema( input.c_str(), schema.c_str() );
+    if( rc != 0 )
+    {
+        fprintf( stderr, "Failed to compile %s: %s\n",
+                 input.c_str(), strerror( rc ) );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}